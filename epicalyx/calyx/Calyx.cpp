@@ -1,4 +1,5 @@
 #include "Calyx.h"
+#include "Canonical.h"
 #include "Directive.h"
 #include "cycle/Cycle.h"
 
@@ -21,6 +22,24 @@ void BasicBlock::push_back(AnyDirective&& value) {
   directives.push_back(std::move(value));
 }
 
+void BasicBlock::pop_back() {
+  directives.pop_back();
+}
+
+void BasicBlock::insert(std::size_t index, AnyDirective&& value) {
+  // directives cannot be assigned, so we cannot shift them in place
+  auto moved = cotyl::vector<AnyDirective>{};
+  moved.reserve(directives.size() - index);
+  for (std::size_t i = index; i < directives.size(); i++) {
+    moved.push_back(std::move(directives[i]));
+  }
+  while (directives.size() > index) directives.pop_back();
+  directives.push_back(std::move(value));
+  for (auto& directive : moved) {
+    directives.push_back(std::move(directive));
+  }
+}
+
 void BasicBlock::reserve(std::size_t size) { 
   directives.reserve(size); 
 }
@@ -42,15 +61,8 @@ std::string TypeString(const Local::Type& type);
 }
 
 size_t Function::Hash() const {
-  size_t seed = blocks.size();
-  cotyl::map<block_label_t, const BasicBlock&> sorted{blocks.begin(), blocks.end()};
-  for (const auto& [block_idx, block] : sorted) {
-    cotyl::hash_combine(seed, block_idx);
-    for (const auto& directive : block) {
-      cotyl::hash_combine(seed, directive.index());
-    }
-  }
-  return seed;
+  // structural hash, independent of var / local / block numbering
+  return CanonicalFunction(*this).Hash();
 }
 
 size_t Program::Hash() const {
@@ -70,7 +82,13 @@ size_t Program::Hash() const {
 
 
 void PrintFunction(const Function& func) {
+  // blocks are laid out in order of their labels
+  cotyl::map<block_label_t, const BasicBlock&> sorted{};
   for (const auto& [i, block] : func.blocks) {
+    sorted.emplace(i, block);
+  }
+
+  for (const auto& [i, block] : sorted) {
     if (!block.empty()) {
       std::cout << func.symbol.c_str() << ".L" << i << std::endl;
       for (const auto& op : block) {
@@ -30,6 +30,8 @@ struct BasicBlock {
   AnyDirective& at(std::size_t index) { return directives.at(index); }
   void reserve(std::size_t size); 
   void push_back(AnyDirective&& value);
+  void pop_back();
+  void insert(std::size_t index, AnyDirective&& value);
 
 private:
   cotyl::vector<AnyDirective> directives{};
@@ -48,6 +50,8 @@ struct Function {
 
   cotyl::unordered_map<var_index_t, Local> locals{};  
   
+  // structural hash of the function contents, independent
+  // of the numbering of vars, locals and blocks
   size_t Hash() const;
   std::pair<block_label_t, BasicBlock&> AddBlock(block_label_t block_idx = 0);
 };
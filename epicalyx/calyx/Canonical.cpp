@@ -0,0 +1,192 @@
+#include "Canonical.h"
+#include "Calyx.h"
+#include "Directive.h"
+#include "Fields.h"
+
+#include "Containers.h"
+#include "Hash.h"
+
+#include <algorithm>
+#include <bit>
+
+
+namespace epi::calyx {
+
+struct CanonicalWriter {
+  CanonicalWriter(CanonicalFunction& canonical, const Function& function) :
+      canonical{canonical}, function{function} {
+
+  }
+
+  void Write();
+
+  void Var(var_index_t var_idx) {
+    Put(Tag::Var, Id(var_ids, canonical.vars, var_idx));
+  }
+
+  void Local(loc_index_t loc_idx) {
+    const auto new_local = !local_ids.contains(loc_idx);
+    Put(Tag::Local, Id(local_ids, canonical.locals, loc_idx));
+    if (new_local && function.locals.contains(loc_idx)) {
+      Describe(function.locals.at(loc_idx));
+    }
+  }
+
+  void Block(block_label_t block_idx) {
+    // blocks are emitted in the order they are found
+    Put(Tag::Block, Id(block_ids, canonical.blocks, block_idx));
+  }
+
+  template<typename T>
+  void Value(const T& value) {
+    if constexpr(std::is_same_v<T, cotyl::CString>) {
+      Put(Tag::Symbol, canonical.symbols.size());
+      canonical.symbols.emplace_back(value.view());
+    }
+    else if constexpr(std::is_same_v<T, calyx::Local>) {
+      Describe(value);
+    }
+    else if constexpr(std::is_same_v<T, Pointer>) {
+      Put(Tag::Value, (u64)value.value);
+    }
+    else if constexpr(std::is_same_v<T, float>) {
+      Put(Tag::Value, std::bit_cast<u32>(value));
+    }
+    else if constexpr(std::is_same_v<T, double>) {
+      Put(Tag::Value, std::bit_cast<u64>(value));
+    }
+    else {
+      static_assert(std::is_integral_v<T> || std::is_enum_v<T>);
+      Put(Tag::Value, (u64)value);
+    }
+  }
+
+  template<typename T>
+  void Shared(const T&) { }
+
+private:
+  enum class Tag : u64 {
+    Var, Local, Block, Value, Symbol, Directive, BlockStart, Describe,
+  };
+
+  CanonicalFunction& canonical;
+  const Function& function;
+
+  cotyl::unordered_map<var_index_t, u64> var_ids{};
+  cotyl::unordered_map<loc_index_t, u64> local_ids{};
+  cotyl::unordered_map<block_label_t, u64> block_ids{};
+
+  void Put(Tag tag, u64 value) {
+    canonical.words.push_back((u64)tag);
+    canonical.words.push_back(value);
+  }
+
+  template<typename I>
+  static u64 Id(cotyl::unordered_map<I, u64>& ids, cotyl::vector<I>& order, I idx) {
+    auto inserted = ids.emplace(idx, ids.size());
+    if (inserted.second) {
+      order.push_back(idx);
+    }
+    return inserted.first->second;
+  }
+
+  void Describe(const calyx::Local& local) {
+    Put(Tag::Describe, (u64)local.type);
+    if (local.type == calyx::Local::Type::Aggregate) {
+      canonical.words.push_back(local.aggregate.size);
+      canonical.words.push_back(local.aggregate.align);
+    }
+    else {
+      const auto& arg_idx = local.non_aggregate.arg_idx;
+      canonical.words.push_back(arg_idx.has_value() ? arg_idx.value() + 1 : 0);
+      canonical.words.push_back(local.type == calyx::Local::Type::Pointer ? local.non_aggregate.stride : 0);
+    }
+  }
+
+  void WriteBlocks(std::size_t first);
+};
+
+void CanonicalWriter::WriteBlocks(std::size_t first) {
+  // canonical.blocks grows as new branch targets are found
+  for (std::size_t i = first; i < canonical.blocks.size(); i++) {
+    const auto block_idx = canonical.blocks[i];
+    const auto block = function.blocks.find(block_idx);
+    if (block == function.blocks.end()) continue;
+
+    canonical.words.push_back((u64)Tag::BlockStart);
+    for (const auto& directive : block->second) {
+      if (IsType<NoOp>(directive)) continue;
+      Put(Tag::Directive, directive.index());
+      VisitFields(directive, *this);
+    }
+  }
+}
+
+void CanonicalWriter::Write() {
+  // arguments are referenced by position,
+  // so they are numbered first
+  cotyl::vector<std::pair<loc_index_t, loc_index_t>> args{};
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type != calyx::Local::Type::Aggregate && local.non_aggregate.arg_idx.has_value()) {
+      args.emplace_back(local.non_aggregate.arg_idx.value(), loc_idx);
+    }
+  }
+  std::sort(args.begin(), args.end());
+  for (const auto& [arg_idx, loc_idx] : args) {
+    Local(loc_idx);
+  }
+
+  Block(Function::Entry);
+  WriteBlocks(0);
+
+  // unreachable blocks, these can only be ordered by label
+  cotyl::vector<block_label_t> unreachable{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    if (!block_ids.contains(block_idx)) unreachable.push_back(block_idx);
+  }
+  std::sort(unreachable.begin(), unreachable.end());
+  for (const auto& block_idx : unreachable) {
+    if (block_ids.contains(block_idx)) continue;
+    const auto first = canonical.blocks.size();
+    Block(block_idx);
+    WriteBlocks(first);
+  }
+
+  // unreferenced locals, ordered by their description
+  cotyl::vector<std::pair<cotyl::vector<u64>, loc_index_t>> unreferenced{};
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local_ids.contains(loc_idx)) continue;
+    auto words = std::move(canonical.words);
+    canonical.words = {};
+    Describe(local);
+    unreferenced.emplace_back(std::move(canonical.words), loc_idx);
+    canonical.words = std::move(words);
+  }
+  std::sort(unreferenced.begin(), unreferenced.end());
+  for (auto& [description, loc_idx] : unreferenced) {
+    Put(Tag::Local, Id(local_ids, canonical.locals, loc_idx));
+    canonical.words.insert(canonical.words.end(), description.begin(), description.end());
+  }
+}
+
+CanonicalFunction::CanonicalFunction(const Function& function) {
+  CanonicalWriter(*this, function).Write();
+
+  hash = words.size();
+  for (const auto& word : words) {
+    cotyl::hash_combine(hash, word);
+  }
+  for (const auto& symbol : symbols) {
+    cotyl::hash_combine(hash, symbol);
+  }
+}
+
+std::size_t CanonicalFunction::Hash() const {
+  return hash;
+}
+
+bool CanonicalFunction::operator==(const CanonicalFunction& other) const {
+  return hash == other.hash && words == other.words && symbols == other.symbols;
+}
+
+}
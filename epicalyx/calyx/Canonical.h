@@ -0,0 +1,41 @@
+#pragma once
+
+#include "CalyxFwd.h"
+#include "Vector.h"
+
+#include <string>
+
+
+namespace epi::calyx {
+
+/*
+ * Canonical form of a function, independent of the numbering of its
+ * vars, locals and blocks. Blocks are numbered in the order they are
+ * reached from the entry block (following branch targets in order),
+ * vars and locals in the order they are first referenced in these blocks.
+ * Argument locals are numbered first, in argument order.
+ * Two functions with the same canonical form only differ in the numbering
+ * of their vars, locals and blocks (and in their symbol).
+ * */
+struct CanonicalFunction {
+  explicit CanonicalFunction(const Function& function);
+
+  std::size_t Hash() const;
+  bool operator==(const CanonicalFunction& other) const;
+
+  // original indices in canonical order
+  cotyl::vector<var_index_t> vars{};
+  cotyl::vector<loc_index_t> locals{};
+  cotyl::vector<block_label_t> blocks{};
+
+private:
+  // structure of the function as a stream of words,
+  // symbols are stored separately to be compared exactly
+  cotyl::vector<u64> words{};
+  cotyl::vector<std::string> symbols{};
+  std::size_t hash;
+
+  friend struct CanonicalWriter;
+};
+
+}
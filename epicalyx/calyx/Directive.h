@@ -82,6 +82,20 @@ enum class CmpType : u32 {
   Eq, Ne, Lt, Le, Gt, Ge
 };
 
+// result of a comparison of two known values, for folding
+template<typename T>
+constexpr bool FoldCompare(T left, CmpType op, T right) {
+  switch (op) {
+    case CmpType::Eq: return left == right;
+    case CmpType::Ne: return left != right;
+    case CmpType::Lt: return left < right;
+    case CmpType::Le: return left <= right;
+    case CmpType::Gt: return left > right;
+    case CmpType::Ge: return left >= right;
+  }
+  return false;
+}
+
 template<typename To, typename From>
 requires (
   is_calyx_type_v<From> && 
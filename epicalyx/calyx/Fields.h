@@ -0,0 +1,109 @@
+#pragma once
+
+#include "Directive.h"
+
+#include <algorithm>
+#include <type_traits>
+
+
+namespace epi::calyx {
+
+/*
+ * Visit all fields of a directive in a fixed order.
+ * References to vars, locals and blocks are passed to the visitor's
+ * Var, Local and Block methods, all other contents (operation types,
+ * immediates, offsets, symbols, ...) are passed to Value.
+ * Call arguments and select tables are shared between copies of a
+ * directive, these are passed to Shared before their contents are visited,
+ * so that visitors that modify the fields can make their own copy first.
+ * Select tables are visited in order of their keys.
+ * The directive may be const, in which case fields are passed as const references.
+ * */
+template<typename D, typename V>
+requires (is_directive_v<std::remove_const_t<D>>)
+void VisitFields(D& directive, V& visitor);
+
+template<typename V>
+void VisitFields(AnyDirective& directive, V& visitor) {
+  directive.visit<void>([&](auto& d) { VisitFields(d, visitor); });
+}
+
+template<typename V>
+void VisitFields(const AnyDirective& directive, V& visitor) {
+  directive.visit<void>([&](const auto& d) { VisitFields(d, visitor); });
+}
+
+namespace detail {
+
+template<typename O, typename V>
+void VisitOperand(O& operand, V& visitor) {
+  if (operand.IsVar()) visitor.Var(operand.GetVar());
+  else visitor.Value(operand.GetScalar());
+}
+
+template<typename A, typename V>
+void VisitArgs(A& args, V& visitor) {
+  visitor.Shared(args);
+  for (auto& [var_idx, arg] : args->args) {
+    visitor.Var(var_idx);
+    visitor.Value(arg);
+  }
+  for (auto& [var_idx, arg] : args->var_args) {
+    visitor.Var(var_idx);
+    visitor.Value(arg);
+  }
+}
+
+}
+
+template<typename D, typename V>
+requires (is_directive_v<std::remove_const_t<D>>)
+void VisitFields(D& directive, V& visitor) {
+  using T = std::remove_const_t<D>;
+
+  // result
+  if constexpr(std::is_base_of_v<Expr, T>) visitor.Var(directive.idx);
+
+  // operands
+  if constexpr(requires { directive.left_idx; }) visitor.Var(directive.left_idx);
+  if constexpr(requires { directive.left.IsVar(); }) detail::VisitOperand(directive.left, visitor);
+  if constexpr(requires { directive.op; }) visitor.Value(directive.op);
+  if constexpr(requires { directive.right_idx; }) visitor.Var(directive.right_idx);
+  if constexpr(requires { directive.right.IsVar(); }) detail::VisitOperand(directive.right, visitor);
+  if constexpr(requires { directive.stride; }) visitor.Value(directive.stride);
+  if constexpr(requires { directive.ptr.IsVar(); }) detail::VisitOperand(directive.ptr, visitor);
+  if constexpr(requires { directive.ptr_idx; }) visitor.Var(directive.ptr_idx);
+  if constexpr(requires { directive.loc_idx; }) visitor.Local(directive.loc_idx);
+  if constexpr(requires { directive.symbol; }) visitor.Value(directive.symbol);
+  if constexpr(requires { directive.offset; }) visitor.Value(directive.offset);
+  if constexpr(requires { directive.src.IsVar(); }) detail::VisitOperand(directive.src, visitor);
+  if constexpr(requires { directive.value; }) visitor.Value(directive.value);
+  if constexpr(requires { directive.val.IsVar(); }) detail::VisitOperand(directive.val, visitor);
+
+  // calls
+  if constexpr(requires { directive.fn_idx; }) visitor.Var(directive.fn_idx);
+  if constexpr(requires { directive.label; }) visitor.Value(directive.label);
+  if constexpr(requires { directive.args; }) detail::VisitArgs(directive.args, visitor);
+
+  // branches
+  if constexpr(std::is_same_v<T, Select>) {
+    visitor.Var(directive.idx);
+    visitor.Shared(directive.table);
+    cotyl::vector<i64> keys{};
+    keys.reserve(directive.table->size());
+    for (const auto& [value, block_idx] : *directive.table) {
+      keys.push_back(value);
+    }
+    std::sort(keys.begin(), keys.end());
+    for (const auto& value : keys) {
+      visitor.Value(value);
+      visitor.Block(directive.table->at(value));
+    }
+    visitor.Block(directive._default);
+  }
+  if constexpr(requires { directive.dest; }) visitor.Block(directive.dest);
+  if constexpr(requires { directive.tdest; }) visitor.Block(directive.tdest);
+  if constexpr(requires { directive.fdest; }) visitor.Block(directive.fdest);
+}
+
+}
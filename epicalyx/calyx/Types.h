@@ -116,12 +116,31 @@ struct Local {
     return loc;
   }
 
+  // local type for values of a (non-aggregate) memory type
+  template<typename T>
+  requires (cotyl::pack_contains_v<T, calyx_memory_types>)
+  static constexpr Type TypeOf() {
+    if constexpr(std::is_same_v<T, i8>) return Type::I8;
+    else if constexpr(std::is_same_v<T, u8>) return Type::U8;
+    else if constexpr(std::is_same_v<T, i16>) return Type::I16;
+    else if constexpr(std::is_same_v<T, u16>) return Type::U16;
+    else if constexpr(std::is_same_v<T, i32>) return Type::I32;
+    else if constexpr(std::is_same_v<T, u32>) return Type::U32;
+    else if constexpr(std::is_same_v<T, i64>) return Type::I64;
+    else if constexpr(std::is_same_v<T, u64>) return Type::U64;
+    else if constexpr(std::is_same_v<T, float>) return Type::Float;
+    else if constexpr(std::is_same_v<T, double>) return Type::Double;
+    else return Type::Pointer;
+  }
+
   u64 Size() const {
     switch (type) {
       case Type::I8: case Type::U8: return 1;
       case Type::I16: case Type::U16: return 2;
       case Type::I32: case Type::U32: return 4;
       case Type::I64: case Type::U64: return 8;
+      case Type::Float: return 4;
+      case Type::Double: return 8;
       case Type::Pointer: return 8;
       case Type::Aggregate: return aggregate.size;
     }
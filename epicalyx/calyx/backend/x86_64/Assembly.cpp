@@ -0,0 +1,79 @@
+#include "Assembly.h"
+
+#include <algorithm>
+#include <bit>
+
+
+namespace epi::x86_64 {
+
+namespace {
+
+void WriteData(const Data& data, std::ostream& out) {
+  out << "\t.p2align " << std::countr_zero(std::max<u32>(data.align, 1)) << "\n";
+  out << data.symbol << ":\n";
+
+  // bytes up to the next relocation, runs of zeros are written at once
+  const auto write_bytes = [&](u64 from, u64 to) {
+    while (from < to) {
+      u64 zeros = from;
+      while (zeros < to && !data.bytes[zeros]) zeros++;
+      if (zeros - from > 1) {
+        out << "\t.zero " << zeros - from << "\n";
+        from = zeros;
+      }
+      else {
+        out << "\t.byte " << (u32)data.bytes[from++] << "\n";
+      }
+    }
+  };
+
+  u64 offset = 0;
+  auto relocations = data.relocations;
+  std::sort(relocations.begin(), relocations.end(), [](const auto& a, const auto& b) {
+    return a.offset < b.offset;
+  });
+  for (const auto& relocation : relocations) {
+    write_bytes(offset, relocation.offset);
+    out << "\t.quad " << relocation.symbol;
+    if (relocation.addend > 0) out << "+" << relocation.addend;
+    else if (relocation.addend < 0) out << relocation.addend;
+    out << "\n";
+    offset = relocation.offset + 8;
+  }
+  write_bytes(offset, data.bytes.size());
+}
+
+}
+
+void WriteAssembly(const Module& module, std::ostream& out) {
+  if (!module.functions.empty()) out << "\t.text\n";
+  for (const auto& function : module.functions) {
+    out << "\t.globl " << function.symbol << "\n";
+    out << "\t.type " << function.symbol << ", @function\n";
+    out << function.symbol << ":\n";
+    for (const auto& instr : function.instructions) {
+      if (instr.opcode == Opcode::Label) out << instr.ToString() << "\n";
+      else out << "\t" << instr.ToString() << "\n";
+    }
+    out << "\t.size " << function.symbol << ", .-" << function.symbol << "\n\n";
+  }
+
+  if (!module.data.empty()) out << "\t.data\n";
+  for (const auto& data : module.data) {
+    out << "\t.globl " << data.symbol << "\n";
+    out << "\t.type " << data.symbol << ", @object\n";
+    out << "\t.size " << data.symbol << ", " << data.bytes.size() << "\n";
+    WriteData(data, out);
+    out << "\n";
+  }
+
+  if (!module.constants.empty()) out << "\t.section .rodata\n";
+  for (const auto& data : module.constants) {
+    WriteData(data, out);
+  }
+
+  // the stack is not executable
+  out << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+}
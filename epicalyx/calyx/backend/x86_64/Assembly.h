@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Module.h"
+
+#include <ostream>
+
+
+namespace epi::x86_64 {
+
+// write the module as assembly for the GNU assembler
+void WriteAssembly(const Module& module, std::ostream& out);
+
+}
@@ -0,0 +1,1232 @@
+#include "Backend.h"
+#include "calyx/Directive.h"
+#include "regalloc/LinearScan.h"
+#include "regalloc/regspaces/X86_64.h"
+#include "CustomAssert.h"
+#include "Exceptions.h"
+#include "Format.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdlib>
+#include <type_traits>
+
+
+namespace epi::x86_64 {
+
+using namespace calyx;
+
+namespace {
+
+template<typename T>
+constexpr bool is_float_v = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+// size of values of a calyx type in bytes
+template<typename T>
+constexpr u8 size_of_v = std::is_same_v<T, Pointer> ? 8 : sizeof(T);
+
+template<typename T>
+i64 ImmValue(const T& value) {
+  if constexpr(std::is_same_v<T, Pointer>) return value.value;
+  else if constexpr(std::is_same_v<T, float>) return std::bit_cast<u32>(value);
+  else if constexpr(std::is_same_v<T, double>) return std::bit_cast<i64>(value);
+  else return (i64)value;
+}
+
+i32 AlignUp(i32 value, i32 align) {
+  return (value + align - 1) / align * align;
+}
+
+Reg ToReg(const register_t& reg) {
+  if (reg.first == static_cast<register_type_t>(X86_64RegSpace::RegType::XMM)) return Xmm(reg.second);
+  return static_cast<Reg>(X86_64RegSpace::GeneralRegister(reg));
+}
+
+bool IsFloat(Local::Type type) {
+  return type == Local::Type::Float || type == Local::Type::Double;
+}
+
+template<typename T>
+Cond Condition(CmpType op) {
+  constexpr bool is_signed = std::is_signed_v<T>;
+  switch (op) {
+    case CmpType::Eq: return Cond::E;
+    case CmpType::Ne: return Cond::NE;
+    case CmpType::Lt: return is_signed ? Cond::L : Cond::B;
+    case CmpType::Le: return is_signed ? Cond::LE : Cond::BE;
+    case CmpType::Gt: return is_signed ? Cond::G : Cond::A;
+    case CmpType::Ge: return is_signed ? Cond::GE : Cond::AE;
+  }
+  throw cotyl::UnreachableException();
+}
+
+void AppendBytes(cotyl::vector<u8>& bytes, u64 value, u8 size) {
+  for (u8 i = 0; i < size; i++) {
+    bytes.push_back((u8)(value >> (8 * i)));
+  }
+}
+
+}
+
+void Backend::Emit(const Program& program) {
+  for (const auto& [symbol, function] : program.functions) {
+    defined.insert(symbol.str());
+  }
+  EmitData(program);
+
+  // emit functions in order of their symbols, so that the output is deterministic
+  cotyl::vector<const Function*> functions{};
+  for (const auto& [symbol, function] : program.functions) {
+    functions.push_back(&function);
+  }
+  std::sort(functions.begin(), functions.end(), [](const auto* a, const auto* b) {
+    return a->symbol.view() < b->symbol.view();
+  });
+  for (const auto* function : functions) {
+    EmitFunction(*function);
+  }
+}
+
+void Backend::EmitData(const Program& program) {
+  // functions that are called by label are declared as globals
+  // as well, these are defined elsewhere
+  cotyl::unordered_set<std::string> called{};
+  for (const auto& [symbol, function] : program.functions) {
+    for (const auto& [block_idx, block] : function.blocks) {
+      for (const auto& directive : block) {
+        directive.visit<void>(
+          [&]<typename T>(const CallLabel<T>& op) { called.insert(op.label.str()); },
+          [](const auto&) { }
+        );
+      }
+    }
+  }
+
+  cotyl::vector<std::pair<std::string, const Global*>> globals{};
+  for (const auto& [symbol, global] : program.globals) {
+    auto name = symbol.str();
+    if (defined.contains(name) || called.contains(name)) continue;
+    globals.emplace_back(std::move(name), &global);
+  }
+  std::sort(globals.begin(), globals.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+  for (auto& [symbol, global] : globals) {
+    auto data = Data{symbol, 8};
+    swl::visit(
+      swl::overloaded{
+        [&](const LabelOffset& glob) {
+          data.relocations.push_back({0, glob.label.str(), glob.offset});
+          AppendBytes(data.bytes, 0, 8);
+        },
+        [&](const Pointer& glob) {
+          AppendBytes(data.bytes, glob.value, 8);
+        },
+        [&]<typename T>(const Scalar<T>& glob) {
+          data.align = sizeof(T);
+          AppendBytes(data.bytes, ImmValue(glob.value), sizeof(T));
+        },
+        swl::exhaustive
+      },
+      *global
+    );
+    defined.insert(symbol);
+    module.data.push_back(std::move(data));
+  }
+
+  for (u32 i = 0; i < program.strings.size(); i++) {
+    auto data = Data{cotyl::Format(".Lstr%d", i), 1};
+    for (const char c : program.strings[i].view()) {
+      data.bytes.push_back((u8)c);
+    }
+    data.bytes.push_back(0);
+    module.constants.push_back(std::move(data));
+  }
+}
+
+void Backend::EmitFunction(const Function& source) {
+  // allocation inserts moves and spill code into the function
+  auto func = source;
+  auto regspace = RegisterSpace::GetRegSpace<X86_64RegSpace>(func);
+  if (linear_scan) allocation = LinearScan(func, *regspace).Run();
+  else allocation = Allocator(func, *regspace).Run();
+
+  function = &func;
+  code = &module.functions.emplace_back(Code{func.symbol.str()});
+  labels = 0;
+  frame.clear();
+  saved.clear();
+
+  // locals that were not assigned a register live in memory,
+  // sorted to get the same layout on every run
+  cotyl::vector<loc_index_t> memory{};
+  for (const auto& [loc_idx, loc] : func.locals) {
+    if (!allocation.registers.contains(GeneralizedVar::Local(loc_idx))) memory.push_back(loc_idx);
+  }
+  std::sort(memory.begin(), memory.end());
+
+  i32 offset = 0;
+  for (const auto loc_idx : memory) {
+    const auto& loc = func.locals.at(loc_idx);
+    const i32 size = std::max<i32>(loc.Size(), 1);
+    const i32 align = loc.type == Local::Type::Aggregate ? std::max<i32>(loc.aggregate.align, 1) : size;
+    offset = AlignUp(offset + size, align);
+    frame.emplace(loc_idx, -offset);
+  }
+
+  cotyl::vector<Reg> callee_saved{};
+  for (const auto& [gvar, reg] : allocation.registers) {
+    if (X86_64RegSpace::IsCallerSaved(reg)) continue;
+    const auto r = ToReg(reg);
+    if (std::find(callee_saved.begin(), callee_saved.end(), r) == callee_saved.end()) callee_saved.push_back(r);
+  }
+  std::sort(callee_saved.begin(), callee_saved.end());
+  for (const auto reg : callee_saved) {
+    offset += 8;
+    saved.emplace_back(reg, -offset);
+  }
+  frame_size = AlignUp(offset, 16);
+
+  Instr(Opcode::Push, 8, {Reg::Rbp});
+  Instr(Opcode::Mov, 8, {Reg::Rbp, Reg::Rsp});
+  if (frame_size) Instr(Opcode::Sub, 8, {Reg::Rsp, Imm{frame_size}});
+  for (const auto& [reg, disp] : saved) {
+    Instr(Opcode::Mov, 8, {Memory{.base = Reg::Rbp, .disp = disp}, reg});
+  }
+  EmitArguments();
+
+  cotyl::vector<block_label_t> order{};
+  for (const auto& [block_idx, block] : func.blocks) {
+    if (block_idx != Function::Entry) order.push_back(block_idx);
+  }
+  std::sort(order.begin(), order.end());
+  order.insert(order.begin(), Function::Entry);
+
+  const auto deps = FunctionDependencies::GetDependencies(func);
+  for (std::size_t i = 0; i < order.size(); i++) {
+    if (i + 1 < order.size()) next_block = order[i + 1];
+    else next_block = {};
+    Instr(Opcode::Label, 0, {Label{BlockLabel(order[i])}});
+    current_block = &func.blocks.at(order[i]);
+    SelectBlock(*regspace, deps);
+    for (current_pos = 0; current_pos < current_block->size(); current_pos++) {
+      // folded nodes are emitted with the directive reading them
+      if (selector.nodes[current_pos].folded) continue;
+      Emit(current_block->at(current_pos));
+    }
+  }
+
+  function = nullptr;
+  code = nullptr;
+  current_block = nullptr;
+}
+
+void Backend::SelectBlock(const RegisterSpace& regspace, const FunctionDependencies& deps) {
+  const auto& block = *current_block;
+  selector.nodes.clear();
+  selector.nodes.resize(block.size());
+
+  const auto var_register = [&](var_index_t var_idx) {
+    return allocation.registers.at(GeneralizedVar::Var(var_idx));
+  };
+
+  // registers written by every directive, registers read by the nodes
+  // that may be folded into a node, and the largest displacement of the
+  // address it may compute
+  cotyl::vector<cotyl::vector<register_t>> writes(block.size());
+  cotyl::vector<cotyl::vector<register_t>> reads(block.size());
+  cotyl::vector<i64> displacement(block.size(), 0);
+  cotyl::unordered_map<var_index_t, u32> defs{};
+
+  for (u32 pos = 0; pos < block.size(); pos++) {
+    const auto& directive = block.at(pos);
+    auto& node = selector.nodes[pos];
+    std::array<std::optional<var_index_t>, 2> operands{};
+    i64 disp = 0;
+
+    directive.visit<void>(
+      [&](const LoadLocalAddr& op) {
+        node.op = NodeOp::LocalAddr;
+        disp = frame.at(op.loc_idx);
+      },
+      [&]<typename T>(const AddToPointer<T>& op) {
+        if (!op.ptr.IsVar()) return;
+        if (op.right.IsScalar()) {
+          const i64 offset = (i64)op.right.GetScalar() * op.stride;
+          if (!FitsImm32(offset)) return;
+          node.op = NodeOp::AddOffset;
+          operands = {op.ptr.GetVar()};
+          disp = offset;
+        }
+        else if (op.stride == 1 || op.stride == 2 || op.stride == 4 || op.stride == 8) {
+          node.op = sizeof(T) == 8 ? NodeOp::AddIndex : NodeOp::AddIndexExtend;
+          operands = {op.ptr.GetVar(), op.right.GetVar()};
+        }
+      },
+      [&]<typename T>(const LoadFromPointer<T>& op) {
+        node.op = NodeOp::LoadPointer;
+        operands = {op.ptr_idx};
+        disp = op.offset;
+      },
+      [&]<typename T>(const StoreToPointer<T>& op) {
+        node.op = NodeOp::StorePointer;
+        operands[0] = op.ptr_idx;
+        if (op.src.IsVar()) operands[1] = op.src.GetVar();
+        disp = op.offset;
+      },
+      [&]<typename T>(const calyx::Compare<T>& op) {
+        node.op = NodeOp::Compare;
+        operands[0] = op.left_idx;
+        if (op.right.IsVar()) operands[1] = op.right.GetVar();
+      },
+      [&]<typename T>(const BranchCompare<T>& op) {
+        // comparison results are i32
+        if constexpr(std::is_same_v<T, i32>) {
+          if (op.op != CmpType::Eq && op.op != CmpType::Ne) return;
+          if (op.right.IsVar() || op.right.GetScalar() != 0) return;
+          node.op = NodeOp::BranchTest;
+          operands[0] = op.left_idx;
+        }
+      },
+      [](const auto&) { }
+    );
+
+    i64 folded_disp = 0;
+    for (u8 i = 0; i < operands.size(); i++) {
+      if (!operands[i].has_value()) continue;
+      const auto var_idx = operands[i].value();
+      reads[pos].push_back(var_register(var_idx));
+
+      // operands are covered together with the node if their var is only
+      // read by this node, and is defined earlier in the block
+      if (!defs.contains(var_idx)) continue;
+      const auto def = defs.at(var_idx);
+      if (deps.var_graph.at(var_idx).reads.size() != 1) continue;
+      if (!Selector::Foldable(selector.nodes[def].op)) continue;
+      if (!FitsImm32(std::abs(disp) + displacement[def])) continue;
+
+      // folded nodes are emitted here, so the registers they read
+      // may not have been overwritten in between
+      const bool intact = std::none_of(writes.begin() + def + 1, writes.begin() + pos, [&](const auto& written) {
+        return std::any_of(written.begin(), written.end(), [&](const auto& reg) {
+          return std::find(reads[def].begin(), reads[def].end(), reg) != reads[def].end();
+        });
+      });
+      if (!intact) continue;
+
+      node.operands[i] = def;
+      reads[pos].insert(reads[pos].end(), reads[def].begin(), reads[def].end());
+      folded_disp = std::max(folded_disp, displacement[def]);
+    }
+    displacement[pos] = std::abs(disp) + folded_disp;
+
+    writes[pos] = regspace.Clobbers(directive);
+    directive.visit<void>(
+      [&]<typename T>(const StoreLocal<T>& op) {
+        const auto gvar = GeneralizedVar::Local(op.loc_idx);
+        if (allocation.registers.contains(gvar)) writes[pos].push_back(allocation.registers.at(gvar));
+      },
+      [&]<typename D>(const D& op) {
+        if constexpr(std::is_base_of_v<Expr, D>) {
+          if constexpr(!std::is_same_v<typename D::result_t, void>) {
+            const auto gvar = GeneralizedVar::Var(op.idx);
+            if (allocation.registers.contains(gvar)) writes[pos].push_back(allocation.registers.at(gvar));
+            defs.emplace(op.idx, pos);
+          }
+        }
+      }
+    );
+  }
+
+  selector.Select();
+}
+
+void Backend::EmitArguments() {
+  cotyl::vector<std::pair<loc_index_t, loc_index_t>> args{};
+  for (const auto& [loc_idx, loc] : function->locals) {
+    if (loc.type == Local::Type::Aggregate || !loc.non_aggregate.arg_idx.has_value()) continue;
+    args.emplace_back(loc.non_aggregate.arg_idx.value(), loc_idx);
+  }
+  std::sort(args.begin(), args.end());
+
+  cotyl::vector<Local::Type> types{};
+  for (const auto& [arg_idx, loc_idx] : args) {
+    types.push_back(function->locals.at(loc_idx).type);
+  }
+  const auto registers = X86_64RegSpace::ArgumentRegisters(types);
+
+  // arguments in memory are stored first, while all argument registers
+  // still hold their argument, then arguments in registers are moved at once,
+  // and finally the arguments passed on the stack are loaded
+  cotyl::vector<std::pair<Reg, Reg>> moves{};
+  cotyl::vector<std::pair<Reg, Memory>> loads{};
+  // stack arguments are above the saved rbp and the return address
+  i32 stack_offset = 16;
+  for (std::size_t i = 0; i < args.size(); i++) {
+    const auto loc_idx = args[i].second;
+    const auto& loc = function->locals.at(loc_idx);
+    const bool is_float = IsFloat(loc.type);
+    const u8 size = loc.Size();
+
+    std::optional<Reg> src{};
+    auto stack = Memory{.base = Reg::Rbp, .disp = stack_offset};
+    if (registers[i].has_value()) src = ToReg(registers[i].value());
+    else stack_offset += 8;
+
+    if (const auto dst = LocalReg(loc_idx)) {
+      if (src.has_value()) moves.emplace_back(dst.value(), src.value());
+      else loads.emplace_back(dst.value(), stack);
+    }
+    else if (frame.contains(loc_idx)) {
+      if (!src.has_value()) {
+        src = is_float ? VectorScratch : Scratch;
+        Instr(is_float ? Opcode::Movs : Opcode::Mov, is_float ? size : 8, {src.value(), stack});
+      }
+      Instr(is_float ? Opcode::Movs : Opcode::Mov, size, {LocalMemory(loc_idx, 0), src.value()});
+    }
+  }
+
+  ParallelMove(std::move(moves));
+  for (const auto& [dst, src] : loads) {
+    if (IsVector(dst)) Instr(Opcode::Movs, 8, {dst, src});
+    else Instr(Opcode::Mov, 8, {dst, src});
+  }
+}
+
+void Backend::EmitEpilogue() {
+  for (const auto& [reg, disp] : saved) {
+    Instr(Opcode::Mov, 8, {reg, Memory{.base = Reg::Rbp, .disp = disp}});
+  }
+  Instr(Opcode::Leave, 8);
+  Instr(Opcode::Ret, 8);
+}
+
+void Backend::Emit(const AnyDirective& dir) {
+  dir.visit<void>([&](const auto& d) { Emit(d); });
+}
+
+void Backend::Instr(Opcode opcode, u8 size, cotyl::vector<Operand>&& operands) {
+  code->instructions.push_back(Instruction{opcode, size, 0, Cond::E, std::move(operands)});
+}
+
+void Backend::Instr(Opcode opcode, u8 size, u8 src_size, cotyl::vector<Operand>&& operands) {
+  code->instructions.push_back(Instruction{opcode, size, src_size, Cond::E, std::move(operands)});
+}
+
+void Backend::Set(Cond cond, Reg dst) {
+  code->instructions.push_back(Instruction{Opcode::Setcc, 1, 0, cond, {dst}});
+}
+
+void Backend::Branch(Cond cond, const std::string& label) {
+  code->instructions.push_back(Instruction{Opcode::Jcc, 8, 0, cond, {Label{label}}});
+}
+
+void Backend::Jump(block_label_t block_idx) {
+  if (next_block == block_idx) return;
+  Instr(Opcode::Jmp, 8, {Label{BlockLabel(block_idx)}});
+}
+
+void Backend::Move(Reg dst, Reg src) {
+  if (dst == src) return;
+  cotyl::Assert(IsVector(dst) == IsVector(src), "Move between register kinds");
+  if (IsVector(dst)) Instr(Opcode::Movaps, 16, {dst, src});
+  else Instr(Opcode::Mov, 8, {dst, src});
+}
+
+void Backend::ParallelMove(cotyl::vector<std::pair<Reg, Reg>>&& moves) {
+  moves.erase(std::remove_if(moves.begin(), moves.end(), [](const auto& move) {
+    return move.first == move.second;
+  }), moves.end());
+  while (!moves.empty()) {
+    // a move can happen if no other move still reads its destination
+    const auto ready = std::find_if(moves.begin(), moves.end(), [&](const auto& move) {
+      return std::none_of(moves.begin(), moves.end(), [&](const auto& other) {
+        return other.second == move.first;
+      });
+    });
+    if (ready != moves.end()) {
+      Move(ready->first, ready->second);
+      moves.erase(ready);
+      continue;
+    }
+
+    // the remaining moves form cycles, break one by
+    // moving one of the destinations out of the way
+    const auto dst = moves.front().first;
+    const auto scratch = IsVector(dst) ? VectorScratch : Scratch;
+    Move(scratch, dst);
+    for (auto& move : moves) {
+      if (move.second == dst) move.second = scratch;
+    }
+  }
+}
+
+std::string Backend::BlockLabel(block_label_t block_idx) const {
+  return cotyl::Format(".L%s.%d", function->symbol.c_str(), block_idx);
+}
+
+std::string Backend::NewLabel() {
+  return cotyl::Format(".L%s.t%d", function->symbol.c_str(), labels++);
+}
+
+Memory Backend::FloatConstant(u8 size, u64 bits) {
+  const auto key = std::make_pair(size, bits);
+  if (!float_constants.contains(key)) {
+    auto data = Data{cotyl::Format(".Lflt%d", float_constants.size()), size};
+    AppendBytes(data.bytes, bits, size);
+    float_constants.emplace(key, data.symbol);
+    module.constants.push_back(std::move(data));
+  }
+  return Memory{.symbol = float_constants.at(key)};
+}
+
+template<typename T>
+Memory Backend::FloatConstant(T value) {
+  return FloatConstant(sizeof(T), (u64)ImmValue(value));
+}
+
+Reg Backend::VarReg(var_index_t var_idx) const {
+  const auto gvar = GeneralizedVar::Var(var_idx);
+  cotyl::Assert(allocation.registers.contains(gvar), "Var was not assigned a register");
+  return ToReg(allocation.registers.at(gvar));
+}
+
+std::optional<Reg> Backend::LocalReg(loc_index_t loc_idx) const {
+  const auto gvar = GeneralizedVar::Local(loc_idx);
+  if (allocation.registers.contains(gvar)) return ToReg(allocation.registers.at(gvar));
+  return {};
+}
+
+std::optional<Reg> Backend::Result(const Expr& expr) const {
+  // results that are never read are not assigned a register
+  const auto gvar = GeneralizedVar::Var(expr.idx);
+  if (allocation.registers.contains(gvar)) return ToReg(allocation.registers.at(gvar));
+  return {};
+}
+
+Memory Backend::LocalMemory(loc_index_t loc_idx, i32 offset) const {
+  return Memory{.base = Reg::Rbp, .disp = frame.at(loc_idx) + offset};
+}
+
+Memory Backend::GlobalMemory(const cotyl::CString& symbol, i32 offset) {
+  auto name = symbol.str();
+  if (defined.contains(name)) return Memory{.disp = offset, .symbol = std::move(name)};
+  Instr(Opcode::Mov, 8, {Scratch, Memory{.symbol = std::move(name), .got = true}});
+  return Memory{.base = Scratch, .disp = offset};
+}
+
+std::optional<u32> Backend::FoldedOperand(u32 node_idx, u8 operand) const {
+  const auto& node = selector.nodes[node_idx].operands[operand];
+  if (node.has_value() && selector.nodes[node.value()].folded) return node;
+  return {};
+}
+
+Memory Backend::Address(u32 node_idx) {
+  return current_block->at(node_idx).visit<Memory>(
+    [&](const LoadLocalAddr& op) {
+      return LocalMemory(op.loc_idx, 0);
+    },
+    [&]<typename T>(const AddToPointer<T>& op) {
+      auto address = OperandAddress(node_idx, 0, op.ptr.GetVar());
+      if (op.right.IsScalar()) {
+        address.disp += (i32)((i64)op.right.GetScalar() * op.stride);
+      }
+      else {
+        address.index = Index<T>(op.right.GetVar());
+        address.scale = (u8)op.stride;
+      }
+      return address;
+    },
+    [](const auto&) -> Memory {
+      throw cotyl::UnreachableException();
+    }
+  );
+}
+
+Memory Backend::OperandAddress(u32 node_idx, u8 operand, var_index_t var_idx) {
+  if (const auto folded = FoldedOperand(node_idx, operand)) return Address(folded.value());
+  return Memory{.base = VarReg(var_idx)};
+}
+
+template<typename T>
+Reg Backend::Index(var_index_t var_idx) {
+  const auto index = VarReg(var_idx);
+  if constexpr(std::is_same_v<T, i32>) {
+    Instr(Opcode::Movsx, 8, 4, {Scratch, index});
+    return Scratch;
+  }
+  else if constexpr(std::is_same_v<T, u32>) {
+    Instr(Opcode::Mov, 4, {Scratch, index});
+    return Scratch;
+  }
+  else {
+    return index;
+  }
+}
+
+template<typename T>
+void Backend::Load(Reg dst, const Memory& src) {
+  if constexpr(is_float_v<T>) {
+    Instr(Opcode::Movs, sizeof(T), {dst, src});
+  }
+  else if constexpr(is_calyx_small_type_v<T>) {
+    Instr(std::is_signed_v<T> ? Opcode::Movsx : Opcode::Movzx, 4, sizeof(T), {dst, src});
+  }
+  else {
+    Instr(Opcode::Mov, size_of_v<T>, {dst, src});
+  }
+}
+
+template<typename T>
+void Backend::Store(const Memory& dst, const calyx::Operand<calyx_upcast_t<T>>& src) {
+  constexpr u8 size = size_of_v<T>;
+  if (src.IsVar()) {
+    Instr(is_float_v<T> ? Opcode::Movs : Opcode::Mov, size, {dst, VarReg(src.GetVar())});
+    return;
+  }
+
+  i64 value;
+  if constexpr(is_calyx_small_type_v<T>) value = (T)src.GetScalar();
+  else value = ImmValue(src.GetScalar());
+
+  if (size < 8 || FitsImm32(value)) {
+    Instr(Opcode::Mov, size, {dst, Imm{size == 4 ? (i32)value : value}});
+  }
+  else {
+    // no 64 bit immediate stores, store both halves
+    auto high = dst;
+    high.disp += 4;
+    Instr(Opcode::Mov, 4, {dst, Imm{(i32)value}});
+    Instr(Opcode::Mov, 4, {high, Imm{(i32)(value >> 32)}});
+  }
+}
+
+template<typename T>
+void Backend::LoadLocalRegister(Reg dst, Reg src) {
+  if constexpr(is_calyx_small_type_v<T>) {
+    Instr(std::is_signed_v<T> ? Opcode::Movsx : Opcode::Movzx, 4, sizeof(T), {dst, src});
+  }
+  else {
+    Move(dst, src);
+  }
+}
+
+template<typename T>
+void Backend::StoreLocalRegister(Reg dst, const calyx::Operand<calyx_upcast_t<T>>& src) {
+  if (src.IsVar()) {
+    // small values are kept extended in their register
+    LoadLocalRegister<T>(dst, VarReg(src.GetVar()));
+    return;
+  }
+
+  if constexpr(is_float_v<T>) {
+    const auto value = (T)src.GetScalar();
+    if (ImmValue(value) == 0) Instr(Opcode::Xorps, 16, {dst, dst});
+    else Instr(Opcode::Movs, sizeof(T), {dst, FloatConstant(value)});
+  }
+  else {
+    i64 value;
+    if constexpr(is_calyx_small_type_v<T>) value = (T)src.GetScalar();
+    else value = ImmValue(src.GetScalar());
+    Instr(Opcode::Mov, size_of_v<T> == 8 ? 8 : 4, {dst, Imm{value}});
+  }
+}
+
+template<typename T>
+Cond Backend::Compare(var_index_t left_idx, const calyx::Operand<T>& right, CmpType op) {
+  const auto left = VarReg(left_idx);
+  if constexpr(is_float_v<T>) {
+    Reg other = VectorScratch;
+    if (right.IsVar()) other = VarReg(right.GetVar());
+    else Instr(Opcode::Movs, sizeof(T), {VectorScratch, FloatConstant(right.GetScalar())});
+
+    // ucomis sets the flags like an unsigned comparison, unordered values
+    // compare as below and equal, so lower than is checked with swapped operands
+    switch (op) {
+      case CmpType::Lt:
+        Instr(Opcode::Ucomis, sizeof(T), {other, left});
+        return Cond::A;
+      case CmpType::Le:
+        Instr(Opcode::Ucomis, sizeof(T), {other, left});
+        return Cond::AE;
+      default:
+        Instr(Opcode::Ucomis, sizeof(T), {left, other});
+        return Condition<unsigned>(op);
+    }
+  }
+  else {
+    constexpr u8 size = size_of_v<T>;
+    Operand other = Scratch;
+    if (right.IsVar()) {
+      other = VarReg(right.GetVar());
+    }
+    else {
+      const auto value = ImmValue(right.GetScalar());
+      if (size == 8 && !FitsImm32(value)) Instr(Opcode::Mov, 8, {Scratch, Imm{value}});
+      else other = Imm{value};
+    }
+    Instr(Opcode::Cmp, size, {left, std::move(other)});
+    return Condition<T>(op);
+  }
+}
+
+template<typename T>
+void Backend::EmitCall(const ArgData& args, const Operand& target, std::optional<var_index_t> result) {
+  cotyl::vector<std::pair<var_index_t, Local::Type>> all{};
+  for (const auto& [var_idx, arg] : args.args) all.emplace_back(var_idx, arg.type);
+  for (const auto& [var_idx, arg] : args.var_args) all.emplace_back(var_idx, arg.type);
+
+  cotyl::vector<Local::Type> types{};
+  for (const auto& [var_idx, type] : all) types.push_back(type);
+  const auto registers = X86_64RegSpace::ArgumentRegisters(types);
+
+  // arguments in registers were already forced into them
+  cotyl::vector<std::pair<var_index_t, Local::Type>> stack{};
+  i64 vector_count = 0;
+  for (std::size_t i = 0; i < all.size(); i++) {
+    if (registers[i].has_value()) {
+      cotyl::Assert(VarReg(all[i].first) == ToReg(registers[i].value()), "Argument is not in its register");
+      if (IsFloat(all[i].second)) vector_count++;
+    }
+    else {
+      stack.push_back(all[i]);
+    }
+  }
+
+  // the stack pointer is 16 byte aligned at the call
+  const i32 stack_size = AlignUp(8 * stack.size(), 16);
+  if (stack_size) {
+    Instr(Opcode::Sub, 8, {Reg::Rsp, Imm{stack_size}});
+    for (std::size_t i = 0; i < stack.size(); i++) {
+      const auto dst = Memory{.base = Reg::Rsp, .disp = (i32)(8 * i)};
+      const auto src = VarReg(stack[i].first);
+      if (IsVector(src)) Instr(Opcode::Movs, stack[i].second == Local::Type::Float ? 4 : 8, {dst, src});
+      else Instr(Opcode::Mov, 8, {dst, src});
+    }
+  }
+
+  auto callee = target;
+  if (!args.var_args.empty()) {
+    // variadic functions get the number of vector registers used in al
+    if (swl::holds_alternative<Reg>(callee) && swl::get<Reg>(callee) == Reg::Rax) {
+      Move(Scratch, Reg::Rax);
+      callee = Scratch;
+    }
+    Instr(Opcode::Mov, 4, {Reg::Rax, Imm{vector_count}});
+  }
+  Instr(Opcode::Call, 8, {std::move(callee)});
+  if (stack_size) Instr(Opcode::Add, 8, {Reg::Rsp, Imm{stack_size}});
+
+  if constexpr(!std::is_same_v<T, void>) {
+    if (!result.has_value()) return;
+    const auto gvar = GeneralizedVar::Var(result.value());
+    if (!allocation.registers.contains(gvar)) return;
+    Move(ToReg(allocation.registers.at(gvar)), is_float_v<T> ? Reg::Xmm0 : Reg::Rax);
+  }
+}
+
+template<typename To, typename From>
+void Backend::Emit(const Cast<To, From>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+  const auto src = VarReg(op.right_idx);
+
+  if constexpr(is_float_v<From>) {
+    if constexpr(is_float_v<To>) {
+      if constexpr(std::is_same_v<To, From>) Move(dst, src);
+      else Instr(Opcode::Cvts2s, sizeof(To), sizeof(From), {dst, src});
+    }
+    else if constexpr(std::is_same_v<To, u64> || std::is_same_v<To, Pointer>) {
+      // values of 2^63 and up do not fit the signed conversion, these
+      // are converted after subtracting 2^63, which is then added back
+      const auto big = NewLabel();
+      const auto done = NewLabel();
+      const auto limit = FloatConstant((From)9223372036854775808.0);
+      Instr(Opcode::Ucomis, sizeof(From), {src, limit});
+      Branch(Cond::AE, big);
+      Instr(Opcode::Cvtts2si, 8, sizeof(From), {dst, src});
+      Instr(Opcode::Jmp, 8, {Label{done}});
+      Instr(Opcode::Label, 0, {Label{big}});
+      Move(VectorScratch, src);
+      Instr(Opcode::Subs, sizeof(From), {VectorScratch, limit});
+      Instr(Opcode::Cvtts2si, 8, sizeof(From), {dst, VectorScratch});
+      Instr(Opcode::Mov, 8, {Scratch, Imm{std::numeric_limits<i64>::min()}});
+      Instr(Opcode::Xor, 8, {dst, Scratch});
+      Instr(Opcode::Label, 0, {Label{done}});
+    }
+    else if constexpr(std::is_same_v<To, i64> || std::is_same_v<To, u32>) {
+      // unsigned 32 bit values fit the signed 64 bit conversion
+      Instr(Opcode::Cvtts2si, 8, sizeof(From), {dst, src});
+    }
+    else {
+      Instr(Opcode::Cvtts2si, 4, sizeof(From), {dst, src});
+      if constexpr(is_calyx_small_type_v<To>) {
+        Instr(std::is_signed_v<To> ? Opcode::Movsx : Opcode::Movzx, 4, sizeof(To), {dst, dst});
+      }
+    }
+  }
+  else if constexpr(is_float_v<To>) {
+    if constexpr(std::is_same_v<From, i32> || std::is_same_v<From, i64>) {
+      Instr(Opcode::Cvtsi2s, sizeof(To), sizeof(From), {dst, src});
+    }
+    else if constexpr(std::is_same_v<From, u32>) {
+      // zero extended, unsigned 32 bit values fit the signed 64 bit conversion
+      Instr(Opcode::Mov, 4, {Scratch, src});
+      Instr(Opcode::Cvtsi2s, sizeof(To), 8, {dst, Scratch});
+    }
+    else {
+      // values of 2^63 and up are halved, keeping the lowest bit
+      // for correct rounding, and doubled after the conversion
+      const auto big = NewLabel();
+      const auto even = NewLabel();
+      const auto done = NewLabel();
+      Instr(Opcode::Test, 8, {src, src});
+      Branch(Cond::S, big);
+      Instr(Opcode::Cvtsi2s, sizeof(To), 8, {dst, src});
+      Instr(Opcode::Jmp, 8, {Label{done}});
+      Instr(Opcode::Label, 0, {Label{big}});
+      Instr(Opcode::Mov, 8, {Scratch, src});
+      Instr(Opcode::Shr, 8, {Scratch, Imm{1}});
+      Branch(Cond::AE, even);
+      Instr(Opcode::Or, 8, {Scratch, Imm{1}});
+      Instr(Opcode::Label, 0, {Label{even}});
+      Instr(Opcode::Cvtsi2s, sizeof(To), 8, {dst, Scratch});
+      Instr(Opcode::Adds, sizeof(To), {dst, dst});
+      Instr(Opcode::Label, 0, {Label{done}});
+    }
+  }
+  else if constexpr(is_calyx_small_type_v<To>) {
+    Instr(std::is_signed_v<To> ? Opcode::Movsx : Opcode::Movzx, 4, sizeof(To), {dst, src});
+  }
+  else if constexpr(size_of_v<To> == 4) {
+    // the upper half of 32 bit values in registers is never read
+    if (dst != src) Instr(Opcode::Mov, 4, {dst, src});
+  }
+  else if constexpr(std::is_same_v<From, i32>) {
+    Instr(Opcode::Movsx, 8, 4, {dst, src});
+  }
+  else if constexpr(std::is_same_v<From, u32>) {
+    // 32 bit moves clear the upper half of the register
+    Instr(Opcode::Mov, 4, {dst, src});
+  }
+  else {
+    Move(dst, src);
+  }
+}
+
+template<typename T>
+void Backend::Emit(const LoadLocal<T>& op) {
+  const auto dst = Result(op);
+  if (!dst.has_value()) return;
+  if (const auto reg = LocalReg(op.loc_idx)) {
+    cotyl::Assert(op.offset == 0, "Offset into local in register");
+    LoadLocalRegister<T>(dst.value(), reg.value());
+  }
+  else {
+    Load<T>(dst.value(), LocalMemory(op.loc_idx, op.offset));
+  }
+}
+
+void Backend::Emit(const LoadLocalAddr& op) {
+  const auto dst = Result(op);
+  if (!dst.has_value()) return;
+  Instr(Opcode::Lea, 8, {dst.value(), LocalMemory(op.loc_idx, 0)});
+}
+
+template<typename T>
+void Backend::Emit(const StoreLocal<T>& op) {
+  if (const auto reg = LocalReg(op.loc_idx)) {
+    cotyl::Assert(op.offset == 0, "Offset into local in register");
+    StoreLocalRegister<T>(reg.value(), op.src);
+  }
+  else if (frame.contains(op.loc_idx)) {
+    Store<T>(LocalMemory(op.loc_idx, op.offset), op.src);
+  }
+}
+
+template<typename T>
+void Backend::Emit(const LoadGlobal<T>& op) {
+  const auto dst = Result(op);
+  if (!dst.has_value()) return;
+  Load<T>(dst.value(), GlobalMemory(op.symbol, op.offset));
+}
+
+void Backend::Emit(const LoadGlobalAddr& op) {
+  const auto dst = Result(op);
+  if (!dst.has_value()) return;
+  auto symbol = op.symbol.str();
+  if (defined.contains(symbol)) Instr(Opcode::Lea, 8, {dst.value(), Memory{.symbol = std::move(symbol)}});
+  else Instr(Opcode::Mov, 8, {dst.value(), Memory{.symbol = std::move(symbol), .got = true}});
+}
+
+template<typename T>
+void Backend::Emit(const StoreGlobal<T>& op) {
+  Store<T>(GlobalMemory(op.symbol, op.offset), op.src);
+}
+
+template<typename T>
+void Backend::Emit(const LoadFromPointer<T>& op) {
+  const auto dst = Result(op);
+  if (!dst.has_value()) return;
+  auto address = OperandAddress(current_pos, 0, op.ptr_idx);
+  address.disp += op.offset;
+  Load<T>(dst.value(), address);
+}
+
+template<typename T>
+void Backend::Emit(const StoreToPointer<T>& op) {
+  auto address = OperandAddress(current_pos, 0, op.ptr_idx);
+  address.disp += op.offset;
+  Store<T>(address, op.src);
+}
+
+template<typename T>
+void Backend::Emit(const AddToPointer<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+
+  if (selector.nodes[current_pos].op != NodeOp::Other) {
+    Instr(Opcode::Lea, 8, {dst, Address(current_pos)});
+    return;
+  }
+
+  // constant pointers, offsets over 32 bits and strides that are not a scale
+  Operand base = Scratch;
+  if (op.ptr.IsVar()) base = VarReg(op.ptr.GetVar());
+  else Instr(Opcode::Mov, 8, {Scratch, Imm{op.ptr.GetScalar().value}});
+  const auto base_reg = swl::get<Reg>(base);
+
+  if (op.right.IsScalar()) {
+    const i64 offset = (i64)op.right.GetScalar() * op.stride;
+    if (FitsImm32(offset)) {
+      Instr(Opcode::Lea, 8, {dst, Memory{.base = base_reg, .disp = (i32)offset}});
+    }
+    else {
+      Move(dst, base_reg);
+      Instr(Opcode::Mov, 8, {Scratch, Imm{offset}});
+      Instr(Opcode::Add, 8, {dst, Scratch});
+    }
+    return;
+  }
+
+  const auto index = Index<T>(op.right.GetVar());
+  if (op.stride == 1 || op.stride == 2 || op.stride == 4 || op.stride == 8) {
+    Instr(Opcode::Lea, 8, {dst, Memory{.base = base_reg, .index = index, .scale = (u8)op.stride}});
+  }
+  else {
+    if (index != Scratch) Instr(Opcode::Mov, 8, {Scratch, index});
+    if (FitsImm32(op.stride)) Instr(Opcode::Imul, 8, {Scratch, Scratch, Imm{(i64)op.stride}});
+    else throw cotyl::UnimplementedException("pointer stride over 32 bits");
+    Instr(Opcode::Lea, 8, {dst, Memory{.base = base_reg, .index = Scratch}});
+  }
+}
+
+template<typename T>
+void Backend::Emit(const Call<T>& op) {
+  std::optional<var_index_t> result{};
+  if constexpr(!std::is_same_v<T, void>) result = op.idx;
+  EmitCall<T>(*op.args, VarReg(op.fn_idx), result);
+}
+
+template<typename T>
+void Backend::Emit(const CallLabel<T>& op) {
+  std::optional<var_index_t> result{};
+  if constexpr(!std::is_same_v<T, void>) result = op.idx;
+  EmitCall<T>(*op.args, Label{op.label.str()}, result);
+}
+
+template<typename T>
+void Backend::Emit(const Return<T>& op) {
+  if constexpr(!std::is_same_v<T, void>) {
+    if (op.val.IsVar()) {
+      Move(is_float_v<T> ? Reg::Xmm0 : Reg::Rax, VarReg(op.val.GetVar()));
+    }
+    else if constexpr(is_float_v<T>) {
+      const auto value = op.val.GetScalar();
+      if (ImmValue(value) == 0) Instr(Opcode::Xorps, 16, {Reg::Xmm0, Reg::Xmm0});
+      else Instr(Opcode::Movs, sizeof(T), {Reg::Xmm0, FloatConstant(value)});
+    }
+    else if (const auto value = ImmValue(op.val.GetScalar())) {
+      Instr(Opcode::Mov, size_of_v<T>, {Reg::Rax, Imm{value}});
+    }
+    else {
+      Instr(Opcode::Xor, 4, {Reg::Rax, Reg::Rax});
+    }
+  }
+  EmitEpilogue();
+}
+
+template<typename T>
+void Backend::Emit(const calyx::Imm<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+  const auto value = ImmValue(op.value);
+
+  if constexpr(is_float_v<T>) {
+    if (value == 0) Instr(Opcode::Xorps, 16, {dst, dst});
+    else Instr(Opcode::Movs, sizeof(T), {dst, FloatConstant(op.value)});
+  }
+  else if (value == 0) {
+    Instr(Opcode::Xor, 4, {dst, dst});
+  }
+  else if (value > 0 && value <= std::numeric_limits<u32>::max()) {
+    // 32 bit moves clear the upper half of the register
+    Instr(Opcode::Mov, 4, {dst, Imm{value}});
+  }
+  else {
+    Instr(Opcode::Mov, size_of_v<T>, {dst, Imm{value}});
+  }
+}
+
+template<typename T>
+void Backend::Emit(const Unop<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+  const auto src = VarReg(op.right_idx);
+
+  if constexpr(is_float_v<T>) {
+    cotyl::Assert(op.op == UnopType::Neg, "Invalid floating point unop");
+    // flip the sign bit
+    Move(dst, src);
+    Instr(Opcode::Movs, sizeof(T), {VectorScratch, FloatConstant(sizeof(T), 1ull << (8 * sizeof(T) - 1))});
+    Instr(Opcode::Xorps, 16, {dst, VectorScratch});
+  }
+  else {
+    Move(dst, src);
+    Instr(op.op == UnopType::Neg ? Opcode::Neg : Opcode::Not, size_of_v<T>, {dst});
+  }
+}
+
+template<typename T>
+void Backend::Emit(const Binop<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+  const auto left = VarReg(op.left_idx);
+  constexpr u8 size = size_of_v<T>;
+
+  if constexpr(is_float_v<T>) {
+    Reg right = VectorScratch;
+    if (op.right.IsVar()) right = VarReg(op.right.GetVar());
+    else Instr(Opcode::Movs, sizeof(T), {VectorScratch, FloatConstant(op.right.GetScalar())});
+
+    if (dst == right && dst != left) {
+      // the right operand would be overwritten by the left one
+      Move(VectorScratch, right);
+      right = VectorScratch;
+    }
+    Move(dst, left);
+    switch (op.op) {
+      case BinopType::Add: Instr(Opcode::Adds, sizeof(T), {dst, right}); break;
+      case BinopType::Sub: Instr(Opcode::Subs, sizeof(T), {dst, right}); break;
+      case BinopType::Mul: Instr(Opcode::Muls, sizeof(T), {dst, right}); break;
+      case BinopType::Div: Instr(Opcode::Divs, sizeof(T), {dst, right}); break;
+      default: throw cotyl::UnreachableException();
+    }
+  }
+  else {
+    if (op.op == BinopType::Div || op.op == BinopType::Mod) {
+      // the dividend was forced into rax, rdx holds the upper half
+      Move(Reg::Rax, left);
+      Reg divisor = Scratch;
+      if (op.right.IsVar()) {
+        divisor = VarReg(op.right.GetVar());
+        if (divisor == Reg::Rdx) {
+          Move(Scratch, Reg::Rdx);
+          divisor = Scratch;
+        }
+      }
+      else {
+        Instr(Opcode::Mov, size, {Scratch, Imm{ImmValue(op.right.GetScalar())}});
+      }
+
+      if constexpr(std::is_signed_v<T>) {
+        Instr(Opcode::SignExtend, size);
+        Instr(Opcode::Idiv, size, {divisor});
+      }
+      else {
+        Instr(Opcode::Xor, 4, {Reg::Rdx, Reg::Rdx});
+        Instr(Opcode::Div, size, {divisor});
+      }
+      Move(dst, op.op == BinopType::Div ? Reg::Rax : Reg::Rdx);
+      return;
+    }
+
+    Operand right = Scratch;
+    if (op.right.IsVar()) {
+      right = VarReg(op.right.GetVar());
+    }
+    else {
+      const auto value = ImmValue(op.right.GetScalar());
+      if (size == 8 && !FitsImm32(value)) Instr(Opcode::Mov, 8, {Scratch, Imm{value}});
+      else right = Imm{value};
+    }
+
+    if (swl::holds_alternative<Reg>(right) && swl::get<Reg>(right) == dst && dst != left) {
+      // all operations but subtraction are commutative, for those
+      // the right operand is already in place
+      if (op.op == BinopType::Sub) {
+        Move(Scratch, dst);
+        right = Scratch;
+        Move(dst, left);
+      }
+      else {
+        right = left;
+      }
+    }
+    else {
+      Move(dst, left);
+    }
+
+    switch (op.op) {
+      case BinopType::Add: Instr(Opcode::Add, size, {dst, std::move(right)}); break;
+      case BinopType::Sub: Instr(Opcode::Sub, size, {dst, std::move(right)}); break;
+      case BinopType::Mul: Instr(Opcode::Imul, size, {dst, std::move(right)}); break;
+      case BinopType::BinAnd: Instr(Opcode::And, size, {dst, std::move(right)}); break;
+      case BinopType::BinOr: Instr(Opcode::Or, size, {dst, std::move(right)}); break;
+      case BinopType::BinXor: Instr(Opcode::Xor, size, {dst, std::move(right)}); break;
+      default: throw cotyl::UnreachableException();
+    }
+  }
+}
+
+template<typename T>
+void Backend::Emit(const Shift<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  constexpr u8 size = size_of_v<T>;
+
+  // a result in rcx would overwrite the count
+  const auto dst = result.value() == Reg::Rcx ? Scratch : result.value();
+
+  Operand count = Reg::Rcx;
+  if (op.right.IsScalar()) count = Imm{op.right.GetScalar() & (8 * size - 1)};
+
+  if (op.left.IsVar()) {
+    const auto left = VarReg(op.left.GetVar());
+    if (size == 4) {
+      if (dst != left) Instr(Opcode::Mov, 4, {dst, left});
+    }
+    else {
+      Move(dst, left);
+    }
+  }
+  else {
+    Instr(Opcode::Mov, size, {dst, Imm{ImmValue(op.left.GetScalar())}});
+  }
+
+  Opcode opcode;
+  if (op.op == ShiftType::Left) opcode = Opcode::Shl;
+  else if constexpr(std::is_signed_v<T>) opcode = Opcode::Sar;
+  else opcode = Opcode::Shr;
+  Instr(opcode, size, {dst, std::move(count)});
+  Move(result.value(), dst);
+}
+
+template<typename T>
+void Backend::Emit(const calyx::Compare<T>& op) {
+  const auto result = Result(op);
+  if (!result.has_value()) return;
+  const auto dst = result.value();
+
+  const auto cond = Compare(op.left_idx, op.right, op.op);
+  Set(cond, dst);
+  if constexpr(is_float_v<T>) {
+    // unordered values are never equal
+    if (op.op == CmpType::Eq) {
+      Set(Cond::NP, Scratch);
+      Instr(Opcode::And, 1, {dst, Scratch});
+    }
+    else if (op.op == CmpType::Ne) {
+      Set(Cond::P, Scratch);
+      Instr(Opcode::Or, 1, {dst, Scratch});
+    }
+  }
+  Instr(Opcode::Movzx, 4, 1, {dst, dst});
+}
+
+template<typename T>
+void Backend::EmitBranch(var_index_t left_idx, const calyx::Operand<T>& right, CmpType op, block_label_t tdest, block_label_t fdest) {
+  const auto cond = Compare(left_idx, right, op);
+  const auto tlabel = BlockLabel(tdest);
+  const auto flabel = BlockLabel(fdest);
+
+  if constexpr(is_float_v<T>) {
+    // unordered values are never equal
+    if (op == CmpType::Eq) {
+      Branch(Cond::P, flabel);
+      Branch(Cond::E, tlabel);
+      Jump(fdest);
+      return;
+    }
+    if (op == CmpType::Ne) {
+      Branch(Cond::P, tlabel);
+      Branch(Cond::NE, tlabel);
+      Jump(fdest);
+      return;
+    }
+  }
+
+  if (next_block == tdest) {
+    Branch(Invert(cond), flabel);
+  }
+  else {
+    Branch(cond, tlabel);
+    Jump(fdest);
+  }
+}
+
+template<typename T>
+void Backend::Emit(const BranchCompare<T>& op) {
+  if (const auto folded = FoldedOperand(current_pos, 0)) {
+    // branch on the comparison that computed the tested value
+    const bool is_true = op.op == CmpType::Ne;
+    current_block->at(folded.value()).visit<void>(
+      [&]<typename U>(const calyx::Compare<U>& compare) {
+        EmitBranch<U>(
+          compare.left_idx, compare.right, compare.op,
+          is_true ? op.tdest : op.fdest, is_true ? op.fdest : op.tdest
+        );
+      },
+      [](const auto&) {
+        throw cotyl::UnreachableException();
+      }
+    );
+    return;
+  }
+  EmitBranch<T>(op.left_idx, op.right, op.op, op.tdest, op.fdest);
+}
+
+void Backend::Emit(const UnconditionalBranch& op) {
+  Jump(op.dest);
+}
+
+void Backend::Emit(const Select& op) {
+  const auto src = VarReg(op.idx);
+  cotyl::vector<std::pair<i64, block_label_t>> table{op.table->begin(), op.table->end()};
+  std::sort(table.begin(), table.end());
+
+  for (std::size_t i = 0; i < table.size(); i++) {
+    const auto& [value, block_idx] = table[i];
+    if (!op._default && i + 1 == table.size()) {
+      // without a default the value is always in the table
+      Jump(block_idx);
+      return;
+    }
+    if (FitsImm32(value)) {
+      Instr(Opcode::Cmp, 8, {src, Imm{value}});
+    }
+    else {
+      Instr(Opcode::Mov, 8, {Scratch, Imm{value}});
+      Instr(Opcode::Cmp, 8, {src, Scratch});
+    }
+    Branch(Cond::E, BlockLabel(block_idx));
+  }
+  if (op._default) Jump(op._default);
+}
+
+}
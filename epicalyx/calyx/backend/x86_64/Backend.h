@@ -0,0 +1,167 @@
+#pragma once
+
+#include "Module.h"
+#include "Instruction.h"
+#include "Selector.h"
+#include "calyx/Calyx.h"
+#include "regalloc/Allocator.h"
+#include "optimizer/ProgramDependencies.h"
+
+#include <map>
+#include <optional>
+#include <string>
+
+
+namespace epi::x86_64 {
+
+/*
+ * Lowers a Calyx program to x86-64 machine code for Linux, following
+ * the System V ABI.
+ * Registers are allocated per function with the x86-64 register space,
+ * which forces arguments, return values, dividends and shift counts into
+ * the registers the ABI and instructions need, so that directives can be
+ * lowered one at a time. r11 and xmm15 are never allocated, and are used
+ * as scratch registers within the code of a single directive.
+ * Instructions are selected per block: address computations that are only
+ * used by a single load, store or other address computation are folded
+ * into its addressing mode, and comparisons that are only used by a branch
+ * set the flags for it directly.
+ * Functions use a frame pointer. Locals in memory live below it, followed
+ * by the callee saved registers that were allocated, and the frame is
+ * kept 16 byte aligned. Incoming arguments are moved into the registers or
+ * memory of their locals on entry, stack arguments of calls are stored
+ * below the frame right before the call.
+ * Pointers to symbols defined in the program are relative to rip,
+ * other symbols are accessed through the global offset table, and
+ * functions are called through the procedure linkage table, so that the
+ * code can be linked into position independent executables.
+ * */
+struct Backend {
+  Backend(bool linear_scan = false) : linear_scan{linear_scan} { }
+
+  void Emit(const calyx::Program& program);
+
+  Module module{};
+
+private:
+  bool linear_scan;
+
+  // symbols of functions and data defined in the program
+  cotyl::unordered_set<std::string> defined{};
+  // float constants by size and value
+  std::map<std::pair<u8, u64>, std::string> float_constants{};
+
+  // state of the function that is being emitted
+  const calyx::Function* function = nullptr;
+  Allocation allocation{};
+  Code* code = nullptr;
+  // offsets to rbp of the locals in memory
+  cotyl::unordered_map<loc_index_t, i32> frame{};
+  // callee saved registers with the offset to rbp they are saved at
+  cotyl::vector<std::pair<Reg, i32>> saved{};
+  i32 frame_size = 0;
+  // block that is emitted after the current one, branches to it fall through
+  std::optional<block_label_t> next_block{};
+  u32 labels = 0;
+  // block that is being emitted, its instruction selection and the
+  // position of the directive that is being emitted
+  const calyx::BasicBlock* current_block = nullptr;
+  Selector selector{};
+  u32 current_pos = 0;
+
+  void EmitData(const calyx::Program& program);
+  void EmitFunction(const calyx::Function& function);
+  void EmitArguments();
+  void EmitEpilogue();
+  void SelectBlock(const RegisterSpace& regspace, const FunctionDependencies& deps);
+
+  void Emit(const calyx::AnyDirective& dir);
+
+  void Instr(Opcode opcode, u8 size, cotyl::vector<Operand>&& operands = {});
+  void Instr(Opcode opcode, u8 size, u8 src_size, cotyl::vector<Operand>&& operands);
+  void Set(Cond cond, Reg dst);
+  void Branch(Cond cond, const std::string& label);
+  void Jump(block_label_t block_idx);
+  void Move(Reg dst, Reg src);
+  // moves between registers that happen at the same time
+  void ParallelMove(cotyl::vector<std::pair<Reg, Reg>>&& moves);
+
+  std::string BlockLabel(block_label_t block_idx) const;
+  std::string NewLabel();
+  Memory FloatConstant(u8 size, u64 bits);
+  template<typename T>
+  Memory FloatConstant(T value);
+
+  Reg VarReg(var_index_t var_idx) const;
+  std::optional<Reg> LocalReg(loc_index_t loc_idx) const;
+  std::optional<Reg> Result(const calyx::Expr& expr) const;
+  Memory LocalMemory(loc_index_t loc_idx, i32 offset) const;
+  Memory GlobalMemory(const cotyl::CString& symbol, i32 offset);
+  // node of an operand of a node, if it is folded into it
+  std::optional<u32> FoldedOperand(u32 node_idx, u8 operand) const;
+  // address computed by a folded node
+  Memory Address(u32 node_idx);
+  // address computed by the operand of a node, or held in the register of its var
+  Memory OperandAddress(u32 node_idx, u8 operand, var_index_t var_idx);
+  // pointer offset in 64 bits
+  template<typename T>
+  Reg Index(var_index_t var_idx);
+
+  template<typename T>
+  void Load(Reg dst, const Memory& src);
+  template<typename T>
+  void Store(const Memory& dst, const calyx::Operand<calyx::calyx_upcast_t<T>>& src);
+  template<typename T>
+  void LoadLocalRegister(Reg dst, Reg src);
+  template<typename T>
+  void StoreLocalRegister(Reg dst, const calyx::Operand<calyx::calyx_upcast_t<T>>& src);
+  // compare the operands, returns the condition that holds if the comparison is true
+  template<typename T>
+  Cond Compare(var_index_t left_idx, const calyx::Operand<T>& right, calyx::CmpType op);
+  template<typename T>
+  void EmitBranch(var_index_t left_idx, const calyx::Operand<T>& right, calyx::CmpType op, block_label_t tdest, block_label_t fdest);
+  template<typename T>
+  void EmitCall(const calyx::ArgData& args, const Operand& target, std::optional<var_index_t> result);
+
+  void Emit(const calyx::NoOp& op) { }
+  template<typename To, typename From>
+  void Emit(const calyx::Cast<To, From>& op);
+  template<typename T>
+  void Emit(const calyx::LoadLocal<T>& op);
+  void Emit(const calyx::LoadLocalAddr& op);
+  template<typename T>
+  void Emit(const calyx::StoreLocal<T>& op);
+  template<typename T>
+  void Emit(const calyx::LoadGlobal<T>& op);
+  void Emit(const calyx::LoadGlobalAddr& op);
+  template<typename T>
+  void Emit(const calyx::StoreGlobal<T>& op);
+  template<typename T>
+  void Emit(const calyx::LoadFromPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::StoreToPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::AddToPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::Call<T>& op);
+  template<typename T>
+  void Emit(const calyx::CallLabel<T>& op);
+  template<typename T>
+  void Emit(const calyx::Return<T>& op);
+  template<typename T>
+  void Emit(const calyx::Imm<T>& op);
+  template<typename T>
+  void Emit(const calyx::Unop<T>& op);
+  template<typename T>
+  void Emit(const calyx::Binop<T>& op);
+  template<typename T>
+  void Emit(const calyx::Shift<T>& op);
+  template<typename T>
+  void Emit(const calyx::Compare<T>& op);
+  template<typename T>
+  void Emit(const calyx::BranchCompare<T>& op);
+  void Emit(const calyx::UnconditionalBranch& op);
+  void Emit(const calyx::Select& op);
+};
+
+}
@@ -0,0 +1,348 @@
+#include "Encoder.h"
+#include "CustomAssert.h"
+#include "Exceptions.h"
+
+#include <bit>
+
+
+namespace epi::x86_64 {
+
+namespace {
+
+bool FitsImm8(i64 value) {
+  return value >= -128 && value <= 127;
+}
+
+// opcode extension in the reg field of the ModRM byte of arithmetic instructions
+u8 ArithmeticExtension(Opcode opcode) {
+  switch (opcode) {
+    case Opcode::Add: return 0;
+    case Opcode::Or: return 1;
+    case Opcode::And: return 4;
+    case Opcode::Sub: return 5;
+    case Opcode::Xor: return 6;
+    case Opcode::Cmp: return 7;
+    default: throw cotyl::UnreachableException();
+  }
+}
+
+// mandatory prefix of scalar floating point instructions
+u8 FloatPrefix(u8 size) {
+  return size == 4 ? 0xf3 : 0xf2;
+}
+
+}
+
+void Encoder::Encode(const Code& code) {
+  const auto start = bytes.size();
+  const auto start_relocations = relocations.size();
+  long_branches.clear();
+  while (true) {
+    bytes.erase(bytes.begin() + start, bytes.end());
+    relocations.erase(relocations.begin() + start_relocations, relocations.end());
+    labels.clear();
+    fixups.clear();
+    for (instr_idx = 0; instr_idx < code.instructions.size(); instr_idx++) {
+      Encode(code.instructions[instr_idx]);
+    }
+
+    bool changed = false;
+    for (const auto& fixup : fixups) {
+      cotyl::Assert(labels.contains(fixup.label), "Branch to unknown label");
+      const auto rel = (i64)labels.at(fixup.label) - (i64)(fixup.offset + fixup.size);
+      if (fixup.size == 1 && !FitsImm8(rel)) {
+        long_branches.insert(fixup.instr_idx);
+        changed = true;
+      }
+    }
+    if (!changed) break;
+  }
+
+  for (const auto& fixup : fixups) {
+    const auto rel = (i64)labels.at(fixup.label) - (i64)(fixup.offset + fixup.size);
+    for (u8 i = 0; i < fixup.size; i++) {
+      bytes[fixup.offset + i] = (u8)(rel >> (8 * i));
+    }
+  }
+}
+
+void Encoder::Immediate(i64 value, u8 size) {
+  for (u8 i = 0; i < size; i++) {
+    Byte((u8)(value >> (8 * i)));
+  }
+}
+
+void Encoder::Branch(std::initializer_list<u8> short_opcode, std::initializer_list<u8> long_opcode, const std::string& label) {
+  const bool is_long = long_branches.contains(instr_idx);
+  for (const auto op : is_long ? long_opcode : short_opcode) Byte(op);
+  const u8 size = is_long ? 4 : 1;
+  fixups.push_back({bytes.size(), label, size, instr_idx});
+  Immediate(0, size);
+}
+
+void Encoder::ModRM(
+    u8 prefix, bool w, std::initializer_list<u8> opcode,
+    u8 reg, bool byte_reg, const Operand& rm, bool byte_rm, u8 imm_size) {
+  // spl, bpl, sil and dil can only be accessed with a REX prefix
+  bool force_rex = byte_reg && reg >= 4 && reg < 8;
+  u8 rex = (w ? 0x8 : 0) | ((reg >> 3) << 2);
+  if (swl::holds_alternative<Reg>(rm)) {
+    const auto r = Encoding(swl::get<Reg>(rm));
+    rex |= r >> 3;
+    force_rex |= byte_rm && !IsVector(swl::get<Reg>(rm)) && r >= 4 && r < 8;
+  }
+  else {
+    const auto& mem = swl::get<Memory>(rm);
+    if (mem.base.has_value()) rex |= Encoding(mem.base.value()) >> 3;
+    if (mem.index.has_value()) rex |= (Encoding(mem.index.value()) >> 3) << 1;
+  }
+
+  if (prefix) Byte(prefix);
+  if (rex || force_rex) Byte(0x40 | rex);
+  for (const auto op : opcode) Byte(op);
+
+  const u8 reg_field = (reg & 7) << 3;
+  if (swl::holds_alternative<Reg>(rm)) {
+    Byte(0xc0 | reg_field | (Encoding(swl::get<Reg>(rm)) & 7));
+    return;
+  }
+
+  const auto& mem = swl::get<Memory>(rm);
+  if (mem.symbol.has_value()) {
+    // rip relative, which is relative to the end of the instruction
+    Byte(reg_field | 5);
+    relocations.push_back({
+      bytes.size(),
+      mem.symbol.value(),
+      mem.got ? RelocationType::GotPCRel : RelocationType::PC32,
+      (i64)mem.disp - 4 - imm_size
+    });
+    Immediate(0, 4);
+    return;
+  }
+
+  cotyl::Assert(mem.base.has_value(), "Memory operand without base");
+  const u8 base = Encoding(mem.base.value()) & 7;
+  // rsp and r12 as base need an SIB byte, rbp and r13 always need a displacement
+  const bool sib = mem.index.has_value() || base == 4;
+  u8 mod;
+  if (mem.disp == 0 && base != 5) mod = 0;
+  else if (FitsImm8(mem.disp)) mod = 1;
+  else mod = 2;
+
+  Byte((mod << 6) | reg_field | (sib ? 4 : base));
+  if (sib) {
+    const u8 index = mem.index.has_value() ? Encoding(mem.index.value()) & 7 : 4;
+    Byte((std::countr_zero(mem.scale) << 6) | (index << 3) | base);
+  }
+  if (mod == 1) Immediate(mem.disp, 1);
+  else if (mod == 2) Immediate(mem.disp, 4);
+}
+
+void Encoder::Encode(const Instruction& instr) {
+  const auto& ops = instr.operands;
+  const u8 size = instr.size;
+  const bool w = size == 8;
+  const bool byte = size == 1;
+  const u8 prefix = size == 2 ? 0x66 : 0;
+  const auto reg = [&](std::size_t i) { return Encoding(swl::get<Reg>(ops[i])); };
+  const auto is_reg = [&](std::size_t i) { return swl::holds_alternative<Reg>(ops[i]); };
+  const auto is_imm = [&](std::size_t i) { return swl::holds_alternative<Imm>(ops[i]); };
+  const auto imm = [&](std::size_t i) { return swl::get<Imm>(ops[i]).value; };
+  // size of the immediate of instructions with a full size immediate
+  const u8 imm_size = size == 8 ? 4 : size;
+
+  switch (instr.opcode) {
+    case Opcode::Label: {
+      labels.emplace(swl::get<Label>(ops[0]).name, bytes.size());
+      return;
+    }
+    case Opcode::Mov: {
+      if (is_imm(1)) {
+        if (is_reg(0) && (size != 8 || !FitsImm32(imm(1)))) {
+          // mov reg, imm with an immediate of the full size (movabs)
+          const auto r = reg(0);
+          if (prefix) Byte(prefix);
+          if (w || r >= 8 || (byte && r >= 4)) Byte(0x40 | (w ? 0x8 : 0) | (r >> 3));
+          Byte((byte ? 0xb0 : 0xb8) + (r & 7));
+          Immediate(imm(1), size);
+        }
+        else {
+          ModRM(prefix, w, {(u8)(byte ? 0xc6 : 0xc7)}, 0, false, ops[0], byte, imm_size);
+          Immediate(imm(1), imm_size);
+        }
+      }
+      else if (is_reg(1)) {
+        ModRM(prefix, w, {(u8)(byte ? 0x88 : 0x89)}, reg(1), byte, ops[0], byte);
+      }
+      else {
+        ModRM(prefix, w, {(u8)(byte ? 0x8a : 0x8b)}, reg(0), byte, ops[1], byte);
+      }
+      return;
+    }
+    case Opcode::Movsx: {
+      if (instr.src_size == 4) ModRM(0, w, {0x63}, reg(0), false, ops[1], false);
+      else ModRM(prefix, w, {0x0f, (u8)(instr.src_size == 1 ? 0xbe : 0xbf)}, reg(0), false, ops[1], instr.src_size == 1);
+      return;
+    }
+    case Opcode::Movzx: {
+      ModRM(prefix, w, {0x0f, (u8)(instr.src_size == 1 ? 0xb6 : 0xb7)}, reg(0), false, ops[1], instr.src_size == 1);
+      return;
+    }
+    case Opcode::Lea: {
+      ModRM(prefix, w, {0x8d}, reg(0), false, ops[1], false);
+      return;
+    }
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::And:
+    case Opcode::Or:
+    case Opcode::Xor:
+    case Opcode::Cmp: {
+      const u8 ext = ArithmeticExtension(instr.opcode);
+      if (is_imm(1)) {
+        if (byte) {
+          ModRM(prefix, w, {0x80}, ext, false, ops[0], byte, 1);
+          Immediate(imm(1), 1);
+        }
+        else if (FitsImm8(imm(1))) {
+          ModRM(prefix, w, {0x83}, ext, false, ops[0], byte, 1);
+          Immediate(imm(1), 1);
+        }
+        else {
+          ModRM(prefix, w, {0x81}, ext, false, ops[0], byte, imm_size);
+          Immediate(imm(1), imm_size);
+        }
+      }
+      else if (is_reg(1)) {
+        ModRM(prefix, w, {(u8)(8 * ext + (byte ? 0 : 1))}, reg(1), byte, ops[0], byte);
+      }
+      else {
+        ModRM(prefix, w, {(u8)(8 * ext + (byte ? 2 : 3))}, reg(0), byte, ops[1], byte);
+      }
+      return;
+    }
+    case Opcode::Test: {
+      ModRM(prefix, w, {(u8)(byte ? 0x84 : 0x85)}, reg(1), byte, ops[0], byte);
+      return;
+    }
+    case Opcode::Imul: {
+      // imul reg, r/m, imm, or imul reg, imm for imul reg, reg, imm
+      const auto& src = ops.size() == 3 || !is_imm(1) ? ops[1] : ops[0];
+      if (is_imm(ops.size() - 1)) {
+        const auto value = imm(ops.size() - 1);
+        if (FitsImm8(value)) {
+          ModRM(prefix, w, {0x6b}, reg(0), false, src, false, 1);
+          Immediate(value, 1);
+        }
+        else {
+          ModRM(prefix, w, {0x69}, reg(0), false, src, false, imm_size);
+          Immediate(value, imm_size);
+        }
+      }
+      else {
+        ModRM(prefix, w, {0x0f, 0xaf}, reg(0), false, src, false);
+      }
+      return;
+    }
+    case Opcode::Neg:
+    case Opcode::Not:
+    case Opcode::Idiv:
+    case Opcode::Div: {
+      u8 ext;
+      switch (instr.opcode) {
+        case Opcode::Neg: ext = 3; break;
+        case Opcode::Not: ext = 2; break;
+        case Opcode::Idiv: ext = 7; break;
+        default: ext = 6; break;
+      }
+      ModRM(prefix, w, {(u8)(byte ? 0xf6 : 0xf7)}, ext, false, ops[0], byte);
+      return;
+    }
+    case Opcode::Shl:
+    case Opcode::Shr:
+    case Opcode::Sar: {
+      const u8 ext = instr.opcode == Opcode::Shl ? 4 : instr.opcode == Opcode::Shr ? 5 : 7;
+      if (is_imm(1) && imm(1) == 1) {
+        ModRM(prefix, w, {(u8)(byte ? 0xd0 : 0xd1)}, ext, false, ops[0], byte);
+      }
+      else if (is_imm(1)) {
+        ModRM(prefix, w, {(u8)(byte ? 0xc0 : 0xc1)}, ext, false, ops[0], byte, 1);
+        Immediate(imm(1), 1);
+      }
+      else {
+        // shift by cl
+        ModRM(prefix, w, {(u8)(byte ? 0xd2 : 0xd3)}, ext, false, ops[0], byte);
+      }
+      return;
+    }
+    case Opcode::SignExtend: {
+      if (w) Byte(0x48);
+      Byte(0x99);
+      return;
+    }
+    case Opcode::Setcc: {
+      ModRM(0, false, {0x0f, (u8)(0x90 + static_cast<u8>(instr.cond))}, 0, false, ops[0], true);
+      return;
+    }
+    case Opcode::Jcc: {
+      const u8 cond = static_cast<u8>(instr.cond);
+      Branch({(u8)(0x70 + cond)}, {0x0f, (u8)(0x80 + cond)}, swl::get<Label>(ops[0]).name);
+      return;
+    }
+    case Opcode::Jmp: {
+      Branch({0xeb}, {0xe9}, swl::get<Label>(ops[0]).name);
+      return;
+    }
+    case Opcode::Call: {
+      if (swl::holds_alternative<Label>(ops[0])) {
+        Byte(0xe8);
+        relocations.push_back({bytes.size(), swl::get<Label>(ops[0]).name, RelocationType::PLT32, -4});
+        Immediate(0, 4);
+      }
+      else {
+        ModRM(0, false, {0xff}, 2, false, ops[0], false);
+      }
+      return;
+    }
+    case Opcode::Ret: Byte(0xc3); return;
+    case Opcode::Leave: Byte(0xc9); return;
+    case Opcode::Push:
+    case Opcode::Pop: {
+      const auto r = reg(0);
+      if (r >= 8) Byte(0x41);
+      Byte((instr.opcode == Opcode::Push ? 0x50 : 0x58) + (r & 7));
+      return;
+    }
+    case Opcode::Movs: {
+      if (is_reg(0)) ModRM(FloatPrefix(size), false, {0x0f, 0x10}, reg(0), false, ops[1], false);
+      else ModRM(FloatPrefix(size), false, {0x0f, 0x11}, reg(1), false, ops[0], false);
+      return;
+    }
+    case Opcode::Movaps: ModRM(0, false, {0x0f, 0x28}, reg(0), false, ops[1], false); return;
+    case Opcode::Xorps: ModRM(0, false, {0x0f, 0x57}, reg(0), false, ops[1], false); return;
+    case Opcode::Adds: ModRM(FloatPrefix(size), false, {0x0f, 0x58}, reg(0), false, ops[1], false); return;
+    case Opcode::Muls: ModRM(FloatPrefix(size), false, {0x0f, 0x59}, reg(0), false, ops[1], false); return;
+    case Opcode::Subs: ModRM(FloatPrefix(size), false, {0x0f, 0x5c}, reg(0), false, ops[1], false); return;
+    case Opcode::Divs: ModRM(FloatPrefix(size), false, {0x0f, 0x5e}, reg(0), false, ops[1], false); return;
+    case Opcode::Ucomis: {
+      ModRM(size == 4 ? 0 : 0x66, false, {0x0f, 0x2e}, reg(0), false, ops[1], false);
+      return;
+    }
+    case Opcode::Cvtsi2s: {
+      ModRM(FloatPrefix(size), instr.src_size == 8, {0x0f, 0x2a}, reg(0), false, ops[1], false);
+      return;
+    }
+    case Opcode::Cvtts2si: {
+      ModRM(FloatPrefix(instr.src_size), w, {0x0f, 0x2c}, reg(0), false, ops[1], false);
+      return;
+    }
+    case Opcode::Cvts2s: {
+      ModRM(FloatPrefix(instr.src_size), false, {0x0f, 0x5a}, reg(0), false, ops[1], false);
+      return;
+    }
+  }
+  throw cotyl::UnreachableException();
+}
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Module.h"
+#include "Instruction.h"
+#include "Default.h"
+#include "Containers.h"
+
+#include <string>
+
+
+namespace epi::x86_64 {
+
+/*
+ * Encodes instructions into x86-64 machine code.
+ * Functions are appended one after the other. Branches to labels are
+ * resolved within the function they are in. They start out with 8 bit
+ * displacements, branches of which the target is out of reach get a 32 bit
+ * displacement, and the function is encoded again, until all targets are
+ * in reach. References to symbols (rip relative memory operands, their
+ * global offset table entries and called functions) are left as
+ * relocations, to be resolved by the linker.
+ * */
+struct Encoder {
+  // relocation types of the System V x86-64 ABI
+  enum class RelocationType : u32 {
+    Abs64 = 1, PC32 = 2, PLT32 = 4, GotPCRel = 9,
+  };
+
+  struct Relocation {
+    u64 offset;
+    std::string symbol;
+    RelocationType type;
+    i64 addend;
+  };
+
+  cotyl::vector<u8> bytes{};
+  cotyl::vector<Relocation> relocations{};
+
+  void Encode(const Code& code);
+
+private:
+  struct Fixup {
+    u64 offset;
+    std::string label;
+    // size of the displacement
+    u8 size;
+    std::size_t instr_idx;
+  };
+
+  // labels of the function that is being encoded, and the displacements to them
+  cotyl::unordered_map<std::string, u64> labels{};
+  cotyl::vector<Fixup> fixups{};
+  // branches that need a 32 bit displacement
+  cotyl::unordered_set<std::size_t> long_branches{};
+  std::size_t instr_idx = 0;
+
+  void Encode(const Instruction& instr);
+
+  void Byte(u8 value) { bytes.push_back(value); }
+  void Immediate(i64 value, u8 size);
+  // short or long branch, with the opcode for either
+  void Branch(std::initializer_list<u8> short_opcode, std::initializer_list<u8> long_opcode, const std::string& label);
+
+  // legacy prefix (0 for none), REX prefix and opcode, followed by the ModRM
+  // byte for the reg field (a register or an opcode extension) and an r/m
+  // operand. Byte registers are accessed through the REX prefix if needed.
+  // The immediate size is that of the immediate following the operands.
+  void ModRM(
+    u8 prefix, bool w, std::initializer_list<u8> opcode,
+    u8 reg, bool byte_reg, const Operand& rm, bool byte_rm, u8 imm_size = 0
+  );
+};
+
+}
@@ -0,0 +1,180 @@
+#include "Instruction.h"
+#include "Format.h"
+#include "Exceptions.h"
+
+#include <array>
+
+
+namespace epi::x86_64 {
+
+namespace {
+
+constexpr std::array<const char*, 16> Names64 = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+constexpr std::array<const char*, 16> Names32 = {
+  "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi",
+  "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"
+};
+
+constexpr std::array<const char*, 16> Names16 = {
+  "ax", "cx", "dx", "bx", "sp", "bp", "si", "di",
+  "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"
+};
+
+constexpr std::array<const char*, 16> Names8 = {
+  "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil",
+  "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"
+};
+
+constexpr std::array<const char*, 16> CondNames = {
+  "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"
+};
+
+char Suffix(u8 size) {
+  switch (size) {
+    case 1: return 'b';
+    case 2: return 'w';
+    case 4: return 'l';
+    case 8: return 'q';
+    default: throw cotyl::UnreachableException();
+  }
+}
+
+// scalar single or double suffix of floating point instructions
+const char* FloatSuffix(u8 size) {
+  return size == 4 ? "ss" : "sd";
+}
+
+std::string OperandString(const Operand& operand, u8 size) {
+  return swl::visit<std::string>(
+    swl::overloaded{
+      [&](const Reg& reg) {
+        return "%" + RegisterName(reg, size);
+      },
+      [](const Memory& mem) {
+        if (mem.symbol.has_value()) {
+          if (mem.got) return cotyl::Format("%s@GOTPCREL(%%rip)", mem.symbol.value().c_str());
+          if (mem.disp) return cotyl::Format("%s%+d(%%rip)", mem.symbol.value().c_str(), mem.disp);
+          return cotyl::Format("%s(%%rip)", mem.symbol.value().c_str());
+        }
+        std::string result = mem.disp ? std::to_string(mem.disp) : "";
+        result += "(";
+        if (mem.base.has_value()) result += "%" + RegisterName(mem.base.value(), 8);
+        if (mem.index.has_value()) {
+          result += cotyl::Format(",%%%s,%d", RegisterName(mem.index.value(), 8).c_str(), mem.scale);
+        }
+        return result + ")";
+      },
+      [](const Imm& imm) {
+        return "$" + std::to_string(imm.value);
+      },
+      [](const Label& label) {
+        return label.name;
+      },
+      swl::exhaustive
+    },
+    operand
+  );
+}
+
+}
+
+std::string RegisterName(Reg reg, u8 size) {
+  if (IsVector(reg)) return cotyl::Format("xmm%d", Encoding(reg));
+  switch (size) {
+    case 1: return Names8[Encoding(reg)];
+    case 2: return Names16[Encoding(reg)];
+    case 4: return Names32[Encoding(reg)];
+    default: return Names64[Encoding(reg)];
+  }
+}
+
+std::string Instruction::ToString() const {
+  // operands in AT&T order, all of the given size
+  const auto operands_string = [&](u8 dst_size, u8 src_size) {
+    std::string result{};
+    for (int i = (int)operands.size() - 1; i >= 0; i--) {
+      result += OperandString(operands[i], i ? src_size : dst_size);
+      if (i) result += ", ";
+    }
+    return result;
+  };
+  const auto op = [&](const std::string& mnemonic) {
+    return mnemonic + " " + operands_string(size, size);
+  };
+  const auto sized = [&](const char* mnemonic) {
+    return op(mnemonic + std::string(1, Suffix(size)));
+  };
+
+  switch (opcode) {
+    case Opcode::Label:
+      return swl::get<Label>(operands[0]).name + ":";
+    case Opcode::Mov:
+      if (size == 8 && swl::holds_alternative<Imm>(operands[1]) && !FitsImm32(swl::get<Imm>(operands[1]).value)) {
+        return op("movabsq");
+      }
+      return sized("mov");
+    case Opcode::Movsx:
+      if (src_size == 4) return "movslq " + operands_string(size, src_size);
+      return cotyl::Format("movs%c%c ", Suffix(src_size), Suffix(size)) + operands_string(size, src_size);
+    case Opcode::Movzx:
+      return cotyl::Format("movz%c%c ", Suffix(src_size), Suffix(size)) + operands_string(size, src_size);
+    case Opcode::Lea: return sized("lea");
+    case Opcode::Add: return sized("add");
+    case Opcode::Sub: return sized("sub");
+    case Opcode::And: return sized("and");
+    case Opcode::Or: return sized("or");
+    case Opcode::Xor: return sized("xor");
+    case Opcode::Cmp: return sized("cmp");
+    case Opcode::Test: return sized("test");
+    case Opcode::Imul: return sized("imul");
+    case Opcode::Neg: return sized("neg");
+    case Opcode::Not: return sized("not");
+    case Opcode::Idiv: return sized("idiv");
+    case Opcode::Div: return sized("div");
+    case Opcode::Shl:
+    case Opcode::Shr:
+    case Opcode::Sar: {
+      const char* mnemonic = opcode == Opcode::Shl ? "shl" : opcode == Opcode::Shr ? "shr" : "sar";
+      // shift counts in a register are in cl
+      return cotyl::Format("%s%c ", mnemonic, Suffix(size)) + operands_string(size, 1);
+    }
+    case Opcode::SignExtend:
+      return size == 8 ? "cqto" : "cltd";
+    case Opcode::Setcc:
+      return cotyl::Format("set%s ", CondNames[static_cast<u8>(cond)]) + operands_string(1, 1);
+    case Opcode::Jcc:
+      return cotyl::Format("j%s ", CondNames[static_cast<u8>(cond)]) + operands_string(8, 8);
+    case Opcode::Jmp:
+      return "jmp " + operands_string(8, 8);
+    case Opcode::Call:
+      if (swl::holds_alternative<Label>(operands[0])) {
+        return "call " + swl::get<Label>(operands[0]).name + "@PLT";
+      }
+      return "call *" + operands_string(8, 8);
+    case Opcode::Ret: return "ret";
+    case Opcode::Push: return "pushq " + operands_string(8, 8);
+    case Opcode::Pop: return "popq " + operands_string(8, 8);
+    case Opcode::Leave: return "leave";
+    case Opcode::Movs: return op(std::string("mov") + FloatSuffix(size));
+    case Opcode::Movaps: return op("movaps");
+    case Opcode::Adds: return op(std::string("add") + FloatSuffix(size));
+    case Opcode::Subs: return op(std::string("sub") + FloatSuffix(size));
+    case Opcode::Muls: return op(std::string("mul") + FloatSuffix(size));
+    case Opcode::Divs: return op(std::string("div") + FloatSuffix(size));
+    case Opcode::Ucomis: return op(std::string("ucomi") + FloatSuffix(size));
+    case Opcode::Xorps: return op("xorps");
+    case Opcode::Cvtsi2s:
+      return cotyl::Format("cvtsi2%s%c ", FloatSuffix(size), Suffix(src_size)) + operands_string(size, src_size);
+    case Opcode::Cvtts2si:
+      return cotyl::Format("cvtt%s2si%c ", FloatSuffix(src_size), Suffix(size)) + operands_string(size, src_size);
+    case Opcode::Cvts2s:
+      return cotyl::Format("cvt%s2%s ", FloatSuffix(src_size), FloatSuffix(size)) + operands_string(size, src_size);
+  }
+  throw cotyl::UnreachableException();
+}
+
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Default.h"
+#include "Containers.h"
+#include "swl/variant.hpp"
+
+#include <limits>
+#include <optional>
+#include <string>
+
+
+namespace epi::x86_64 {
+
+// general purpose registers in order of their encoding, followed by the xmm registers
+enum class Reg : u8 {
+  Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi,
+  R8, R9, R10, R11, R12, R13, R14, R15,
+  Xmm0, Xmm1, Xmm2, Xmm3, Xmm4, Xmm5, Xmm6, Xmm7,
+  Xmm8, Xmm9, Xmm10, Xmm11, Xmm12, Xmm13, Xmm14, Xmm15,
+};
+
+constexpr bool IsVector(Reg reg) { return reg >= Reg::Xmm0; }
+constexpr Reg Xmm(u32 idx) { return static_cast<Reg>(static_cast<u8>(Reg::Xmm0) + idx); }
+
+// register number within its kind, as it is encoded
+constexpr u8 Encoding(Reg reg) { return static_cast<u8>(reg) & 0xf; }
+
+// registers that are never allocated, these are free
+// to be used within the code for a single directive
+constexpr Reg Scratch = Reg::R11;
+constexpr Reg VectorScratch = Reg::Xmm15;
+
+// condition codes, in order of their encoding
+enum class Cond : u8 {
+  O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G
+};
+
+constexpr Cond Invert(Cond cond) { return static_cast<Cond>(static_cast<u8>(cond) ^ 1); }
+
+struct Memory {
+  std::optional<Reg> base{};
+  std::optional<Reg> index{};
+  u8 scale = 1;
+  i32 disp = 0;
+
+  // address relative to rip of a symbol (plus disp), without base or index
+  std::optional<std::string> symbol{};
+  // address of the entry of the symbol in the global offset table instead
+  bool got = false;
+};
+
+struct Imm {
+  i64 value;
+};
+
+// code label, or symbol of a called function
+struct Label {
+  std::string name;
+};
+
+using Operand = swl::variant<Reg, Memory, Imm, Label>;
+
+enum class Opcode : u8 {
+  // not an instruction, places its label operand
+  Label,
+
+  Mov, Movsx, Movzx, Lea,
+  Add, Sub, And, Or, Xor, Cmp, Test, Imul,
+  Neg, Not, Idiv, Div, Shl, Shr, Sar,
+  // sign extend the accumulator into rdx (cltd / cqto)
+  SignExtend,
+  Setcc, Jcc, Jmp, Call, Ret, Push, Pop, Leave,
+
+  // scalar floating point instructions, sized by their float operand
+  Movs, Movaps, Adds, Subs, Muls, Divs, Ucomis, Xorps,
+  // conversions, sized by their destination, src_size is that of the source
+  Cvtsi2s, Cvtts2si, Cvts2s,
+};
+
+/*
+ * A single x86-64 instruction.
+ * Operands are in Intel order, the destination comes first.
+ * The size is that of the operation in bytes, extending moves and
+ * conversions also hold the size of their source operand. Shifts by a
+ * register always shift by cl. Immediates of 64 bit moves that do not fit
+ * in 32 bits are moved with movabs, all other immediates must fit in
+ * 32 bits, and are sign extended by the processor.
+ * */
+struct Instruction {
+  Opcode opcode;
+  u8 size = 8;
+  u8 src_size = 0;
+  Cond cond = Cond::E;
+  cotyl::vector<Operand> operands{};
+
+  // AT&T syntax, as accepted by the GNU assembler
+  std::string ToString() const;
+};
+
+// whether an immediate can be sign extended from 32 bits
+constexpr bool FitsImm32(i64 value) {
+  return value >= std::numeric_limits<i32>::min() && value <= std::numeric_limits<i32>::max();
+}
+
+std::string RegisterName(Reg reg, u8 size);
+
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Instruction.h"
+#include "Default.h"
+#include "Containers.h"
+
+#include <string>
+
+
+namespace epi::x86_64 {
+
+struct Code {
+  std::string symbol;
+  cotyl::vector<Instruction> instructions{};
+};
+
+struct Data {
+  // 64 bit address of a symbol stored in the data
+  struct Relocation {
+    u64 offset;
+    std::string symbol;
+    i64 addend;
+  };
+
+  std::string symbol;
+  u32 align;
+  cotyl::vector<u8> bytes{};
+  cotyl::vector<Relocation> relocations{};
+};
+
+/*
+ * Machine code and data of a whole program, before it is
+ * written as assembly or as an object file.
+ * Functions and data are visible to other objects, constants
+ * (floating point values and strings) are local.
+ * Symbols that are not defined in the module are external.
+ * */
+struct Module {
+  cotyl::vector<Code> functions{};
+  cotyl::vector<Data> data{};
+  cotyl::vector<Data> constants{};
+};
+
+}
@@ -0,0 +1,257 @@
+#include "Object.h"
+#include "Encoder.h"
+#include "CustomAssert.h"
+
+#include <algorithm>
+#include <array>
+
+
+namespace epi::x86_64 {
+
+namespace {
+
+// section indices, in the order they are written
+enum SectionIndex : u16 {
+  NullSection, TextSection, DataSection, RodataSection, RelaTextSection, RelaDataSection,
+  SymtabSection, StrtabSection, ShstrtabSection, GnuStackSection, SectionCount
+};
+
+constexpr u32 TypeProgBits = 1;
+constexpr u32 TypeSymtab = 2;
+constexpr u32 TypeStrtab = 3;
+constexpr u32 TypeRela = 4;
+
+constexpr u64 FlagWrite = 0x1;
+constexpr u64 FlagAlloc = 0x2;
+constexpr u64 FlagExec = 0x4;
+constexpr u64 FlagInfoLink = 0x40;
+
+constexpr u8 BindLocal = 0;
+constexpr u8 BindGlobal = 1;
+
+constexpr u8 SymbolNoType = 0;
+constexpr u8 SymbolObject = 1;
+constexpr u8 SymbolFunction = 2;
+constexpr u8 SymbolSection = 3;
+
+constexpr u64 SymbolSize = 24;
+constexpr u64 RelaSize = 24;
+constexpr u64 HeaderSize = 64;
+constexpr u64 SectionHeaderSize = 64;
+
+// little endian byte buffer
+struct Buffer {
+  cotyl::vector<u8> bytes{};
+
+  template<typename T>
+  void Put(T value) {
+    for (u32 i = 0; i < sizeof(T); i++) {
+      bytes.push_back((u8)((u64)value >> (8 * i)));
+    }
+  }
+
+  void Append(const cotyl::vector<u8>& other) {
+    bytes.insert(bytes.end(), other.begin(), other.end());
+  }
+
+  void Align(u64 align) {
+    while (bytes.size() % align) bytes.push_back(0);
+  }
+};
+
+struct StringTable {
+  Buffer buffer{};
+
+  StringTable() { buffer.Put<u8>(0); }
+
+  u32 Add(const std::string& string) {
+    const u32 offset = buffer.bytes.size();
+    for (const char c : string) buffer.Put<u8>(c);
+    buffer.Put<u8>(0);
+    return offset;
+  }
+};
+
+struct Section {
+  const char* name;
+  u32 type;
+  u64 flags;
+  u64 align;
+  u64 entsize = 0;
+  u32 link = 0;
+  u32 info = 0;
+  cotyl::vector<u8> bytes{};
+};
+
+struct Symbol {
+  std::string name;
+  u8 type;
+  u16 section;
+  u64 value;
+  u64 size;
+};
+
+}
+
+void WriteObject(const Module& module, std::ostream& out) {
+  cotyl::vector<Symbol> defined{};
+
+  Encoder encoder{};
+  for (const auto& function : module.functions) {
+    const u64 offset = encoder.bytes.size();
+    encoder.Encode(function);
+    defined.push_back({function.symbol, SymbolFunction, TextSection, offset, encoder.bytes.size() - offset});
+  }
+
+  Buffer data{};
+  u64 data_align = 1;
+  cotyl::vector<Encoder::Relocation> data_relocations{};
+  for (const auto& object : module.data) {
+    data.Align(object.align);
+    const u64 offset = data.bytes.size();
+    data.Append(object.bytes);
+    data_align = std::max<u64>(data_align, object.align);
+    for (const auto& relocation : object.relocations) {
+      data_relocations.push_back({
+        offset + relocation.offset, relocation.symbol, Encoder::RelocationType::Abs64, relocation.addend
+      });
+    }
+    defined.push_back({object.symbol, SymbolObject, DataSection, offset, object.bytes.size()});
+  }
+
+  // constants are local, references to them are relative to the section
+  Buffer rodata{};
+  u64 rodata_align = 1;
+  cotyl::unordered_map<std::string, u64> constants{};
+  for (const auto& constant : module.constants) {
+    cotyl::Assert(constant.relocations.empty(), "Relocation in constant");
+    rodata.Align(constant.align);
+    constants.emplace(constant.symbol, rodata.bytes.size());
+    rodata.Append(constant.bytes);
+    rodata_align = std::max<u64>(rodata_align, constant.align);
+  }
+
+  // local section symbols come first, followed by the global symbols
+  StringTable strtab{};
+  Buffer symtab{};
+  u32 symbol_count = 0;
+  const auto add_symbol = [&](u32 name, u8 bind, u8 type, u16 section, u64 value, u64 size) {
+    symtab.Put<u32>(name);
+    symtab.Put<u8>((bind << 4) | type);
+    symtab.Put<u8>(0);
+    symtab.Put<u16>(section);
+    symtab.Put<u64>(value);
+    symtab.Put<u64>(size);
+    return symbol_count++;
+  };
+  add_symbol(0, BindLocal, SymbolNoType, NullSection, 0, 0);
+  u32 rodata_symbol = 0;
+  for (const u16 section : {TextSection, DataSection, RodataSection}) {
+    const auto symbol = add_symbol(0, BindLocal, SymbolSection, section, 0, 0);
+    if (section == RodataSection) rodata_symbol = symbol;
+  }
+  const u32 first_global = symbol_count;
+
+  cotyl::unordered_map<std::string, u32> symbols{};
+  for (const auto& symbol : defined) {
+    symbols.emplace(symbol.name, add_symbol(
+      strtab.Add(symbol.name), BindGlobal, symbol.type, symbol.section, symbol.value, symbol.size
+    ));
+  }
+
+  const auto add_relocations = [&](const cotyl::vector<Encoder::Relocation>& relocations) {
+    Buffer rela{};
+    for (const auto& relocation : relocations) {
+      i64 addend = relocation.addend;
+      u32 symbol;
+      if (constants.contains(relocation.symbol)) {
+        symbol = rodata_symbol;
+        addend += constants.at(relocation.symbol);
+      }
+      else {
+        // symbols that are not defined are external
+        if (!symbols.contains(relocation.symbol)) {
+          symbols.emplace(relocation.symbol, add_symbol(
+            strtab.Add(relocation.symbol), BindGlobal, SymbolNoType, NullSection, 0, 0
+          ));
+        }
+        symbol = symbols.at(relocation.symbol);
+      }
+      rela.Put<u64>(relocation.offset);
+      rela.Put<u64>(((u64)symbol << 32) | static_cast<u32>(relocation.type));
+      rela.Put<i64>(addend);
+    }
+    return std::move(rela.bytes);
+  };
+
+  std::array<Section, SectionCount> sections = {
+    Section{"", 0, 0, 0},
+    Section{".text", TypeProgBits, FlagAlloc | FlagExec, 16, 0, 0, 0, std::move(encoder.bytes)},
+    Section{".data", TypeProgBits, FlagAlloc | FlagWrite, data_align, 0, 0, 0, std::move(data.bytes)},
+    Section{".rodata", TypeProgBits, FlagAlloc, rodata_align, 0, 0, 0, std::move(rodata.bytes)},
+    Section{".rela.text", TypeRela, FlagInfoLink, 8, RelaSize, SymtabSection, TextSection, add_relocations(encoder.relocations)},
+    Section{".rela.data", TypeRela, FlagInfoLink, 8, RelaSize, SymtabSection, DataSection, add_relocations(data_relocations)},
+    Section{".symtab", TypeSymtab, 0, 8, SymbolSize, StrtabSection, first_global},
+    Section{".strtab", TypeStrtab, 0, 1},
+    Section{".shstrtab", TypeStrtab, 0, 1},
+    // the stack is not executable
+    Section{".note.GNU-stack", TypeProgBits, 0, 1},
+  };
+  sections[SymtabSection].bytes = std::move(symtab.bytes);
+  sections[StrtabSection].bytes = std::move(strtab.buffer.bytes);
+
+  StringTable shstrtab{};
+  std::array<u32, SectionCount> names{};
+  for (u32 i = 1; i < SectionCount; i++) {
+    names[i] = shstrtab.Add(sections[i].name);
+  }
+  sections[ShstrtabSection].bytes = std::move(shstrtab.buffer.bytes);
+
+  // section contents follow the header, the section headers come last
+  Buffer file{};
+  file.bytes.resize(HeaderSize);
+  std::array<u64, SectionCount> offsets{};
+  for (u32 i = 1; i < SectionCount; i++) {
+    file.Align(std::max<u64>(sections[i].align, 1));
+    offsets[i] = file.bytes.size();
+    file.Append(sections[i].bytes);
+  }
+  file.Align(8);
+  const u64 section_headers = file.bytes.size();
+  for (u32 i = 0; i < SectionCount; i++) {
+    const auto& section = sections[i];
+    file.Put<u32>(names[i]);
+    file.Put<u32>(section.type);
+    file.Put<u64>(section.flags);
+    file.Put<u64>(0);
+    file.Put<u64>(offsets[i]);
+    file.Put<u64>(section.bytes.size());
+    file.Put<u32>(section.link);
+    file.Put<u32>(section.info);
+    file.Put<u64>(section.align);
+    file.Put<u64>(section.entsize);
+  }
+
+  Buffer header{};
+  // magic, 64 bit, little endian, current version, System V ABI
+  for (const u8 c : {0x7f, 0x45, 0x4c, 0x46, 2, 1, 1, 0}) header.Put<u8>(c);
+  header.Align(16);
+  header.Put<u16>(1);   // relocatable
+  header.Put<u16>(62);  // x86-64
+  header.Put<u32>(1);
+  header.Put<u64>(0);   // no entry point
+  header.Put<u64>(0);   // no program headers
+  header.Put<u64>(section_headers);
+  header.Put<u32>(0);
+  header.Put<u16>(HeaderSize);
+  header.Put<u16>(0);
+  header.Put<u16>(0);
+  header.Put<u16>(SectionHeaderSize);
+  header.Put<u16>(SectionCount);
+  header.Put<u16>(ShstrtabSection);
+  std::copy(header.bytes.begin(), header.bytes.end(), file.bytes.begin());
+
+  out.write(reinterpret_cast<const char*>(file.bytes.data()), file.bytes.size());
+}
+
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "Module.h"
+
+#include <ostream>
+
+
+namespace epi::x86_64 {
+
+// write the module as a relocatable ELF64 object file
+void WriteObject(const Module& module, std::ostream& out);
+
+}
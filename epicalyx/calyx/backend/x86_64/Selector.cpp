@@ -0,0 +1,76 @@
+#include "Selector.h"
+#include "CustomAssert.h"
+
+
+namespace epi::x86_64 {
+
+void Selector::Select() {
+  for (u32 node_idx = 0; node_idx < nodes.size(); node_idx++) {
+    Label(node_idx);
+  }
+
+  cotyl::vector<bool> is_operand(nodes.size(), false);
+  for (const auto& node : nodes) {
+    for (const auto& operand : node.operands) {
+      if (operand.has_value()) is_operand[operand.value()] = true;
+    }
+  }
+  for (u32 node_idx = 0; node_idx < nodes.size(); node_idx++) {
+    if (!is_operand[node_idx]) Reduce(node_idx, Nonterminal::Stmt);
+  }
+}
+
+void Selector::Label(u32 node_idx) {
+  auto& node = nodes[node_idx];
+  node.cost.fill(rules::Infinite);
+  node.best.fill(nullptr);
+
+  const auto update = [&](const Rule& rule, u32 cost) {
+    const auto lhs = static_cast<u8>(rule.lhs);
+    if (cost >= node.cost[lhs]) return false;
+    node.cost[lhs] = cost;
+    node.best[lhs] = &rule;
+    return true;
+  };
+
+  for (const auto& rule : rules::Rules) {
+    if (rule.op != node.op) continue;
+    u32 cost = rule.cost;
+    for (u8 i = 0; i < rule.arity && cost != rules::Infinite; i++) {
+      const auto nonterminal = static_cast<u8>(rule.operands[i]);
+      const auto& operand = node.operands[i];
+      const u32 operand_cost = operand.has_value() ? nodes[operand.value()].cost[nonterminal] : rules::LeafCost[nonterminal];
+      cost = operand_cost == rules::Infinite ? rules::Infinite : cost + operand_cost;
+    }
+    if (cost != rules::Infinite) update(rule, cost);
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& rule : rules::Rules) {
+      if (rule.op != NodeOp::Chain) continue;
+      const auto from = node.cost[static_cast<u8>(rule.operands[0])];
+      if (from == rules::Infinite) continue;
+      changed |= update(rule, from + rule.cost);
+    }
+  }
+}
+
+void Selector::Reduce(u32 node_idx, Nonterminal nonterminal) {
+  auto& node = nodes[node_idx];
+  const auto* rule = node.best[static_cast<u8>(nonterminal)];
+  cotyl::Assert(rule != nullptr, "Node cannot be covered");
+  if (rule->op == NodeOp::Chain) {
+    Reduce(node_idx, rule->operands[0]);
+    return;
+  }
+
+  node.rule = rule;
+  node.folded = rule->lhs != Nonterminal::Reg && rule->lhs != Nonterminal::Stmt;
+  for (u8 i = 0; i < rule->arity; i++) {
+    if (node.operands[i].has_value()) Reduce(node.operands[i].value(), rule->operands[i]);
+  }
+}
+
+}
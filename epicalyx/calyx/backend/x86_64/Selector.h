@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Default.h"
+#include "Containers.h"
+
+#include <array>
+#include <limits>
+#include <optional>
+
+
+namespace epi::x86_64 {
+
+/*
+ * Instruction selection by bottom up rewriting (BURS).
+ * The directives of a block form a forest: a directive whose result is read
+ * by only a single directive later in the same block may become a child of
+ * that directive, so that both are covered by a single pattern. The patterns
+ * are the rules of a tree grammar, annotated with the number of instructions
+ * they emit. Nodes are labeled bottom up with the cheapest rule that derives
+ * each nonterminal, after which the roots are reduced top down, selecting the
+ * cover with the fewest instructions.
+ * Nodes that are reduced to a Reg or a Stmt are emitted on their own, at
+ * their own position in the block. Other nodes are folded into the pattern
+ * of their parent, and emitted together with it.
+ * */
+
+enum class Nonterminal : u8 {
+  // the node is emitted on its own, for its effect
+  Stmt,
+  // the node is emitted on its own, its result is in its register
+  Reg,
+  // base register (or rbp) with a displacement
+  Base,
+  // base register with a scaled index and a displacement
+  Addr,
+  // the node sets the flags to its condition
+  Flags,
+};
+
+constexpr std::size_t NonterminalCount = 5;
+
+enum class NodeOp : u8 {
+  // any directive without patterns, emitted on its own
+  Other,
+  // address of a local in memory
+  LocalAddr,
+  // pointer plus a constant offset
+  AddOffset,
+  // pointer plus a 64 bit index scaled by 1, 2, 4 or 8
+  AddIndex,
+  // pointer plus a 32 bit index scaled by 1, 2, 4 or 8
+  AddIndexExtend,
+  LoadPointer,
+  StorePointer,
+  Compare,
+  // branch on a comparison result being (not) equal to 0
+  BranchTest,
+  // chain rules, deriving a nonterminal from another for the same node
+  Chain,
+};
+
+struct Rule {
+  Nonterminal lhs;
+  NodeOp op;
+  // nonterminals of the operands, in the order the directive reads them
+  std::array<Nonterminal, 2> operands;
+  u8 arity;
+  u8 cost;
+};
+
+namespace rules {
+
+using enum Nonterminal;
+using enum NodeOp;
+
+constexpr auto Rules = std::to_array<Rule>({
+  {Reg,   Other,          {},           0, 1},
+  {Stmt,  Chain,          {Reg},        1, 0},
+
+  // addressing modes
+  {Base,  Chain,          {Reg},        1, 0},  // (reg)
+  {Addr,  Chain,          {Base},       1, 0},
+  {Base,  LocalAddr,      {},           0, 0},  // disp(%rbp)
+  {Reg,   LocalAddr,      {},           0, 1},  // lea
+  {Base,  AddOffset,      {Base},       1, 0},  // disp(base)
+  {Addr,  AddOffset,      {Addr},       1, 0},  // disp(base, index, scale)
+  {Reg,   AddOffset,      {Addr},       1, 1},  // lea
+  {Addr,  AddIndex,       {Base, Reg},  2, 0},  // disp(base, index, scale)
+  {Reg,   AddIndex,       {Base, Reg},  2, 1},  // lea
+  {Addr,  AddIndexExtend, {Base, Reg},  2, 1},  // extend the index into the scratch register
+  {Reg,   AddIndexExtend, {Base, Reg},  2, 2},  // extend, lea
+  {Reg,   LoadPointer,    {Addr},       1, 1},  // mov
+  {Stmt,  StorePointer,   {Addr, Reg},  2, 1},  // mov
+
+  // conditions
+  {Flags, Compare,        {Reg, Reg},   2, 1},  // cmp
+  {Reg,   Compare,        {Reg, Reg},   2, 3},  // cmp, setcc, movzx
+  {Stmt,  BranchTest,     {Flags},      1, 1},  // jcc
+  {Stmt,  BranchTest,     {Reg},        1, 2},  // cmp, jcc
+});
+
+constexpr u32 Infinite = std::numeric_limits<u32>::max();
+
+// cost of deriving a nonterminal from a chain of rules starting at the given costs
+constexpr std::array<u32, NonterminalCount> Closure(std::array<u32, NonterminalCount> cost) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& rule : Rules) {
+      if (rule.op != Chain) continue;
+      const auto from = cost[static_cast<u8>(rule.operands[0])];
+      if (from == Infinite) continue;
+      auto& to = cost[static_cast<u8>(rule.lhs)];
+      if (from + rule.cost < to) {
+        to = from + rule.cost;
+        changed = true;
+      }
+    }
+  }
+  return cost;
+}
+
+// operands that are not covered by a node are vars in a register
+constexpr auto LeafCost = Closure({Infinite, 0, Infinite, Infinite, Infinite});
+
+// whether a node with the operator can be covered by itself, with all operands in registers
+constexpr bool CoversLeaves(NodeOp op) {
+  std::array<u32, NonterminalCount> cost{Infinite, Infinite, Infinite, Infinite, Infinite};
+  for (const auto& rule : Rules) {
+    if (rule.op != op) continue;
+    u32 total = rule.cost;
+    for (u8 i = 0; i < rule.arity; i++) {
+      const auto operand = LeafCost[static_cast<u8>(rule.operands[i])];
+      total = operand == Infinite ? Infinite : total + operand;
+    }
+    auto& lhs = cost[static_cast<u8>(rule.lhs)];
+    if (total < lhs) lhs = total;
+  }
+  return Closure(cost)[static_cast<u8>(Stmt)] != Infinite;
+}
+
+// whether a node with the operator can be covered together with its parent
+constexpr bool Foldable(NodeOp op) {
+  for (const auto& rule : Rules) {
+    if (rule.op == op && rule.lhs != Reg && rule.lhs != Stmt) return true;
+  }
+  return false;
+}
+
+static_assert(LeafCost[static_cast<u8>(Addr)] == 0, "Registers should be valid addresses");
+static_assert(
+  CoversLeaves(Other) && CoversLeaves(LocalAddr) && CoversLeaves(AddOffset) &&
+  CoversLeaves(AddIndex) && CoversLeaves(AddIndexExtend) && CoversLeaves(LoadPointer) &&
+  CoversLeaves(StorePointer) && CoversLeaves(Compare) && CoversLeaves(BranchTest),
+  "Every directive should be emittable with its operands in registers"
+);
+
+}
+
+struct Selector {
+  struct Node {
+    NodeOp op = NodeOp::Other;
+    // nodes that compute the operands, if they may be covered together with this node
+    std::array<std::optional<u32>, 2> operands{};
+
+    // cheapest rule for every nonterminal
+    std::array<u32, NonterminalCount> cost{};
+    std::array<const Rule*, NonterminalCount> best{};
+
+    // rule the node was covered with, and whether it is emitted
+    // together with its parent, instead of on its own
+    const Rule* rule = nullptr;
+    bool folded = false;
+  };
+
+  // nodes in the order of the directives of the block,
+  // operands are always before the nodes reading them
+  cotyl::vector<Node> nodes{};
+
+  void Select();
+
+  static constexpr bool Foldable(NodeOp op) { return rules::Foldable(op); }
+
+private:
+  void Label(u32 node_idx);
+  void Reduce(u32 node_idx, Nonterminal nonterminal);
+};
+
+}
@@ -8,7 +8,10 @@
 
 #include "argparse/argparse.hpp"
 #include <iostream>
+#include <string>
+#include <vector>
 #include <cstdlib>
+#include <stdexcept>
 
 
 namespace epi::info {
@@ -33,11 +36,75 @@ ProgramSettings parse_args(int argc, char** argv) {
          .help("Catch runtime errors and display a message to stderr")
          .flag()
          .store_into(settings.catch_errors);
+  auto& opt_level = program.add_mutually_exclusive_group();
+  opt_level.add_argument("-O0")
+           .help("Disable optimizations")
+           .flag()
+           .action([&](const auto&) { settings.opt_level = 0; });
+  opt_level.add_argument("-O1")
+           .help("Run the basic optimizer once")
+           .flag()
+           .action([&](const auto&) { settings.opt_level = 1; });
+  opt_level.add_argument("-O2")
+           .help("Run all optimization passes until functions no longer change (default)")
+           .flag()
+           .action([&](const auto&) { settings.opt_level = 2; });
+  program.add_argument("-passes")
+         .help("Comma separated list of optimization passes to run, overrides the optimization level")
+         .metavar("PASSES")
+         .default_value(std::string{})
+         .store_into(settings.passes);
+  program.add_argument("-max-iterations")
+         .help("Maximum number of times the optimization pipeline is repeated per function (0 for the default)")
+         .metavar("N")
+         .default_value(0)
+         .store_into(settings.max_iterations);
+  program.add_argument("-unroll-factor")
+         .help("Number of loop iterations per pass through a partially unrolled loop (0 for the default, 1 to disable)")
+         .metavar("N")
+         .default_value(0)
+         .store_into(settings.unroll_factor);
+  program.add_argument("-unroll-budget")
+         .help("Maximum number of directives a single unrolled loop may grow to (0 for the default)")
+         .metavar("N")
+         .default_value(0)
+         .store_into(settings.unroll_budget);
+  program.add_argument("-time-passes")
+         .help("Print the time spent in, and IR size changes by every optimization pass")
+         .flag()
+         .store_into(settings.time_passes);
+  program.add_argument("-j")
+         .help("Number of threads to optimize functions with (0 for all hardware threads)")
+         .metavar("N")
+         .default_value(1)
+         .store_into(settings.jobs);
   program.add_argument("-rigfunc")
          .help("Function to analyze the RIG for")
          .metavar("FUNCTION")
          .default_value("main")
          .store_into(settings.rigfunc);
+  program.add_argument("-regalloc")
+         .help("Register allocator for the RIG function: graph coloring, or linear scan for faster compilation of large functions")
+         .metavar("ALLOCATOR")
+         .default_value(std::string{"coloring"})
+         .choices("coloring", "linear")
+         .store_into(settings.regalloc);
+  program.add_argument("-regspace")
+         .help("Register space for the RIG function: the example architecture, or x86-64 under the System V ABI")
+         .metavar("REGSPACE")
+         .default_value(std::string{"example"})
+         .choices("example", "x86-64")
+         .store_into(settings.regspace);
+  program.add_argument("-asm")
+         .help("Write x86-64 assembly for the whole program to a file, with the selected register allocator")
+         .metavar("ASM_FILE")
+         .default_value(std::string{})
+         .store_into(settings.assembly);
+  program.add_argument("-obj")
+         .help("Write an x86-64 ELF object file for the whole program, without an external assembler")
+         .metavar("OBJ_FILE")
+         .default_value(std::string{})
+         .store_into(settings.object);
   program.add_argument("-stl")
          .help("Standard library header location")
          .metavar("STL_PATH")
@@ -49,8 +116,26 @@ ProgramSettings parse_args(int argc, char** argv) {
          .required()
          .store_into(settings.filename);
   
+  // argparse only splits --option=value arguments,
+  // so split LLVM style -option=value arguments ourselves
+  std::vector<std::string> args{};
+  for (int i = 0; i < argc; i++) {
+    const auto arg = std::string{argv[i]};
+    const auto assign = arg.find('=');
+    if (i && arg.starts_with('-') && !arg.starts_with("--") && assign != std::string::npos) {
+      args.push_back(arg.substr(0, assign));
+      args.push_back(arg.substr(assign + 1));
+    }
+    else {
+      args.push_back(arg);
+    }
+  }
+
   try {
-    program.parse_args(argc, argv);
+    program.parse_args(args);
+    if (settings.jobs < 0) {
+      throw std::runtime_error("Number of threads (-j) may not be negative");
+    }
   }
   catch (const std::exception& err) {
     std::cerr << err.what() << std::endl;
@@ -9,6 +9,17 @@ struct ProgramSettings {
   std::string stl;
   
   std::string rigfunc;
+  std::string regalloc;
+  std::string regspace;
+  std::string assembly;
+  std::string object;
+  std::string passes;
+  int opt_level = 2;
+  int max_iterations;
+  int unroll_factor;
+  int unroll_budget;
+  int jobs;
+  bool time_passes;
   bool novisualize;
   bool catch_errors;
 };
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Default.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+
+
+namespace epi::cotyl {
+
+/*
+ * Dense set of small integers, with set operations on whole words at a time.
+ * Sets used in binary operations must have the same size.
+ * */
+struct BitSet {
+  BitSet(std::size_t size = 0) : bits{size}, words((size + 63) / 64, 0) { }
+
+  std::size_t size() const { return bits; }
+
+  bool Test(std::size_t idx) const { return (words[idx >> 6] >> (idx & 63)) & 1; }
+  void Set(std::size_t idx) { words[idx >> 6] |= u64(1) << (idx & 63); }
+  void Reset(std::size_t idx) { words[idx >> 6] &= ~(u64(1) << (idx & 63)); }
+  void Clear() { std::fill(words.begin(), words.end(), 0); }
+
+  // returns whether any bits were added
+  bool Union(const BitSet& other) {
+    u64 added = 0;
+    for (std::size_t i = 0; i < words.size(); i++) {
+      added |= other.words[i] & ~words[i];
+      words[i] |= other.words[i];
+    }
+    return added != 0;
+  }
+
+  void Subtract(const BitSet& other) {
+    for (std::size_t i = 0; i < words.size(); i++) {
+      words[i] &= ~other.words[i];
+    }
+  }
+
+  void Intersect(const BitSet& other) {
+    for (std::size_t i = 0; i < words.size(); i++) {
+      words[i] &= other.words[i];
+    }
+  }
+
+  std::size_t Count() const {
+    std::size_t count = 0;
+    for (const auto& word : words) count += std::popcount(word);
+    return count;
+  }
+
+  bool Empty() const {
+    for (const auto& word : words) if (word) return false;
+    return true;
+  }
+
+  // call func with the index of every set bit, in ascending order
+  template<typename F>
+  void ForEach(F&& func) const {
+    for (std::size_t i = 0; i < words.size(); i++) {
+      for (u64 word = words[i]; word; word &= word - 1) {
+        func((i << 6) + std::countr_zero(word));
+      }
+    }
+  }
+
+  bool operator==(const BitSet& other) const = default;
+
+private:
+  std::size_t bits;
+  cotyl::vector<u64> words;
+};
+
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Default.h"
+#include "Vector.h"
+
+#include <algorithm>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+
+namespace epi::cotyl {
+
+/*
+ * Work-stealing thread pool for a fixed batch of independent tasks.
+ * Tasks are identified by their index. Every worker owns a deque of
+ * task indices, initially a contiguous range of the batch. A worker pops
+ * tasks from the back of its own deque, and steals from the front of
+ * other workers' deques once it runs out of work, so long-running tasks
+ * do not leave other threads idle.
+ *
+ * Exceptions thrown by tasks are caught on the worker thread, and the one
+ * for the lowest task index is rethrown on the calling thread after all
+ * workers have finished, so that error reporting does not depend on the
+ * order in which tasks happened to be scheduled.
+ * */
+struct ThreadPool {
+
+  explicit ThreadPool(std::size_t num_threads) :
+      num_threads{std::max<std::size_t>(num_threads, 1)} {
+
+  }
+
+  // number of threads used when "all" threads are requested
+  static std::size_t HardwareThreads() {
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  template<typename F>
+  void ForEach(std::size_t num_tasks, F&& task) {
+    if (!num_tasks) return;
+    const auto num_workers = std::min(num_threads, num_tasks);
+    if (num_workers == 1) {
+      // no need to spawn any threads
+      for (std::size_t i = 0; i < num_tasks; i++) {
+        task(i);
+      }
+      return;
+    }
+
+    cotyl::vector<std::unique_ptr<WorkQueue>> queues{};
+    queues.reserve(num_workers);
+    for (std::size_t worker = 0; worker < num_workers; worker++) {
+      auto& queue = queues.emplace_back(std::make_unique<WorkQueue>());
+      const auto first = (worker * num_tasks) / num_workers;
+      const auto last  = ((worker + 1) * num_tasks) / num_workers;
+      for (auto i = first; i < last; i++) {
+        queue->tasks.push_back(i);
+      }
+    }
+
+    cotyl::vector<std::exception_ptr> errors(num_tasks);
+
+    const auto run_worker = [&](std::size_t worker) {
+      while (true) {
+        auto next = queues[worker]->PopBack();
+        for (std::size_t i = 1; !next.has_value() && i < num_workers; i++) {
+          next = queues[(worker + i) % num_workers]->StealFront();
+        }
+
+        // all queues are empty, and tasks never spawn new tasks
+        if (!next.has_value()) return;
+
+        try {
+          task(next.value());
+        }
+        catch (...) {
+          errors[next.value()] = std::current_exception();
+        }
+      }
+    };
+
+    {
+      cotyl::vector<std::thread> workers{};
+      workers.reserve(num_workers - 1);
+      for (std::size_t worker = 1; worker < num_workers; worker++) {
+        workers.emplace_back(run_worker, worker);
+      }
+
+      // the calling thread is a worker as well
+      run_worker(0);
+      for (auto& worker : workers) {
+        worker.join();
+      }
+    }
+
+    for (const auto& error : errors) {
+      if (error) std::rethrow_exception(error);
+    }
+  }
+
+private:
+  struct WorkQueue {
+    std::mutex mutex{};
+    std::deque<std::size_t> tasks{};
+
+    std::optional<std::size_t> PopBack() {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (tasks.empty()) return {};
+      const auto task = tasks.back();
+      tasks.pop_back();
+      return task;
+    }
+
+    std::optional<std::size_t> StealFront() {
+      std::lock_guard<std::mutex> lock{mutex};
+      if (tasks.empty()) return {};
+      const auto task = tasks.front();
+      tasks.pop_front();
+      return task;
+    }
+  };
+
+  std::size_t num_threads;
+};
+
+}
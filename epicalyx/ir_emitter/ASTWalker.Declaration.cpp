@@ -94,6 +94,12 @@ void ASTWalker::Visit(const epi::DeclarationNode& decl) {
     // global symbols
     AddGlobal(decl.name, decl.type);
 
+    // functions are not data, their symbols are defined
+    // by the function itself or in another object
+    if (decl.type.holds_alternative<type::FunctionType>()) {
+      return;
+    }
+
     auto global_type = detail::GetGlobalValue(decl.type);
     // todo: return since previously initialized?
     // see 0098-tentative.c
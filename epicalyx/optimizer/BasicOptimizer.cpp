@@ -6,7 +6,6 @@
 #include "CustomAssert.h"
 #include "TypeTraits.h"
 #include "Decltype.h"
-#include "Log.h"
 
 
 namespace epi {
@@ -28,7 +27,9 @@ T BasicOptimizer::CopyDirective(const T& directive) {
 func_pos_t BasicOptimizer::OutputAnyUnsafe(calyx::AnyDirective&& dir) {
   const u64 in_block = current_block->size();
   current_block->push_back(std::move(dir));
-  return std::make_pair(current_new_block_idx, in_block);
+  const auto pos = std::make_pair(current_new_block_idx, in_block);
+  new_deps.AddDirective(current_block->back(), pos);
+  return pos;
 }
 
 template<typename T>
@@ -102,69 +103,6 @@ block_label_t BasicOptimizer::CommonBlockAncestor(block_label_t first, block_lab
   return *ancestors.begin();
 }
 
-template<class BadPred, class GoodPred>
-bool BasicOptimizer::NoBadBeforeGoodAllPaths(BadPred bad, GoodPred good, func_pos_t pos) const {
-  cotyl::unordered_set<block_label_t> todo{};
-  cotyl::unordered_set<block_label_t> done{};
-
-  const auto register_branch = [&](const block_label_t& block_idx) {
-    if (!done.contains(block_idx)) {
-      todo.emplace(block_idx);
-    }
-  };
-
-  while (true) {
-    bool _reachable = true;
-
-    // use old program blocks
-    const auto& block = old_function.blocks.at(pos.first);
-
-    while (_reachable && pos.second < block.size()) {
-      const auto& op = block.at(pos.second);
-      op.visit<void>(
-        [&](const Select& select) {
-          for (const auto& [value, block_idx] : *select.table) {
-            register_branch(block_idx);
-          }
-          if (select._default) {
-            register_branch(select._default);
-          }
-          _reachable = false;
-        },
-        [&](const UnconditionalBranch& branch) {
-          register_branch(branch.dest);
-          _reachable = false;
-        },
-        [&]<typename T>(const BranchCompare<T>& branch) {
-          register_branch(branch.tdest);
-          register_branch(branch.fdest);
-          _reachable = false;
-        },
-        [&]<typename T>(const Return<T>& ret) {
-          _reachable = false;
-        },
-        [](const auto&) { }
-      );
-
-      if (bad(op, pos)) return false;
-      if (good(op, pos)) break;
-      pos.second++;
-    }
-
-    if (todo.empty()) break;
-
-    pos.first = *todo.begin();
-    pos.second = 0;
-
-    // add to done here, and not before, since we may 
-    // have started halfway through the first block
-    done.emplace(pos.first);
-    todo.erase(todo.begin());
-  }
-  
-  return true;
-}
-
 void BasicOptimizer::PropagateLocalValues() {
   // try to find local replacement from previous blocks
   auto& initial_values = local_initial_values[current_new_block_idx];
@@ -219,76 +157,12 @@ void BasicOptimizer::StoreLocalData(var_index_t loc_idx, LocalData&& local) {
 }
 
 bool BasicOptimizer::ShouldFlushLocal(var_index_t loc_idx, const LocalData& local) {
-  const auto& old_local = old_deps.local_graph.at(loc_idx);
-  cotyl::unordered_set<func_pos_t> reads  = {old_local.reads.begin(), old_local.reads.end()};
-  cotyl::unordered_set<func_pos_t> writes = {old_local.writes.begin(), old_local.writes.end()};
-  
-  static const cotyl::unordered_set<size_t> alias_blocking_tids = {
-      AnyDirective::type_index_v<StoreToPointer<i8>>,                                                                   
-      AnyDirective::type_index_v<StoreToPointer<u8>>,                                                                   
-      AnyDirective::type_index_v<StoreToPointer<i16>>,                                                                   
-      AnyDirective::type_index_v<StoreToPointer<u16>>,                                                                       
-      AnyDirective::type_index_v<StoreToPointer<i32>>,    
-      AnyDirective::type_index_v<StoreToPointer<u32>>,    
-      AnyDirective::type_index_v<StoreToPointer<i64>>,    
-      AnyDirective::type_index_v<StoreToPointer<u64>>,    
-      AnyDirective::type_index_v<StoreToPointer<float>>,     
-      AnyDirective::type_index_v<StoreToPointer<double>>,         
-      AnyDirective::type_index_v<StoreToPointer<Pointer>>,
-      AnyDirective::type_index_v<LoadFromPointer<i8>>,     
-      AnyDirective::type_index_v<LoadFromPointer<u8>>,     
-      AnyDirective::type_index_v<LoadFromPointer<i16>>,    
-      AnyDirective::type_index_v<LoadFromPointer<u16>>,    
-      AnyDirective::type_index_v<LoadFromPointer<i32>>,    
-      AnyDirective::type_index_v<LoadFromPointer<u32>>,    
-      AnyDirective::type_index_v<LoadFromPointer<i64>>,    
-      AnyDirective::type_index_v<LoadFromPointer<u64>>,    
-      AnyDirective::type_index_v<LoadFromPointer<float>>,  
-      AnyDirective::type_index_v<LoadFromPointer<double>>, 
-      AnyDirective::type_index_v<LoadFromPointer<Pointer>>,
-      AnyDirective::type_index_v<Call<i32>>,     
-      AnyDirective::type_index_v<Call<u32>>,     
-      AnyDirective::type_index_v<Call<i64>>,     
-      AnyDirective::type_index_v<Call<u64>>,     
-      AnyDirective::type_index_v<Call<float>>,   
-      AnyDirective::type_index_v<Call<double>>,  
-      AnyDirective::type_index_v<Call<Pointer>>, 
-      AnyDirective::type_index_v<Call<void>>, 
-      AnyDirective::type_index_v<CallLabel<i32>>,     
-      AnyDirective::type_index_v<CallLabel<u32>>,     
-      AnyDirective::type_index_v<CallLabel<i64>>,     
-      AnyDirective::type_index_v<CallLabel<u64>>,     
-      AnyDirective::type_index_v<CallLabel<float>>,    
-      AnyDirective::type_index_v<CallLabel<double>>,   
-      AnyDirective::type_index_v<CallLabel<Pointer>>,
-      AnyDirective::type_index_v<CallLabel<void>>,        
-  };
-
-  // local does not need to be flushed if no "bad" operation (load) happens
-  // before a "good" operation (store)
-  return !NoBadBeforeGoodAllPaths(
-    [&](const AnyDirective& op, const func_pos_t& pos) -> bool {
-      // we need to flush the local if it is read before it is stored again
-      // or if any aliased variable exists, and one of the following happens:
-      // - a pointer read (potentially reading the local's (aliased) value)
-      // - a function call (potentially passing the local's address, potentially
-      //                    reading the local's value)
-      if (reads.contains(pos)) return true;
-      if (!old_local.aliased_by.empty()) {
-        if (alias_blocking_tids.contains(op.index())) {
-          return true;
-        }
-      }
-
-      // operation is OK, does not affect local
-      return false;
-    },
-    [&](const AnyDirective& op, const func_pos_t& pos) -> bool {
-      // write: stop searching path
-      return writes.contains(pos);
-    },
-    current_old_pos
-  );
+  // we need to flush the local if it is read before it is stored again
+  // or if any aliased variable exists, and one of the following happens:
+  // - a pointer read (potentially reading the local's (aliased) value)
+  // - a function call (potentially passing the local's address, potentially
+  //                    reading the local's value)
+  return flush_analysis.ReadBeforeWrite(loc_idx, current_old_pos);
 }
 
 void BasicOptimizer::FlushOnBranch() {
@@ -310,6 +184,7 @@ void BasicOptimizer::FlushOnBranch() {
   }
 
   locals.clear();
+  globals.clear();
 }
 
 
@@ -342,13 +217,29 @@ void BasicOptimizer::DoBranch(T&& branch) {
   reachable = false;
 }
 
-void BasicOptimizer::FlushAliasedLocals() {
+void BasicOptimizer::FlushAliasedLocals(var_index_t ptr_idx) {
+  FlushAliasedLocals([&](var_index_t loc_idx) {
+    return points_to.MayPointTo(ptr_idx, loc_idx);
+  });
+}
+
+void BasicOptimizer::FlushEscapedLocals() {
+  FlushAliasedLocals([&](var_index_t loc_idx) {
+    return points_to.Escaped(loc_idx);
+  });
+}
+
+template<class F>
+void BasicOptimizer::FlushAliasedLocals(F may_access) {
   cotyl::vector<var_index_t> removed{};
   auto& initial_values = local_initial_values[current_new_block_idx];
   for (auto& [loc_idx, local] : locals) {
     if (old_deps.local_graph.at(loc_idx).aliased_by.empty()) {
       continue;
     }
+    if (!may_access(loc_idx)) {
+      continue;
+    }
 
     // no need to check ShouldFlushLocal, 
     // this is a forced local flush
@@ -374,6 +265,50 @@ void BasicOptimizer::FlushAliasedLocals() {
   }
 }
 
+void BasicOptimizer::FlushEscapedLocalStores() {
+  for (auto& [loc_idx, local] : locals) {
+    if (old_deps.local_graph.at(loc_idx).aliased_by.empty()) {
+      continue;
+    }
+    if (!points_to.Escaped(loc_idx)) {
+      continue;
+    }
+
+    // the stored value stays valid, so we keep the replacement
+    if (local.store) {
+      auto store = std::move(local.store);
+      OutputAnyUnsafe(std::move(*store));
+    }
+  }
+}
+
+void BasicOptimizer::FlushForCall(const FunctionEffects& call_effects) {
+  using Kind = FunctionEffects::Kind;
+  switch (call_effects.kind) {
+    case Kind::Pure: {
+      // callee never accesses our locals, or any globals
+      break;
+    }
+    case Kind::ReadOnly: {
+      FlushEscapedLocalStores();
+      break;
+    }
+    case Kind::WritesGlobals: {
+      FlushEscapedLocalStores();
+      for (const auto& symbol : call_effects.globals) {
+        globals.erase(symbol);
+      }
+      break;
+    }
+    case Kind::Unknown: {
+      // need to flush locals on call, in case a pointer read/store happens
+      FlushEscapedLocals();
+      globals.clear();
+      break;
+    }
+  }
+}
+
 void BasicOptimizer::TryReplaceVar(var_index_t& var_idx) const {
   while (var_replacement.contains(var_idx)) {
     var_idx = var_replacement.at(var_idx);
@@ -508,6 +443,10 @@ void BasicOptimizer::RemoveUnreachableBlockEdges(block_label_t block) {
 
 Function&& BasicOptimizer::Optimize() {
   new_function.locals = std::move(old_function.locals);
+  new_deps.local_graph.reserve(new_function.locals.size());
+  for (const auto& [loc_idx, _] : new_function.locals) {
+    new_deps.AddLocal(loc_idx);
+  }
 
   cotyl::unordered_map<block_label_t, u32> top_sort_positions{};
   {
@@ -543,6 +482,7 @@ Function&& BasicOptimizer::Optimize() {
     auto inserted = new_function.AddBlock(current_new_block_idx);
     current_block = &inserted.second;
     node.value = current_block;
+    new_deps.AddBlock(current_new_block_idx, current_block);
 
     bool block_finished;
     do {
@@ -559,7 +499,7 @@ Function&& BasicOptimizer::Optimize() {
       }
     } while (!block_finished);
   }
-  while (RemoveUnused(new_function));
+  RemoveUnused(new_function, new_deps, effects);
   return std::move(new_function);
 }
 
@@ -687,6 +627,16 @@ void BasicOptimizer::Emit(StoreLocal<T>&& op) {
 
 template<typename T>
 void BasicOptimizer::Emit(LoadGlobal<T>&& op) {
+  // global value may still be known from an earlier load
+  auto& loaded = globals[op.symbol];
+  for (const auto& var_idx : loaded) {
+    auto* candidate = TryGetVarDirective<LoadGlobal<T>>(var_idx);
+    if (candidate && candidate->offset == op.offset) {
+      var_replacement[op.idx] = var_idx;
+      return;
+    }
+  }
+  loaded.push_back(op.idx);
   OutputExpr(std::move(op));
 }
 
@@ -701,6 +651,7 @@ void BasicOptimizer::Emit(LoadGlobalAddr&& op) {
 
 template<typename T>
 void BasicOptimizer::Emit(StoreGlobal<T>&& op) {
+  globals.erase(op.symbol);
   Output(std::move(op));
 }
 
@@ -726,7 +677,7 @@ void BasicOptimizer::Emit(LoadFromPointer<T>&& op) {
 
   // this needs to happen, as we may be computing aliases wrong,
   // and we do not want to break the program control flow
-  FlushAliasedLocals();
+  FlushAliasedLocals(op.ptr_idx);
   OutputExpr(std::move(op));
 }
 
@@ -773,7 +724,9 @@ void BasicOptimizer::Emit(StoreToPointer<T>&& op) {
   // }
 
   // need to flush local writes on pointer write
-  FlushAliasedLocals();
+  // the pointer may point to any global as well
+  FlushAliasedLocals(op.ptr_idx);
+  globals.clear();
   Output(std::move(op));
 }
 
@@ -794,7 +747,8 @@ void BasicOptimizer::Emit(Call<T>&& op) {
   }
 
   // need to flush locals on call, in case a pointer read/store happens
-  FlushAliasedLocals();
+  FlushEscapedLocals();
+  globals.clear();
   const auto idx = op.idx;
   vars_found[idx] = Output(std::move(op));
 }
@@ -808,8 +762,25 @@ void BasicOptimizer::Emit(CallLabel<T>&& op) {
     TryReplaceVar(var_idx);
   }
 
-  // need to flush locals on call, in case a pointer read/store happens
-  FlushAliasedLocals();
+  const auto& call_effects = effects.Get(op.label);
+  if (call_effects.kind == FunctionEffects::Kind::Pure) {
+    // pure calls with the same arguments always give the same result
+    const auto same_args = [](const arg_list_t& args, const arg_list_t& other) {
+      return std::equal(args.begin(), args.end(), other.begin(), other.end(), [](const auto& arg, const auto& other_arg) {
+        return arg.first == other_arg.first;
+      });
+    };
+    auto replaced = FindExprResultReplacement(op, [&](auto& op, auto& candidate) {
+      return candidate.label == op.label 
+          && same_args(candidate.args->args, op.args->args) 
+          && same_args(candidate.args->var_args, op.args->var_args);
+    });
+    if (replaced) {
+      return;
+    }
+  }
+
+  FlushForCall(call_effects);
   // op will be moved on read
   const auto idx = op.idx;
   vars_found[idx] = Output(std::move(op));
@@ -822,6 +793,7 @@ void BasicOptimizer::Emit(Return<T>&& op) {
   }
   // no need to flush locals right before a return
   locals.clear();
+  globals.clear();
   Output(std::move(op));
   reachable = false;
 }
@@ -920,8 +892,9 @@ void BasicOptimizer::Emit(Binop<T>&& op) {
           case BinopType::Sub: result = left_imm->value - right; break;
           case BinopType::Mul: result = left_imm->value * right; break;
           case BinopType::Div: {
-            if (right == 0) {
-              Log::Warn("Integer division by 0");
+            // floating point division by 0 is well defined
+            if (is_calyx_integral_type_v<T> && right == 0) {
+              warnings.emplace_back("Integer division by 0");
               EmitRepl<Imm<T>>(op.idx, left_imm->value);
               return;
             }
@@ -934,7 +907,7 @@ void BasicOptimizer::Emit(Binop<T>&& op) {
                 case BinopType::Mod: {
                   // UB
                   if (right == 0) {
-                    Log::Warn("Integer modulo 0");
+                    warnings.emplace_back("Integer modulo 0");
                     EmitRepl<Imm<T>>(op.idx, left_imm->value);
                     return;
                   }
@@ -2,30 +2,64 @@
 
 #include "calyx/CalyxFwd.h"
 #include "ProgramDependencies.h"
+#include "FlushAnalysis.h"
+#include "PointsTo.h"
+#include "SideEffects.h"
 #include "Containers.h"
 #include "CustomAssert.h"
 
 #include "Vector.h"
 
+#include <string>
+
 
 namespace epi {
 
 struct BasicOptimizer {
 
   BasicOptimizer(calyx::Function&& function) : 
+      BasicOptimizer{std::move(function), FunctionDependencies::GetDependencies(function)} {
+
+  }
+
+  // dependencies may be passed if they are known already, for example
+  // from a previous optimization pass
+  // side effects of called functions may be passed to keep local and
+  // global values across calls that do not affect them
+  BasicOptimizer(
+      calyx::Function&& function, 
+      FunctionDependencies&& deps, 
+      const SideEffects& effects = SideEffects::None()
+  ) : 
       old_function{std::move(function)},
-      old_deps{FunctionDependencies::GetDependencies(old_function)},
+      old_deps{std::move(deps)},
+      flush_analysis{old_function, old_deps},
+      points_to{old_function, old_deps},
+      effects{effects},
       new_function{std::move(old_function.symbol)} {
 
   }
 
   calyx::Function&& Optimize();
 
+  // dependencies of the optimized function, maintained while
+  // emitting it, so they do not have to be recomputed
+  FunctionDependencies&& Dependencies() { return std::move(new_deps); }
+
+  // warnings found while optimizing, these are not printed directly,
+  // as functions may be optimized on multiple threads at once
+  cotyl::vector<std::string>&& Warnings() { return std::move(warnings); }
+
 private:
   calyx::Function old_function;
   FunctionDependencies old_deps;
+  FlushAnalysis flush_analysis;
+  PointsTo points_to;
+  const SideEffects& effects;
 
   calyx::Function new_function;
+  FunctionDependencies new_deps;
+  cotyl::vector<std::string> warnings{};
   
   // current block that is being built
   calyx::BasicBlock* current_block{};
@@ -121,7 +155,23 @@ private:
   // as these may update the local's value and a
   // later flush of the write operation (or any reads
   // in the function call) may retrieve the wrong value
-  void FlushAliasedLocals();
+  // only locals that the pointer may point to are flushed
+  // on pointer accesses, and only escaped locals on calls
+  void FlushAliasedLocals(var_index_t ptr_idx);
+  void FlushEscapedLocals();
+  template<class F>
+  void FlushAliasedLocals(F may_access);
+
+  // only emit the pending stores of escaped locals, keeping their values,
+  // for calls that may read, but never write them
+  void FlushEscapedLocalStores();
+
+  // flush / forget local and global values a call may access
+  void FlushForCall(const FunctionEffects& call_effects);
+
+  // global values loaded in the current block, that have not been
+  // invalidated by a store or call since
+  cotyl::unordered_map<cotyl::CString, cotyl::vector<var_index_t>> globals{};
 
   // propagate local values when starting a new block
   void PropagateLocalValues();
@@ -131,13 +181,8 @@ private:
   // replacements, to be flushed / stored for propagation later
   void StoreLocalData(var_index_t loc_idx, LocalData&& local);
 
-  // check whether predicate BadPred occurs before a GoodPred happens
-  // on all forward paths (including loops) ...
-  template<class BadPred, class GoodPred>
-  bool NoBadBeforeGoodAllPaths(BadPred bad, GoodPred good, func_pos_t pos) const;
-
-  // ... used for example to check whether we even need to flush a local,
-  // or whether the value is overwritten anyway, before a write happens
+  // check whether we even need to flush a local,
+  // or whether the value is overwritten anyway, before a read happens
   bool ShouldFlushLocal(var_index_t loc_idx, const LocalData& local);
 
   // try to get the expression directive a var was created with
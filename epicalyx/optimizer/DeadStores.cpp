@@ -0,0 +1,378 @@
+#include "DeadStores.h"
+#include "PointsTo.h"
+#include "ProgramDependencies.h"
+#include "SideEffects.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <optional>
+#include <tuple>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// a global memory range, written to by some store
+struct Slot {
+  u32 symbol;
+  i64 offset;
+  u64 size;
+
+  bool Overlaps(u32 other_symbol, i64 other_offset, u64 other_size) const {
+    if (symbol != other_symbol) return false;
+    return offset < other_offset + (i64)other_size && other_offset < offset + (i64)size;
+  }
+};
+
+struct State {
+  // locals that may be read before they are completely overwritten
+  cotyl::flat_set<loc_index_t> live{};
+
+  // slots that are written before they are read on every path
+  cotyl::flat_set<u32> dead{};
+
+  bool operator==(const State& other) const = default;
+};
+
+// constant address of a local or global
+struct Address {
+  bool global;
+  // symbol index for globals
+  u64 base;
+  i64 offset;
+};
+
+struct DeadStores {
+  DeadStores(Function& function, FunctionDependencies& deps, const SideEffects& effects) :
+      function{function}, deps{deps}, effects{effects}, points_to{function, deps} {
+
+  }
+
+  std::size_t Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+  const SideEffects& effects;
+  PointsTo points_to;
+
+  cotyl::unordered_map<cotyl::CString, u32> symbols{};
+  cotyl::vector<Slot> slots{};
+  std::map<std::tuple<u32, i64, u64>, u32> slot_indices{};
+
+  // locals that may be accessed through pointers
+  cotyl::vector<loc_index_t> addressed{};
+
+  cotyl::unordered_map<var_index_t, std::optional<Address>> addresses{};
+  cotyl::unordered_map<block_label_t, State> in{};
+
+  u32 Symbol(const cotyl::CString& symbol);
+  std::optional<Address> Resolve(var_index_t ptr_idx);
+  void AddSlot(u32 symbol, i64 offset, u64 size);
+  std::optional<u32> FindSlot(u32 symbol, i64 offset, u64 size) const;
+
+  // collect all global slots that are written to
+  void Collect();
+
+  // state at the end of a block, from the states of its successors
+  State Out(block_label_t block_idx) const;
+
+  // the number of directives that are executed in a block,
+  // anything after the branch or return ending it is not
+  static u64 Executed(const BasicBlock& block);
+
+  // update the state from after to before a directive,
+  // returns whether the directive is a dead store
+  bool Transfer(State& state, const AnyDirective& directive);
+
+  void ReadLocal(State& state, loc_index_t loc_idx) const;
+  void WriteLocal(State& state, loc_index_t loc_idx, i64 offset, u64 size) const;
+  void ReadGlobal(State& state, u32 symbol, i64 offset, u64 size) const;
+  bool WriteGlobal(State& state, u32 symbol, i64 offset, u64 size) const;
+  void ReadPointer(State& state, var_index_t ptr_idx) const;
+  void ReadEscaped(State& state) const;
+  void CallEffects(State& state, const FunctionEffects& call_effects) const;
+};
+
+u32 DeadStores::Symbol(const cotyl::CString& symbol) {
+  auto it = symbols.find(symbol);
+  if (it != symbols.end()) return it->second;
+  const u32 index = symbols.size();
+  symbols.emplace(cotyl::CString{symbol}, index);
+  return index;
+}
+
+std::optional<Address> DeadStores::Resolve(var_index_t ptr_idx) {
+  if (addresses.contains(ptr_idx)) return addresses.at(ptr_idx);
+  std::optional<Address> address{};
+  if (deps.var_graph.contains(ptr_idx)) {
+    const auto pos = deps.var_graph.at(ptr_idx).created;
+    address = function.blocks.at(pos.first).at(pos.second).visit<std::optional<Address>>(
+      [&](const LoadLocalAddr& addr) -> std::optional<Address> {
+        return Address{false, addr.loc_idx, 0};
+      },
+      [&](const LoadGlobalAddr& addr) -> std::optional<Address> {
+        return Address{true, Symbol(addr.symbol), 0};
+      },
+      [&]<typename T>(const AddToPointer<T>& add) -> std::optional<Address> {
+        if (!add.ptr.IsVar() || !add.right.IsScalar()) return {};
+        auto base = Resolve(add.ptr.GetVar());
+        if (!base.has_value()) return {};
+        base->offset += (i64)add.stride * (i64)add.right.GetScalar();
+        return base;
+      },
+      [](const auto&) -> std::optional<Address> { return {}; }
+    );
+  }
+  addresses.emplace(ptr_idx, address);
+  return address;
+}
+
+void DeadStores::AddSlot(u32 symbol, i64 offset, u64 size) {
+  const auto key = std::make_tuple(symbol, offset, size);
+  if (slot_indices.contains(key)) return;
+  slot_indices.emplace(key, slots.size());
+  slots.push_back(Slot{symbol, offset, size});
+}
+
+std::optional<u32> DeadStores::FindSlot(u32 symbol, i64 offset, u64 size) const {
+  auto it = slot_indices.find(std::make_tuple(symbol, offset, size));
+  if (it == slot_indices.end()) return {};
+  return it->second;
+}
+
+void DeadStores::Collect() {
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (const auto& directive : block) {
+      directive.visit<void>(
+        [&]<typename T>(const StoreGlobal<T>& store) {
+          AddSlot(Symbol(store.symbol), store.offset, sizeof(T));
+        },
+        [&]<typename T>(const StoreToPointer<T>& store) {
+          const auto address = Resolve(store.ptr_idx);
+          if (address.has_value() && address->global) {
+            AddSlot(address->base, address->offset + store.offset, sizeof(T));
+          }
+        },
+        [](const auto&) { }
+      );
+    }
+  }
+
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (!local.aliased_by.empty() || local.needs_address) {
+      addressed.push_back(loc_idx);
+    }
+  }
+}
+
+u64 DeadStores::Executed(const BasicBlock& block) {
+  for (u64 i = 0; i < block.size(); i++) {
+    const bool end = block.at(i).visit<bool>(
+      [](const Select&) { return true; },
+      [](const UnconditionalBranch&) { return true; },
+      [&]<typename T>(const BranchCompare<T>&) { return true; },
+      [&]<typename T>(const Return<T>&) { return true; },
+      [](const auto&) { return false; }
+    );
+    if (end) return i + 1;
+  }
+  return block.size();
+}
+
+State DeadStores::Out(block_label_t block_idx) const {
+  auto out = State{};
+  bool first = true;
+  for (const auto& to : deps.block_graph.At(block_idx).to) {
+    const auto& succ = in.at(to);
+    out.live.insert(succ.live.begin(), succ.live.end());
+    if (first) {
+      out.dead = succ.dead;
+      first = false;
+    }
+    else {
+      cotyl::flat_set<u32> dead{};
+      for (const auto& slot : out.dead) {
+        if (succ.dead.contains(slot)) dead.insert(slot);
+      }
+      out.dead = std::move(dead);
+    }
+  }
+  return out;
+}
+
+void DeadStores::ReadLocal(State& state, loc_index_t loc_idx) const {
+  state.live.insert(loc_idx);
+}
+
+void DeadStores::WriteLocal(State& state, loc_index_t loc_idx, i64 offset, u64 size) const {
+  // partial writes do not kill the rest of the local
+  if (offset == 0 && size >= function.locals.at(loc_idx).Size()) {
+    state.live.erase(loc_idx);
+  }
+}
+
+void DeadStores::ReadGlobal(State& state, u32 symbol, i64 offset, u64 size) const {
+  cotyl::vector<u32> read{};
+  for (const auto& slot : state.dead) {
+    if (slots[slot].Overlaps(symbol, offset, size)) read.push_back(slot);
+  }
+  for (const auto& slot : read) {
+    state.dead.erase(slot);
+  }
+}
+
+bool DeadStores::WriteGlobal(State& state, u32 symbol, i64 offset, u64 size) const {
+  const auto slot = FindSlot(symbol, offset, size);
+  cotyl::Assert(slot.has_value(), "Global store slot was not collected");
+  return !state.dead.insert(slot.value()).second;
+}
+
+void DeadStores::ReadEscaped(State& state) const {
+  for (const auto& loc_idx : addressed) {
+    if (points_to.Escaped(loc_idx)) state.live.insert(loc_idx);
+  }
+}
+
+void DeadStores::ReadPointer(State& state, var_index_t ptr_idx) const {
+  for (const auto& loc_idx : addressed) {
+    if (points_to.MayPointTo(ptr_idx, loc_idx)) state.live.insert(loc_idx);
+  }
+  if (!points_to.OnlyLocals(ptr_idx)) {
+    state.dead.clear();
+  }
+}
+
+void DeadStores::CallEffects(State& state, const FunctionEffects& call_effects) const {
+  // calls only write memory, or read their own locals
+  if (!call_effects.ReadsMemory()) return;
+  ReadEscaped(state);
+  state.dead.clear();
+}
+
+bool DeadStores::Transfer(State& state, const AnyDirective& directive) {
+  return directive.visit<bool>(
+    [&]<typename T>(const LoadLocal<T>& load) {
+      ReadLocal(state, load.loc_idx);
+      return false;
+    },
+    [&]<typename T>(const StoreLocal<T>& store) {
+      const bool dead = !state.live.contains(store.loc_idx);
+      WriteLocal(state, store.loc_idx, store.offset, sizeof(T));
+      return dead;
+    },
+    [&]<typename T>(const LoadGlobal<T>& load) {
+      ReadGlobal(state, Symbol(load.symbol), load.offset, sizeof(T));
+      return false;
+    },
+    [&]<typename T>(const StoreGlobal<T>& store) {
+      return WriteGlobal(state, Symbol(store.symbol), store.offset, sizeof(T));
+    },
+    [&]<typename T>(const LoadFromPointer<T>& load) {
+      const auto address = Resolve(load.ptr_idx);
+      if (address.has_value() && address->global) {
+        ReadGlobal(state, address->base, address->offset + load.offset, sizeof(T));
+      }
+      else {
+        ReadPointer(state, load.ptr_idx);
+      }
+      return false;
+    },
+    [&]<typename T>(const StoreToPointer<T>& store) {
+      const auto address = Resolve(store.ptr_idx);
+      if (!address.has_value()) {
+        // unknown memory may be read at any point
+        return false;
+      }
+      if (address->global) {
+        return WriteGlobal(state, address->base, address->offset + store.offset, sizeof(T));
+      }
+      const bool dead = !state.live.contains(address->base);
+      WriteLocal(state, address->base, address->offset + store.offset, sizeof(T));
+      return dead;
+    },
+    [&]<typename T>(const calyx::Call<T>&) {
+      // unknown function, unknown effects
+      ReadEscaped(state);
+      state.dead.clear();
+      return false;
+    },
+    [&]<typename T>(const CallLabel<T>& call) {
+      CallEffects(state, effects.Get(call.label));
+      return false;
+    },
+    [&]<typename T>(const Return<T>&) {
+      // locals go out of scope, globals are visible to the caller
+      state.live.clear();
+      state.dead.clear();
+      return false;
+    },
+    [](const auto&) { return false; }
+  );
+}
+
+std::size_t DeadStores::Run() {
+  Collect();
+
+  // live locals start empty, dead slots start with all slots,
+  // blocks are revisited until nothing changes
+  auto initial = State{};
+  for (u32 slot = 0; slot < slots.size(); slot++) {
+    initial.dead.insert(slot);
+  }
+  cotyl::vector<block_label_t> order{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    in.emplace(block_idx, initial);
+    order.push_back(block_idx);
+  }
+
+  // later blocks are mostly successors of earlier ones
+  std::sort(order.begin(), order.end(), std::greater<block_label_t>{});
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& block_idx : order) {
+      const auto& block = function.blocks.at(block_idx);
+      auto state = Out(block_idx);
+      for (u64 i = Executed(block); i > 0; i--) {
+        Transfer(state, block.at(i - 1));
+      }
+      if (!(state == in.at(block_idx))) {
+        in.at(block_idx) = std::move(state);
+        changed = true;
+      }
+    }
+  }
+
+  cotyl::vector<func_pos_t> dead{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    auto state = Out(block_idx);
+    for (u64 i = Executed(block); i > 0; i--) {
+      if (Transfer(state, block.at(i - 1))) {
+        dead.emplace_back(block_idx, i - 1);
+      }
+    }
+  }
+
+  for (const auto& pos : dead) {
+    auto& directive = function.blocks.at(pos.first).at(pos.second);
+    deps.RemoveDirective(directive, pos);
+    directive.template emplace<NoOp>(NoOp{});
+    deps.AddDirective(directive, pos);
+  }
+  return dead.size();
+}
+
+}
+
+std::size_t RemoveDeadStores(Function& function, FunctionDependencies& deps, const SideEffects& effects) {
+  return DeadStores(function, deps, effects).Run();
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+struct SideEffects;
+
+/*
+ * Global dead store elimination.
+ * A backward dataflow analysis over the blocks of a function determines,
+ * at every position, which memory may still be read later on:
+ *  - locals (by index) that may be read before they are completely
+ *    overwritten or the function returns
+ *  - global slots (symbol, offset and size) that are written on every
+ *    path before they are read, and before the function returns
+ * Pointers that are the (constant offset) address of a local or global
+ * access that memory directly, other pointer loads may read any local
+ * they may point to (using the points-to analysis), and any global.
+ * Calls may read escaped locals and any global, unless they are pure.
+ * Stores into memory that is not read afterwards are removed.
+ * The dependencies are kept up to date.
+ * Returns the number of removed stores.
+ * */
+std::size_t RemoveDeadStores(calyx::Function& function, FunctionDependencies& deps, const SideEffects& effects);
+
+}
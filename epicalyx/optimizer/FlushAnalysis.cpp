@@ -0,0 +1,137 @@
+#include "FlushAnalysis.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+
+
+namespace epi {
+
+using namespace calyx;
+
+FlushAnalysis::FlushAnalysis(const Function& function, const FunctionDependencies& deps) : deps{deps} {
+  blocks.reserve(function.blocks.size());
+  for (const auto& [block_idx, block] : function.blocks) {
+    auto& summary = blocks[block_idx];
+    for (u64 i = 0; i < block.size() && summary.end == NoIndex; i++) {
+      block.at(i).visit<void>(
+        [&](const Select& select) {
+          for (const auto& [value, dest] : *select.table) {
+            summary.successors.push_back(dest);
+          }
+          if (select._default) {
+            summary.successors.push_back(select._default);
+          }
+          summary.end = i;
+        },
+        [&](const UnconditionalBranch& branch) {
+          summary.successors.push_back(branch.dest);
+          summary.end = i;
+        },
+        [&]<typename T>(const BranchCompare<T>& branch) {
+          summary.successors.push_back(branch.tdest);
+          summary.successors.push_back(branch.fdest);
+          summary.end = i;
+        },
+        [&]<typename T>(const Return<T>& ret) {
+          summary.end = i;
+        },
+        [&]<typename T>(const LoadFromPointer<T>&) { summary.alias_accesses.push_back(i); },
+        [&]<typename T>(const StoreToPointer<T>&) { summary.alias_accesses.push_back(i); },
+        [&]<typename T>(const Call<T>&) { summary.alias_accesses.push_back(i); },
+        [&]<typename T>(const CallLabel<T>&) { summary.alias_accesses.push_back(i); },
+        [](const auto&) { }
+      );
+    }
+  }
+
+  for (const auto& [block_idx, summary] : blocks) {
+    for (const auto& succ : summary.successors) {
+      if (blocks.contains(succ)) {
+        blocks.at(succ).predecessors.push_back(block_idx);
+      }
+    }
+  }
+}
+
+FlushAnalysis::Access FlushAnalysis::FirstAccess(const LocalSummary& local, block_label_t block_idx, u64 from) const {
+  const auto& block = blocks.at(block_idx);
+  const auto first_from = [&](const cotyl::vector<u64>& indices) -> u64 {
+    auto it = std::lower_bound(indices.begin(), indices.end(), from);
+    if (it == indices.end() || *it > block.end) return NoIndex;
+    return *it;
+  };
+
+  u64 read = NoIndex;
+  u64 write = NoIndex;
+  if (local.reads.contains(block_idx)) read = first_from(local.reads.at(block_idx));
+  if (local.writes.contains(block_idx)) write = first_from(local.writes.at(block_idx));
+  if (local.aliased) read = std::min(read, first_from(block.alias_accesses));
+
+  // a read and a write never happen in the same directive
+  if (read != NoIndex && read < write) return Access::Read;
+  if (write != NoIndex) return Access::Write;
+  return Access::None;
+}
+
+FlushAnalysis::LocalSummary& FlushAnalysis::GetLocalSummary(var_index_t loc_idx) {
+  if (locals.contains(loc_idx)) {
+    return locals.at(loc_idx);
+  }
+
+  const auto& local_deps = deps.local_graph.at(loc_idx);
+  auto& local = locals[loc_idx];
+  local.aliased = !local_deps.aliased_by.empty();
+  for (const auto& [block_idx, i] : local_deps.reads) {
+    local.reads[block_idx].push_back(i);
+  }
+  for (const auto& [block_idx, i] : local_deps.writes) {
+    local.writes[block_idx].push_back(i);
+  }
+  for (auto& [block_idx, indices] : local.reads) {
+    std::sort(indices.begin(), indices.end());
+  }
+  for (auto& [block_idx, indices] : local.writes) {
+    std::sort(indices.begin(), indices.end());
+  }
+
+  // backwards dataflow: a block reaches a read if it reads the local
+  // before writing it, or if it does not access it at all and
+  // one of its successors reaches a read
+  cotyl::vector<block_label_t> todo{};
+  for (const auto& [block_idx, block] : blocks) {
+    if (FirstAccess(local, block_idx, 0) == Access::Read) {
+      local.read_before_write.insert(block_idx);
+      todo.push_back(block_idx);
+    }
+  }
+
+  while (!todo.empty()) {
+    const auto block_idx = todo.back();
+    todo.pop_back();
+    for (const auto& pred : blocks.at(block_idx).predecessors) {
+      if (local.read_before_write.contains(pred)) continue;
+      if (FirstAccess(local, pred, 0) == Access::None) {
+        local.read_before_write.insert(pred);
+        todo.push_back(pred);
+      }
+    }
+  }
+  return local;
+}
+
+bool FlushAnalysis::ReadBeforeWrite(var_index_t loc_idx, func_pos_t pos) {
+  const auto& local = GetLocalSummary(loc_idx);
+  switch (FirstAccess(local, pos.first, pos.second)) {
+    case Access::Read: return true;
+    case Access::Write: return false;
+    case Access::None: break;
+  }
+
+  const auto& successors = blocks.at(pos.first).successors;
+  return std::any_of(successors.begin(), successors.end(), [&](const auto& succ) {
+    return local.read_before_write.contains(succ);
+  });
+}
+
+}
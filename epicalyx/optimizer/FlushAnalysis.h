@@ -0,0 +1,70 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "Containers.h"
+
+#include "Vector.h"
+#include <optional>
+
+
+namespace epi {
+
+struct FunctionDependencies;
+
+/*
+ * Determines whether the value of a local may still be needed at some
+ * position in a function, i.e. whether it may be read before it is
+ * written again on any path starting at that position.
+ * Reads are direct loads, or, for aliased locals, any pointer access
+ * or call (which may access the local through its alias).
+ * Blocks are summarized once (reads / writes per local, pointer accesses
+ * and calls, successors), and for every local the set of blocks that
+ * reach a read before a write is computed once, on the first query for
+ * that local. Queries then only look at the remainder of a single block.
+ * */
+struct FlushAnalysis {
+  FlushAnalysis(const calyx::Function& function, const FunctionDependencies& deps);
+
+  bool ReadBeforeWrite(var_index_t loc_idx, func_pos_t pos);
+
+private:
+  static constexpr u64 NoIndex = -1;
+
+  struct BlockSummary {
+    // index of the terminating branch / return,
+    // anything after this is never executed
+    u64 end = NoIndex;
+    cotyl::vector<block_label_t> successors{};
+    cotyl::vector<block_label_t> predecessors{};
+
+    // sorted indices of pointer accesses and calls
+    cotyl::vector<u64> alias_accesses{};
+  };
+
+  struct LocalSummary {
+    bool aliased;
+
+    // sorted read / write indices per block
+    cotyl::unordered_map<block_label_t, cotyl::vector<u64>> reads{};
+    cotyl::unordered_map<block_label_t, cotyl::vector<u64>> writes{};
+
+    // blocks in which a read may happen before a write,
+    // when starting from the first directive
+    cotyl::unordered_set<block_label_t> read_before_write{};
+  };
+
+  enum class Access {
+    Read, Write, None
+  };
+
+  const FunctionDependencies& deps;
+  cotyl::unordered_map<block_label_t, BlockSummary> blocks{};
+  cotyl::unordered_map<var_index_t, LocalSummary> locals{};
+
+  LocalSummary& GetLocalSummary(var_index_t loc_idx);
+
+  // first access of a local in a block starting at some index
+  Access FirstAccess(const LocalSummary& local, block_label_t block_idx, u64 from) const;
+};
+
+}
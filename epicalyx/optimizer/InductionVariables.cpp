@@ -0,0 +1,305 @@
+#include "InductionVariables.h"
+#include "ProgramDependencies.h"
+#include "Loops.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// wrapping multiplication, the results are used in
+// wrapping additions anyway
+template<typename T>
+T WrapMul(T left, T right) {
+  using U = std::make_unsigned_t<T>;
+  return (T)((U)left * (U)right);
+}
+
+template<typename D>
+const D* TryGet(const AnyDirective& directive) {
+  if (!IsType<D>(directive)) return nullptr;
+  return &directive.get<D>();
+}
+
+struct StrengthReduction {
+  StrengthReduction(Function& function, const FunctionDependencies& deps) :
+      function{function}, deps{deps}, loops{deps} {
+    for (const auto& [var_idx, var] : deps.var_graph) {
+      next_var = std::max(next_var, var_idx + 1);
+    }
+    for (const auto& [loc_idx, local] : function.locals) {
+      next_loc = std::max(next_loc, loc_idx + 1);
+    }
+  }
+
+  // reduce the induction variables derived from a single basic
+  // induction variable, the dependencies are no longer valid
+  // if this returns true
+  bool Run();
+
+private:
+  Function& function;
+  const FunctionDependencies& deps;
+  Loops loops;
+
+  var_index_t next_var = 1;
+  loc_index_t next_loc = 1;
+
+  // base pointer of an array indexed by an induction variable
+  struct Base {
+    // invariant var, or local of which the address is taken in the loop
+    var_index_t var_idx = 0;
+    loc_index_t loc_idx = 0;
+
+    bool operator==(const Base& other) const = default;
+  };
+
+  template<typename T>
+  struct PointerIV {
+    Base base;
+    u32 stride;
+    cotyl::vector<func_pos_t> uses{};
+  };
+
+  template<typename T>
+  struct ScaledIV {
+    T factor;
+    cotyl::vector<func_pos_t> uses{};
+  };
+
+  AnyDirective& At(func_pos_t pos) { return function.blocks.at(pos.first).at(pos.second); }
+  const AnyDirective& At(func_pos_t pos) const { return function.blocks.at(pos.first).at(pos.second); }
+
+  // var is created outside the loop, so its value is the same in every iteration
+  bool Invariant(const Loops::Loop& loop, var_index_t var_idx) const;
+
+  template<typename T>
+  bool Reduce(const Loops::Loop& loop, block_label_t preheader, const Loops::InductionVariable<T>& iv);
+};
+
+bool StrengthReduction::Invariant(const Loops::Loop& loop, var_index_t var_idx) const {
+  if (!deps.var_graph.contains(var_idx)) return false;
+  const auto created = deps.var_graph.at(var_idx).created;
+  return created.first && !loop.Contains(created.first);
+}
+
+bool StrengthReduction::Run() {
+  for (const auto& loop : loops.All()) {
+    // values are initialized in the preheader
+    if (loop.entries.size() != 1) continue;
+    const auto preheader = loop.entries[0];
+    if (deps.block_graph.At(preheader).to.size() != 1) continue;
+
+    const auto& header = function.blocks.at(loop.header);
+    for (u64 i = 0; i < header.size(); i++) {
+      // the function is only changed after we are done visiting the directive
+      std::function<bool()> reduce{};
+      header.at(i).visit<void>(
+        [&]<typename T>(const LoadLocal<T>&) {
+          if constexpr(cotyl::pack_contains_v<T, calyx_integral_types>) {
+            const auto iv = loops.FindInductionVariable<T>(function, deps, loop, func_pos_t{loop.header, (int)i});
+            if (iv.has_value()) {
+              reduce = [=, this, &loop] { return Reduce(loop, preheader, iv.value()); };
+            }
+          }
+        },
+        [](const auto&) { }
+      );
+      if (reduce && reduce()) return true;
+      if (IsBlockEnd(header.at(i))) break;
+    }
+  }
+  return false;
+}
+
+template<typename T>
+bool StrengthReduction::Reduce(const Loops::Loop& loop, block_label_t preheader, const Loops::InductionVariable<T>& iv) {
+  const auto loc_idx = iv.loc_idx;
+  const auto value = iv.value;
+  const auto increment_pos = iv.increment;
+  const auto store_pos = iv.store;
+  const auto step = iv.step;
+
+  // find derived induction variables
+  cotyl::vector<PointerIV<T>> pointers{};
+  cotyl::vector<ScaledIV<T>> scaled{};
+  std::optional<func_pos_t> exit_test{};
+  bool other_uses = false;
+
+  for (const auto& pos : deps.var_graph.at(value).reads) {
+    if (pos == increment_pos) continue;
+    if (!loop.Contains(pos.first)) {
+      other_uses = true;
+      continue;
+    }
+
+    const auto& directive = At(pos);
+    if (const auto* add = TryGet<AddToPointer<T>>(directive)) {
+      if (add->right.IsVar() && add->right.GetVar() == value && add->ptr.IsVar() && add->stride) {
+        const auto ptr_idx = add->ptr.GetVar();
+        std::optional<Base> base{};
+        if (Invariant(loop, ptr_idx)) {
+          base = Base{.var_idx = ptr_idx};
+        }
+        else if (const auto* addr = TryGet<LoadLocalAddr>(At(deps.var_graph.at(ptr_idx).created))) {
+          // address can simply be loaded again before the loop
+          base = Base{.loc_idx = addr->loc_idx};
+        }
+
+        if (base.has_value()) {
+          auto it = std::find_if(pointers.begin(), pointers.end(), [&](const auto& ptr) {
+            return ptr.base == base.value() && ptr.stride == add->stride;
+          });
+          if (it == pointers.end()) {
+            it = pointers.insert(pointers.end(), PointerIV<T>{base.value(), add->stride});
+          }
+          it->uses.push_back(pos);
+          continue;
+        }
+      }
+    }
+    else if (const auto* mul = TryGet<Binop<T>>(directive)) {
+      if (mul->op == BinopType::Mul && mul->left_idx == value && mul->right.IsScalar()) {
+        const auto factor = mul->right.GetScalar();
+        auto it = std::find_if(scaled.begin(), scaled.end(), [&](const auto& iv) {
+          return iv.factor == factor;
+        });
+        if (it == scaled.end()) {
+          it = scaled.insert(scaled.end(), ScaledIV<T>{factor});
+        }
+        it->uses.push_back(pos);
+        continue;
+      }
+    }
+    else if (const auto* branch = TryGet<BranchCompare<T>>(directive)) {
+      if (!exit_test.has_value() && branch->left_idx == value
+          && (branch->right.IsScalar() || Invariant(loop, branch->right.GetVar()))) {
+        exit_test = pos;
+        continue;
+      }
+    }
+    other_uses = true;
+  }
+
+  if (pointers.empty() && scaled.empty()) return false;
+
+  // linear function test replacement, only when this makes the counter unused
+  // pointer comparisons are only valid within the same object, so we only
+  // replace the test for local arrays, where the stride is always positive
+  // as well, so that comparisons of the pointers have the same result
+  PointerIV<T>* test_pointer = nullptr;
+  if (exit_test.has_value() && !other_uses && std::is_signed_v<T>) {
+    auto it = std::find_if(pointers.begin(), pointers.end(), [](const auto& ptr) {
+      return ptr.base.loc_idx != 0;
+    });
+    if (it != pointers.end()) test_pointer = &*it;
+    else other_uses = true;
+  }
+
+  // build the reduced induction variables
+  cotyl::vector<AnyDirective> init{};
+  cotyl::vector<AnyDirective> next{};
+  cotyl::vector<AnyDirective> current{};
+
+  const auto start = next_var++;
+  init.emplace_back(LoadLocal<T>{start, loc_idx});
+
+  for (auto& ptr : pointers) {
+    const auto reduced_loc = next_loc++;
+    function.locals.emplace(reduced_loc, Local::Pointer(reduced_loc, ptr.stride));
+
+    auto base = Operand<Pointer>{ptr.base.var_idx};
+    if (ptr.base.loc_idx) {
+      const auto addr = next_var++;
+      init.emplace_back(LoadLocalAddr{addr, ptr.base.loc_idx});
+      base = Operand<Pointer>{addr};
+    }
+    const auto initial = next_var++;
+    init.emplace_back(AddToPointer<T>{initial, base, ptr.stride, Operand<T>{start}});
+    init.emplace_back(StoreLocal<Pointer>{reduced_loc, Operand<Pointer>{initial}});
+
+    const auto reduced = next_var++;
+    current.emplace_back(LoadLocal<Pointer>{reduced, reduced_loc});
+
+    // the step is added as a signed 64 bit offset, a negative step of an
+    // unsigned counter would otherwise be zero extended to a huge offset
+    const auto incremented = next_var++;
+    const auto offset = (i64)(std::make_signed_t<T>)step;
+    next.emplace_back(AddToPointer<i64>{incremented, Operand<Pointer>{reduced}, ptr.stride, Scalar<i64>{offset}});
+    next.emplace_back(StoreLocal<Pointer>{reduced_loc, Operand<Pointer>{incremented}});
+
+    for (const auto& pos : ptr.uses) {
+      const auto idx = At(pos).template get<AddToPointer<T>>().idx;
+      At(pos).template emplace<Cast<Pointer, Pointer>>(Cast<Pointer, Pointer>{idx, reduced});
+    }
+
+    if (&ptr == test_pointer) {
+      const auto& branch = At(exit_test.value()).template get<BranchCompare<T>>();
+      const auto end = next_var++;
+      init.emplace_back(AddToPointer<T>{end, base, ptr.stride, branch.right});
+      At(exit_test.value()).template emplace<BranchCompare<Pointer>>(BranchCompare<Pointer>{
+        branch.tdest, branch.fdest, reduced, branch.op, Operand<Pointer>{end}
+      });
+    }
+  }
+
+  for (auto& iv : scaled) {
+    const auto reduced_loc = next_loc++;
+    function.locals.emplace(reduced_loc, Local{Local::TypeOf<T>(), reduced_loc});
+
+    const auto initial = next_var++;
+    init.emplace_back(Binop<T>{initial, start, BinopType::Mul, Scalar<T>{iv.factor}});
+    init.emplace_back(StoreLocal<T>{reduced_loc, Operand<T>{initial}});
+
+    const auto reduced = next_var++;
+    current.emplace_back(LoadLocal<T>{reduced, reduced_loc});
+
+    const auto incremented = next_var++;
+    next.emplace_back(Binop<T>{incremented, reduced, BinopType::Add, Scalar<T>{WrapMul(iv.factor, step)}});
+    next.emplace_back(StoreLocal<T>{reduced_loc, Operand<T>{incremented}});
+
+    for (const auto& pos : iv.uses) {
+      const auto idx = At(pos).template get<Binop<T>>().idx;
+      At(pos).template emplace<Cast<T, T>>(Cast<T, T>{idx, reduced});
+    }
+  }
+
+  // insert the new directives, later positions in a block first
+  auto& store_block = function.blocks.at(store_pos.first);
+  for (u64 i = 0; i < next.size(); i++) {
+    store_block.insert(store_pos.second + 1 + i, std::move(next[i]));
+  }
+
+  auto& preheader_block = function.blocks.at(preheader);
+  auto branch_it = std::find_if(preheader_block.begin(), preheader_block.end(), IsBlockEnd);
+  auto branch_idx = branch_it - preheader_block.begin();
+  for (u64 i = 0; i < init.size(); i++) {
+    preheader_block.insert(branch_idx + i, std::move(init[i]));
+  }
+
+  auto& header_block = function.blocks.at(loop.header);
+  for (u64 i = 0; i < current.size(); i++) {
+    header_block.insert(i, std::move(current[i]));
+  }
+  return true;
+}
+
+}
+
+std::size_t ReduceInductionVariables(Function& function, FunctionDependencies& deps) {
+  std::size_t reduced = 0;
+  while (StrengthReduction(function, deps).Run()) {
+    deps = FunctionDependencies::GetDependencies(function);
+    reduced++;
+  }
+  return reduced;
+}
+
+}
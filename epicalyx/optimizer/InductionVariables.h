@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Induction variable strength reduction.
+ * A basic induction variable is a local (that is never aliased) which is
+ * loaded in a loop header, and stored exactly once every iteration, with
+ * the loaded value plus a constant step. Derived induction variables
+ * are pointers into an array indexed by the loaded value (AddToPointer
+ * with a loop invariant base), or the loaded value multiplied by a constant.
+ * These are replaced by new locals, that are initialized before the loop,
+ * and incremented along with the basic induction variable, turning the
+ * address computation / multiplication into an addition.
+ * If the loaded value is then only used in the exit test, the test is
+ * replaced by a test on a reduced pointer (linear function test replacement),
+ * so that the original counter becomes unused.
+ * Only loops with a preheader (a single entry block that only branches
+ * to the loop header) are considered.
+ * The dependencies are recomputed if the function changed.
+ * Returns the number of reduced basic induction variables.
+ * */
+std::size_t ReduceInductionVariables(calyx::Function& function, FunctionDependencies& deps);
+
+}
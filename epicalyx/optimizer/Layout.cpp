@@ -0,0 +1,339 @@
+#include "Layout.h"
+#include "Loops.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+#include "calyx/Fields.h"
+
+#include <algorithm>
+#include <optional>
+#include <tuple>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// probabilities of the less likely successor of a branch
+constexpr double LoopExitProbability = 0.12;
+constexpr double CallProbability = 0.28;
+constexpr double ReturnProbability = 0.28;
+
+// number of times a loop header is executed per entry of the loop
+constexpr double LoopIterations = 8;
+
+// blocks executed less often than this (relative to the entry block) are cold
+constexpr double ColdFrequency = 1.0 / 16;
+
+struct Edge {
+  block_label_t from;
+  block_label_t to;
+  double weight;
+};
+
+using chain_t = cotyl::vector<block_label_t>;
+
+// map all block labels in a branch
+struct RelabelBlocks {
+  const cotyl::unordered_map<block_label_t, block_label_t>& labels;
+
+  void Var(var_index_t&) { }
+  void Local(loc_index_t&) { }
+  void Block(block_label_t& block_idx) {
+    // select directives without default use label 0
+    if (block_idx) block_idx = labels.at(block_idx);
+  }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // select tables are shared with copies of the function
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+};
+
+struct BlockLayout {
+  BlockLayout(Function& function, FunctionDependencies& deps) :
+      function{function}, deps{deps}, loops{deps} {
+    for (const auto& loop : loops.All()) {
+      headers.insert(loop.header);
+    }
+  }
+
+  void Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+  Loops loops;
+  cotyl::unordered_set<block_label_t> headers{};
+
+  cotyl::unordered_map<block_label_t, double> frequency{};
+  cotyl::vector<Edge> edges{};
+
+  // successors of a block, with the probability of branching to them
+  cotyl::vector<std::pair<block_label_t, double>> Successors(block_label_t block_idx) const;
+
+  // probability of branching to the first of two successors,
+  // from the first heuristic that applies
+  double Probability(block_label_t from, block_label_t first, block_label_t second) const;
+  bool ContainsCall(block_label_t block_idx) const;
+  bool Returns(block_label_t block_idx) const;
+
+  void EstimateFrequencies();
+  bool Cold(const chain_t& chain) const;
+  cotyl::vector<chain_t> FormChains() const;
+  chain_t PlaceChains(const cotyl::vector<chain_t>& chains) const;
+  void Relabel(const chain_t& order);
+};
+
+bool BlockLayout::ContainsCall(block_label_t block_idx) const {
+  const auto& block = function.blocks.at(block_idx);
+  return std::any_of(block.begin(), block.end(), [](const auto& directive) {
+    return directive.template visit<bool>(
+      []<typename T>(const Call<T>&) { return true; },
+      []<typename T>(const CallLabel<T>&) { return true; },
+      [](const auto&) { return false; }
+    );
+  });
+}
+
+bool BlockLayout::Returns(block_label_t block_idx) const {
+  const auto& block = function.blocks.at(block_idx);
+  for (const auto& directive : block) {
+    const auto end = directive.visit<std::optional<bool>>(
+      []<typename T>(const Return<T>&) -> std::optional<bool> { return true; },
+      []<typename D>(const D&) -> std::optional<bool> {
+        if constexpr(std::is_base_of_v<Branch, D>) return false;
+        return {};
+      }
+    );
+    if (end.has_value()) return end.value();
+  }
+  return false;
+}
+
+double BlockLayout::Probability(block_label_t from, block_label_t first, block_label_t second) const {
+  // loop branch heuristic
+  const auto* loop = loops.Innermost(from);
+  if (loop && loop->Contains(first) != loop->Contains(second)) {
+    return loop->Contains(first) ? 1 - LoopExitProbability : LoopExitProbability;
+  }
+
+  // call heuristic
+  const bool first_call = ContainsCall(first);
+  if (first_call != ContainsCall(second)) {
+    return first_call ? CallProbability : 1 - CallProbability;
+  }
+
+  // return heuristic
+  const bool first_returns = Returns(first);
+  if (first_returns != Returns(second)) {
+    return first_returns ? ReturnProbability : 1 - ReturnProbability;
+  }
+  return 0.5;
+}
+
+cotyl::vector<std::pair<block_label_t, double>> BlockLayout::Successors(block_label_t block_idx) const {
+  cotyl::vector<std::pair<block_label_t, double>> successors{};
+  for (const auto& directive : function.blocks.at(block_idx)) {
+    const bool end = directive.visit<bool>(
+      [&](const Select& select) {
+        const double count = select.table->size() + (select._default ? 1 : 0);
+        for (const auto& [value, dest] : *select.table) {
+          successors.emplace_back(dest, 1 / count);
+        }
+        if (select._default) {
+          successors.emplace_back(select._default, 1 / count);
+        }
+        return true;
+      },
+      [&](const UnconditionalBranch& branch) {
+        successors.emplace_back(branch.dest, 1);
+        return true;
+      },
+      [&]<typename T>(const BranchCompare<T>& branch) {
+        if (branch.tdest == branch.fdest) {
+          successors.emplace_back(branch.tdest, 1);
+        }
+        else {
+          const auto probability = Probability(block_idx, branch.tdest, branch.fdest);
+          successors.emplace_back(branch.tdest, probability);
+          successors.emplace_back(branch.fdest, 1 - probability);
+        }
+        return true;
+      },
+      []<typename T>(const Return<T>&) { return true; },
+      [](const auto&) { return false; }
+    );
+    if (end) break;
+  }
+  return successors;
+}
+
+void BlockLayout::EstimateFrequencies() {
+  // reverse postorder of the blocks reachable from the entry
+  chain_t rpo{};
+  {
+    cotyl::unordered_set<block_label_t> visited{Function::Entry};
+    cotyl::vector<std::pair<block_label_t, cotyl::vector<block_label_t>>> stack{};
+    const auto push = [&](block_label_t block_idx) {
+      auto& [_, successors] = stack.emplace_back(block_idx, cotyl::vector<block_label_t>{});
+      for (const auto& [succ, probability] : Successors(block_idx)) {
+        successors.push_back(succ);
+      }
+      std::reverse(successors.begin(), successors.end());
+    };
+    push(Function::Entry);
+    while (!stack.empty()) {
+      auto& [block_idx, successors] = stack.back();
+      if (successors.empty()) {
+        rpo.push_back(block_idx);
+        stack.pop_back();
+        continue;
+      }
+      const auto next = successors.back();
+      successors.pop_back();
+      if (visited.insert(next).second) {
+        push(next);
+      }
+    }
+    std::reverse(rpo.begin(), rpo.end());
+  }
+
+  // all forward edges into a block come from blocks earlier in reverse postorder
+  cotyl::unordered_map<block_label_t, double> incoming{};
+  for (const auto& block_idx : rpo) {
+    double freq = block_idx == Function::Entry ? 1 : incoming[block_idx];
+    if (headers.contains(block_idx)) freq *= LoopIterations;
+    frequency[block_idx] = freq;
+
+    for (const auto& [succ, probability] : Successors(block_idx)) {
+      edges.push_back(Edge{block_idx, succ, freq * probability});
+      if (!loops.Dominates(succ, block_idx)) {
+        incoming[succ] += freq * probability;
+      }
+    }
+  }
+}
+
+bool BlockLayout::Cold(const chain_t& chain) const {
+  return std::all_of(chain.begin(), chain.end(), [&](const auto& block_idx) {
+    return !frequency.contains(block_idx) || frequency.at(block_idx) < ColdFrequency;
+  });
+}
+
+cotyl::vector<chain_t> BlockLayout::FormChains() const {
+  cotyl::vector<chain_t> chains{};
+  cotyl::unordered_map<block_label_t, std::size_t> chain_of{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    chain_of.emplace(block_idx, chains.size());
+    chains.push_back({block_idx});
+  }
+
+  auto sorted = edges;
+  std::sort(sorted.begin(), sorted.end(), [](const Edge& a, const Edge& b) {
+    if (a.weight != b.weight) return a.weight > b.weight;
+    return std::make_pair(a.from, a.to) < std::make_pair(b.from, b.to);
+  });
+
+  // join chains if the edge goes from the tail of one to the head of the other
+  // back edges are skipped, so that loop headers start their chain,
+  // instead of following the latch
+  for (const auto& edge : sorted) {
+    if (edge.to == Function::Entry) continue;
+    if (loops.Dominates(edge.to, edge.from)) continue;
+    const auto from = chain_of.at(edge.from);
+    const auto to = chain_of.at(edge.to);
+    if (from == to) continue;
+    if (chains[from].back() != edge.from || chains[to].front() != edge.to) continue;
+
+    for (const auto& block_idx : chains[to]) {
+      chains[from].push_back(block_idx);
+      chain_of.at(block_idx) = from;
+    }
+    chains[to].clear();
+  }
+
+  cotyl::vector<chain_t> result{};
+  for (auto& chain : chains) {
+    if (!chain.empty()) result.push_back(std::move(chain));
+  }
+  return result;
+}
+
+chain_t BlockLayout::PlaceChains(const cotyl::vector<chain_t>& chains) const {
+  cotyl::unordered_map<block_label_t, std::size_t> chain_of{};
+  for (std::size_t i = 0; i < chains.size(); i++) {
+    for (const auto& block_idx : chains[i]) {
+      chain_of.emplace(block_idx, i);
+    }
+  }
+
+  cotyl::unordered_map<block_label_t, cotyl::vector<const Edge*>> outgoing{};
+  for (const auto& edge : edges) {
+    outgoing[edge.from].push_back(&edge);
+  }
+
+  chain_t order{};
+  cotyl::vector<bool> placed(chains.size(), false);
+  cotyl::vector<double> connection(chains.size(), 0);
+  const auto place = [&](std::size_t chain) {
+    placed[chain] = true;
+    for (const auto& block_idx : chains[chain]) {
+      order.push_back(block_idx);
+      if (!outgoing.contains(block_idx)) continue;
+      for (const auto* edge : outgoing.at(block_idx)) {
+        connection[chain_of.at(edge->to)] += edge->weight;
+      }
+    }
+  };
+
+  place(chain_of.at(Function::Entry));
+  while (order.size() < function.blocks.size()) {
+    // hot chains before cold chains, strongest connection first,
+    // then in order of their first block
+    std::optional<std::size_t> best{};
+    const auto key = [&](std::size_t chain) {
+      return std::make_tuple(Cold(chains[chain]), -connection[chain], chains[chain].front());
+    };
+    for (std::size_t i = 0; i < chains.size(); i++) {
+      if (placed[i]) continue;
+      if (!best.has_value() || key(i) < key(best.value())) best = i;
+    }
+    place(best.value());
+  }
+  return order;
+}
+
+void BlockLayout::Relabel(const chain_t& order) {
+  cotyl::unordered_map<block_label_t, block_label_t> labels{};
+  for (std::size_t i = 0; i < order.size(); i++) {
+    labels.emplace(order[i], Function::Entry + i);
+  }
+
+  auto relabel = RelabelBlocks{labels};
+  cotyl::unordered_map<block_label_t, BasicBlock> blocks{};
+  for (auto& [block_idx, block] : function.blocks) {
+    for (auto& directive : block) {
+      VisitFields(directive, relabel);
+    }
+    blocks.emplace(labels.at(block_idx), std::move(block));
+  }
+  function.blocks = std::move(blocks);
+}
+
+void BlockLayout::Run() {
+  EstimateFrequencies();
+  Relabel(PlaceChains(FormChains()));
+  deps = FunctionDependencies::GetDependencies(function);
+}
+
+}
+
+void LayoutBlocks(Function& function, FunctionDependencies& deps) {
+  BlockLayout(function, deps).Run();
+}
+
+}
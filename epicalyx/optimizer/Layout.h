@@ -0,0 +1,33 @@
+#pragma once
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Block layout, after Pettis and Hansen.
+ * Branch probabilities are estimated with static heuristics (after Ball
+ * and Larus): loop back edges are likely taken and loop exits are not,
+ * successors containing calls or returning are less likely than the
+ * alternative. Block frequencies follow from these in reverse postorder,
+ * with loop headers executing a fixed number of times per entry.
+ * Blocks are then joined into chains along the most frequent edges, so that
+ * the source of an edge directly precedes its destination (falls through).
+ * Chains are placed greedily after the chain holding the entry block, by
+ * the weight of the edges into them from the chains already placed.
+ * Cold chains, of which every block is executed much less often than the
+ * entry block (such as error paths), come last. Loop exits are unlikely,
+ * so the blocks after a loop follow its body, rather than its header.
+ * The layout is stored in the block labels: blocks are renumbered,
+ * so that iterating the labels in ascending order gives the layout,
+ * starting at the entry block.
+ * The dependencies are recomputed.
+ * */
+void LayoutBlocks(calyx::Function& function, FunctionDependencies& deps);
+
+}
@@ -0,0 +1,150 @@
+#include "Liveness.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// whether a write to a local overwrites all of it
+bool IsFullWrite(const Function& function, func_pos_t pos) {
+  return function.blocks.at(pos.first).at(pos.second).visit<bool>(
+    [&]<typename T>(const StoreLocal<T>& store) {
+      if (!function.locals.contains(store.loc_idx)) return false;
+      return store.offset == 0 && sizeof(T) >= function.locals.at(store.loc_idx).Size();
+    },
+    [](const auto&) { return false; }
+  );
+}
+
+}
+
+Liveness::Liveness(const Function& function, const FunctionDependencies& deps) {
+  // compact numbering
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    values.push_back(GeneralizedVar::Var(var_idx));
+  }
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (loc_idx) values.push_back(GeneralizedVar::Local(loc_idx));
+  }
+  std::sort(values.begin(), values.end(), [](const auto& a, const auto& b) {
+    return std::make_pair(a.is_local, a.idx) < std::make_pair(b.is_local, b.idx);
+  });
+  index.reserve(values.size());
+  for (u32 i = 0; i < values.size(); i++) {
+    index.emplace(values[i], i);
+  }
+
+  blocks.reserve(function.blocks.size());
+  for (const auto& [block_idx, block] : function.blocks) {
+    blocks.emplace(block_idx, Block{values.size()});
+  }
+
+  // use and def sets
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    const auto idx = Index(GeneralizedVar::Var(var_idx));
+    blocks.at(var.created.first).def.Set(idx);
+    for (const auto& pos : var.reads) {
+      if (pos.first != var.created.first) blocks.at(pos.first).use.Set(idx);
+    }
+  }
+
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (!loc_idx) continue;
+    const auto idx = Index(GeneralizedVar::Local(loc_idx));
+
+    // only writes that overwrite the whole local kill it,
+    // the rest of a partially written local may still be read
+    cotyl::unordered_map<block_label_t, decltype(func_pos_t::second)> first_write{};
+    for (const auto& pos : local.writes) {
+      if (!IsFullWrite(function, pos)) continue;
+      const auto& [block_idx, i] = pos;
+      blocks.at(block_idx).def.Set(idx);
+      if (!first_write.contains(block_idx) || first_write.at(block_idx) > i) {
+        first_write[block_idx] = i;
+      }
+    }
+    for (const auto& [block_idx, i] : local.reads) {
+      if (!first_write.contains(block_idx) || first_write.at(block_idx) > i) {
+        blocks.at(block_idx).use.Set(idx);
+      }
+    }
+
+    if (function.locals.contains(loc_idx)) {
+      const auto& loc = function.locals.at(loc_idx);
+      if (loc.type != Local::Type::Aggregate && loc.non_aggregate.arg_idx.has_value()) {
+        blocks.at(Function::Entry).def.Set(idx);
+      }
+    }
+  }
+
+  // postorder of the blocks reachable from the entry, followed by the others
+  cotyl::vector<block_label_t> postorder{};
+  {
+    cotyl::unordered_set<block_label_t> visited{Function::Entry};
+    cotyl::vector<std::pair<block_label_t, cotyl::vector<block_label_t>>> stack{};
+    const auto push = [&](block_label_t block_idx) {
+      const auto& to = deps.block_graph.At(block_idx).to;
+      cotyl::vector<block_label_t> successors{to.begin(), to.end()};
+      std::sort(successors.begin(), successors.end(), std::greater<block_label_t>{});
+      stack.emplace_back(block_idx, std::move(successors));
+    };
+    push(Function::Entry);
+    while (!stack.empty()) {
+      auto& [block_idx, successors] = stack.back();
+      if (successors.empty()) {
+        postorder.push_back(block_idx);
+        stack.pop_back();
+        continue;
+      }
+      const auto next = successors.back();
+      successors.pop_back();
+      if (visited.insert(next).second) push(next);
+    }
+
+    cotyl::vector<block_label_t> unreachable{};
+    for (const auto& [block_idx, block] : function.blocks) {
+      if (!visited.contains(block_idx)) unreachable.push_back(block_idx);
+    }
+    std::sort(unreachable.begin(), unreachable.end());
+    postorder.insert(postorder.end(), unreachable.begin(), unreachable.end());
+  }
+
+  // the back of the worklist is visited first
+  cotyl::vector<block_label_t> worklist{postorder.rbegin(), postorder.rend()};
+  cotyl::unordered_set<block_label_t> queued{postorder.begin(), postorder.end()};
+  while (!worklist.empty()) {
+    const auto block_idx = worklist.back();
+    worklist.pop_back();
+    queued.erase(block_idx);
+
+    auto& block = blocks.at(block_idx);
+    for (const auto& succ : deps.block_graph.At(block_idx).to) {
+      block.out.Union(blocks.at(succ).in);
+    }
+
+    auto in = block.out;
+    in.Subtract(block.def);
+    in.Union(block.use);
+    if (block.in.Union(in)) {
+      for (const auto& pred : deps.block_graph.At(block_idx).from) {
+        if (queued.insert(pred).second) worklist.push_back(pred);
+      }
+    }
+  }
+}
+
+bool Liveness::LiveIn(block_label_t block_idx, const GeneralizedVar& gvar) const {
+  return Contains(gvar) && LiveIn(block_idx).Test(Index(gvar));
+}
+
+bool Liveness::LiveOut(block_label_t block_idx, const GeneralizedVar& gvar) const {
+  return Contains(gvar) && LiveOut(block_idx).Test(Index(gvar));
+}
+
+}
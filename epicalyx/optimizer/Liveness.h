@@ -0,0 +1,61 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "regalloc/GeneralizedVar.h"
+#include "Containers.h"
+#include "BitSet.h"
+
+
+namespace epi {
+
+struct FunctionDependencies;
+
+/*
+ * Liveness of vars and locals at block boundaries.
+ * Vars and locals are numbered compactly (vars first, both in ascending
+ * order), and the live-in and live-out sets of every block are bit sets
+ * over these numbers. A var is used in every block it is read in other than
+ * the block it is created in, a local is used in a block if it is read
+ * there before it is completely overwritten (by a store of its full width
+ * at offset 0). Argument locals are written in the entry block.
+ * The sets are found with the usual backward dataflow
+ *   out[b] = U_{s : succ b} in[s]
+ *   in[b]  = use[b] U (out[b] - def[b])
+ * with a worklist that starts in postorder (reverse postorder of
+ * the reversed flow), revisiting the predecessors of blocks whose
+ * live-in set grew.
+ * Local 0 is not tracked. Accesses through pointers are not taken into
+ * account, so locals of which the address is taken should be treated
+ * as live everywhere.
+ * */
+struct Liveness {
+  Liveness(const calyx::Function& function, const FunctionDependencies& deps);
+
+  // number of tracked values
+  std::size_t size() const { return values.size(); }
+
+  bool Contains(const GeneralizedVar& gvar) const { return index.contains(gvar); }
+  u32 Index(const GeneralizedVar& gvar) const { return index.at(gvar); }
+  const GeneralizedVar& Value(u32 idx) const { return values[idx]; }
+
+  const cotyl::BitSet& LiveIn(block_label_t block_idx) const { return blocks.at(block_idx).in; }
+  const cotyl::BitSet& LiveOut(block_label_t block_idx) const { return blocks.at(block_idx).out; }
+  bool LiveIn(block_label_t block_idx, const GeneralizedVar& gvar) const;
+  bool LiveOut(block_label_t block_idx, const GeneralizedVar& gvar) const;
+
+private:
+  struct Block {
+    Block(std::size_t size) : use{size}, def{size}, in{size}, out{size} { }
+
+    cotyl::BitSet use;
+    cotyl::BitSet def;
+    cotyl::BitSet in;
+    cotyl::BitSet out;
+  };
+
+  cotyl::vector<GeneralizedVar> values{};
+  cotyl::unordered_map<GeneralizedVar, u32> index{};
+  cotyl::unordered_map<block_label_t, Block> blocks{};
+};
+
+}
@@ -0,0 +1,203 @@
+#include "Loops.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+
+
+namespace epi {
+
+using namespace calyx;
+
+Loops::Loops(const FunctionDependencies& deps) {
+  const auto& graph = deps.block_graph;
+
+  // reverse postorder of the blocks reachable from the entry
+  cotyl::vector<block_label_t> rpo{};
+  cotyl::unordered_map<block_label_t, u32> rpo_index{};
+  {
+    cotyl::unordered_set<block_label_t> visited{Function::Entry};
+    cotyl::vector<std::pair<block_label_t, cotyl::vector<block_label_t>>> stack{};
+    const auto push = [&](block_label_t block) {
+      const auto& to = graph.At(block).to;
+      stack.emplace_back(block, cotyl::vector<block_label_t>{to.begin(), to.end()});
+    };
+    push(Function::Entry);
+    while (!stack.empty()) {
+      auto& [block, successors] = stack.back();
+      if (successors.empty()) {
+        rpo.push_back(block);
+        stack.pop_back();
+        continue;
+      }
+      const auto next = successors.back();
+      successors.pop_back();
+      if (visited.insert(next).second) {
+        push(next);
+      }
+    }
+    std::reverse(rpo.begin(), rpo.end());
+    for (u32 i = 0; i < rpo.size(); i++) {
+      rpo_index.emplace(rpo[i], i);
+    }
+  }
+
+  // iterative dominator computation
+  const auto intersect = [&](block_label_t a, block_label_t b) {
+    while (a != b) {
+      while (rpo_index.at(a) > rpo_index.at(b)) a = idom.at(a);
+      while (rpo_index.at(b) > rpo_index.at(a)) b = idom.at(b);
+    }
+    return a;
+  };
+
+  idom.emplace(Function::Entry, Function::Entry);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto& block : rpo) {
+      if (block == Function::Entry) continue;
+      block_label_t new_idom = 0;
+      for (const auto& pred : graph.At(block).from) {
+        if (!idom.contains(pred)) continue;
+        new_idom = new_idom ? intersect(pred, new_idom) : pred;
+      }
+      if (!idom.contains(block) || idom.at(block) != new_idom) {
+        idom[block] = new_idom;
+        changed = true;
+      }
+    }
+  }
+
+  // natural loops from back edges
+  cotyl::unordered_map<block_label_t, std::size_t> header_loop{};
+  for (const auto& block : rpo) {
+    for (const auto& to : graph.At(block).to) {
+      if (!Dominates(to, block)) continue;
+
+      if (!header_loop.contains(to)) {
+        header_loop.emplace(to, loops.size());
+        loops.push_back(Loop{.header = to, .blocks = {to}});
+      }
+      auto& loop = loops[header_loop.at(to)];
+      loop.latches.push_back(block);
+
+      cotyl::vector<block_label_t> todo{};
+      if (loop.blocks.insert(block).second) todo.push_back(block);
+      while (!todo.empty()) {
+        const auto current = todo.back();
+        todo.pop_back();
+        for (const auto& pred : graph.At(current).from) {
+          if (!Reachable(pred)) continue;
+          if (loop.blocks.insert(pred).second) todo.push_back(pred);
+        }
+      }
+    }
+  }
+
+  for (auto& loop : loops) {
+    for (const auto& pred : graph.At(loop.header).from) {
+      if (Reachable(pred) && !loop.Contains(pred)) {
+        loop.entries.push_back(pred);
+      }
+    }
+  }
+
+  // inner loops are strictly smaller than the loops they are nested in
+  std::stable_sort(loops.begin(), loops.end(), [](const auto& a, const auto& b) {
+    return a.blocks.size() < b.blocks.size();
+  });
+  for (auto& loop : loops) {
+    loop.depth = Depth(loop.header);
+  }
+}
+
+bool Loops::Reachable(block_label_t block) const {
+  return idom.contains(block);
+}
+
+bool Loops::Dominates(block_label_t dom, block_label_t block) const {
+  if (!Reachable(block)) return false;
+  while (true) {
+    if (block == dom) return true;
+    if (block == Function::Entry) return false;
+    block = idom.at(block);
+  }
+}
+
+u32 Loops::Depth(block_label_t block) const {
+  return std::count_if(loops.begin(), loops.end(), [&](const auto& loop) {
+    return loop.Contains(block);
+  });
+}
+
+const Loops::Loop* Loops::Innermost(block_label_t block) const {
+  for (const auto& loop : loops) {
+    if (loop.Contains(block)) return &loop;
+  }
+  return nullptr;
+}
+
+template<typename T>
+requires (cotyl::pack_contains_v<T, calyx::calyx_integral_types>)
+std::optional<Loops::InductionVariable<T>> Loops::FindInductionVariable(
+        const Function& function, const FunctionDependencies& deps,
+        const Loop& loop, func_pos_t load_pos
+) const {
+  using U = std::make_unsigned_t<T>;
+  const auto at = [&](func_pos_t pos) -> const AnyDirective& {
+    return function.blocks.at(pos.first).at(pos.second);
+  };
+
+  if (load_pos.first != loop.header || !IsType<LoadLocal<T>>(at(load_pos))) return {};
+  const auto& load = at(load_pos).template get<LoadLocal<T>>();
+  if (load.offset) return {};
+  if (function.locals.at(load.loc_idx).type != Local::TypeOf<T>()) return {};
+  const auto& local_deps = deps.local_graph.at(load.loc_idx);
+  if (!local_deps.aliased_by.empty()) return {};
+
+  // the local must be stored exactly once every iteration, after it is loaded
+  std::optional<func_pos_t> store_pos{};
+  for (const auto& pos : local_deps.writes) {
+    if (!loop.Contains(pos.first)) continue;
+    if (store_pos.has_value()) return {};
+    store_pos = pos;
+  }
+  if (!store_pos.has_value()) return {};
+  if (store_pos->first == loop.header && store_pos->second < load_pos.second) return {};
+  if (Innermost(store_pos->first)->header != loop.header) return {};
+  for (const auto& latch : loop.latches) {
+    if (!Dominates(store_pos->first, latch)) return {};
+  }
+
+  // with the loaded value plus a constant step
+  if (!IsType<StoreLocal<T>>(at(store_pos.value()))) return {};
+  const auto& store = at(store_pos.value()).template get<StoreLocal<T>>();
+  if (store.offset || !store.src.IsVar()) return {};
+  const auto increment_pos = deps.var_graph.at(store.src.GetVar()).created;
+  if (!increment_pos.first || !IsType<Binop<T>>(at(increment_pos))) return {};
+  const auto& increment = at(increment_pos).template get<Binop<T>>();
+  if (increment.left_idx != load.idx || !increment.right.IsScalar()) return {};
+
+  T step;
+  switch (increment.op) {
+    case BinopType::Add: step = increment.right.GetScalar(); break;
+    case BinopType::Sub: step = (T)((U)0 - (U)increment.right.GetScalar()); break;
+    default: return {};
+  }
+  return InductionVariable<T>{
+    .loc_idx = load.loc_idx,
+    .value = load.idx,
+    .load = load_pos,
+    .increment = increment_pos,
+    .store = store_pos.value(),
+    .step = step,
+  };
+}
+
+template std::optional<Loops::InductionVariable<i32>> Loops::FindInductionVariable(const Function&, const FunctionDependencies&, const Loop&, func_pos_t) const;
+template std::optional<Loops::InductionVariable<u32>> Loops::FindInductionVariable(const Function&, const FunctionDependencies&, const Loop&, func_pos_t) const;
+template std::optional<Loops::InductionVariable<i64>> Loops::FindInductionVariable(const Function&, const FunctionDependencies&, const Loop&, func_pos_t) const;
+template std::optional<Loops::InductionVariable<u64>> Loops::FindInductionVariable(const Function&, const FunctionDependencies&, const Loop&, func_pos_t) const;
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "Containers.h"
+
+#include "Vector.h"
+
+#include <optional>
+
+
+namespace epi {
+
+struct FunctionDependencies;
+
+/*
+ * Dominator tree and natural loops of a function, computed from the block graph.
+ * Dominators are found with the iterative algorithm by Cooper, Harvey and Kennedy,
+ * a natural loop is formed for every block that is the target of a back edge
+ * (an edge to a block that dominates the source), and contains all blocks that
+ * can reach such a back edge without passing through the loop header.
+ * Loops with the same header are merged. Blocks unreachable from the entry
+ * are ignored.
+ * */
+struct Loops {
+  struct Loop {
+    block_label_t header;
+
+    // all blocks in the loop, including the header
+    cotyl::flat_set<block_label_t> blocks{};
+
+    // blocks in the loop with a back edge to the header
+    cotyl::vector<block_label_t> latches{};
+
+    // blocks outside the loop branching to the header
+    cotyl::vector<block_label_t> entries{};
+
+    // number of loops this loop is nested in, plus one
+    u32 depth = 1;
+
+    bool Contains(block_label_t block) const { return blocks.contains(block); }
+  };
+
+  // a local that is loaded in the loop header, and stored exactly once
+  // every iteration, after it is loaded, with the loaded value plus a constant
+  template<typename T>
+  struct InductionVariable {
+    loc_index_t loc_idx;
+    var_index_t value;     // loaded in the header
+    func_pos_t load;
+    func_pos_t increment;  // loaded value plus step
+    func_pos_t store;
+    T step;                // wrapped for unsigned counters
+  };
+
+  explicit Loops(const FunctionDependencies& deps);
+
+  bool Reachable(block_label_t block) const;
+  bool Dominates(block_label_t dom, block_label_t block) const;
+
+  // number of loops containing a block
+  u32 Depth(block_label_t block) const;
+
+  // innermost loop containing a block, nullptr if it is not in a loop
+  const Loop* Innermost(block_label_t block) const;
+
+  // basic induction variable loaded by the LoadLocal<T> at load_pos in the loop header
+  template<typename T>
+  requires (cotyl::pack_contains_v<T, calyx::calyx_integral_types>)
+  std::optional<InductionVariable<T>> FindInductionVariable(
+          const calyx::Function& function, const FunctionDependencies& deps,
+          const Loop& loop, func_pos_t load_pos
+  ) const;
+
+  // innermost loops come before the loops they are nested in
+  const cotyl::vector<Loop>& All() const { return loops; }
+
+private:
+  cotyl::unordered_map<block_label_t, block_label_t> idom{};
+  cotyl::vector<Loop> loops{};
+};
+
+}
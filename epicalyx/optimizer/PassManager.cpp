@@ -0,0 +1,326 @@
+#include "PassManager.h"
+#include "BasicOptimizer.h"
+#include "DeadStores.h"
+#include "InductionVariables.h"
+#include "Layout.h"
+#include "ProgramDependencies.h"
+#include "RemoveUnused.h"
+#include "SCCP.h"
+#include "ScalarReplacement.h"
+#include "SimplifyCFG.h"
+#include "TailRecursion.h"
+#include "Unroll.h"
+#include "calyx/Calyx.h"
+
+#include "Containers.h"
+#include "Format.h"
+#include "Is.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+
+namespace epi {
+
+using namespace calyx;
+
+static void RunBasicOptimizer(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  auto optimizer = BasicOptimizer(std::move(function), std::move(deps), effects);
+  function = optimizer.Optimize();
+  deps = optimizer.Dependencies();
+  for (auto& warning : optimizer.Warnings()) {
+    warnings.push_back(std::move(warning));
+  }
+}
+
+static void RunTailRecursion(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  EliminateTailRecursion(function, deps);
+}
+
+static void RunSCCP(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  PropagateConstants(function, deps);
+}
+
+static void RunSimplifyCFG(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  SimplifyCFG(function, deps);
+}
+
+static void RunScalarReplacement(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  ReplaceAggregates(function, deps);
+}
+
+static void RunInductionVariables(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  ReduceInductionVariables(function, deps);
+}
+
+static void RunUnroll(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  UnrollLoops(function, deps, options.unroll);
+}
+
+static void RunDeadStores(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  RemoveDeadStores(function, deps, effects);
+}
+
+static void RunLayout(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  LayoutBlocks(function, deps);
+}
+
+static void RunRemoveUnused(Function& function, FunctionDependencies& deps, const SideEffects& effects, const PassOptions& options, cotyl::vector<std::string>& warnings) {
+  RemoveUnused(function, deps, effects);
+}
+
+const cotyl::vector<Pass>& Pass::All() {
+  static const cotyl::vector<Pass> passes = {
+    {"basic", "Block linking, local propagation, constant folding and common subexpression elimination", RunBasicOptimizer},
+    {"tailrec", "Turn self tail calls into a loop, reusing the argument locals", RunTailRecursion},
+    {"sccp", "Sparse conditional constant propagation, removing branches that are never taken", RunSCCP},
+    {"simplifycfg", "Fold constant branches, thread jumps, remove empty and unreachable blocks and merge straight-line blocks", RunSimplifyCFG},
+    {"sra", "Split aggregate locals of which the address does not escape into scalar locals", RunScalarReplacement},
+    {"indvars", "Induction variable strength reduction and linear function test replacement", RunInductionVariables},
+    {"unroll", "Full unrolling of short counted loops, partial unrolling of other counted loops", RunUnroll},
+    {"dse", "Remove stores to locals and globals that are overwritten before being read, across blocks", RunDeadStores},
+    {"layout", "Order blocks to maximize fallthrough edges, placing cold blocks last", RunLayout},
+    {"remove-unused", "Remove unused variables and locals", RunRemoveUnused},
+  };
+  return passes;
+}
+
+const Pass& Pass::Get(const std::string& name) {
+  const auto& passes = All();
+  auto it = std::find_if(passes.begin(), passes.end(), [&](const auto& pass) { return name == pass.name; });
+  if (it == passes.end()) {
+    throw cotyl::FormatExcept<PassError>("Unknown pass: '%s'", name.c_str());
+  }
+  return *it;
+}
+
+PassPipeline PassPipeline::FromLevel(int level) {
+  auto pipeline = PassPipeline{};
+  switch (level) {
+    case 0: break;
+    case 1: {
+      pipeline.passes.push_back(&Pass::Get("basic"));
+      pipeline.max_iterations = 1;
+      break;
+    }
+    case 2: {
+      // repeating the basic optimizer multiple times will link more blocks
+      pipeline.passes.push_back(&Pass::Get("basic"));
+      pipeline.passes.push_back(&Pass::Get("tailrec"));
+      pipeline.passes.push_back(&Pass::Get("sccp"));
+      pipeline.passes.push_back(&Pass::Get("simplifycfg"));
+      pipeline.passes.push_back(&Pass::Get("sra"));
+      pipeline.passes.push_back(&Pass::Get("indvars"));
+      pipeline.passes.push_back(&Pass::Get("unroll"));
+      pipeline.passes.push_back(&Pass::Get("dse"));
+      pipeline.passes.push_back(&Pass::Get("layout"));
+      break;
+    }
+    default:
+      throw cotyl::FormatExcept<PassError>("Invalid optimization level: %d", level);
+  }
+  return pipeline;
+}
+
+PassPipeline PassPipeline::Parse(const std::string& passes) {
+  auto pipeline = PassPipeline{};
+  std::size_t start = 0;
+  while (start <= passes.size()) {
+    auto end = passes.find(',', start);
+    if (end == std::string::npos) end = passes.size();
+    if (end != start) {
+      pipeline.passes.push_back(&Pass::Get(passes.substr(start, end - start)));
+    }
+    start = end + 1;
+  }
+  return pipeline;
+}
+
+void PassStatistics::Merge(const PassStatistics& other) {
+  time += other.time;
+  runs += other.runs;
+  directives_before += other.directives_before;
+  directives_after  += other.directives_after;
+  blocks_before     += other.blocks_before;
+  blocks_after      += other.blocks_after;
+}
+
+// (non-NoOp) directive count and block count
+static std::pair<std::size_t, std::size_t> IRSize(const Function& function) {
+  std::size_t directives = 0;
+  for (const auto& [block_idx, block] : function.blocks) {
+    directives += std::count_if(block.begin(), block.end(), [](const auto& directive) {
+      return !IsType<NoOp>(directive);
+    });
+  }
+  return {directives, function.blocks.size()};
+}
+
+FunctionPassStatistics PassManager::Run(Function& function, const SideEffects& effects) const {
+  auto stats = FunctionPassStatistics{};
+  stats.symbol = cotyl::CString{function.symbol};
+  stats.passes.resize(pipeline.passes.size());
+  if (pipeline.passes.empty()) return stats;
+
+  // dependencies are only computed once, and maintained by the passes
+  auto deps = FunctionDependencies::GetDependencies(function);
+  auto func_hash = function.Hash();
+  cotyl::unordered_set<std::size_t> seen_hashes{func_hash};
+
+  auto size = IRSize(function);
+  while (true) {
+    for (std::size_t i = 0; i < pipeline.passes.size(); i++) {
+      auto& pass_stats = stats.passes[i];
+      if (!pass_stats.runs) {
+        pass_stats.directives_before = size.first;
+        pass_stats.blocks_before = size.second;
+      }
+
+      const auto start = std::chrono::steady_clock::now();
+      pipeline.passes[i]->run(function, deps, effects, pipeline.options, stats.warnings);
+      pass_stats.time += std::chrono::steady_clock::now() - start;
+      pass_stats.runs++;
+
+      size = IRSize(function);
+      pass_stats.directives_after = size.first;
+      pass_stats.blocks_after = size.second;
+    }
+    stats.iterations++;
+
+    const auto new_hash = function.Hash();
+    if (new_hash == func_hash) {
+      stats.convergence = FunctionPassStatistics::Convergence::Converged;
+      break;
+    }
+    if (seen_hashes.contains(new_hash)) {
+      // passes may undo each others changes, which
+      // would otherwise never converge
+      stats.convergence = FunctionPassStatistics::Convergence::Cycle;
+      break;
+    }
+    if (stats.iterations >= pipeline.max_iterations) {
+      stats.convergence = FunctionPassStatistics::Convergence::Limit;
+      break;
+    }
+    seen_hashes.insert(new_hash);
+    func_hash = new_hash;
+  }
+  return stats;
+}
+
+static double Seconds(PassStatistics::duration_t time) {
+  return std::chrono::duration<double>(time).count();
+}
+
+static void PrintHeader(const char* title) {
+  const auto rule = "===-------------------------------------------------------------------------===";
+  const auto padding = (std::strlen(rule) - std::strlen(title)) / 2;
+  std::cout << rule << std::endl;
+  std::cout << std::string(padding, ' ') << title << std::endl;
+  std::cout << rule << std::endl;
+}
+
+static void PrintTable(const cotyl::vector<std::pair<std::string, PassStatistics>>& rows, const PassStatistics& total) {
+  const auto total_time = Seconds(total.time);
+  const auto print_row = [&](const std::string& name, const PassStatistics& stats) {
+    const auto time = Seconds(stats.time);
+    std::cout << cotyl::Format(
+      "  %8.4f (%5.1f%%)  %8zu  %7zu -> %7zu  %6zu -> %6zu  %s",
+      time, total_time > 0 ? 100 * time / total_time : 0.0, stats.runs,
+      stats.directives_before, stats.directives_after,
+      stats.blocks_before, stats.blocks_after, name.c_str()
+    ) << std::endl;
+  };
+
+  std::cout << "    ---Wall Time---  ---Runs-  ----Directives----  ----Blocks------  --- Name ---" << std::endl;
+  for (const auto& [name, stats] : rows) {
+    print_row(name, stats);
+  }
+  print_row("Total", total);
+}
+
+// statistics for the whole pipeline, from the IR size
+// before the first pass, to the IR size after the last pass
+static PassStatistics PipelineTotal(const FunctionPassStatistics& func_stats) {
+  auto total = PassStatistics{};
+  if (func_stats.passes.empty()) return total;
+  for (const auto& stats : func_stats.passes) {
+    total.time += stats.time;
+    total.runs += stats.runs;
+  }
+  total.directives_before = func_stats.passes.front().directives_before;
+  total.blocks_before     = func_stats.passes.front().blocks_before;
+  total.directives_after  = func_stats.passes.back().directives_after;
+  total.blocks_after      = func_stats.passes.back().blocks_after;
+  return total;
+}
+
+void PassManager::PrintReport(const cotyl::vector<FunctionPassStatistics>& stats) const {
+  // sort rows by time spent, like LLVM does
+  const auto sorted = [](cotyl::vector<std::pair<std::string, PassStatistics>>&& rows) {
+    std::stable_sort(rows.begin(), rows.end(), [](const auto& a, const auto& b) {
+      return a.second.time > b.second.time;
+    });
+    return std::move(rows);
+  };
+
+  // merge statistics of all functions per pass in the pipeline
+  cotyl::vector<std::pair<std::string, PassStatistics>> pass_rows{};
+  for (const auto* pass : pipeline.passes) {
+    pass_rows.emplace_back(pass->name, PassStatistics{});
+  }
+
+  auto total = PassStatistics{};
+  std::size_t num_converged = 0, num_cycle = 0, num_limit = 0, num_memoized = 0;
+  for (const auto& func_stats : stats) {
+    for (std::size_t i = 0; i < func_stats.passes.size(); i++) {
+      pass_rows[i].second.Merge(func_stats.passes[i]);
+    }
+    total.Merge(PipelineTotal(func_stats));
+    if (func_stats.memoized) {
+      num_memoized++;
+      continue;
+    }
+    switch (func_stats.convergence) {
+      case FunctionPassStatistics::Convergence::Converged: num_converged++; break;
+      case FunctionPassStatistics::Convergence::Cycle: num_cycle++; break;
+      case FunctionPassStatistics::Convergence::Limit: num_limit++; break;
+    }
+  }
+
+  std::cout << std::endl;
+  PrintHeader("Pass execution timing report");
+  std::cout << cotyl::Format("  Total Execution Time: %.4f seconds (wall)", Seconds(total.time)) << std::endl;
+  std::cout << cotyl::Format(
+    "  Functions: %zu (%zu converged, %zu cycled, %zu hit the iteration limit of %d, %zu memoized)",
+    stats.size(), num_converged, num_cycle, num_limit, pipeline.max_iterations, num_memoized
+  ) << std::endl << std::endl;
+  PrintTable(sorted(std::move(pass_rows)), total);
+
+  std::cout << std::endl;
+  PrintHeader("Per-function pass statistics");
+  for (const auto& func_stats : stats) {
+    const char* convergence = "";
+    switch (func_stats.convergence) {
+      case FunctionPassStatistics::Convergence::Converged: convergence = "converged"; break;
+      case FunctionPassStatistics::Convergence::Cycle: convergence = "cycled"; break;
+      case FunctionPassStatistics::Convergence::Limit: convergence = "hit iteration limit"; break;
+    }
+    if (func_stats.memoized) {
+      convergence = "memoized";
+    }
+    std::cout << std::endl << cotyl::Format(
+      "  %s: %d iterations, %s", func_stats.symbol.c_str(), func_stats.iterations, convergence
+    ) << std::endl;
+
+    cotyl::vector<std::pair<std::string, PassStatistics>> rows{};
+    for (std::size_t i = 0; i < func_stats.passes.size(); i++) {
+      rows.emplace_back(pipeline.passes[i]->name, func_stats.passes[i]);
+    }
+    PrintTable(sorted(std::move(rows)), PipelineTotal(func_stats));
+  }
+  std::cout << std::endl;
+}
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "Unroll.h"
+#include "calyx/CalyxFwd.h"
+#include "CString.h"
+#include "Exceptions.h"
+#include "Vector.h"
+
+#include <chrono>
+#include <string>
+
+
+namespace epi {
+
+struct FunctionDependencies;
+struct SideEffects;
+
+struct PassError : cotyl::Exception {
+  PassError(std::string&& message) :
+      Exception("Pass Error", std::move(message)) { }
+};
+
+// settings of passes that can be changed from the command line
+struct PassOptions {
+  UnrollSettings unroll{};
+};
+
+/*
+ * A named optimization pass over a single function.
+ * The dependencies are valid for the function when a pass is run,
+ * and every pass must leave them valid for the next pass, either by
+ * maintaining them, or by recomputing them.
+ * Passes are also given the side effects of the functions in the program,
+ * which stay valid while functions are optimized.
+ * Warnings are collected instead of printed, as functions may be
+ * optimized on multiple threads.
+ * */
+struct Pass {
+  using run_t = void (*)(
+          calyx::Function& function, FunctionDependencies& deps,
+          const SideEffects& effects, const PassOptions& options,
+          cotyl::vector<std::string>& warnings
+  );
+
+  const char* name;
+  const char* description;
+  run_t run;
+
+  // find a pass by name, throws a PassError if it does not exist
+  static const Pass& Get(const std::string& name);
+  static const cotyl::vector<Pass>& All();
+};
+
+struct PassPipeline {
+  static constexpr int DefaultMaxIterations = 32;
+
+  // passes in the order they are run
+  cotyl::vector<const Pass*> passes{};
+
+  // the full pipeline is repeated until the function no longer
+  // changes, or until this many iterations have been run
+  int max_iterations = DefaultMaxIterations;
+
+  PassOptions options{};
+
+  // -O0: no optimizations
+  // -O1: run the basic optimizer once
+  // -O2: run all passes until the function no longer changes
+  static PassPipeline FromLevel(int level);
+
+  // comma separated list of pass names
+  static PassPipeline Parse(const std::string& passes);
+};
+
+struct PassStatistics {
+  using duration_t = std::chrono::steady_clock::duration;
+
+  duration_t time{};
+  std::size_t runs = 0;
+
+  // IR size before the first run and after the last run of the pass
+  std::size_t directives_before = 0;
+  std::size_t directives_after = 0;
+  std::size_t blocks_before = 0;
+  std::size_t blocks_after = 0;
+
+  void Merge(const PassStatistics& other);
+};
+
+struct FunctionPassStatistics {
+  cotyl::CString symbol{};
+
+  // statistics per pass in the pipeline, in pipeline order
+  cotyl::vector<PassStatistics> passes{};
+  int iterations = 0;
+
+  enum class Convergence {
+    Converged,  // pipeline no longer changes the function
+    Cycle,      // pipeline returned the function to an earlier state
+    Limit,      // maximum number of iterations was reached
+  } convergence = Convergence::Converged;
+
+  // result was copied from an identical function
+  bool memoized = false;
+
+  // warnings of the passes, in the order they were found
+  cotyl::vector<std::string> warnings{};
+};
+
+struct PassManager {
+  PassManager(PassPipeline&& pipeline) : pipeline{std::move(pipeline)} { }
+
+  // run the pipeline on a single function
+  // this does not modify the pass manager, so it may be called
+  // from multiple threads at once
+  FunctionPassStatistics Run(calyx::Function& function, const SideEffects& effects) const;
+
+  // print an overview of the time spent in every pass, and of how
+  // the IR size changed, similar to LLVM's -time-passes
+  void PrintReport(const cotyl::vector<FunctionPassStatistics>& stats) const;
+
+private:
+  PassPipeline pipeline;
+};
+
+}
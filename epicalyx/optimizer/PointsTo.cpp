@@ -0,0 +1,207 @@
+#include "PointsTo.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include "Vector.h"
+
+
+namespace epi {
+
+using namespace calyx;
+
+bool PointsTo::Pointees::Merge(const Pointees& other) {
+  bool changed = false;
+  if (other.unknown && !unknown) {
+    unknown = true;
+    changed = true;
+  }
+  if (other.global && !global) {
+    global = true;
+    changed = true;
+  }
+  for (const auto& loc_idx : other.locals) {
+    changed |= locals.insert(loc_idx).second;
+  }
+  return changed;
+}
+
+PointsTo::PointsTo(const Function& function, const FunctionDependencies& deps) {
+  // seed with direct local aliases
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    if (var.aliases) {
+      vars[var_idx].locals.insert(var.aliases);
+    }
+  }
+
+  // arguments hold pointers of unknown origin
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type != Local::Type::Aggregate && local.non_aggregate.arg_idx.has_value()) {
+      contents[loc_idx].unknown = true;
+    }
+  }
+
+  cotyl::vector<const AnyDirective*> directives{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (const auto& directive : block) {
+      directives.push_back(&directive);
+    }
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (const auto* directive : directives) {
+      changed |= Emit(*directive);
+    }
+
+    // anything stored in escaped locals escapes as well
+    const cotyl::vector<loc_index_t> escaped_locals = {escaped.begin(), escaped.end()};
+    for (const auto& loc_idx : escaped_locals) {
+      const auto pointees = contents[loc_idx];
+      changed |= Escape(pointees);
+    }
+  }
+}
+
+bool PointsTo::MayPointTo(var_index_t ptr_idx, loc_index_t loc_idx) const {
+  if (!vars.contains(ptr_idx)) [[unlikely]] {
+    // var does not occur in the analyzed function
+    return true;
+  }
+  const auto& pointees = vars.at(ptr_idx);
+  return pointees.locals.contains(loc_idx) || (pointees.unknown && escaped.contains(loc_idx));
+}
+
+bool PointsTo::OnlyLocals(var_index_t ptr_idx) const {
+  if (!vars.contains(ptr_idx)) return false;
+  const auto& pointees = vars.at(ptr_idx);
+  return !pointees.unknown && !pointees.global && !pointees.locals.empty();
+}
+
+bool PointsTo::Escaped(loc_index_t loc_idx) const {
+  return escaped.contains(loc_idx);
+}
+
+bool PointsTo::Escape(const Pointees& pointees) {
+  bool changed = false;
+  for (const auto& loc_idx : pointees.locals) {
+    if (escaped.insert(loc_idx).second) {
+      // unknown code may store anything in the local
+      contents[loc_idx].unknown = true;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool PointsTo::Emit(const AnyDirective& directive) {
+  const auto unknown = Pointees{.unknown = true};
+  const auto var_pointees = [&](var_index_t var_idx) -> Pointees {
+    return vars.contains(var_idx) ? vars.at(var_idx) : Pointees{};
+  };
+  const auto operand_pointees = [&](const Operand<Pointer>& operand) -> Pointees {
+    return operand.IsVar() ? var_pointees(operand.GetVar()) : unknown;
+  };
+
+  return directive.visit<bool>(
+    [&]<typename To, typename From>(const Cast<To, From>& op) {
+      if constexpr(std::is_same_v<To, Pointer>) {
+        if constexpr(std::is_same_v<From, Pointer>) {
+          return vars[op.idx].Merge(var_pointees(op.right_idx));
+        }
+        else {
+          // pointer from integer, may be any escaped pointer
+          return vars[op.idx].Merge(unknown);
+        }
+      }
+      else if constexpr(std::is_same_v<From, Pointer>) {
+        // pointer converted to integer, can no longer be tracked
+        return Escape(var_pointees(op.right_idx));
+      }
+      return false;
+    },
+    [&]<typename T>(const AddToPointer<T>& op) {
+      return vars[op.idx].Merge(operand_pointees(op.ptr));
+    },
+    [&](const Imm<Pointer>& op) {
+      return vars[op.idx].Merge(unknown);
+    },
+    [&](const LoadGlobalAddr& op) {
+      // pointer to a global, never points into a local, but the
+      // global itself is memory that is not tracked
+      return vars[op.idx].Merge(Pointees{.global = true});
+    },
+    [&](const LoadGlobal<Pointer>& op) {
+      return vars[op.idx].Merge(unknown);
+    },
+    [&]<typename T>(const LoadLocal<T>& op) {
+      const auto pointees = contents[op.loc_idx];
+      if constexpr(std::is_same_v<T, Pointer>) {
+        return vars[op.idx].Merge(pointees);
+      }
+      else {
+        // stored pointer may be read as integer
+        return Escape(pointees);
+      }
+    },
+    [&](const StoreLocal<Pointer>& op) {
+      return contents[op.loc_idx].Merge(operand_pointees(op.src));
+    },
+    [&]<typename T>(const LoadFromPointer<T>& op) {
+      const auto ptr = var_pointees(op.ptr_idx);
+      bool changed = false;
+      for (const auto& loc_idx : ptr.locals) {
+        const auto pointees = contents[loc_idx];
+        if constexpr(std::is_same_v<T, Pointer>) {
+          changed |= vars[op.idx].Merge(pointees);
+        }
+        else {
+          changed |= Escape(pointees);
+        }
+      }
+      if constexpr(std::is_same_v<T, Pointer>) {
+        // globals may hold any escaped pointer
+        if (ptr.unknown || ptr.global) changed |= vars[op.idx].Merge(unknown);
+      }
+      return changed;
+    },
+    [&](const StoreToPointer<Pointer>& op) {
+      const auto ptr = var_pointees(op.ptr_idx);
+      const auto src = operand_pointees(op.src);
+      bool changed = false;
+      for (const auto& loc_idx : ptr.locals) {
+        changed |= contents[loc_idx].Merge(src);
+      }
+      // pointers stored in globals may be read anywhere
+      if (ptr.unknown || ptr.global) changed |= Escape(src);
+      return changed;
+    },
+    [&](const StoreGlobal<Pointer>& op) {
+      return Escape(operand_pointees(op.src));
+    },
+    [&](const Return<Pointer>& op) {
+      return Escape(operand_pointees(op.val));
+    },
+    [&]<typename T>(const Call<T>& op) {
+      bool changed = false;
+      for (const auto& [var_idx, arg] : op.args->args) changed |= Escape(var_pointees(var_idx));
+      for (const auto& [var_idx, arg] : op.args->var_args) changed |= Escape(var_pointees(var_idx));
+      if constexpr(std::is_same_v<T, Pointer>) {
+        changed |= vars[op.idx].Merge(unknown);
+      }
+      return changed;
+    },
+    [&]<typename T>(const CallLabel<T>& op) {
+      bool changed = false;
+      for (const auto& [var_idx, arg] : op.args->args) changed |= Escape(var_pointees(var_idx));
+      for (const auto& [var_idx, arg] : op.args->var_args) changed |= Escape(var_pointees(var_idx));
+      if constexpr(std::is_same_v<T, Pointer>) {
+        changed |= vars[op.idx].Merge(unknown);
+      }
+      return changed;
+    },
+    [](const auto&) { return false; }
+  );
+}
+
+}
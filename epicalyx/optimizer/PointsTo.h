@@ -0,0 +1,59 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "Containers.h"
+
+
+namespace epi {
+
+struct FunctionDependencies;
+
+/*
+ * Flow-insensitive, intraprocedural (Andersen style) points-to analysis.
+ * Tracks which locals pointer vars, and pointers stored in locals, may
+ * point into. Pointers of unknown origin (globals, arguments, call results,
+ * integer casts) may point to any local that escaped the function, i.e.
+ * whose address was passed to a call, stored to unknown memory, returned,
+ * or converted to an integer. Calls may access any escaped local.
+ * Memory behind pointers into globals is not tracked either: pointers
+ * stored through them escape, and pointers loaded through them are of
+ * unknown origin.
+ * Fields are not distinguished, so a pointer into an aggregate local
+ * aliases the whole local.
+ * */
+struct PointsTo {
+  PointsTo(const calyx::Function& function, const FunctionDependencies& deps);
+
+  // whether a pointer var may point into a local
+  bool MayPointTo(var_index_t ptr_idx, loc_index_t loc_idx) const;
+
+  // whether a pointer var only ever points into locals of the function
+  bool OnlyLocals(var_index_t ptr_idx) const;
+
+  // whether a local may be accessed outside of the function,
+  // or through pointers of unknown origin
+  bool Escaped(loc_index_t loc_idx) const;
+
+private:
+  struct Pointees {
+    cotyl::flat_set<loc_index_t> locals{};
+    // pointer of unknown origin
+    bool unknown = false;
+    // pointer into a global
+    bool global = false;
+
+    // returns whether anything was added
+    bool Merge(const Pointees& other);
+  };
+
+  cotyl::unordered_map<var_index_t, Pointees> vars{};
+  // pointers stored in locals
+  cotyl::unordered_map<loc_index_t, Pointees> contents{};
+  cotyl::unordered_set<loc_index_t> escaped{};
+
+  // returns whether anything changed
+  bool Escape(const Pointees& pointees);
+  bool Emit(const calyx::AnyDirective& directive);
+};
+
+}
@@ -68,6 +68,74 @@ void FunctionDependencies::EmitFunction(const Function& function) {
   }
 }
 
+void FunctionDependencies::AddBlock(block_label_t block_idx, const BasicBlock* block) {
+  // node may already exist if it was branched to before
+  block_graph.AddNodeIfNotExists(block_idx, block).value = block;
+}
+
+void FunctionDependencies::AddLocal(var_index_t loc_idx) {
+  local_graph.emplace(loc_idx, LocalData{});
+}
+
+void FunctionDependencies::AddDirective(const AnyDirective& dir, func_pos_t dir_pos) {
+  pos = dir_pos;
+  Emit(dir);
+}
+
+FunctionDependencies FunctionDependencies::RemoveDirective(const AnyDirective& dir, func_pos_t dir_pos) {
+  // find the dependencies of the single directive
+  auto removed = FunctionDependencies();
+  removed.AddDirective(dir, dir_pos);
+
+  // a directive may access the same var or local more than once
+  const auto erase_pos = [&](cotyl::vector<func_pos_t>& positions) {
+    positions.erase(std::remove(positions.begin(), positions.end(), dir_pos), positions.end());
+  };
+
+  for (const auto& [var_idx, removed_var] : removed.var_graph) {
+    auto& var = var_graph.at(var_idx);
+    erase_pos(var.reads);
+    if (var.function_result == dir_pos) {
+      var.function_result = {0, 0};
+    }
+    if (var.created == dir_pos) {
+      var = Var{.reads = std::move(var.reads)};
+    }
+
+    // var is neither created nor read anymore
+    if (!var.created.first && var.reads.empty()) {
+      var_graph.erase(var_idx);
+    }
+  }
+
+  for (const auto& [loc_idx, removed_local] : removed.local_graph) {
+    auto& local = local_graph.at(loc_idx);
+    erase_pos(local.reads);
+    erase_pos(local.writes);
+    for (const auto& var_idx : removed_local.aliased_by) {
+      auto it = std::find(local.aliased_by.begin(), local.aliased_by.end(), var_idx);
+      if (it != local.aliased_by.end()) local.aliased_by.erase(it);
+    }
+    local.needs_address = !local.aliased_by.empty();
+  }
+
+  for (const auto& [block_idx, node] : removed.block_graph) {
+    for (const auto& to_idx : node.to) {
+      block_graph.RemoveEdge(block_idx, to_idx);
+    }
+  }
+
+  return removed;
+}
+
+void FunctionDependencies::AddBlockEdge(block_label_t from, block_label_t to) {
+  // blocks might not have been added yet when the
+  // dependencies are maintained incrementally
+  block_graph.AddNodeIfNotExists(from, nullptr);
+  block_graph.AddNodeIfNotExists(to, nullptr);
+  block_graph.AddEdge(from, to);
+}
+
 void FunctionDependencies::Emit(const AnyDirective& dir) {
   dir.visit<void>([&](const auto& d) { Emit(d); });
 }
@@ -82,21 +150,21 @@ void FunctionDependencies::Emit(const Cast<To, From>& op) {
 template<typename T>
 void FunctionDependencies::Emit(const LoadLocal<T>& op) {
   cotyl::get_default(var_graph, op.idx).created = pos;
-  local_graph.at(op.loc_idx).reads.push_back(pos);
+  cotyl::get_default(local_graph, op.loc_idx).reads.push_back(pos);
 }
 
 void FunctionDependencies::Emit(const LoadLocalAddr& op) {
   cotyl::get_default(var_graph, op.idx).created = pos;
   var_graph[op.idx].aliases = op.loc_idx;
-  local_graph.at(op.loc_idx).reads.push_back(pos);
-  local_graph.at(op.loc_idx).needs_address = true;
-  local_graph.at(op.loc_idx).aliased_by.emplace_back(op.idx);
+  cotyl::get_default(local_graph, op.loc_idx).reads.push_back(pos);
+  cotyl::get_default(local_graph, op.loc_idx).needs_address = true;
+  cotyl::get_default(local_graph, op.loc_idx).aliased_by.emplace_back(op.idx);
 }
 
 template<typename T>
 void FunctionDependencies::Emit(const StoreLocal<T>& op) {
   if (op.src.IsVar()) cotyl::get_default(var_graph, op.src.GetVar()).reads.push_back(pos);
-  local_graph.at(op.loc_idx).writes.push_back(pos);
+  cotyl::get_default(local_graph, op.loc_idx).writes.push_back(pos);
 }
 
 template<typename T>
@@ -214,13 +282,13 @@ void FunctionDependencies::Emit(const Compare<T>& op) {
 }
 
 void FunctionDependencies::Emit(const UnconditionalBranch& op) {
-  block_graph.AddEdge(pos.first, op.dest);
+  AddBlockEdge(pos.first, op.dest);
 }
 
 template<typename T>
 void FunctionDependencies::Emit(const BranchCompare<T>& op) {
-  block_graph.AddEdge(pos.first, op.tdest);
-  block_graph.AddEdge(pos.first, op.fdest);
+  AddBlockEdge(pos.first, op.tdest);
+  AddBlockEdge(pos.first, op.fdest);
   cotyl::get_default(var_graph, op.left_idx).reads.push_back(pos);
   if (op.right.IsVar()) {
     cotyl::get_default(var_graph, op.right.GetVar()).reads.push_back(pos);
@@ -230,10 +298,10 @@ void FunctionDependencies::Emit(const BranchCompare<T>& op) {
 void FunctionDependencies::Emit(const Select& op) {
   cotyl::get_default(var_graph, op.idx).reads.push_back(pos);
   for (const auto& [value, block_idx] : *op.table) {
-    block_graph.AddEdge(pos.first, block_idx);
+    AddBlockEdge(pos.first, block_idx);
   }
   if (op._default) {
-    block_graph.AddEdge(pos.first, op._default);
+    AddBlockEdge(pos.first, op._default);
   }
 }
 
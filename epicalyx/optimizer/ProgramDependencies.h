@@ -50,10 +50,22 @@ struct FunctionDependencies {
   }
   void EmitFunction(const calyx::Function& function);
 
+  // incrementally maintain the dependencies as the function is changed,
+  // instead of rebuilding them by rescanning the whole function
+  void AddBlock(block_label_t block_idx, const calyx::BasicBlock* block);
+  void AddLocal(var_index_t loc_idx);
+  void AddDirective(const calyx::AnyDirective& dir, func_pos_t dir_pos);
+
+  // remove the dependencies of a directive that is about to be replaced
+  // or nullified, returning the dependencies that were removed, as the
+  // vars / locals in there may have become unused
+  FunctionDependencies RemoveDirective(const calyx::AnyDirective& dir, func_pos_t dir_pos);
+
 protected:
   func_pos_t pos;
 
   void Emit(const calyx::AnyDirective& dir);
+  void AddBlockEdge(block_label_t from, block_label_t to);
 
 private:
   void Emit(const calyx::NoOp& op) { }
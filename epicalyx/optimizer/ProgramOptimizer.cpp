@@ -0,0 +1,156 @@
+#include "ProgramOptimizer.h"
+#include "SideEffects.h"
+#include "calyx/Calyx.h"
+#include "calyx/Canonical.h"
+#include "calyx/Fields.h"
+
+#include "ThreadPool.h"
+#include "Containers.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <memory>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// renumber the vars and locals of an optimized copy of a function,
+// mapping them onto those of an identical function, unknown indices
+// (created while optimizing) get fresh ones
+// block labels are kept, as they hold the block layout
+struct Renumber {
+  template<typename I>
+  struct Mapping {
+    cotyl::unordered_map<I, I> map{};
+    I next = 0;
+
+    Mapping(const cotyl::vector<I>& from, const cotyl::vector<I>& to) {
+      for (std::size_t i = 0; i < from.size(); i++) {
+        map.emplace(from[i], to[i]);
+      }
+      if (!to.empty()) next = *std::max_element(to.begin(), to.end()) + 1;
+    }
+
+    I operator()(I idx) {
+      auto inserted = map.emplace(idx, next);
+      if (inserted.second) next++;
+      return inserted.first->second;
+    }
+  };
+
+  Renumber(const CanonicalFunction& from, const CanonicalFunction& to) :
+      vars{from.vars, to.vars}, locals{from.locals, to.locals} {
+
+  }
+
+  Mapping<var_index_t> vars;
+  Mapping<loc_index_t> locals;
+
+  void Var(var_index_t& var_idx) { var_idx = vars(var_idx); }
+  void Local(loc_index_t& loc_idx) { loc_idx = locals(loc_idx); }
+  void Block(block_label_t& block_idx) { }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // shared data is still referenced by the original function
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+
+  void Apply(const Function& optimized, Function& dest) {
+    dest.blocks.clear();
+    for (const auto& [block_idx, block] : optimized.blocks) {
+      auto& new_block = dest.blocks.emplace(block_idx, block).first->second;
+      for (auto& directive : new_block) {
+        VisitFields(directive, *this);
+      }
+    }
+
+    dest.locals.clear();
+    for (const auto& [loc_idx, local] : optimized.locals) {
+      auto new_local = local;
+      new_local.idx = locals(loc_idx);
+      dest.locals.emplace(new_local.idx, std::move(new_local));
+    }
+  }
+};
+
+}
+
+cotyl::vector<FunctionPassStatistics> OptimizeProgram(Program& program, const PassManager& passes, std::size_t jobs) {
+  cotyl::vector<Function*> functions{};
+  functions.reserve(program.functions.size());
+  for (auto& [sym, func] : program.functions) {
+    functions.push_back(&func);
+  }
+
+  auto pool = cotyl::ThreadPool(jobs ? jobs : cotyl::ThreadPool::HardwareThreads());
+
+  // identical functions (up to numbering) are only optimized once
+  cotyl::vector<std::optional<CanonicalFunction>> canonical(functions.size());
+  pool.ForEach(functions.size(), [&](std::size_t i) {
+    canonical[i].emplace(*functions[i]);
+  });
+
+  cotyl::vector<std::size_t> optimize{};
+  cotyl::vector<std::optional<std::size_t>> memoized(functions.size());
+  cotyl::unordered_map<std::size_t, cotyl::vector<std::size_t>> by_hash{};
+  for (std::size_t i = 0; i < functions.size(); i++) {
+    auto& candidates = by_hash[canonical[i]->Hash()];
+    auto it = std::find_if(candidates.begin(), candidates.end(), [&](const auto& j) {
+      return *canonical[j] == *canonical[i];
+    });
+    if (it != candidates.end()) {
+      memoized[i] = *it;
+    }
+    else {
+      candidates.push_back(i);
+      optimize.push_back(i);
+    }
+  }
+
+  // summaries of the unoptimized functions stay valid
+  // while they are optimized
+  const auto effects = SideEffects(program);
+
+  cotyl::vector<FunctionPassStatistics> stats(functions.size());
+  pool.ForEach(optimize.size(), [&](std::size_t i) {
+    stats[optimize[i]] = passes.Run(*functions[optimize[i]], effects);
+  });
+
+  for (std::size_t i = 0; i < functions.size(); i++) {
+    if (!memoized[i].has_value()) continue;
+    const auto j = memoized[i].value();
+    Renumber(*canonical[j], *canonical[i]).Apply(*functions[j], *functions[i]);
+
+    auto func_stats = FunctionPassStatistics{stats[j]};
+    func_stats.symbol = cotyl::CString{functions[i]->symbol};
+    func_stats.iterations = 0;
+    func_stats.memoized = true;
+    for (auto& pass_stats : func_stats.passes) {
+      pass_stats.time = {};
+      pass_stats.runs = 0;
+    }
+    stats[i] = std::move(func_stats);
+  }
+
+  for (const auto& func_stats : stats) {
+    for (const auto& warning : func_stats.warnings) {
+      Log::Warn("%s in function %s", warning.c_str(), func_stats.symbol.c_str());
+    }
+    if (func_stats.convergence == FunctionPassStatistics::Convergence::Limit && func_stats.iterations > 1) {
+      Log::Warn(
+        "Optimization of function %s did not converge after %d iterations",
+        func_stats.symbol.c_str(), func_stats.iterations
+      );
+    }
+  }
+  return stats;
+}
+
+}
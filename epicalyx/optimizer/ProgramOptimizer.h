@@ -0,0 +1,28 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "PassManager.h"
+
+#include "Vector.h"
+
+#include <cstddef>
+
+
+namespace epi {
+
+/*
+ * Optimizes all functions in a program with the pass manager's pipeline.
+ * Functions are independent at this stage, and share no mutable
+ * state while they are being optimized, so they are distributed
+ * over a pool of jobs worker threads (0 meaning all hardware threads).
+ * Functions that are identical up to the numbering of their vars, locals
+ * and blocks are only optimized once, the others copy the result.
+ * Statistics are returned per function in program order, and warnings
+ * are printed in program order afterwards, so the output does not
+ * depend on the number of jobs.
+ * */
+cotyl::vector<FunctionPassStatistics> OptimizeProgram(
+    calyx::Program& program, const PassManager& passes, std::size_t jobs = 1
+);
+
+}
@@ -7,77 +7,84 @@
 
 namespace epi {
 
-static std::size_t NullifyUnusedLocals(calyx::Function& func, FunctionDependencies& deps) {
-  // remove unused locals
+std::size_t RemoveUnused(calyx::Function& function, FunctionDependencies& deps, const SideEffects& effects) {
   std::size_t removed = 0;
-  for (const auto& [loc_idx, local] : deps.local_graph) {
-    bool local_unread = std::all_of(local.reads.begin(), local.reads.end(), [&](const auto& pos) {
-      return calyx::IsType<calyx::NoOp>(func.blocks.at(pos.first).at(pos.second));
-    });
-    if (local_unread) {
-      // local is never read/aliased
-      // remove all local writes
-      for (const auto& pos : local.writes) {
-        func.blocks.at(pos.first).at(pos.second).template emplace<calyx::NoOp>();
-      }
-      if (!func.locals.at(loc_idx).non_aggregate.arg_idx.has_value()) {
-        func.locals.erase(loc_idx);
-        removed++;
-      }
-    }
-  }
-  return removed;
-}
-
-static std::size_t NullifyUnusedVars(calyx::Function& function, FunctionDependencies& dependencies) {
-  std::size_t removed = 0;
-  cotyl::unordered_set<var_index_t> todo{};
+  cotyl::unordered_set<var_index_t> todo_vars{};
+  cotyl::unordered_set<var_index_t> todo_locals{};
   // copy map keys
-  std::transform(dependencies.var_graph.begin(), dependencies.var_graph.end(), std::inserter(todo, todo.begin()),
+  std::transform(deps.var_graph.begin(), deps.var_graph.end(), std::inserter(todo_vars, todo_vars.begin()),
+                 [](auto& kv) { return kv.first; });
+  std::transform(deps.local_graph.begin(), deps.local_graph.end(), std::inserter(todo_locals, todo_locals.begin()),
                  [](auto& kv) { return kv.first; });
 
-  while (!todo.empty()) {
-    const auto var_idx = *todo.begin();
-    todo.erase(todo.begin());
+  const auto nullify = [&](func_pos_t pos) {
+    auto& directive = function.blocks.at(pos.first).at(pos.second);
+    const auto nullified = deps.RemoveDirective(directive, pos);
+    directive.template emplace<calyx::NoOp>();
 
-    // remove nullified reads
-    auto& var = dependencies.var_graph.at(var_idx);
-    var.reads.erase(
-      std::remove_if(
-        var.reads.begin(), var.reads.end(),
-        [&](const auto& pos) { 
-          return calyx::IsType<calyx::NoOp>(function.blocks.at(pos.first).at(pos.second)); 
-        }
-      ), 
-      var.reads.end()
+    // anything the directive used is now possibly unused
+    for (const auto& [var_idx, _] : nullified.var_graph) {
+      todo_vars.insert(var_idx);
+    }
+    for (const auto& [loc_idx, _] : nullified.local_graph) {
+      todo_locals.insert(loc_idx);
+    }
+  };
+
+  // calls that do not write memory and always return may be removed
+  const auto removable_call = [&](func_pos_t pos) {
+    return function.blocks.at(pos.first).at(pos.second).template visit<bool>(
+      [&]<typename T>(const calyx::CallLabel<T>& call) { return effects.Get(call.label).Removable(); },
+      [](const auto&) { return false; }
     );
+  };
+
+  while (!todo_vars.empty() || !todo_locals.empty()) {
+    while (!todo_vars.empty()) {
+      const auto var_idx = *todo_vars.begin();
+      todo_vars.erase(todo_vars.begin());
 
-    // NEVER erase call results
-    if (var.reads.empty() && !var.is_call_result) {
-      // remove from all dependencies
-      for (auto other : var.deps) {
-        // other var is now also possibly unused
-        todo.insert(other);
+      // var may have been removed altogether
+      if (!deps.var_graph.contains(var_idx)) continue;
+      const auto& var = deps.var_graph.at(var_idx);
+
+      // NEVER erase call results, unless the call has no side effects
+      if (var.reads.empty() && var.created.first && (!var.is_call_result || removable_call(var.created))) {
+        // nullify write
+        nullify(var.created);
+        removed++;
       }
+    }
+
+    if (!todo_locals.empty()) {
+      const auto loc_idx = *todo_locals.begin();
+      todo_locals.erase(todo_locals.begin());
 
-      // nullify write
-      function.blocks.at(var.created.first).at(var.created.second).template emplace<calyx::NoOp>();
-      removed++;
+      // local was already removed
+      if (!function.locals.contains(loc_idx)) continue;
+      auto& local = deps.local_graph.at(loc_idx);
+      if (local.reads.empty()) {
+        // local is never read/aliased
+        // remove all local writes
+        while (!local.writes.empty()) {
+          nullify(local.writes.back());
+        }
+        if (!function.locals.at(loc_idx).non_aggregate.arg_idx.has_value()) {
+          function.locals.erase(loc_idx);
+          deps.local_graph.erase(loc_idx);
+          removed++;
+        }
+      }
     }
   }
+
+  // noops will be removed in the next optimization step
   return removed;
 }
 
 std::size_t RemoveUnused(calyx::Function& function) {
-  std::size_t removed = 0;
   auto deps = FunctionDependencies::GetDependencies(function);
-
-  // this also removed any uses from the stored vars
-  removed += NullifyUnusedLocals(function, deps);
-  removed += NullifyUnusedVars(function, deps);
-
-  // noops will be removed in the next optimization step
-  return removed;
+  return RemoveUnused(function, deps);
 }
 
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "SideEffects.h"
+
 #include <cstddef>
 
 
@@ -9,6 +11,15 @@ namespace calyx {
 struct Function;
 }
 
+struct FunctionDependencies;
+
 std::size_t RemoveUnused(calyx::Function& program);
 
-}
\ No newline at end of file
+// remove unused vars / locals, keeping the dependencies up to date
+// this removes everything in one go, so it does not have to be repeated
+// calls are only removed if their effects show that this is safe
+std::size_t RemoveUnused(
+    calyx::Function& program, FunctionDependencies& deps, const SideEffects& effects = SideEffects::None()
+);
+
+}
@@ -0,0 +1,532 @@
+#include "SCCP.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include "Containers.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+struct Lattice {
+  enum class State : u8 {
+    Top,       // not (yet) known to be executed
+    Constant,
+    Bottom,    // varying
+  };
+
+  State state = State::Top;
+  // raw bytes of the constant, as it would be stored in memory
+  u64 bits = 0;
+  u32 size = 0;
+
+  template<typename T>
+  static Lattice Constant(T value) {
+    static_assert(sizeof(T) <= sizeof(u64));
+    auto lattice = Lattice{State::Constant};
+    std::memcpy(&lattice.bits, &value, sizeof(T));
+    lattice.size = sizeof(T);
+    return lattice;
+  }
+
+  static Lattice Bottom() {
+    return Lattice{State::Bottom};
+  }
+
+  bool IsTop() const { return state == State::Top; }
+  bool IsConstant() const { return state == State::Constant; }
+  bool IsBottom() const { return state == State::Bottom; }
+
+  template<typename T>
+  T Get() const {
+    cotyl::Assert(IsConstant() && size == sizeof(T), "Invalid lattice access");
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+  }
+
+  // returns whether the value changed
+  bool Meet(const Lattice& other) {
+    if (other.IsTop() || IsBottom()) return false;
+    if (IsTop()) {
+      *this = other;
+      return true;
+    }
+    if (other.IsBottom() || other.bits != bits || other.size != size) {
+      *this = Bottom();
+      return true;
+    }
+    return false;
+  }
+};
+
+// folding never introduces behavior that differs from the
+// program at runtime, undefined operations are never folded
+template<typename T>
+std::optional<T> FoldBinop(BinopType op, T left, T right) {
+  if constexpr(std::is_integral_v<T>) {
+    // wrap around on overflow instead of invoking undefined behavior
+    using U = std::make_unsigned_t<T>;
+    switch (op) {
+      case BinopType::Add: return (T)((U)left + (U)right);
+      case BinopType::Sub: return (T)((U)left - (U)right);
+      case BinopType::Mul: return (T)((U)left * (U)right);
+      case BinopType::Div:
+      case BinopType::Mod: {
+        if (right == 0) return {};
+        if constexpr(std::is_signed_v<T>) {
+          if (left == std::numeric_limits<T>::min() && right == -1) return {};
+        }
+        return op == BinopType::Div ? left / right : left % right;
+      }
+      case BinopType::BinAnd: return left & right;
+      case BinopType::BinOr: return left | right;
+      case BinopType::BinXor: return left ^ right;
+    }
+  }
+  else {
+    switch (op) {
+      case BinopType::Add: return left + right;
+      case BinopType::Sub: return left - right;
+      case BinopType::Mul: return left * right;
+      case BinopType::Div: return left / right;
+      default: return {};
+    }
+  }
+  return {};
+}
+
+template<typename T>
+std::optional<T> FoldUnop(UnopType op, T right) {
+  switch (op) {
+    case UnopType::Neg: {
+      if constexpr(std::is_integral_v<T>) {
+        return (T)((std::make_unsigned_t<T>)0 - (std::make_unsigned_t<T>)right);
+      }
+      else {
+        return -right;
+      }
+    }
+    case UnopType::BinNot: {
+      if constexpr(std::is_integral_v<T>) {
+        return ~right;
+      }
+      break;
+    }
+  }
+  return {};
+}
+
+template<typename T>
+std::optional<T> FoldShift(ShiftType op, T left, u32 right) {
+  if (right >= 8 * sizeof(T)) return {};
+  if (op == ShiftType::Left) {
+    return (T)((std::make_unsigned_t<T>)left << right);
+  }
+  return (T)(left >> right);
+}
+
+template<typename To, typename From>
+std::optional<calyx_upcast_t<To>> FoldCast(From right) {
+  if constexpr(std::is_floating_point_v<From> && std::is_integral_v<To>) {
+    // out of range float to integer conversions are undefined
+    const auto value = (long double)right;
+    if (std::isnan(value)) return {};
+    if (value <= (long double)std::numeric_limits<To>::min() - 1) return {};
+    if (value >= (long double)std::numeric_limits<To>::max() + 1) return {};
+  }
+  return (calyx_upcast_t<To>)(To)right;
+}
+
+struct SCCP {
+  using LocalState = cotyl::unordered_map<loc_index_t, Lattice>;
+
+  SCCP(Function& function, FunctionDependencies& deps) :
+      function{function}, deps{deps} {
+
+  }
+
+  std::size_t Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+
+  cotyl::unordered_map<var_index_t, Lattice> values{};
+  // locals whose address is never taken, so that their
+  // value can only change through direct stores
+  cotyl::unordered_set<loc_index_t> tracked{};
+  // tracked local values at the start of executable blocks
+  cotyl::unordered_map<block_label_t, LocalState> entry{};
+
+  cotyl::vector<block_label_t> todo{};
+  cotyl::unordered_set<block_label_t> in_todo{};
+
+  void Enqueue(block_label_t block_idx);
+  void Flow(block_label_t block_idx, const LocalState& state);
+  void SetValue(var_index_t var_idx, const Lattice& value);
+  void Visit(block_label_t block_idx);
+
+  Lattice Value(var_index_t var_idx) const;
+  template<typename T>
+  Lattice Value(const Operand<T>& operand) const;
+
+  // successor of a branch with a constant condition, 0 if not known
+  template<typename T>
+  block_label_t ConstantTarget(const BranchCompare<T>& branch) const;
+  block_label_t ConstantTarget(const Select& select) const;
+
+  // constant directive replacing a directive, if any
+  std::optional<AnyDirective> Replacement(const AnyDirective& directive) const;
+};
+
+void SCCP::Enqueue(block_label_t block_idx) {
+  if (in_todo.insert(block_idx).second) {
+    todo.push_back(block_idx);
+  }
+}
+
+void SCCP::Flow(block_label_t block_idx, const LocalState& state) {
+  if (!entry.contains(block_idx)) {
+    // block is executable from now on
+    entry.emplace(block_idx, state);
+    Enqueue(block_idx);
+    return;
+  }
+
+  bool changed = false;
+  auto& block_entry = entry.at(block_idx);
+  for (const auto& [loc_idx, value] : state) {
+    changed |= block_entry[loc_idx].Meet(value);
+  }
+  if (changed) {
+    Enqueue(block_idx);
+  }
+}
+
+void SCCP::SetValue(var_index_t var_idx, const Lattice& value) {
+  if (!values[var_idx].Meet(value)) return;
+
+  // revisit any executable block that reads the var
+  if (!deps.var_graph.contains(var_idx)) return;
+  for (const auto& [block_idx, i] : deps.var_graph.at(var_idx).reads) {
+    if (entry.contains(block_idx)) {
+      Enqueue(block_idx);
+    }
+  }
+}
+
+Lattice SCCP::Value(var_index_t var_idx) const {
+  if (!values.contains(var_idx)) return {};
+  return values.at(var_idx);
+}
+
+template<typename T>
+Lattice SCCP::Value(const Operand<T>& operand) const {
+  if (operand.IsVar()) return Value(operand.GetVar());
+  if constexpr(std::is_same_v<T, Pointer>) {
+    return Lattice::Bottom();
+  }
+  else {
+    return Lattice::Constant(operand.GetScalar());
+  }
+}
+
+// apply a fold to some lattice values, the result is unknown if any
+// of the values is, and varying if any of them is, or if the fold failed
+template<typename F, typename... Ls>
+static Lattice Fold(F fold, const Ls&... values) {
+  if ((values.IsBottom() || ...)) return Lattice::Bottom();
+  if ((values.IsTop() || ...)) return {};
+  auto result = fold();
+  if (!result.has_value()) return Lattice::Bottom();
+  return Lattice::Constant(result.value());
+}
+
+template<typename T>
+block_label_t SCCP::ConstantTarget(const BranchCompare<T>& branch) const {
+  if constexpr(std::is_same_v<T, Pointer>) {
+    return 0;
+  }
+  else {
+    const auto left = Value(branch.left_idx);
+    const auto right = Value(branch.right);
+    if (!left.IsConstant() || !right.IsConstant()) return 0;
+    return FoldCompare(left.template Get<T>(), branch.op, right.template Get<T>()) ? branch.tdest : branch.fdest;
+  }
+}
+
+block_label_t SCCP::ConstantTarget(const Select& select) const {
+  const auto value = Value(select.idx);
+  if (!value.IsConstant()) return 0;
+  if (select.table->contains(value.Get<i64>())) {
+    return select.table->at(value.Get<i64>());
+  }
+  return select._default;
+}
+
+void SCCP::Visit(block_label_t block_idx) {
+  auto state = entry.at(block_idx);
+  for (const auto& directive : function.blocks.at(block_idx)) {
+    const bool end = directive.visit<bool>(
+      [&]<typename T>(const Imm<T>& op) {
+        if constexpr(std::is_same_v<T, Pointer>) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        else {
+          SetValue(op.idx, Lattice::Constant(op.value));
+        }
+        return false;
+      },
+      [&]<typename To, typename From>(const Cast<To, From>& op) {
+        if constexpr(std::is_same_v<To, Pointer> || std::is_same_v<From, Pointer>) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        else {
+          const auto right = Value(op.right_idx);
+          SetValue(op.idx, Fold([&] { return FoldCast<To>(right.template Get<From>()); }, right));
+        }
+        return false;
+      },
+      [&]<typename T>(const Binop<T>& op) {
+        const auto left = Value(op.left_idx);
+        const auto right = Value(op.right);
+        SetValue(op.idx, Fold([&] {
+          return FoldBinop(op.op, left.template Get<T>(), right.template Get<T>());
+        }, left, right));
+        return false;
+      },
+      [&]<typename T>(const Unop<T>& op) {
+        const auto right = Value(op.right_idx);
+        SetValue(op.idx, Fold([&] { return FoldUnop(op.op, right.template Get<T>()); }, right));
+        return false;
+      },
+      [&]<typename T>(const Shift<T>& op) {
+        const auto left = Value(op.left);
+        const auto right = Value(op.right);
+        SetValue(op.idx, Fold([&] {
+          return FoldShift(op.op, left.template Get<T>(), right.template Get<u32>());
+        }, left, right));
+        return false;
+      },
+      [&]<typename T>(const Compare<T>& op) {
+        if constexpr(std::is_same_v<T, Pointer>) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        else {
+          const auto left = Value(op.left_idx);
+          const auto right = Value(op.right);
+          SetValue(op.idx, Fold([&] {
+            return std::optional<i32>{FoldCompare(left.template Get<T>(), op.op, right.template Get<T>())};
+          }, left, right));
+        }
+        return false;
+      },
+      [&]<typename T>(const LoadLocal<T>& op) {
+        if (!tracked.contains(op.loc_idx) || op.offset) {
+          SetValue(op.idx, Lattice::Bottom());
+          return false;
+        }
+
+        const auto stored = state.at(op.loc_idx);
+        if constexpr(std::is_same_v<T, Pointer>) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        else if (stored.IsConstant() && stored.size == sizeof(T)) {
+          // reinterpret the stored bytes, like the actual load would
+          SetValue(op.idx, Lattice::Constant((calyx_upcast_t<T>)stored.template Get<T>()));
+        }
+        else if (stored.IsConstant()) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        else {
+          SetValue(op.idx, stored);
+        }
+        return false;
+      },
+      [&]<typename T>(const StoreLocal<T>& op) {
+        if (!tracked.contains(op.loc_idx)) return false;
+        if constexpr(std::is_same_v<T, Pointer>) {
+          state[op.loc_idx] = Lattice::Bottom();
+        }
+        else {
+          const auto src = Value(op.src);
+          if (op.offset) {
+            state[op.loc_idx] = Lattice::Bottom();
+          }
+          else if (src.IsConstant()) {
+            // truncate to the stored type
+            state[op.loc_idx] = Lattice::Constant((T)src.template Get<calyx_upcast_t<T>>());
+          }
+          else {
+            state[op.loc_idx] = src;
+          }
+        }
+        return false;
+      },
+      [&](const UnconditionalBranch& op) {
+        Flow(op.dest, state);
+        return true;
+      },
+      [&]<typename T>(const BranchCompare<T>& op) {
+        if constexpr(std::is_same_v<T, Pointer>) {
+          Flow(op.tdest, state);
+          Flow(op.fdest, state);
+        }
+        else {
+          const auto cond = Fold([&] {
+            return std::optional<i32>{FoldCompare(Value(op.left_idx).template Get<T>(), op.op, Value(op.right).template Get<T>())};
+          }, Value(op.left_idx), Value(op.right));
+          if (cond.IsConstant()) {
+            Flow(cond.template Get<i32>() ? op.tdest : op.fdest, state);
+          }
+          else if (cond.IsBottom()) {
+            Flow(op.tdest, state);
+            Flow(op.fdest, state);
+          }
+        }
+        return true;
+      },
+      [&](const Select& op) {
+        const auto value = Value(op.idx);
+        if (value.IsTop()) return true;
+
+        const auto target = ConstantTarget(op);
+        if (target) {
+          Flow(target, state);
+          return true;
+        }
+
+        // either varying, or no matching case (undefined),
+        // in both cases we assume any case may be taken
+        for (const auto& [_, dest] : *op.table) {
+          Flow(dest, state);
+        }
+        if (op._default) {
+          Flow(op._default, state);
+        }
+        return true;
+      },
+      [&]<typename T>(const Return<T>& op) {
+        return true;
+      },
+      [&]<typename D>(const D& op) {
+        // any other expression (loads, pointers, calls) is varying
+        if constexpr(is_expr_v<D>) {
+          SetValue(op.idx, Lattice::Bottom());
+        }
+        return false;
+      }
+    );
+    if (end) break;
+  }
+}
+
+std::optional<AnyDirective> SCCP::Replacement(const AnyDirective& directive) const {
+  return directive.visit<std::optional<AnyDirective>>(
+    [&]<typename T>(const Imm<T>& op) -> std::optional<AnyDirective> {
+      return {};
+    },
+    [&]<typename T>(const BranchCompare<T>& op) -> std::optional<AnyDirective> {
+      const auto target = ConstantTarget(op);
+      if (!target) return {};
+      return UnconditionalBranch{target};
+    },
+    [&](const Select& op) -> std::optional<AnyDirective> {
+      const auto target = ConstantTarget(op);
+      if (!target) return {};
+      return UnconditionalBranch{target};
+    },
+    [&]<typename D>(const D& op) -> std::optional<AnyDirective> {
+      // calls can never be replaced, as they may have side effects
+      if constexpr(cotyl::pack_contains_v<D, calyx::detail::expr_pack>) {
+        using result_t = typename D::result_t;
+        if constexpr(!std::is_same_v<result_t, Pointer>) {
+          const auto value = Value(op.idx);
+          if (value.IsConstant()) {
+            return Imm<result_t>{op.idx, value.template Get<result_t>()};
+          }
+        }
+      }
+      return {};
+    }
+  );
+}
+
+std::size_t SCCP::Run() {
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type == Local::Type::Aggregate) continue;
+    if (!deps.local_graph.at(loc_idx).aliased_by.empty()) continue;
+    tracked.insert(loc_idx);
+  }
+
+  // values of arguments and uninitialized locals are unknown
+  auto initial = LocalState{};
+  for (const auto& loc_idx : tracked) {
+    initial.emplace(loc_idx, Lattice::Bottom());
+  }
+  Flow(Function::Entry, initial);
+
+  while (!todo.empty()) {
+    const auto block_idx = todo.back();
+    todo.pop_back();
+    in_todo.erase(block_idx);
+    Visit(block_idx);
+  }
+
+  std::size_t changed = 0;
+  for (auto& [block_idx, block] : function.blocks) {
+    if (!entry.contains(block_idx)) continue;
+    for (u64 i = 0; i < block.size(); i++) {
+      auto replacement = Replacement(block.at(i));
+      if (!replacement.has_value()) continue;
+
+      const auto pos = func_pos_t{block_idx, i};
+      deps.RemoveDirective(block.at(i), pos);
+      replacement->visit<void>([&]<typename D>(D& repl) {
+        block.at(i).template emplace<D>(std::move(repl));
+      });
+      deps.AddDirective(block.at(i), pos);
+      changed++;
+    }
+  }
+
+  // remove blocks that are never executed
+  cotyl::vector<block_label_t> unreachable{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    if (!entry.contains(block_idx)) {
+      unreachable.push_back(block_idx);
+    }
+  }
+
+  for (const auto& block_idx : unreachable) {
+    const auto& block = function.blocks.at(block_idx);
+    for (u64 i = 0; i < block.size(); i++) {
+      deps.RemoveDirective(block.at(i), {block_idx, i});
+    }
+  }
+  for (const auto& block_idx : unreachable) {
+    auto& node = deps.block_graph[block_idx];
+    cotyl::Assert(node.from.empty() && node.to.empty(), "Unreachable block is still linked");
+    deps.block_graph.Erase(block_idx);
+    function.blocks.erase(block_idx);
+    changed++;
+  }
+  return changed;
+}
+
+}
+
+std::size_t PropagateConstants(Function& function, FunctionDependencies& deps) {
+  return SCCP(function, deps).Run();
+}
+
+}
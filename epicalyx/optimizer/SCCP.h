@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Sparse conditional constant propagation (Wegman / Zadeck).
+ * Every var is assigned a lattice value (unknown, constant or varying),
+ * only considering blocks that are reachable through branches that may
+ * actually be taken. Locals whose address is never taken are tracked
+ * through the function as well, their values at block entry are the meet
+ * of the values at the end of all executable predecessors.
+ * Afterwards, constant expressions are replaced by immediates, branches
+ * with a constant condition become unconditional, and blocks that are never
+ * executed are removed. The dependencies are kept up to date.
+ * Returns the number of replaced directives and removed blocks.
+ * */
+std::size_t PropagateConstants(calyx::Function& function, FunctionDependencies& deps);
+
+}
@@ -0,0 +1,214 @@
+#include "ScalarReplacement.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include "Exceptions.h"
+
+#include <map>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// aggregates with more accessed fields than this are kept in memory
+constexpr std::size_t MaxFields = 64;
+
+struct Field {
+  Local::Type type;
+  u64 size;
+  loc_index_t loc_idx = 0;
+};
+
+struct Split {
+  loc_index_t loc_idx;
+
+  // accessed fields by offset
+  std::map<i64, Field> fields{};
+
+  // directives accessing a field, with the offset of the field
+  cotyl::vector<std::pair<func_pos_t, i64>> accesses{};
+
+  // directives computing an address in the aggregate
+  cotyl::vector<func_pos_t> addresses{};
+};
+
+struct ScalarReplacement {
+  ScalarReplacement(Function& function, FunctionDependencies& deps) :
+      function{function}, deps{deps} {
+    for (const auto& [loc_idx, local] : function.locals) {
+      next_loc = std::max(next_loc, loc_idx + 1);
+    }
+  }
+
+  std::size_t Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+  loc_index_t next_loc = 1;
+
+  AnyDirective& At(func_pos_t pos) { return function.blocks.at(pos.first).at(pos.second); }
+  const AnyDirective& At(func_pos_t pos) const { return function.blocks.at(pos.first).at(pos.second); }
+
+  // all accesses to the aggregate, nullopt if it cannot be split
+  std::optional<Split> Analyze(loc_index_t loc_idx, const Local& local) const;
+  void Apply(Split& split);
+  void Replace(func_pos_t pos, AnyDirective&& replacement);
+
+  template<typename T>
+  static bool AddField(Split& split, func_pos_t pos, i64 offset) {
+    const auto type = Local::TypeOf<T>();
+    split.accesses.emplace_back(pos, offset);
+    const auto [it, inserted] = split.fields.emplace(offset, Field{type, sizeof(T)});
+    return inserted || it->second.type == type;
+  }
+};
+
+std::optional<Split> ScalarReplacement::Analyze(loc_index_t loc_idx, const Local& local) const {
+  if (!deps.local_graph.contains(loc_idx)) return {};
+  const auto& local_deps = deps.local_graph.at(loc_idx);
+  auto split = Split{loc_idx};
+
+  // addresses into the aggregate, with their offset
+  cotyl::vector<std::pair<var_index_t, i64>> addresses{};
+
+  cotyl::vector<func_pos_t> direct{local_deps.reads.begin(), local_deps.reads.end()};
+  direct.insert(direct.end(), local_deps.writes.begin(), local_deps.writes.end());
+  for (const auto& pos : direct) {
+    const auto valid = At(pos).visit<bool>(
+      [&]<typename T>(const LoadLocal<T>& load) {
+        return AddField<T>(split, pos, load.offset);
+      },
+      [&]<typename T>(const StoreLocal<T>& store) {
+        return AddField<T>(split, pos, store.offset);
+      },
+      [&](const LoadLocalAddr& addr) {
+        split.addresses.push_back(pos);
+        addresses.emplace_back(addr.idx, 0);
+        return true;
+      },
+      [](const auto&) { return false; }
+    );
+    if (!valid) return {};
+  }
+
+  // the address may only be offset by constants and dereferenced
+  while (!addresses.empty()) {
+    const auto [addr_idx, offset] = addresses.back();
+    addresses.pop_back();
+    if (!deps.var_graph.contains(addr_idx)) continue;
+
+    for (const auto& pos : deps.var_graph.at(addr_idx).reads) {
+      const auto valid = At(pos).visit<bool>(
+        [&]<typename T>(const LoadFromPointer<T>& load) {
+          return AddField<T>(split, pos, offset + load.offset);
+        },
+        [&]<typename T>(const StoreToPointer<T>& store) {
+          // storing the address itself makes it escape
+          if (store.ptr_idx != addr_idx) return false;
+          if (store.src.IsVar() && store.src.GetVar() == addr_idx) return false;
+          return AddField<T>(split, pos, offset + store.offset);
+        },
+        [&]<typename T>(const AddToPointer<T>& add) {
+          if (!add.ptr.IsVar() || add.ptr.GetVar() != addr_idx || !add.right.IsScalar()) return false;
+          split.addresses.push_back(pos);
+          addresses.emplace_back(add.idx, offset + (i64)add.stride * (i64)add.right.GetScalar());
+          return true;
+        },
+        [](const auto&) { return false; }
+      );
+      if (!valid) return {};
+    }
+  }
+
+  if (split.fields.empty() || split.fields.size() > MaxFields) return {};
+
+  // fields may not overlap, and must lie within the aggregate
+  i64 end = 0;
+  for (const auto& [offset, field] : split.fields) {
+    if (offset < end) return {};
+    end = offset + field.size;
+  }
+  if (end > (i64)local.aggregate.size) return {};
+  return split;
+}
+
+void ScalarReplacement::Replace(func_pos_t pos, AnyDirective&& replacement) {
+  deps.RemoveDirective(At(pos), pos);
+  replacement.visit<void>([&]<typename D>(D& repl) {
+    At(pos).template emplace<D>(std::move(repl));
+  });
+  deps.AddDirective(At(pos), pos);
+}
+
+void ScalarReplacement::Apply(Split& split) {
+  for (auto& [offset, field] : split.fields) {
+    field.loc_idx = next_loc++;
+    if (field.type == Local::Type::Pointer) {
+      // the stride of the pointer is not known, it is only
+      // used when the pointer is loaded from a variable
+      function.locals.emplace(field.loc_idx, Local::Pointer(field.loc_idx, 1));
+    }
+    else {
+      function.locals.emplace(field.loc_idx, Local{field.type, field.loc_idx});
+    }
+    deps.AddLocal(field.loc_idx);
+  }
+
+  for (const auto& [pos, offset] : split.accesses) {
+    const auto loc_idx = split.fields.at(offset).loc_idx;
+    auto replacement = At(pos).visit<AnyDirective>(
+      [&]<typename T>(const LoadLocal<T>& load) -> AnyDirective {
+        return LoadLocal<T>{load.idx, loc_idx};
+      },
+      [&]<typename T>(const LoadFromPointer<T>& load) -> AnyDirective {
+        return LoadLocal<T>{load.idx, loc_idx};
+      },
+      [&]<typename T>(const StoreLocal<T>& store) -> AnyDirective {
+        return StoreLocal<T>{loc_idx, store.src};
+      },
+      [&]<typename T>(const StoreToPointer<T>& store) -> AnyDirective {
+        return StoreLocal<T>{loc_idx, store.src};
+      },
+      [](const auto&) -> AnyDirective {
+        throw cotyl::UnreachableException();
+      }
+    );
+    Replace(pos, std::move(replacement));
+  }
+
+  // addresses are no longer used
+  for (const auto& pos : split.addresses) {
+    Replace(pos, NoOp{});
+  }
+
+  function.locals.erase(split.loc_idx);
+  deps.local_graph.erase(split.loc_idx);
+}
+
+std::size_t ScalarReplacement::Run() {
+  cotyl::vector<Split> splits{};
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type != Local::Type::Aggregate) continue;
+    auto split = Analyze(loc_idx, local);
+    if (split.has_value()) splits.push_back(std::move(split.value()));
+  }
+
+  // accesses to different aggregates never overlap
+  for (auto& split : splits) {
+    Apply(split);
+  }
+  return splits.size();
+}
+
+}
+
+std::size_t ReplaceAggregates(Function& function, FunctionDependencies& deps) {
+  return ScalarReplacement(function, deps).Run();
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Scalar replacement of aggregates.
+ * Aggregate locals are split into one scalar local per accessed field,
+ * if every access is at a constant offset: either directly with a
+ * LoadLocal / StoreLocal offset, or through the address of the local,
+ * possibly offset by AddToPointer with a constant, that is only ever
+ * dereferenced. If the address is used in any other way (passed to a call,
+ * stored, compared, indexed with a variable...), it escapes, and the local
+ * is left alone. Fields are identified by their offset and type, locals
+ * that are accessed with overlapping fields are not split.
+ * The new locals are treated like any other scalar local by later passes.
+ * The dependencies are kept up to date.
+ * Returns the number of split aggregates.
+ * */
+std::size_t ReplaceAggregates(calyx::Function& function, FunctionDependencies& deps);
+
+}
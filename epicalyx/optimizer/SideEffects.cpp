@@ -0,0 +1,191 @@
+#include "SideEffects.h"
+#include "ProgramDependencies.h"
+#include "PointsTo.h"
+#include "calyx/Calyx.h"
+
+#include <algorithm>
+
+
+namespace epi {
+
+using namespace calyx;
+
+bool FunctionEffects::Merge(const FunctionEffects& other) {
+  bool changed = false;
+  if (other.kind > kind) {
+    kind = other.kind;
+    changed = true;
+  }
+  if (kind == Kind::Unknown) {
+    // written globals are irrelevant
+    changed |= !globals.empty();
+    globals.clear();
+  }
+  else {
+    for (const auto& symbol : other.globals) {
+      changed |= globals.insert(symbol).second;
+    }
+  }
+  if (returns && !other.returns) {
+    returns = false;
+    changed = true;
+  }
+  return changed;
+}
+
+namespace {
+
+const auto UnknownEffects = FunctionEffects{.kind = FunctionEffects::Kind::Unknown, .returns = false};
+
+// whether there is a cycle in the blocks reachable from the entry
+bool HasLoop(const FunctionDependencies& deps) {
+  enum class State { Visiting, Done };
+  cotyl::unordered_map<block_label_t, State> state{};
+
+  const auto visit = [&](const auto& self, block_label_t block_idx) -> bool {
+    state.emplace(block_idx, State::Visiting);
+    for (const auto& to : deps.block_graph.At(block_idx).to) {
+      if (!state.contains(to)) {
+        if (self(self, to)) return true;
+      }
+      else if (state.at(to) == State::Visiting) {
+        return true;
+      }
+    }
+    state.at(block_idx) = State::Done;
+    return false;
+  };
+  return visit(visit, Function::Entry);
+}
+
+// effects of a function by itself, and the functions it calls
+std::pair<FunctionEffects, cotyl::unordered_set<cotyl::CString>> LocalEffects(const Function& function) {
+  const auto deps = FunctionDependencies::GetDependencies(function);
+  const auto points_to = PointsTo(function, deps);
+
+  auto effects = FunctionEffects{};
+  auto callees = cotyl::unordered_set<cotyl::CString>{};
+  effects.returns = !HasLoop(deps);
+
+  const auto read = FunctionEffects{.kind = FunctionEffects::Kind::ReadOnly};
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (const auto& directive : block) {
+      directive.visit<void>(
+        [&]<typename T>(const LoadGlobal<T>& op) {
+          effects.Merge(read);
+        },
+        [&]<typename T>(const StoreGlobal<T>& op) {
+          auto write = FunctionEffects{.kind = FunctionEffects::Kind::WritesGlobals};
+          write.globals.insert(op.symbol);
+          effects.Merge(write);
+        },
+        [&]<typename T>(const LoadFromPointer<T>& op) {
+          if (!points_to.OnlyLocals(op.ptr_idx)) {
+            effects.Merge(read);
+          }
+        },
+        [&]<typename T>(const StoreToPointer<T>& op) {
+          if (!points_to.OnlyLocals(op.ptr_idx)) {
+            effects.Merge(UnknownEffects);
+          }
+        },
+        [&]<typename T>(const Call<T>& op) {
+          effects.Merge(UnknownEffects);
+        },
+        [&]<typename T>(const CallLabel<T>& op) {
+          callees.insert(op.label);
+        },
+        [](const auto&) { }
+      );
+    }
+  }
+  return {std::move(effects), std::move(callees)};
+}
+
+}
+
+SideEffects::SideEffects(const Program& program) {
+  cotyl::unordered_map<cotyl::CString, cotyl::unordered_set<cotyl::CString>> calls{};
+  for (const auto& [symbol, function] : program.functions) {
+    auto [effects, callees] = LocalEffects(function);
+    functions.emplace(symbol, std::move(effects));
+    calls.emplace(symbol, std::move(callees));
+  }
+
+  // Tarjan's algorithm, components are found bottom up,
+  // i.e. all callees are done before their callers
+  struct Node {
+    std::size_t index;
+    std::size_t lowlink;
+    bool on_stack;
+  };
+  cotyl::unordered_map<cotyl::CString, Node> nodes{};
+  cotyl::vector<cotyl::CString> stack{};
+
+  const auto component = [&](cotyl::vector<cotyl::CString>&& scc) {
+    const auto recursive = scc.size() > 1 || calls.at(scc.front()).contains(scc.front());
+
+    // effects within a component depend on each other
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (const auto& symbol : scc) {
+        auto& effects = functions.at(symbol);
+        if (recursive) {
+          changed |= effects.Merge(FunctionEffects{.returns = false});
+        }
+        for (const auto& callee : calls.at(symbol)) {
+          changed |= effects.Merge(Get(callee));
+        }
+      }
+    }
+  };
+
+  const auto visit = [&](const auto& self, const cotyl::CString& symbol) -> void {
+    const auto index = nodes.size();
+    nodes.emplace(symbol, Node{index, index, true});
+    stack.push_back(symbol);
+
+    for (const auto& callee : calls.at(symbol)) {
+      if (!functions.contains(callee)) continue;
+      if (!nodes.contains(callee)) {
+        self(self, callee);
+        nodes.at(symbol).lowlink = std::min(nodes.at(symbol).lowlink, nodes.at(callee).lowlink);
+      }
+      else if (nodes.at(callee).on_stack) {
+        nodes.at(symbol).lowlink = std::min(nodes.at(symbol).lowlink, nodes.at(callee).index);
+      }
+    }
+
+    if (nodes.at(symbol).lowlink == nodes.at(symbol).index) {
+      cotyl::vector<cotyl::CString> scc{};
+      do {
+        scc.push_back(std::move(stack.back()));
+        stack.pop_back();
+        nodes.at(scc.back()).on_stack = false;
+      } while (!(scc.back() == symbol));
+      component(std::move(scc));
+    }
+  };
+
+  for (const auto& [symbol, function] : program.functions) {
+    if (!nodes.contains(symbol)) {
+      visit(visit, symbol);
+    }
+  }
+}
+
+const SideEffects& SideEffects::None() {
+  static const auto none = SideEffects{};
+  return none;
+}
+
+const FunctionEffects& SideEffects::Get(const cotyl::CString& symbol) const {
+  if (!functions.contains(symbol)) {
+    // function outside of the program
+    return UnknownEffects;
+  }
+  return functions.at(symbol);
+}
+
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "calyx/CalyxFwd.h"
+#include "Containers.h"
+#include "CString.h"
+
+
+namespace epi {
+
+struct FunctionEffects {
+  // ordered from least to most side effects
+  enum class Kind {
+    Pure,           // never accesses memory outside of its own locals
+    ReadOnly,       // may read any memory, never writes memory
+    WritesGlobals,  // may read any memory, only writes the globals below
+    Unknown,        // may read or write any memory
+  } kind = Kind::Pure;
+
+  // globals that are directly written, for WritesGlobals
+  cotyl::unordered_set<cotyl::CString> globals{};
+
+  // function contains no loops, recursion or calls to functions
+  // that may not return, so it always returns
+  bool returns = true;
+
+  // returns whether anything changed
+  bool Merge(const FunctionEffects& other);
+
+  bool ReadsMemory() const { return kind != Kind::Pure; }
+  bool WritesMemory() const { return kind >= Kind::WritesGlobals; }
+
+  // calls of which the result is unused may be removed altogether
+  bool Removable() const { return !WritesMemory() && returns; }
+};
+
+/*
+ * Interprocedural side effect summaries for all functions in a program.
+ * Every function is first summarized on its own: global loads and stores,
+ * and pointer accesses that may not be to its own locals (using the
+ * points-to analysis), where a store through such a pointer has unknown
+ * effects. The call graph is then walked bottom up, per strongly connected
+ * component, merging in the summaries of the callees. Indirect calls and
+ * calls to functions outside the program have unknown effects.
+ * */
+struct SideEffects {
+  // nothing is known about any function
+  SideEffects() = default;
+  explicit SideEffects(const calyx::Program& program);
+
+  static const SideEffects& None();
+
+  // effects of calling a function by its symbol
+  const FunctionEffects& Get(const cotyl::CString& symbol) const;
+
+private:
+  cotyl::unordered_map<cotyl::CString, FunctionEffects> functions{};
+};
+
+}
@@ -0,0 +1,404 @@
+#include "SimplifyCFG.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+#include "calyx/Fields.h"
+
+#include "Exceptions.h"
+#include "Is.h"
+
+#include <algorithm>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+template<typename T>
+static constexpr bool is_foldable_v = cotyl::pack_contains_v<T, calyx_integral_types>;
+
+// replace all references to a block in a branch
+struct RetargetBlock {
+  block_label_t from;
+  block_label_t to;
+
+  void Var(var_index_t&) { }
+  void Local(loc_index_t&) { }
+  void Block(block_label_t& block_idx) { if (block_idx == from) block_idx = to; }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // select tables are shared with copies of the function
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+};
+
+struct CFGSimplifier {
+  CFGSimplifier(Function& function, FunctionDependencies& deps) :
+      function{function}, deps{deps} {
+
+  }
+
+  std::size_t Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+  cotyl::unordered_map<block_label_t, cotyl::vector<block_label_t>> predecessors{};
+
+  // the number of directives that are executed in a block,
+  // the last one is the branch or return ending it
+  static u64 Executed(const BasicBlock& block);
+  static AnyDirective& Terminator(BasicBlock& block) { return block.at(Executed(block) - 1); }
+  static cotyl::vector<block_label_t> Successors(const BasicBlock& block);
+  void ComputePredecessors();
+  cotyl::vector<block_label_t> SortedBlocks() const;
+
+  // value of a var, if it is an integer immediate
+  std::optional<i64> ImmValue(var_index_t var_idx) const;
+
+  // value of a local at the end of a block, if it is stored
+  // to in that block with an integer immediate
+  std::optional<i64> StoredValue(const BasicBlock& block, loc_index_t loc_idx) const;
+
+  // destination of a branch in a block, if it only depends on loaded
+  // locals with a known value at the end of some predecessor
+  block_label_t ThreadedTarget(const BasicBlock& block, const BasicBlock& pred) const;
+
+  void Retarget(BasicBlock& block, block_label_t from, block_label_t to);
+
+  std::size_t FoldBranches();
+  std::size_t ThreadJumps();
+  std::size_t ForwardEmptyBlocks();
+  std::size_t RemoveUnreachable();
+  std::size_t MergeBlocks();
+};
+
+u64 CFGSimplifier::Executed(const BasicBlock& block) {
+  for (u64 i = 0; i < block.size(); i++) {
+    const bool end = block.at(i).visit<bool>(
+      [](const Select&) { return true; },
+      [](const UnconditionalBranch&) { return true; },
+      []<typename T>(const BranchCompare<T>&) { return true; },
+      []<typename T>(const Return<T>&) { return true; },
+      [](const auto&) { return false; }
+    );
+    if (end) return i + 1;
+  }
+  throw cotyl::UnreachableException();
+}
+
+cotyl::vector<block_label_t> CFGSimplifier::Successors(const BasicBlock& block) {
+  cotyl::vector<block_label_t> successors{};
+  block.at(Executed(block) - 1).visit<void>(
+    [&](const Select& select) {
+      for (const auto& [value, dest] : *select.table) {
+        successors.push_back(dest);
+      }
+      if (select._default) {
+        successors.push_back(select._default);
+      }
+    },
+    [&](const UnconditionalBranch& branch) {
+      successors.push_back(branch.dest);
+    },
+    [&]<typename T>(const BranchCompare<T>& branch) {
+      successors.push_back(branch.tdest);
+      successors.push_back(branch.fdest);
+    },
+    [](const auto&) { }
+  );
+  return successors;
+}
+
+void CFGSimplifier::ComputePredecessors() {
+  predecessors.clear();
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (const auto& succ : Successors(block)) {
+      predecessors[succ].push_back(block_idx);
+    }
+  }
+}
+
+cotyl::vector<block_label_t> CFGSimplifier::SortedBlocks() const {
+  cotyl::vector<block_label_t> blocks{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    blocks.push_back(block_idx);
+  }
+  std::sort(blocks.begin(), blocks.end());
+  return blocks;
+}
+
+std::optional<i64> CFGSimplifier::ImmValue(var_index_t var_idx) const {
+  if (!deps.var_graph.contains(var_idx)) return {};
+  const auto pos = deps.var_graph.at(var_idx).created;
+  if (!function.blocks.contains(pos.first)) return {};
+  return function.blocks.at(pos.first).at(pos.second).visit<std::optional<i64>>(
+    [&]<typename T>(const Imm<T>& imm) -> std::optional<i64> {
+      if constexpr(is_foldable_v<T>) {
+        if (imm.idx == var_idx) return (i64)imm.value;
+      }
+      return {};
+    },
+    [](const auto&) -> std::optional<i64> { return {}; }
+  );
+}
+
+std::optional<i64> CFGSimplifier::StoredValue(const BasicBlock& block, loc_index_t loc_idx) const {
+  for (u64 i = Executed(block) - 1; i > 0; i--) {
+    std::optional<std::optional<i64>> stored = block.at(i - 1).visit<std::optional<std::optional<i64>>>(
+      [&]<typename T>(const StoreLocal<T>& store) -> std::optional<std::optional<i64>> {
+        if (store.loc_idx != loc_idx) return {};
+        if constexpr(is_foldable_v<T>) {
+          if (store.offset != 0) return std::optional<i64>{};
+          if (store.src.IsScalar()) return std::optional<i64>{(i64)store.src.GetScalar()};
+          return ImmValue(store.src.GetVar());
+        }
+        return std::optional<i64>{};
+      },
+      [](const auto&) -> std::optional<std::optional<i64>> { return {}; }
+    );
+    if (stored.has_value()) return stored.value();
+  }
+  return {};
+}
+
+block_label_t CFGSimplifier::ThreadedTarget(const BasicBlock& block, const BasicBlock& pred) const {
+  cotyl::unordered_map<var_index_t, i64> values{};
+  const auto value = [&](var_index_t var_idx) -> std::optional<i64> {
+    if (values.contains(var_idx)) return values.at(var_idx);
+    return ImmValue(var_idx);
+  };
+
+  const auto end = Executed(block);
+  for (u64 i = 0; i < end; i++) {
+    const auto target = block.at(i).visit<std::optional<block_label_t>>(
+      [](const NoOp&) -> std::optional<block_label_t> { return {}; },
+      [&]<typename T>(const Imm<T>& imm) -> std::optional<block_label_t> {
+        if constexpr(is_foldable_v<T>) {
+          values.emplace(imm.idx, (i64)imm.value);
+          return {};
+        }
+        return 0;
+      },
+      [&]<typename T>(const LoadLocal<T>& load) -> std::optional<block_label_t> {
+        if constexpr(is_foldable_v<T>) {
+          const auto& local_deps = deps.local_graph.at(load.loc_idx);
+          if (load.offset != 0 || !local_deps.aliased_by.empty() || local_deps.needs_address) return 0;
+          const auto stored = StoredValue(pred, load.loc_idx);
+          if (!stored.has_value()) return 0;
+          values.emplace(load.idx, stored.value());
+          return {};
+        }
+        return 0;
+      },
+      [&]<typename T>(const BranchCompare<T>& branch) -> std::optional<block_label_t> {
+        if constexpr(is_foldable_v<T>) {
+          const auto left = value(branch.left_idx);
+          const auto right = branch.right.IsVar() ? value(branch.right.GetVar()) : std::optional<i64>{(i64)branch.right.GetScalar()};
+          if (!left.has_value() || !right.has_value()) return 0;
+          return FoldCompare((T)left.value(), branch.op, (T)right.value()) ? branch.tdest : branch.fdest;
+        }
+        return 0;
+      },
+      [](const auto&) -> std::optional<block_label_t> { return 0; }
+    );
+    if (target.has_value()) return target.value();
+  }
+  return 0;
+}
+
+void CFGSimplifier::Retarget(BasicBlock& block, block_label_t from, block_label_t to) {
+  auto retarget = RetargetBlock{from, to};
+  VisitFields(Terminator(block), retarget);
+}
+
+std::size_t CFGSimplifier::FoldBranches() {
+  std::size_t changed = 0;
+  for (auto& [block_idx, block] : function.blocks) {
+    auto& terminator = Terminator(block);
+    const auto target = terminator.visit<block_label_t>(
+      [&]<typename T>(const BranchCompare<T>& branch) -> block_label_t {
+        if (branch.tdest == branch.fdest) return branch.tdest;
+        if constexpr(is_foldable_v<T>) {
+          const auto left = ImmValue(branch.left_idx);
+          const auto right = branch.right.IsVar() ? ImmValue(branch.right.GetVar()) : std::optional<i64>{(i64)branch.right.GetScalar()};
+          if (left.has_value() && right.has_value()) {
+            return FoldCompare((T)left.value(), branch.op, (T)right.value()) ? branch.tdest : branch.fdest;
+          }
+        }
+        return 0;
+      },
+      [&](const Select& select) -> block_label_t {
+        const auto value = ImmValue(select.idx);
+        if (!value.has_value()) return 0;
+        if (select.table->contains(value.value())) return select.table->at(value.value());
+        return select._default;
+      },
+      [](const auto&) -> block_label_t { return 0; }
+    );
+
+    if (target) {
+      terminator.emplace<UnconditionalBranch>(UnconditionalBranch{target});
+      changed++;
+    }
+  }
+  return changed;
+}
+
+std::size_t CFGSimplifier::ThreadJumps() {
+  ComputePredecessors();
+  std::size_t changed = 0;
+  for (const auto& block_idx : SortedBlocks()) {
+    if (!predecessors.contains(block_idx)) continue;
+    const auto& block = function.blocks.at(block_idx);
+
+    // vars created in the block may not be used anywhere else,
+    // as the block is skipped when threading
+    bool local_vars = true;
+    for (u64 i = 0; i < Executed(block) && local_vars; i++) {
+      block.at(i).visit<void>(
+        [&]<typename D>(const D& directive) {
+          if constexpr(std::is_base_of_v<Expr, D>) {
+            if (!deps.var_graph.contains(directive.idx)) return;
+            for (const auto& pos : deps.var_graph.at(directive.idx).reads) {
+              if (pos.first != block_idx) local_vars = false;
+            }
+          }
+        }
+      );
+    }
+    if (!local_vars) continue;
+
+    for (const auto& pred_idx : predecessors.at(block_idx)) {
+      if (pred_idx == block_idx) continue;
+      auto& pred = function.blocks.at(pred_idx);
+      const auto target = ThreadedTarget(block, pred);
+      if (!target || target == block_idx) continue;
+      Retarget(pred, block_idx, target);
+      changed++;
+    }
+  }
+  return changed;
+}
+
+std::size_t CFGSimplifier::ForwardEmptyBlocks() {
+  cotyl::unordered_map<block_label_t, block_label_t> forward{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    if (block_idx == Function::Entry) continue;
+    const auto end = Executed(block);
+    bool empty = true;
+    for (u64 i = 0; i < end - 1; i++) {
+      if (!IsType<NoOp>(block.at(i))) empty = false;
+    }
+    if (!empty) continue;
+    if (IsType<UnconditionalBranch>(block.at(end - 1))) {
+      const auto dest = block.at(end - 1).get<UnconditionalBranch>().dest;
+      if (dest != block_idx) forward.emplace(block_idx, dest);
+    }
+  }
+
+  // final destination of a chain of empty blocks, 0 for cycles
+  const auto destination = [&](block_label_t block_idx) -> block_label_t {
+    cotyl::unordered_set<block_label_t> visited{};
+    while (forward.contains(block_idx)) {
+      if (!visited.insert(block_idx).second) return 0;
+      block_idx = forward.at(block_idx);
+    }
+    return block_idx;
+  };
+
+  std::size_t changed = 0;
+  for (auto& [block_idx, block] : function.blocks) {
+    for (const auto& succ : Successors(block)) {
+      if (!forward.contains(succ)) continue;
+      const auto dest = destination(succ);
+      if (!dest) continue;
+      Retarget(block, succ, dest);
+      changed++;
+    }
+  }
+  return changed;
+}
+
+std::size_t CFGSimplifier::RemoveUnreachable() {
+  cotyl::unordered_set<block_label_t> reachable{Function::Entry};
+  cotyl::vector<block_label_t> todo{Function::Entry};
+  while (!todo.empty()) {
+    const auto block_idx = todo.back();
+    todo.pop_back();
+    for (const auto& succ : Successors(function.blocks.at(block_idx))) {
+      if (reachable.insert(succ).second) todo.push_back(succ);
+    }
+  }
+
+  cotyl::vector<block_label_t> unreachable{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    if (!reachable.contains(block_idx)) unreachable.push_back(block_idx);
+  }
+  for (const auto& block_idx : unreachable) {
+    function.blocks.erase(block_idx);
+  }
+  return unreachable.size();
+}
+
+std::size_t CFGSimplifier::MergeBlocks() {
+  ComputePredecessors();
+  std::size_t changed = 0;
+  for (const auto& block_idx : SortedBlocks()) {
+    if (!function.blocks.contains(block_idx)) continue;
+    auto& block = function.blocks.at(block_idx);
+    while (true) {
+      const auto end = Executed(block);
+      if (!IsType<UnconditionalBranch>(block.at(end - 1))) break;
+      const auto succ_idx = block.at(end - 1).get<UnconditionalBranch>().dest;
+      if (succ_idx == block_idx || succ_idx == Function::Entry) break;
+      if (predecessors.at(succ_idx).size() != 1) break;
+
+      // drop the branch, and anything after it
+      while (block.size() >= end) block.pop_back();
+      auto& succ = function.blocks.at(succ_idx);
+      const auto succ_end = Executed(succ);
+      for (u64 i = 0; i < succ_end; i++) {
+        block.push_back(std::move(succ.at(i)));
+      }
+      function.blocks.erase(succ_idx);
+
+      for (const auto& next : Successors(block)) {
+        std::replace(predecessors.at(next).begin(), predecessors.at(next).end(), succ_idx, block_idx);
+      }
+      changed++;
+    }
+  }
+  return changed;
+}
+
+std::size_t CFGSimplifier::Run() {
+  std::size_t total = 0;
+  while (true) {
+    // directives are only moved when merging blocks, the
+    // dependencies are recomputed after every round
+    std::size_t changed = 0;
+    changed += FoldBranches();
+    changed += ThreadJumps();
+    changed += ForwardEmptyBlocks();
+    changed += RemoveUnreachable();
+    changed += MergeBlocks();
+    if (!changed) break;
+
+    total += changed;
+    deps = FunctionDependencies::GetDependencies(function);
+  }
+  return total;
+}
+
+}
+
+std::size_t SimplifyCFG(Function& function, FunctionDependencies& deps) {
+  return CFGSimplifier(function, deps).Run();
+}
+
+}
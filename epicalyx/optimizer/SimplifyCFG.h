@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Control flow graph simplification, repeated until nothing changes:
+ *  - branches with a constant condition (BranchCompare on immediates,
+ *    or a Select on an immediate) become unconditional
+ *  - jumps are threaded through blocks that only load some (non-aliased)
+ *    locals and branch on them, if the values of these locals are known
+ *    at the end of the predecessor, from stores of immediates
+ *  - branches to empty blocks (containing only an unconditional branch)
+ *    are forwarded to the destination of that block
+ *  - blocks that are unreachable from the entry block are removed
+ *  - blocks with a single successor are merged with that successor,
+ *    if it has no other predecessors
+ * The dependencies are recomputed if anything changed.
+ * Returns the number of changes.
+ * */
+std::size_t SimplifyCFG(calyx::Function& function, FunctionDependencies& deps);
+
+}
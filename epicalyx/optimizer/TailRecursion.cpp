@@ -0,0 +1,182 @@
+#include "TailRecursion.h"
+#include "ProgramDependencies.h"
+#include "calyx/Calyx.h"
+
+#include "Exceptions.h"
+#include "Is.h"
+
+#include <algorithm>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+struct TailCall {
+  block_label_t block_idx;
+  u64 call;
+  u64 ret;
+  var_index_t result;
+  std::shared_ptr<ArgData> args;
+};
+
+// store of an argument into its local, with the memory type of the local
+AnyDirective StoreArg(const Local& local, var_index_t var_idx) {
+  switch (local.type) {
+    case Local::Type::I8: return StoreLocal<i8>{local.idx, var_idx};
+    case Local::Type::U8: return StoreLocal<u8>{local.idx, var_idx};
+    case Local::Type::I16: return StoreLocal<i16>{local.idx, var_idx};
+    case Local::Type::U16: return StoreLocal<u16>{local.idx, var_idx};
+    case Local::Type::I32: return StoreLocal<i32>{local.idx, var_idx};
+    case Local::Type::U32: return StoreLocal<u32>{local.idx, var_idx};
+    case Local::Type::I64: return StoreLocal<i64>{local.idx, var_idx};
+    case Local::Type::U64: return StoreLocal<u64>{local.idx, var_idx};
+    case Local::Type::Float: return StoreLocal<float>{local.idx, var_idx};
+    case Local::Type::Double: return StoreLocal<double>{local.idx, var_idx};
+    case Local::Type::Pointer: return StoreLocal<Pointer>{local.idx, var_idx};
+    case Local::Type::Aggregate: break;
+  }
+  throw cotyl::UnreachableException();
+}
+
+struct TailRecursion {
+  TailRecursion(Function& function, FunctionDependencies& deps) :
+      function{function}, deps{deps} {
+
+  }
+
+  std::size_t Run();
+
+private:
+  Function& function;
+  FunctionDependencies& deps;
+
+  // argument locals by argument index
+  cotyl::unordered_map<u64, const Local*> args{};
+
+  bool IsSelf(var_index_t fn_idx) const;
+
+  // the tail call ending a block, if any
+  std::optional<TailCall> FindTailCall(block_label_t block_idx, const BasicBlock& block) const;
+  bool ValidArgs(const ArgData& call_args) const;
+  void Replace(const TailCall& call, block_label_t header_idx);
+};
+
+bool TailRecursion::IsSelf(var_index_t fn_idx) const {
+  if (!deps.var_graph.contains(fn_idx)) return false;
+  const auto pos = deps.var_graph.at(fn_idx).created;
+  const auto& directive = function.blocks.at(pos.first).at(pos.second);
+  return IsType<LoadGlobalAddr>(directive) && directive.get<LoadGlobalAddr>().symbol == function.symbol;
+}
+
+bool TailRecursion::ValidArgs(const ArgData& call_args) const {
+  if (!call_args.var_args.empty()) return false;
+  return std::all_of(args.begin(), args.end(), [&](const auto& arg) {
+    return arg.first < call_args.args.size();
+  });
+}
+
+std::optional<TailCall> TailRecursion::FindTailCall(block_label_t block_idx, const BasicBlock& block) const {
+  std::optional<TailCall> call{};
+  for (u64 i = 0; i < block.size(); i++) {
+    const auto& directive = block.at(i);
+    if (IsType<NoOp>(directive)) continue;
+
+    if (call.has_value()) {
+      // the call must be directly followed by a return of its result
+      const bool returns_result = directive.visit<bool>(
+        [&]<typename T>(const Return<T>& ret) {
+          if constexpr(std::is_same_v<T, void>) {
+            return true;
+          }
+          else {
+            return ret.val.IsVar() && ret.val.GetVar() == call->result;
+          }
+        },
+        [](const auto&) { return false; }
+      );
+      if (returns_result) {
+        call->ret = i;
+        return call;
+      }
+      call.reset();
+    }
+
+    directive.visit<void>(
+      [&]<typename T>(const CallLabel<T>& op) {
+        if (op.label == function.symbol) call = TailCall{block_idx, i, 0, op.idx, op.args};
+      },
+      [&]<typename T>(const Call<T>& op) {
+        if (IsSelf(op.fn_idx)) call = TailCall{block_idx, i, 0, op.idx, op.args};
+      },
+      [](const auto&) { }
+    );
+  }
+  return {};
+}
+
+void TailRecursion::Replace(const TailCall& call, block_label_t header_idx) {
+  auto& block = function.blocks.at(call.block_idx);
+  block.at(call.call).emplace<NoOp>(NoOp{});
+  block.at(call.ret).emplace<UnconditionalBranch>(UnconditionalBranch{header_idx});
+
+  // all arguments are evaluated before the call, so the locals
+  // can be overwritten in any order
+  u64 pos = call.ret;
+  for (const auto& [arg_idx, local] : args) {
+    block.insert(pos++, StoreArg(*local, call.args->args[arg_idx].first));
+  }
+}
+
+std::size_t TailRecursion::Run() {
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (local.needs_address || !local.aliased_by.empty()) return 0;
+  }
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type != Local::Type::Aggregate && local.non_aggregate.arg_idx.has_value()) {
+      args.emplace(local.non_aggregate.arg_idx.value(), &local);
+    }
+  }
+
+  cotyl::vector<TailCall> calls{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    auto call = FindTailCall(block_idx, block);
+    if (call.has_value() && ValidArgs(*call->args)) {
+      calls.push_back(std::move(call.value()));
+    }
+  }
+  if (calls.empty()) return 0;
+
+  block_label_t header_idx = 0;
+  for (const auto& [block_idx, block] : function.blocks) {
+    header_idx = std::max(header_idx, block_idx);
+  }
+  header_idx++;
+
+  for (const auto& call : calls) {
+    Replace(call, header_idx);
+  }
+
+  // the entry block cannot be branched to, as it is entered
+  // after loading the arguments, so its code is moved to the header
+  auto& header = function.AddBlock(header_idx).second;
+  for (auto& directive : function.blocks.at(Function::Entry)) {
+    header.push_back(std::move(directive));
+  }
+  function.blocks.erase(Function::Entry);
+  function.AddBlock(Function::Entry).second.push_back(UnconditionalBranch{header_idx});
+
+  deps = FunctionDependencies::GetDependencies(function);
+  return calls.size();
+}
+
+}
+
+std::size_t EliminateTailRecursion(Function& function, FunctionDependencies& deps) {
+  return TailRecursion(function, deps).Run();
+}
+
+}
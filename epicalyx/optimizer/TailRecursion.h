@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+/*
+ * Tail recursion elimination.
+ * A tail call is a call of the function to itself (by label, or through
+ * the address of its own symbol), that is directly followed by a return
+ * of its result. The code of the entry block is moved to a new loop header,
+ * and tail calls are replaced by stores of the call arguments into the
+ * argument locals, followed by a branch to that header.
+ * Every call shares the same locals after this, so functions of which
+ * any local has its address taken (which may then still be in use by a
+ * recursive call) are left alone, as are variadic calls.
+ * The dependencies are recomputed if the function changed.
+ * Returns the number of replaced tail calls.
+ * */
+std::size_t EliminateTailRecursion(calyx::Function& function, FunctionDependencies& deps);
+
+}
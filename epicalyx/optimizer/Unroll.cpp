@@ -0,0 +1,420 @@
+#include "Unroll.h"
+#include "ProgramDependencies.h"
+#include "Loops.h"
+#include "calyx/Calyx.h"
+#include "calyx/Fields.h"
+
+#include <algorithm>
+#include <functional>
+#include <optional>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+template<typename T>
+static constexpr bool is_counter_type_v = cotyl::pack_contains_v<T, calyx_integral_types>;
+
+// number of iterations of a loop with a constant initial value,
+// nullopt if it is larger than max, or if a signed counter overflows
+template<typename T>
+std::optional<u32> TripCount(T value, T step, CmpType op, T bound, u32 max) {
+  for (u32 trips = 0; trips <= max; trips++) {
+    if (!FoldCompare(value, op, bound)) return trips;
+    if constexpr(std::is_signed_v<T>) {
+      if (__builtin_add_overflow(value, step, &value)) return {};
+    }
+    else {
+      value += step;
+    }
+  }
+  return {};
+}
+
+// renames vars created in a loop, and the blocks of the loop
+struct LoopCopier {
+  cotyl::unordered_map<var_index_t, var_index_t> vars{};
+  cotyl::unordered_map<block_label_t, block_label_t> blocks{};
+
+  void Var(var_index_t& var_idx) {
+    if (vars.contains(var_idx)) var_idx = vars.at(var_idx);
+  }
+
+  void Local(loc_index_t& loc_idx) { }
+
+  void Block(block_label_t& block_idx) {
+    if (blocks.contains(block_idx)) block_idx = blocks.at(block_idx);
+  }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // shared data is still referenced by the original directive
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+};
+
+struct Unroller {
+  Unroller(Function& function, const FunctionDependencies& deps, const UnrollSettings& settings) :
+      function{function}, deps{deps}, settings{settings}, loops{deps} {
+    for (const auto& [var_idx, var] : deps.var_graph) {
+      next_var = std::max(next_var, var_idx + 1);
+    }
+    for (const auto& [block_idx, block] : function.blocks) {
+      next_block = std::max(next_block, block_idx + 1);
+    }
+  }
+
+  // unroll a single loop, the dependencies are no longer
+  // valid if this returns true
+  bool Run();
+
+private:
+  Function& function;
+  const FunctionDependencies& deps;
+  const UnrollSettings& settings;
+  Loops loops;
+
+  var_index_t next_var = 1;
+  block_label_t next_block = Function::Entry + 1;
+
+  // loop that is being unrolled
+  const Loops::Loop* loop = nullptr;
+  block_label_t preheader = 0;
+  block_label_t body = 0;   // header successor in the loop
+  block_label_t exit = 0;   // header successor outside the loop
+  cotyl::vector<var_index_t> created{};
+  std::size_t size = 0;
+
+  const AnyDirective& At(func_pos_t pos) const { return function.blocks.at(pos.first).at(pos.second); }
+
+  bool IsCountedLoop(const Loops::Loop& loop);
+
+  template<typename T>
+  bool Unroll(func_pos_t load_pos, const BranchCompare<T>& test);
+
+  // constant the counter is initialized with in the preheader
+  template<typename T>
+  std::optional<T> InitialValue(loc_index_t loc_idx) const;
+
+  // copy a single iteration of the loop, branching to next_header
+  // on the back edge, the copy of the header is not terminated
+  LoopCopier CopyIteration(block_label_t header, block_label_t next_header);
+
+  // the loop was unrolled before: it exits to the loop running the
+  // remaining iterations, which uses the same counter
+  bool IsUnrolled(loc_index_t counter) const;
+
+  // var has the same value in every iteration: it is created outside the loop,
+  // or loaded in the header from a local that is not written in the loop
+  bool IsInvariant(var_index_t var_idx) const;
+
+  void FullyUnroll(u32 trips);
+
+  template<typename T>
+  bool PartiallyUnroll(var_index_t value, T step, const BranchCompare<T>& test);
+
+  void Redirect(block_label_t block_idx, block_label_t dest);
+};
+
+bool Unroller::IsCountedLoop(const Loops::Loop& loop) {
+  // the preheader only branches to the loop
+  if (loop.entries.size() != 1) return false;
+  preheader = loop.entries[0];
+  if (!IsType<UnconditionalBranch>(function.blocks.at(preheader).back())) return false;
+  if (loop.latches.size() != 1) return false;
+
+  // the loop can only be exited from the header
+  for (const auto& block_idx : loop.blocks) {
+    if (block_idx == loop.header) continue;
+    for (const auto& to : deps.block_graph.At(block_idx).to) {
+      if (!loop.Contains(to)) return false;
+    }
+  }
+
+  // the header only computes the exit test, the unrolled loop evaluates it
+  // before falling back to the original loop, which evaluates it again
+  const auto& header = function.blocks.at(loop.header);
+  for (std::size_t i = 0; i < header.size() - 1; i++) {
+    const auto pure = header.at(i).visit<bool>(
+      [&]<typename D>(const D& dir) {
+        if constexpr(cotyl::is_instantiation_of_v<Call, D> || cotyl::is_instantiation_of_v<CallLabel, D>) return false;
+        else return std::is_base_of_v<Expr, D> || std::is_same_v<D, NoOp>;
+      }
+    );
+    if (!pure) return false;
+  }
+
+  // vars created in the loop are only used in the loop, copies of the loop
+  // would have to be merged otherwise
+  created.clear();
+  size = 0;
+  for (const auto& block_idx : loop.blocks) {
+    const auto& block = function.blocks.at(block_idx);
+    size += block.size();
+    for (const auto& directive : block) {
+      directive.visit<void>(
+        [&]<typename D>(const D& dir) {
+          if constexpr(std::is_base_of_v<Expr, D>) {
+            created.push_back(dir.idx);
+          }
+        }
+      );
+    }
+  }
+  for (const auto& var_idx : created) {
+    if (!deps.var_graph.contains(var_idx)) continue;
+    for (const auto& pos : deps.var_graph.at(var_idx).reads) {
+      if (!loop.Contains(pos.first)) return false;
+    }
+  }
+  return true;
+}
+
+bool Unroller::Run() {
+  for (const auto& candidate : loops.All()) {
+    if (!IsCountedLoop(candidate)) continue;
+    loop = &candidate;
+
+    // the exit test on the counter
+    std::function<bool()> unroll{};
+    function.blocks.at(loop->header).back().visit<void>(
+      [&]<typename T>(const BranchCompare<T>& test) {
+        if constexpr(is_counter_type_v<T>) {
+          if (!loop->Contains(test.tdest) || loop->Contains(test.fdest)) return;
+          const auto created = deps.var_graph.at(test.left_idx).created;
+          body = test.tdest;
+          exit = test.fdest;
+
+          // the function is only changed after we are done visiting the directive
+          unroll = [=, this] { return Unroll(created, test); };
+        }
+      },
+      [](const auto&) { }
+    );
+    if (unroll && unroll()) return true;
+  }
+  return false;
+}
+
+template<typename T>
+bool Unroller::Unroll(func_pos_t load_pos, const BranchCompare<T>& test) {
+  const auto iv = loops.FindInductionVariable<T>(function, deps, *loop, load_pos);
+  if (!iv.has_value()) return false;
+  if (IsUnrolled(iv->loc_idx)) return false;
+  const auto loc_idx = iv->loc_idx;
+  const auto value = iv->value;
+  const auto step = iv->step;
+
+  if (test.right.IsScalar()) {
+    const auto initial = InitialValue<T>(loc_idx);
+    if (initial.has_value()) {
+      const auto trips = TripCount(initial.value(), step, test.op, test.right.GetScalar(), settings.max_full_trips);
+      if (trips.has_value() && (trips.value() + 1) * size <= settings.budget) {
+        FullyUnroll(trips.value());
+        return true;
+      }
+    }
+  }
+  return PartiallyUnroll(value, step, test);
+}
+
+bool Unroller::IsUnrolled(loc_index_t counter) const {
+  const auto& all = loops.All();
+  const auto is_header = std::any_of(all.begin(), all.end(), [&](const auto& other) {
+    return other.header == exit;
+  });
+  if (!is_header) return false;
+  const auto& block = function.blocks.at(exit);
+  return std::any_of(block.begin(), block.end(), [&](const auto& directive) {
+    return directive.template visit<bool>(
+      [&]<typename T>(const LoadLocal<T>& load) { return load.loc_idx == counter; },
+      [](const auto&) { return false; }
+    );
+  });
+}
+
+bool Unroller::IsInvariant(var_index_t var_idx) const {
+  const auto created = deps.var_graph.at(var_idx).created;
+  if (!created.first) return false;
+  if (!loop->Contains(created.first)) return true;
+  if (created.first != loop->header) return false;
+
+  return At(created).visit<bool>(
+    [&]<typename T>(const LoadLocal<T>& load) {
+      const auto& local_deps = deps.local_graph.at(load.loc_idx);
+      if (!local_deps.aliased_by.empty()) return false;
+      return std::none_of(local_deps.writes.begin(), local_deps.writes.end(), [&](const auto& pos) {
+        return loop->Contains(pos.first);
+      });
+    },
+    [](const auto&) { return false; }
+  );
+}
+
+template<typename T>
+std::optional<T> Unroller::InitialValue(loc_index_t loc_idx) const {
+  const auto& block = function.blocks.at(preheader);
+  for (auto i = (i64)block.size() - 1; i >= 0; i--) {
+    const auto& directive = block.at(i);
+    if (!IsType<StoreLocal<T>>(directive)) continue;
+    const auto& store = directive.template get<StoreLocal<T>>();
+    if (store.loc_idx != loc_idx) continue;
+    if (store.src.IsScalar()) return store.src.GetScalar();
+    const auto created = deps.var_graph.at(store.src.GetVar()).created;
+    if (created.first && IsType<Imm<T>>(At(created))) {
+      return At(created).template get<Imm<T>>().value;
+    }
+    return {};
+  }
+  return {};
+}
+
+LoopCopier Unroller::CopyIteration(block_label_t header, block_label_t next_header) {
+  auto copier = LoopCopier{};
+  for (const auto& var_idx : created) {
+    copier.vars.emplace(var_idx, next_var++);
+  }
+  for (const auto& block_idx : loop->blocks) {
+    if (block_idx != loop->header) copier.blocks.emplace(block_idx, next_block++);
+  }
+  copier.blocks.emplace(loop->header, next_header);
+
+  for (const auto& block_idx : loop->blocks) {
+    const auto& block = function.blocks.at(block_idx);
+    const auto copy_idx = block_idx == loop->header ? header : copier.blocks.at(block_idx);
+    auto& copy = function.blocks.emplace(copy_idx, BasicBlock{}).first->second;
+    copy.reserve(block.size());
+    for (std::size_t i = 0; i < block.size(); i++) {
+      if (block_idx == loop->header && i == block.size() - 1) break;
+      auto directive = block.at(i);
+      VisitFields(directive, copier);
+      copy.push_back(std::move(directive));
+    }
+  }
+  return copier;
+}
+
+void Unroller::FullyUnroll(u32 trips) {
+  cotyl::vector<block_label_t> headers{};
+  for (u32 i = 0; i <= trips; i++) {
+    headers.push_back(next_block++);
+  }
+
+  for (u32 i = 0; i < trips; i++) {
+    auto copier = CopyIteration(headers[i], headers[i + 1]);
+    function.blocks.at(headers[i]).push_back(UnconditionalBranch{copier.blocks.at(body)});
+  }
+
+  // the final test only runs the header
+  auto copier = LoopCopier{};
+  for (const auto& var_idx : created) {
+    copier.vars.emplace(var_idx, next_var++);
+  }
+  const auto& header = function.blocks.at(loop->header);
+  auto& last = function.blocks.emplace(headers[trips], BasicBlock{}).first->second;
+  for (std::size_t i = 0; i < header.size() - 1; i++) {
+    auto directive = header.at(i);
+    VisitFields(directive, copier);
+    last.push_back(std::move(directive));
+  }
+  last.push_back(UnconditionalBranch{exit});
+
+  Redirect(preheader, headers[0]);
+  for (const auto& block_idx : loop->blocks) {
+    function.blocks.erase(block_idx);
+  }
+}
+
+template<typename T>
+bool Unroller::PartiallyUnroll(var_index_t value, T step, const BranchCompare<T>& test) {
+  using S = std::make_signed_t<T>;
+  const auto factor = settings.factor;
+  if (factor < 2 || factor * size > settings.budget) return false;
+
+  // the counter must move towards the bound, so that if the test holds for the
+  // counter after factor - 1 more steps, it holds for all steps before it
+  const auto delta = (i64)(S)step;
+  switch (test.op) {
+    case CmpType::Lt: case CmpType::Le: if (delta <= 0) return false; break;
+    case CmpType::Gt: case CmpType::Ge: if (delta >= 0) return false; break;
+    default: return false;
+  }
+  const auto ahead = (__int128)delta * (factor - 1);
+
+  // check the test on the value of the counter in the last copy of the body,
+  // without overflowing: either by adjusting a constant bound, or by testing
+  // in a wider type
+  std::function<void(BasicBlock&, LoopCopier&)> guard{};
+  if (test.right.IsScalar()) {
+    const auto bound = (__int128)test.right.GetScalar() - ahead;
+    if (bound < (__int128)std::numeric_limits<T>::min() || bound > (__int128)std::numeric_limits<T>::max()) {
+      return false;
+    }
+    guard = [&](BasicBlock& block, LoopCopier& copier) {
+      block.push_back(BranchCompare<T>{
+        copier.blocks.at(body), loop->header, copier.vars.at(value), test.op, Scalar<T>{(T)bound}
+      });
+    };
+  }
+  else if constexpr(sizeof(T) < sizeof(i64)) {
+    if (!IsInvariant(test.right.GetVar())) return false;
+    guard = [&](BasicBlock& block, LoopCopier& copier) {
+      const auto wide = next_var++;
+      const auto last = next_var++;
+      const auto bound = next_var++;
+      auto bound_idx = test.right.GetVar();
+      copier.Var(bound_idx);
+      block.push_back(Cast<i64, T>{wide, copier.vars.at(value)});
+      block.push_back(Binop<i64>{last, wide, BinopType::Add, Scalar<i64>{(i64)ahead}});
+      block.push_back(Cast<i64, T>{bound, bound_idx});
+      block.push_back(BranchCompare<i64>{
+        copier.blocks.at(body), loop->header, last, test.op, Operand<i64>{bound}
+      });
+    };
+  }
+  else {
+    return false;
+  }
+
+  // the unrolled loop runs before the original loop, which handles the
+  // remaining iterations
+  cotyl::vector<block_label_t> headers{};
+  for (u32 i = 0; i < factor; i++) {
+    headers.push_back(next_block++);
+  }
+  for (u32 i = 0; i < factor; i++) {
+    const auto next_header = i + 1 < factor ? headers[i + 1] : headers[0];
+    auto copier = CopyIteration(headers[i], next_header);
+    auto& header = function.blocks.at(headers[i]);
+    if (i == 0) {
+      guard(header, copier);
+    }
+    else {
+      header.push_back(UnconditionalBranch{copier.blocks.at(body)});
+    }
+  }
+
+  Redirect(preheader, headers[0]);
+  return true;
+}
+
+void Unroller::Redirect(block_label_t block_idx, block_label_t dest) {
+  function.blocks.at(block_idx).back().template emplace<UnconditionalBranch>(UnconditionalBranch{dest});
+}
+
+}
+
+std::size_t UnrollLoops(Function& function, FunctionDependencies& deps, const UnrollSettings& settings) {
+  std::size_t unrolled = 0;
+  while (Unroller(function, deps, settings).Run()) {
+    deps = FunctionDependencies::GetDependencies(function);
+    unrolled++;
+  }
+  return unrolled;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Default.h"
+
+
+namespace epi {
+
+namespace calyx {
+struct Function;
+}
+
+struct FunctionDependencies;
+
+struct UnrollSettings {
+  // loops with a constant trip count of at most this many iterations are fully unrolled
+  u32 max_full_trips = 16;
+
+  // number of iterations per pass through a partially unrolled loop,
+  // partial unrolling is disabled if this is less than 2
+  u32 factor = 4;
+
+  // maximum number of directives a single loop may be expanded to
+  u32 budget = 256;
+};
+
+/*
+ * Unroll counted loops.
+ * A counted loop has a preheader, a single latch, and only exits from its
+ * header, through a test on a basic induction variable (a local that is loaded
+ * in the header, and stored exactly once every iteration, with the loaded value
+ * plus a constant step) against a constant or a loop invariant bound.
+ * If the counter is initialized with a constant in the preheader, and the loop
+ * runs at most max_full_trips times, the loop is fully unrolled.
+ * Otherwise, the loop is partially unrolled: a new loop with factor copies of
+ * the body is run while at least factor more iterations remain, checked once per
+ * pass through the new loop. The original loop is kept to run the remaining
+ * iterations. Loops are only unrolled if they stay within the code size budget.
+ * The dependencies are recomputed if the function changed.
+ * Returns the number of unrolled loops.
+ * */
+std::size_t UnrollLoops(calyx::Function& function, FunctionDependencies& deps, const UnrollSettings& settings = {});
+
+}
@@ -685,7 +685,15 @@ cotyl::CString Parser::DDirectDeclaratorImpl(std::stack<any_pointer_t>& dest) {
               }
 
               auto arg = DDeclarator(std::move(arg_specifier.first), StorageClass::Auto);
-              typ.AddArg(std::move(arg.name), std::make_shared<type::AnyType>(std::move(arg.type)));
+              auto arg_type = std::make_shared<type::AnyType>(std::move(arg.type));
+              if (arg_type->holds_alternative<type::ArrayType>()) {
+                // arguments of array type are pointers to their elements
+                const auto& arr = arg_type->get<type::ArrayType>();
+                arg_type = std::make_shared<type::AnyType>(
+                  type::PointerType{type::nested_type_t{arr.contained}, type::LValue::Assignable}
+                );
+              }
+              typ.AddArg(std::move(arg.name), std::move(arg_type));
               if (in_stream.EatIf(TokenType::Comma)) {
                 if (in_stream.EatIf(TokenType::Ellipsis)) {
                   typ.variadic = true;
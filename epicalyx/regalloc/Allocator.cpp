@@ -0,0 +1,328 @@
+#include "Allocator.h"
+#include "RIG.h"
+#include "Spill.h"
+#include "optimizer/ProgramDependencies.h"
+#include "optimizer/Loops.h"
+#include "calyx/Calyx.h"
+#include "Format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <ranges>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// reads and writes in a loop are assumed to happen this many times
+// as often as those outside it
+constexpr double LoopWeight = 10;
+
+constexpr double Unspillable = std::numeric_limits<double>::infinity();
+}
+
+Allocator::Allocator(Function& function, RegisterSpace& regspace) :
+    function{function}, regspace{regspace} {
+
+}
+
+cotyl::unordered_map<GeneralizedVar, double> Allocator::SpillCosts(const FunctionDependencies& deps, const Loops& loops) const {
+  const auto weight = [&](const func_pos_t& pos) {
+    return std::pow(LoopWeight, loops.Depth(pos.first));
+  };
+
+  cotyl::unordered_map<GeneralizedVar, double> costs{};
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    double cost = Unspillable;
+    if (!reloads.contains(var_idx)) {
+      cost = weight(var.created);
+      for (const auto& pos : var.reads) {
+        cost += weight(pos);
+      }
+    }
+    costs.emplace(GeneralizedVar::Var(var_idx), cost);
+  }
+
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    double cost = 0;
+    for (const auto& pos : local.writes) {
+      cost += weight(pos);
+    }
+    for (const auto& pos : local.reads) {
+      cost += weight(pos);
+    }
+    costs.emplace(GeneralizedVar::Local(loc_idx), cost);
+  }
+  return costs;
+}
+
+cotyl::vector<GeneralizedVar> Allocator::Color(
+        register_type_t type, InterferenceGraph graph, const Loops& loops,
+        const cotyl::unordered_map<GeneralizedVar, double>& costs,
+        cotyl::unordered_map<GeneralizedVar, register_t>& registers, bool coalesce
+) const {
+  const auto population = regspace.RegisterTypePopulation(type);
+
+  cotyl::vector<std::optional<register_idx_t>> color(graph.size());
+  cotyl::vector<double> cost(graph.size());
+  for (u32 node = 0; node < graph.size(); node++) {
+    const auto& gvar = graph.Value(node);
+    const auto forced = regspace.ForcedRegister(gvar);
+    if (forced.has_value()) {
+      registers.emplace(gvar, forced.value());
+      color[node] = forced.value().second;
+    }
+    cost[node] = costs.contains(gvar) ? costs.at(gvar) : 0;
+  }
+
+  // coalesce
+  // nodes that were merged into another node point to the node they were merged into
+  cotyl::vector<u32> alias(graph.size());
+  std::iota(alias.begin(), alias.end(), 0);
+  const auto find = [&](u32 node) {
+    while (alias[node] != node) node = alias[node] = alias[alias[node]];
+    return node;
+  };
+
+  // the neighbors of a node that was not merged are exactly
+  // the nodes that were not merged in its adjacency list
+  const auto degree = [&](u32 node) {
+    return (std::size_t)std::ranges::count_if(graph.Neighbors(node), [&](u32 neighbor) { return alias[neighbor] == neighbor; });
+  };
+  const auto significant = [&](u32 node, std::size_t degree) {
+    return color[node].has_value() || degree >= population;
+  };
+
+  // Briggs: the merged node has fewer than population significant neighbors
+  const auto briggs = [&](u32 u, u32 v) {
+    std::size_t count = 0;
+    for (const auto& neighbor : graph.Neighbors(u)) {
+      if (alias[neighbor] != neighbor) continue;
+      // neighbors of both u and v lose a neighbor
+      auto neighbor_degree = degree(neighbor);
+      if (graph.Interferes(neighbor, v)) neighbor_degree--;
+      if (significant(neighbor, neighbor_degree)) count++;
+    }
+    for (const auto& neighbor : graph.Neighbors(v)) {
+      if (alias[neighbor] != neighbor || graph.Interferes(neighbor, u)) continue;
+      if (significant(neighbor, degree(neighbor))) count++;
+    }
+    return count < population;
+  };
+
+  // George: every neighbor of v is a neighbor of u or is insignificant
+  const auto george = [&](u32 u, u32 v) {
+    return std::ranges::all_of(graph.Neighbors(v), [&](u32 neighbor) {
+      if (alias[neighbor] != neighbor) return true;
+      return graph.Interferes(neighbor, u) || !significant(neighbor, degree(neighbor));
+    });
+  };
+
+  // try the moves that are executed most often first
+  auto moves = graph.Moves();
+  std::stable_sort(moves.begin(), moves.end(), [&](const auto& a, const auto& b) {
+    return loops.Depth(a.block) > loops.Depth(b.block);
+  });
+
+  // merging nodes lowers the degree of their common neighbors,
+  // so previously rejected moves may be coalesced later
+  bool changed = coalesce;
+  while (changed) {
+    changed = false;
+    for (const auto& move : moves) {
+      auto u = find(move.dst);
+      auto v = find(move.src);
+      if (u == v) continue;
+      if (color[v].has_value()) std::swap(u, v);
+
+      // precolored nodes are not merged with each other
+      if (color[v].has_value()) continue;
+      if (graph.Interferes(u, v)) continue;
+      if (color[u].has_value() && graph.Excluded(v).contains(color[u].value())) continue;
+
+      // Briggs' test would count the (many) neighbors of a precolored node
+      if (color[u].has_value() ? !george(u, v) : !(briggs(u, v) || george(u, v))) continue;
+
+      alias[v] = u;
+      cost[u] += cost[v];
+      for (const auto& neighbor : graph.Neighbors(v)) {
+        if (alias[neighbor] == neighbor) graph.AddEdge(u, neighbor);
+      }
+      for (const auto& reg : graph.Excluded(v)) {
+        graph.Exclude(u, reg);
+      }
+      changed = true;
+    }
+  }
+
+  // values a node is still moved to and from, to bias the register choice
+  cotyl::vector<cotyl::vector<u32>> partners(graph.size());
+  for (const auto& move : moves) {
+    const auto u = find(move.dst);
+    const auto v = find(move.src);
+    if (u == v || graph.Interferes(u, v)) continue;
+    partners[u].push_back(v);
+    partners[v].push_back(u);
+  }
+
+  cotyl::vector<std::size_t> node_degree(graph.size());
+  cotyl::vector<bool> removed(graph.size(), false);
+  std::size_t remaining = 0;
+  cotyl::vector<u32> low{};
+  for (u32 node = 0; node < graph.size(); node++) {
+    if (color[node].has_value() || alias[node] != node) {
+      // precolored and merged nodes are never removed from the graph
+      removed[node] = true;
+      continue;
+    }
+    node_degree[node] = degree(node);
+    remaining++;
+    if (node_degree[node] < population) low.push_back(node);
+  }
+  // visit nodes in a fixed order
+  std::reverse(low.begin(), low.end());
+
+  // simplify
+  cotyl::vector<u32> stack{};
+  stack.reserve(remaining);
+  while (remaining) {
+    u32 node;
+    if (!low.empty()) {
+      node = low.back();
+      low.pop_back();
+      if (removed[node]) continue;
+    }
+    else {
+      // optimistically push the node that is cheapest to spill
+      std::optional<u32> cheapest{};
+      for (u32 other = 0; other < graph.size(); other++) {
+        if (removed[other]) continue;
+        if (!cheapest.has_value() || cost[other] / node_degree[other] < cost[cheapest.value()] / node_degree[cheapest.value()]) {
+          cheapest = other;
+        }
+      }
+      node = cheapest.value();
+    }
+
+    removed[node] = true;
+    remaining--;
+    stack.push_back(node);
+    for (const auto& neighbor : graph.Neighbors(node)) {
+      if (removed[neighbor]) continue;
+      if (node_degree[neighbor]-- == population) {
+        low.push_back(neighbor);
+      }
+    }
+  }
+
+  // select
+  cotyl::vector<bool> used(population);
+  for (const auto& node : std::ranges::views::reverse(stack)) {
+    std::fill(used.begin(), used.end(), false);
+    for (const auto& neighbor : graph.Neighbors(node)) {
+      if (alias[neighbor] == neighbor && color[neighbor].has_value() && color[neighbor].value() < population) {
+        used[color[neighbor].value()] = true;
+      }
+    }
+    for (const auto& reg : graph.Excluded(node)) {
+      if (reg < population) used[reg] = true;
+    }
+
+    // prefer the register of a value this node is moved to or from
+    auto reg = std::find(used.begin(), used.end(), false);
+    for (const auto& partner : partners[node]) {
+      if (color[partner].has_value() && color[partner].value() < population && !used[color[partner].value()]) {
+        reg = used.begin() + color[partner].value();
+        break;
+      }
+    }
+    if (reg != used.end()) {
+      color[node] = (register_idx_t)(reg - used.begin());
+    }
+  }
+
+  // merged nodes get the register of the node they were merged into
+  cotyl::vector<GeneralizedVar> spills{};
+  for (u32 node = 0; node < graph.size(); node++) {
+    const auto rep = find(node);
+    if (color[rep].has_value()) {
+      registers.emplace(graph.Value(node), register_t{type, color[rep].value()});
+    }
+    else {
+      spills.push_back(graph.Value(node));
+    }
+  }
+  return spills;
+}
+
+Allocation Allocator::Run() {
+  Allocation result{};
+  regspace.IsolateForcedRegisters(function);
+  while (true) {
+    result.rounds++;
+    const auto deps = FunctionDependencies::GetDependencies(function);
+    FindMemoryLocals(function, deps, memory);
+
+    const auto rig = RIG::GenerateRIG(function, regspace, memory);
+    const auto loops = Loops(deps);
+    const auto costs = SpillCosts(deps, loops);
+    result.registers.clear();
+
+    cotyl::vector<GeneralizedVar> spills{};
+    for (const auto& [type, graph] : rig.classes) {
+      cotyl::unordered_map<GeneralizedVar, register_t> registers{};
+      const auto class_spills = Color(type, graph, loops, costs, registers, false);
+      if (class_spills.empty()) {
+        // coalescing changes which nodes are spilled, so it is only done
+        // if the values can be colored without spilling
+        cotyl::unordered_map<GeneralizedVar, register_t> coalesced{};
+        if (Color(type, graph, loops, costs, coalesced, true).empty()) {
+          registers = std::move(coalesced);
+        }
+      }
+      for (const auto& gvar : class_spills) {
+        if (costs.contains(gvar) && costs.at(gvar) == Unspillable) {
+          throw cotyl::FormatExcept<RegSpaceError>(
+            "Unable to allocate a register for %c%d", gvar.is_local ? 'c' : 'v', gvar.idx
+          );
+        }
+      }
+      result.registers.insert(registers.begin(), registers.end());
+      spills.insert(spills.end(), class_spills.begin(), class_spills.end());
+    }
+    if (spills.empty()) {
+      for (const auto& [type, graph] : rig.classes) {
+        for (const auto& move : graph.Moves()) {
+          if (result.registers.at(graph.Value(move.dst)) == result.registers.at(graph.Value(move.src))) {
+            result.coalesced++;
+          }
+        }
+      }
+      break;
+    }
+
+    cotyl::vector<var_index_t> vars{};
+    for (const auto& gvar : spills) {
+      if (gvar.is_local) memory.emplace(gvar.idx);
+      else vars.push_back(gvar.idx);
+    }
+    if (!vars.empty()) {
+      const auto spilled = SpillVars(function, deps, vars);
+      memory.insert(spilled.locals.begin(), spilled.locals.end());
+      reloads.insert(spilled.reloads.begin(), spilled.reloads.end());
+      result.spilled += vars.size();
+      result.rematerialized += spilled.rematerialized;
+      regspace.EmitFunction(function);
+    }
+  }
+
+  AssignStackSlots(result, memory);
+  return result;
+}
+
+}
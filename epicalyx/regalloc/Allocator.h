@@ -1,5 +1,99 @@
 #pragma once
 
+#include "Default.h"
+#include "Containers.h"
+#include "GeneralizedVar.h"
+#include "RegisterSpace.h"
+#include "calyx/CalyxFwd.h"
+
+
+namespace epi {
+
+struct InterferenceGraph;
+struct FunctionDependencies;
+struct Loops;
+
+/*
+ * Result of register allocation for a single function.
+ * Every var and every local that is not in memory is assigned a register,
+ * locals that live in memory (aggregates, locals of which the address is
+ * taken and spilled values) are assigned a stack slot instead.
+ * */
+struct Allocation {
+  cotyl::unordered_map<GeneralizedVar, register_t> registers{};
+  cotyl::unordered_map<loc_index_t, u32> stack_slots{};
+
+  // number of vars that were spilled, and how many of those were rematerialized
+  std::size_t spilled = 0;
+  std::size_t rematerialized = 0;
+  // number of values that were split at block boundaries,
+  // and the moves inserted between their parts
+  std::size_t split = 0;
+  std::size_t moves = 0;
+  // number of times the RIG was colored
+  std::size_t rounds = 0;
+  // number of moves between values that were assigned the same register
+  std::size_t coalesced = 0;
+};
+
+/*
+ * Graph coloring register allocator, after Chaitin, with optimistic
+ * coloring by Briggs.
+ * Every round, the RIG of the function is built, holding an interference
+ * graph for every register type, which are colored separately.
+ * Values with a forced register are precolored, after the register space
+ * has isolated them. Values that live across a directive are never
+ * assigned a register that it overwrites.
+ * If a graph can be colored without spilling, it is colored again with
+ * coalescing, which is kept if that succeeds as well. Before simplifying,
+ * values that are copied into one another by a move (a local loaded into
+ * a var or a var stored to a local without extension, or a cast that does
+ * not change the representation) are then merged into a single node, if
+ * they do not interfere and this can not make the graph uncolorable: with
+ * the test by Briggs (the merged node has few significant neighbors) or
+ * the test by George (all neighbors of one node are insignificant or
+ * neighbors of the other, the only test used for precolored nodes). Moves
+ * in deeper loops are tried first. Moves that were not coalesced bias the
+ * register choice of the nodes that are still moved to and from each other.
+ * Nodes with fewer neighbors than there are registers of their type are
+ * removed from the graph (simplify), if there are none, the node with the
+ * lowest spill cost per neighbor is removed instead, as it may still get
+ * a register. Registers are then assigned in the reverse order of removal
+ * (select), values that were coalesced get the same register.
+ * The spill cost of a value is the number of reads and writes, weighted
+ * by the loop depth of the blocks they are in. Locals that could not be
+ * colored are moved to memory. Vars are spilled by storing them to a new
+ * local in memory after their definition, and loading them into a new var
+ * before every read. Vars defined by an immediate or an address are
+ * rematerialized instead, repeating their definition before every read.
+ * The function is changed in that case, and the register space is updated
+ * with the new vars and locals before the next round. Vars loaded from
+ * spill slots or rematerialized are never spilled again.
+ * */
 struct Allocator {
-    
+  Allocator(calyx::Function& function, RegisterSpace& regspace);
+
+  Allocation Run();
+
+private:
+  calyx::Function& function;
+  RegisterSpace& regspace;
+
+  // locals that live in memory
+  cotyl::unordered_set<loc_index_t> memory{};
+
+  // vars loaded from spill slots
+  cotyl::unordered_set<var_index_t> reloads{};
+
+  cotyl::unordered_map<GeneralizedVar, double> SpillCosts(const FunctionDependencies& deps, const Loops& loops) const;
+
+  // assign registers to the values of a single register type,
+  // returns the values that could not be colored
+  cotyl::vector<GeneralizedVar> Color(
+          register_type_t type, InterferenceGraph graph, const Loops& loops,
+          const cotyl::unordered_map<GeneralizedVar, double>& costs,
+          cotyl::unordered_map<GeneralizedVar, register_t>& registers, bool coalesce
+  ) const;
 };
+
+}
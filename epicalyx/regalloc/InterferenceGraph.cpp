@@ -0,0 +1,45 @@
+#include "InterferenceGraph.h"
+
+#include <utility>
+
+
+namespace epi {
+
+namespace {
+
+// number of pairs of distinct nodes
+std::size_t TriangleSize(std::size_t nodes) {
+  return nodes ? nodes * (nodes - 1) / 2 : 0;
+}
+
+}
+
+InterferenceGraph::InterferenceGraph(cotyl::vector<GeneralizedVar>&& values) :
+    values{std::move(values)},
+    adjacency(this->values.size()),
+    matrix{TriangleSize(this->values.size())},
+    excluded(this->values.size()) {
+
+}
+
+std::size_t InterferenceGraph::MatrixIndex(u32 a, u32 b) {
+  // row a holds the edges to nodes 0..a-1
+  if (a < b) std::swap(a, b);
+  return (std::size_t)a * (a - 1) / 2 + b;
+}
+
+bool InterferenceGraph::Interferes(u32 a, u32 b) const {
+  if (a == b) return false;
+  return matrix.Test(MatrixIndex(a, b));
+}
+
+void InterferenceGraph::AddEdge(u32 a, u32 b) {
+  if (a == b) return;
+  const auto idx = MatrixIndex(a, b);
+  if (matrix.Test(idx)) return;
+  matrix.Set(idx);
+  adjacency[a].push_back(b);
+  adjacency[b].push_back(a);
+}
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Default.h"
+#include "Containers.h"
+#include "BitSet.h"
+#include "GeneralizedVar.h"
+#include "RegisterSpace.h"
+
+
+namespace epi {
+
+/*
+ * Interference graph of the values of a single register type.
+ * Nodes are numbered densely from 0. Edges are stored twice:
+ * in a triangular bit matrix, for constant time interference queries,
+ * and in an adjacency vector per node, for iterating over neighbors.
+ * An edge is only added to the adjacency vectors if it was not yet
+ * in the matrix, so these never contain duplicates.
+ * Moves between nodes are kept as well, these are candidates
+ * for coalescing, and so are the registers that a node can not
+ * be assigned.
+ * */
+struct InterferenceGraph {
+  struct Move {
+    u32 dst;
+    u32 src;
+    block_label_t block;
+  };
+
+  InterferenceGraph(cotyl::vector<GeneralizedVar>&& values);
+
+  std::size_t size() const { return values.size(); }
+  const GeneralizedVar& Value(u32 node) const { return values[node]; }
+
+  bool Interferes(u32 a, u32 b) const;
+  void AddEdge(u32 a, u32 b);
+
+  const cotyl::vector<u32>& Neighbors(u32 node) const { return adjacency[node]; }
+  std::size_t Degree(u32 node) const { return adjacency[node].size(); }
+
+  void AddMove(u32 dst, u32 src, block_label_t block) { moves.push_back({dst, src, block}); }
+  const cotyl::vector<Move>& Moves() const { return moves; }
+
+  void Exclude(u32 node, register_idx_t reg) { excluded[node].insert(reg); }
+  const cotyl::flat_set<register_idx_t>& Excluded(u32 node) const { return excluded[node]; }
+
+private:
+  cotyl::vector<GeneralizedVar> values;
+  cotyl::vector<cotyl::vector<u32>> adjacency;
+  cotyl::BitSet matrix;
+  cotyl::vector<Move> moves{};
+  cotyl::vector<cotyl::flat_set<register_idx_t>> excluded;
+
+  static std::size_t MatrixIndex(u32 a, u32 b);
+};
+
+}
@@ -0,0 +1,394 @@
+#include "LinearScan.h"
+#include "Spill.h"
+#include "optimizer/ProgramDependencies.h"
+#include "optimizer/Liveness.h"
+#include "calyx/Calyx.h"
+#include "Format.h"
+
+#include <algorithm>
+#include <limits>
+#include <list>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+/*
+ * Positions of directives in block order.
+ * Every directive takes three positions: it reads its operands at the
+ * first, overwrites the registers it clobbers at the second and writes its
+ * result at the last. This way, a directive can write its result to the
+ * register of a value that it reads for the last time, and only values that
+ * live across it overlap with the registers it clobbers.
+ * */
+struct Positions {
+  Positions(const Function& function) {
+    cotyl::vector<block_label_t> order{};
+    for (const auto& [block_idx, block] : function.blocks) {
+      order.push_back(block_idx);
+    }
+    std::sort(order.begin(), order.end());
+
+    u64 pos = 0;
+    for (const auto& block_idx : order) {
+      const auto size = std::max<u64>(function.blocks.at(block_idx).size(), 1);
+      blocks.emplace(block_idx, std::make_pair(pos, pos + 3 * size - 1));
+      pos += 3 * size;
+    }
+  }
+
+  u64 Start(block_label_t block_idx) const { return blocks.at(block_idx).first; }
+  u64 End(block_label_t block_idx) const { return blocks.at(block_idx).second; }
+  u64 Read(const func_pos_t& pos) const { return Start(pos.first) + 3 * pos.second; }
+  u64 Clobber(const func_pos_t& pos) const { return Start(pos.first) + 3 * pos.second + 1; }
+  u64 Write(const func_pos_t& pos) const { return Start(pos.first) + 3 * pos.second + 2; }
+
+private:
+  cotyl::unordered_map<block_label_t, std::pair<u64, u64>> blocks{};
+};
+
+}
+
+bool LinearScan::Interval::Covers(u64 pos) const {
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), pos, [](u64 pos, const auto& range) {
+    return pos < range.first;
+  });
+  if (it == ranges.begin()) return false;
+  return (--it)->second >= pos;
+}
+
+std::optional<u64> LinearScan::Interval::FirstOverlap(const Interval& other) const {
+  auto it = ranges.begin();
+  auto other_it = other.ranges.begin();
+  while (it != ranges.end() && other_it != other.ranges.end()) {
+    if (it->second < other_it->first) it++;
+    else if (other_it->second < it->first) other_it++;
+    else return std::max(it->first, other_it->first);
+  }
+  return {};
+}
+
+LinearScan::Interval LinearScan::Interval::Split(std::size_t index) {
+  auto split = Interval{gvar, type, {}, {}, spillable, splittable};
+  split.ranges.insert(split.ranges.end(), ranges.begin() + index, ranges.end());
+  split.blocks.insert(split.blocks.end(), blocks.begin() + index, blocks.end());
+  ranges.erase(ranges.begin() + index, ranges.end());
+  blocks.erase(blocks.begin() + index, blocks.end());
+  return split;
+}
+
+LinearScan::LinearScan(Function& function, RegisterSpace& regspace) :
+    function{function}, regspace{regspace} {
+
+}
+
+cotyl::vector<LinearScan::Interval> LinearScan::BuildIntervals(const FunctionDependencies& deps) const {
+  const auto positions = Positions(function);
+  const auto liveness = Liveness(function, deps);
+
+  // range of every value in every block it is live in
+  cotyl::vector<cotyl::unordered_map<block_label_t, std::pair<u64, u64>>> ranges(liveness.size());
+  const auto extend = [&](u32 idx, block_label_t block_idx, u64 pos) {
+    auto [it, inserted] = ranges[idx].emplace(block_idx, std::make_pair(pos, pos));
+    if (!inserted) {
+      it->second.first = std::min(it->second.first, pos);
+      it->second.second = std::max(it->second.second, pos);
+    }
+  };
+
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    const auto idx = liveness.Index(GeneralizedVar::Var(var_idx));
+    extend(idx, var.created.first, positions.Write(var.created));
+    for (const auto& pos : var.reads) extend(idx, pos.first, positions.Read(pos));
+  }
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (!loc_idx) continue;
+    const auto idx = liveness.Index(GeneralizedVar::Local(loc_idx));
+    for (const auto& pos : local.writes) extend(idx, pos.first, positions.Write(pos));
+    for (const auto& pos : local.reads) extend(idx, pos.first, positions.Read(pos));
+  }
+  for (const auto& [block_idx, block] : function.blocks) {
+    liveness.LiveIn(block_idx).ForEach([&](u32 idx) { extend(idx, block_idx, positions.Start(block_idx)); });
+    liveness.LiveOut(block_idx).ForEach([&](u32 idx) { extend(idx, block_idx, positions.End(block_idx)); });
+  }
+
+  // argument locals are all written on entry, before the first directive
+  for (const auto& [loc_idx, loc] : function.locals) {
+    if (loc.type == Local::Type::Aggregate || !loc.non_aggregate.arg_idx.has_value()) continue;
+    const auto gvar = GeneralizedVar::Local(loc_idx);
+    if (liveness.Contains(gvar)) extend(liveness.Index(gvar), Function::Entry, positions.Start(Function::Entry));
+  }
+
+  cotyl::vector<Interval> intervals{};
+  for (u32 idx = 0; idx < liveness.size(); idx++) {
+    const auto& gvar = liveness.Value(idx);
+    if (ranges[idx].empty()) continue;
+    if (gvar.is_local && memory.contains(gvar.idx)) continue;
+
+    cotyl::vector<std::pair<std::pair<u64, u64>, block_label_t>> sorted{};
+    for (const auto& [block_idx, range] : ranges[idx]) {
+      sorted.emplace_back(range, block_idx);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    auto& interval = intervals.emplace_back(Interval{
+      gvar, regspace.RegisterType(gvar), {}, {},
+      gvar.is_local || !reloads.contains(gvar.idx),
+      !gvar.is_local || !parts.contains(gvar.idx)
+    });
+    for (const auto& [range, block_idx] : sorted) {
+      interval.ranges.push_back(range);
+      interval.blocks.push_back(block_idx);
+    }
+  }
+  return intervals;
+}
+
+cotyl::vector<std::pair<LinearScan::Interval, register_t>> LinearScan::BuildClobbers() const {
+  const auto positions = Positions(function);
+
+  cotyl::vector<std::pair<Interval, register_t>> clobbers{};
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (u64 i = 0; i < block.size(); i++) {
+      const auto pos = positions.Clobber({block_idx, (int)i});
+      for (const auto& reg : regspace.Clobbers(block.at(i))) {
+        // clobbers are not values, local 0 is never allocated
+        clobbers.emplace_back(Interval{GeneralizedVar::Local(0), reg.first, {{pos, pos}}, {block_idx}, false}, reg);
+      }
+    }
+  }
+  return clobbers;
+}
+
+void LinearScan::Scan(
+        const cotyl::vector<Interval*>& intervals, const cotyl::vector<std::pair<Interval*, register_t>>& fixed,
+        locations_t& locations
+) const {
+  if (intervals.empty()) return;
+  const auto type = intervals.front()->type;
+  const auto population = regspace.RegisterTypePopulation(type);
+
+  // intervals that are still to be visited, the one that starts first at the back
+  const auto later = [](const Interval* a, const Interval* b) {
+    return std::make_pair(a->Start(), a->gvar) > std::make_pair(b->Start(), b->gvar);
+  };
+  cotyl::vector<Interval*> unhandled{intervals.begin(), intervals.end()};
+  std::make_heap(unhandled.begin(), unhandled.end(), later);
+
+  // intervals split off of others, and the register of every interval,
+  // none if it is in memory
+  std::list<Interval> split{};
+  cotyl::unordered_map<Interval*, std::optional<register_idx_t>> assigned_regs{};
+  const auto visit_later = [&](Interval&& interval) {
+    unhandled.push_back(&split.emplace_back(std::move(interval)));
+    std::push_heap(unhandled.begin(), unhandled.end(), later);
+  };
+
+  // move the range of an interval in the block of pos to memory,
+  // the ranges after it are visited again
+  const auto spill = [&](Interval* interval, u64 pos) {
+    if (!interval->splittable) {
+      assigned_regs[interval] = {};
+      return;
+    }
+    std::size_t index = 0;
+    while (interval->ranges[index].second < pos) index++;
+    if (index) interval = &split.emplace_back(interval->Split(index));
+    if (interval->ranges.size() > 1) visit_later(interval->Split(1));
+    assigned_regs[interval] = {};
+  };
+
+  using assigned_t = std::pair<Interval*, register_idx_t>;
+  cotyl::vector<assigned_t> active{};
+  cotyl::vector<assigned_t> inactive{};
+
+  while (!unhandled.empty()) {
+    std::pop_heap(unhandled.begin(), unhandled.end(), later);
+    auto* current = unhandled.back();
+    unhandled.pop_back();
+    const auto pos = current->Start();
+
+    cotyl::vector<assigned_t> still_active{};
+    cotyl::vector<assigned_t> still_inactive{};
+    for (const auto& assigned : active) {
+      if (assigned.first->End() < pos) continue;
+      if (assigned.first->Covers(pos)) still_active.push_back(assigned);
+      else still_inactive.push_back(assigned);
+    }
+    for (const auto& assigned : inactive) {
+      if (assigned.first->End() < pos) continue;
+      if (assigned.first->Covers(pos)) still_active.push_back(assigned);
+      else still_inactive.push_back(assigned);
+    }
+    active = std::move(still_active);
+    inactive = std::move(still_inactive);
+
+    // position up to which every register is not used by values that are live
+    // at the same time as the current one, other than those of the active
+    // intervals, which may be spilled
+    cotyl::vector<u64> blocked(population, std::numeric_limits<u64>::max());
+    for (const auto& [interval, reg] : inactive) {
+      const auto overlap = interval->FirstOverlap(*current);
+      if (overlap.has_value()) blocked[reg] = std::min(blocked[reg], overlap.value());
+    }
+    for (const auto& [interval, reg] : fixed) {
+      if (reg.second >= population) continue;
+      const auto overlap = interval->FirstOverlap(*current);
+      if (overlap.has_value()) blocked[reg.second] = std::min(blocked[reg.second], overlap.value());
+    }
+
+    auto free = blocked;
+    for (const auto& [interval, reg] : active) {
+      free[reg] = 0;
+    }
+
+    const auto reg = std::find_if(free.begin(), free.end(), [&](u64 until) { return until > current->End(); });
+    if (reg != free.end()) {
+      const auto reg_idx = (register_idx_t)(reg - free.begin());
+      assigned_regs[current] = reg_idx;
+      active.emplace_back(current, reg_idx);
+      continue;
+    }
+
+    // assign the register that is free the longest to the ranges
+    // in the blocks before it is taken, if there are any
+    const auto longest = std::max_element(free.begin(), free.end());
+    if (current->splittable && *longest > pos) {
+      std::size_t index = 0;
+      while (current->ranges[index].second < *longest) index++;
+      if (index) {
+        const auto reg_idx = (register_idx_t)(longest - free.begin());
+        visit_later(current->Split(index));
+        assigned_regs[current] = reg_idx;
+        active.emplace_back(current, reg_idx);
+        continue;
+      }
+    }
+
+    // spill the active interval that ends last, if it ends after the current one
+    std::optional<std::size_t> spilled{};
+    for (std::size_t i = 0; i < active.size(); i++) {
+      const auto& [interval, reg_idx] = active[i];
+      if (!interval->spillable || blocked[reg_idx] <= current->End()) continue;
+      if (!spilled.has_value() || interval->End() > active[spilled.value()].first->End()) spilled = i;
+    }
+
+    if (spilled.has_value() && (!current->spillable || active[spilled.value()].first->End() > current->End())) {
+      auto& [interval, reg_idx] = active[spilled.value()];
+      spill(interval, pos);
+      assigned_regs[current] = reg_idx;
+      interval = current;
+    }
+    else if (current->spillable) {
+      spill(current, pos);
+    }
+    else {
+      throw cotyl::FormatExcept<RegSpaceError>(
+        "Unable to allocate a register for %c%d", current->gvar.is_local ? 'c' : 'v', current->gvar.idx
+      );
+    }
+  }
+
+  for (const auto& [interval, reg_idx] : assigned_regs) {
+    auto& blocks = locations[interval->gvar];
+    for (const auto& block_idx : interval->blocks) {
+      if (reg_idx.has_value()) blocks.emplace(block_idx, register_t{type, reg_idx.value()});
+      else blocks.emplace(block_idx, std::nullopt);
+    }
+  }
+}
+
+Allocation LinearScan::Run() {
+  Allocation result{};
+  regspace.IsolateForcedRegisters(function);
+  while (true) {
+    result.rounds++;
+    auto deps = FunctionDependencies::GetDependencies(function);
+    FindMemoryLocals(function, deps, memory);
+
+    auto intervals = BuildIntervals(deps);
+    auto clobbers = BuildClobbers();
+    result.registers.clear();
+
+    cotyl::unordered_map<register_type_t, cotyl::vector<Interval*>> by_type{};
+    cotyl::unordered_map<register_type_t, cotyl::vector<std::pair<Interval*, register_t>>> fixed{};
+    for (auto& [interval, reg] : clobbers) {
+      fixed[reg.first].emplace_back(&interval, reg);
+    }
+    for (auto& interval : intervals) {
+      const auto forced = regspace.ForcedRegister(interval.gvar);
+      if (forced.has_value()) {
+        result.registers.emplace(interval.gvar, forced.value());
+        fixed[forced.value().first].emplace_back(&interval, forced.value());
+      }
+      else {
+        by_type[interval.type].push_back(&interval);
+      }
+    }
+
+    locations_t locations{};
+    for (auto& [type, type_intervals] : by_type) {
+      Scan(type_intervals, fixed[type], locations);
+    }
+
+    // values with a single location are assigned that register or spilled,
+    // the others are split into a part for every location
+    cotyl::vector<GeneralizedVar> values{};
+    for (const auto& [gvar, blocks] : locations) {
+      values.push_back(gvar);
+    }
+    std::sort(values.begin(), values.end());
+
+    cotyl::vector<GeneralizedVar> spills{};
+    cotyl::vector<SplitValue> splits{};
+    for (const auto& gvar : values) {
+      cotyl::vector<std::optional<register_t>> distinct{};
+      auto split = SplitValue{gvar};
+      for (const auto& [block_idx, reg] : locations.at(gvar)) {
+        auto part = std::find(distinct.begin(), distinct.end(), reg);
+        if (part == distinct.end()) {
+          split.memory.push_back(!reg.has_value());
+          part = distinct.insert(distinct.end(), reg);
+        }
+        split.parts.emplace(block_idx, (u32)(part - distinct.begin()));
+      }
+
+      if (distinct.size() > 1) splits.push_back(std::move(split));
+      else if (distinct.front().has_value()) result.registers.emplace(gvar, distinct.front().value());
+      else spills.push_back(gvar);
+    }
+    if (spills.empty() && splits.empty()) break;
+
+    if (!splits.empty()) {
+      const auto split = SplitAtBlockBoundaries(function, deps, splits);
+      parts.insert(split.locals.begin(), split.locals.end());
+      memory.insert(split.memory.begin(), split.memory.end());
+      reloads.insert(split.reloads.begin(), split.reloads.end());
+      result.split += splits.size();
+      result.moves += split.moves;
+      deps = FunctionDependencies::GetDependencies(function);
+    }
+
+    cotyl::vector<var_index_t> vars{};
+    for (const auto& gvar : spills) {
+      if (gvar.is_local) memory.emplace(gvar.idx);
+      else vars.push_back(gvar.idx);
+    }
+    if (!vars.empty()) {
+      const auto spilled = SpillVars(function, deps, vars);
+      memory.insert(spilled.locals.begin(), spilled.locals.end());
+      reloads.insert(spilled.reloads.begin(), spilled.reloads.end());
+      result.spilled += vars.size();
+      result.rematerialized += spilled.rematerialized;
+    }
+    regspace.EmitFunction(function);
+  }
+
+  AssignStackSlots(result, memory);
+  return result;
+}
+
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Allocator.h"
+
+#include <optional>
+
+
+namespace epi {
+
+/*
+ * Linear scan register allocator, after Poletto and Sarkar, with lifetime
+ * holes (after Traub et al. and Wimmer).
+ * Directives are numbered in order of the block labels, and the live range
+ * of every value is split at block boundaries into one range per block
+ * it is live in, found from the read and write positions in the
+ * dependencies and the live-in and live-out sets of the blocks.
+ * Intervals are visited in order of their start, keeping the intervals
+ * that contain the current position (active) and those that are in a
+ * hole (inactive). An interval is assigned a register that is not used by
+ * an active interval, nor by an inactive or precolored interval it
+ * overlaps with. If there is none, but there is a register that is free
+ * for its ranges in the first few blocks, the interval is split at the
+ * start of the first block where that register is taken, it is assigned
+ * that register up to there, and the rest is visited again later.
+ * Otherwise, the interval that ends last is spilled in the block of the
+ * current position: its ranges in earlier blocks keep their register, its
+ * range in that block is moved to memory and the rest is visited again.
+ * Registers overwritten by a directive are fixed intervals between the
+ * positions the directive reads its operands and writes its result, so
+ * that only values that live across it are kept out of these registers.
+ * Values that ended up in the same register or in memory everywhere are
+ * assigned that register, or spilled like in the graph coloring allocator.
+ * The live range of a value with different locations in different blocks
+ * is split at the block boundaries: every location gets its own local, and
+ * the value is moved between them on the edges where its location changes
+ * (see SplitAtBlockBoundaries). The scan is repeated until no more values
+ * are split or spilled. Like vars loaded from spill slots are never spilled,
+ * the locals of the parts of a split value are never split again, but
+ * spilled entirely, which bounds the number of rounds.
+ * No interference graph is built, which makes this much faster than
+ * graph coloring on large functions, at the cost of worse allocations.
+ * */
+struct LinearScan {
+  LinearScan(calyx::Function& function, RegisterSpace& regspace);
+
+  Allocation Run();
+
+  struct Interval {
+    GeneralizedVar gvar;
+    register_type_t type;
+
+    // sorted, disjoint, inclusive ranges of positions,
+    // and the block every range is in
+    cotyl::vector<std::pair<u64, u64>> ranges{};
+    cotyl::vector<block_label_t> blocks{};
+    bool spillable = true;
+    bool splittable = true;
+
+    u64 Start() const { return ranges.front().first; }
+    u64 End() const { return ranges.back().second; }
+    bool Covers(u64 pos) const;
+    std::optional<u64> FirstOverlap(const Interval& other) const;
+
+    // split off the ranges from index on into a new interval
+    Interval Split(std::size_t index);
+  };
+
+  // location of a value in every block it is live in, memory if there is no register
+  using locations_t = cotyl::unordered_map<GeneralizedVar, cotyl::unordered_map<block_label_t, std::optional<register_t>>>;
+
+private:
+  calyx::Function& function;
+  RegisterSpace& regspace;
+
+  // locals that live in memory
+  cotyl::unordered_set<loc_index_t> memory{};
+
+  // vars loaded from spill slots
+  cotyl::unordered_set<var_index_t> reloads{};
+
+  // locals holding the parts of split values
+  cotyl::unordered_set<loc_index_t> parts{};
+
+  cotyl::vector<Interval> BuildIntervals(const FunctionDependencies& deps) const;
+  cotyl::vector<std::pair<Interval, register_t>> BuildClobbers() const;
+
+  // assign registers to intervals of a single register type,
+  // splitting them at block boundaries where needed
+  void Scan(
+          const cotyl::vector<Interval*>& intervals, const cotyl::vector<std::pair<Interval*, register_t>>& fixed,
+          locations_t& locations
+  ) const;
+};
+
+}
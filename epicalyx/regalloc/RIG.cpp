@@ -2,7 +2,10 @@
 #include "RegisterSpace.h"
 #include "Format.h"
 #include "optimizer/ProgramDependencies.h"
+#include "optimizer/Liveness.h"
+#include "calyx/Calyx.h"
 #include "cycle/Cycle.h"
+#include "cycle/Graph.h"
 
 #include <ranges>
 
@@ -11,149 +14,128 @@ namespace epi {
 
 using namespace calyx;
 
-RIG RIG::GenerateRIG(const Function& function) {
+namespace {
+
+// types that are held in the same register at the same width
+template<typename T, typename U>
+constexpr bool same_register_v = std::is_same_v<T, U> || (
+  (is_calyx_integral_type_v<T> || std::is_same_v<T, calyx::Pointer>) &&
+  (is_calyx_integral_type_v<U> || std::is_same_v<U, calyx::Pointer>) &&
+  sizeof(T) == sizeof(U)
+);
+
+// value copied by a directive, if it is a plain copy
+std::optional<GeneralizedVar> MoveSource(const AnyDirective& directive) {
+  return directive.visit<std::optional<GeneralizedVar>>(
+    [](const auto&) -> std::optional<GeneralizedVar> { return {}; },
+    []<typename T>(const LoadLocal<T>& op) -> std::optional<GeneralizedVar> {
+      // smaller types are extended on load
+      if (op.offset || !std::is_same_v<T, calyx_upcast_t<T>>) return {};
+      return GeneralizedVar::Local(op.loc_idx);
+    },
+    []<typename T>(const StoreLocal<T>& op) -> std::optional<GeneralizedVar> {
+      if (op.offset || !op.src.IsVar() || !std::is_same_v<T, calyx_upcast_t<T>>) return {};
+      return GeneralizedVar::Var(op.src.GetVar());
+    },
+    []<typename To, typename From>(const Cast<To, From>& op) -> std::optional<GeneralizedVar> {
+      if constexpr(same_register_v<To, From> && std::is_same_v<To, calyx_upcast_t<To>>) {
+        return GeneralizedVar::Var(op.right_idx);
+      }
+      return {};
+    }
+  );
+}
+
+}
+
+RIG RIG::GenerateRIG(
+        const Function& function, const RegisterSpace& regspace,
+        const cotyl::unordered_set<loc_index_t>& memory
+) {
   const auto deps = FunctionDependencies::GetDependencies(function);
+  const auto liveness = Liveness(function, deps);
   RIG rig{};
 
   struct InstrLiveliness {
-    std::optional<GeneralizedVar> def{};
+    // values by their index in the liveness analysis
+    std::optional<u32> def{};
     // may be more than 2 uses in CALL
-    cotyl::vector<GeneralizedVar> use{};
-  };
-  
-  struct Liveliness {
-    Liveliness(size_t block_len) : single{block_len} { }
-
-    cotyl::unordered_set<GeneralizedVar> def{};
-    cotyl::unordered_set<GeneralizedVar> in{};
-    cotyl::unordered_set<GeneralizedVar> out{};
-    // no need to track "use" on a block level,
-    // as we insert all uses into the "in" set right away,
-    // and will never reset "in".
-
-    // definitions and uses at an instruction level
-    cotyl::vector<InstrLiveliness> single{};
+    cotyl::vector<u32> use{};
+    // value copied into def
+    std::optional<u32> move{};
+    // registers overwritten by the instruction
+    cotyl::vector<register_t> clobbers{};
   };
-  
-  // initialize empty nodes
-  cotyl::unordered_map<block_label_t, Liveliness> liveliness{};
-  liveliness.reserve(function.blocks.size());
+
+  // definitions and uses at an instruction level
+  cotyl::unordered_map<block_label_t, cotyl::vector<InstrLiveliness>> single{};
+  single.reserve(function.blocks.size());
   for (const auto& [block_idx, block] : function.blocks) {
-    liveliness.emplace(block_idx, Liveliness{block.size()});
+    single.emplace(block_idx, cotyl::vector<InstrLiveliness>(block.size()));
   }
 
-  // add definitions and uses and RIG nodes
-  for (const auto& [var_idx, var] : deps.var_graph) {
-    const auto gvar = GeneralizedVar::Var(var_idx);
-    liveliness.at(var.created.first).def.emplace(gvar);
-    liveliness.at(var.created.first).single[var.created.second].def = gvar;
-    rig.graph.AddNodeIfNotExists(gvar.NodeUID(), gvar);
-
-    // insert uses
-    for (const auto& pos : var.reads) {
-      liveliness.at(pos.first).single[pos.second].use.emplace_back(gvar);
-      // first iteration, add to "in" if in "use" and not in "def"
-      if (pos.first != var.created.first) {
-        liveliness.at(pos.first).in.emplace(gvar);
+  for (const auto& [block_idx, block] : function.blocks) {
+    for (u64 i = 0; i < block.size(); i++) {
+      auto& instr = single.at(block_idx)[i];
+      const auto src = MoveSource(block.at(i));
+      if (src.has_value() && liveness.Contains(src.value())) {
+        instr.move = liveness.Index(src.value());
       }
+      instr.clobbers = regspace.Clobbers(block.at(i));
     }
-
-    // forced "out" for program result
-    if (var.function_result.first) 
-      liveliness.at(var.function_result.first).out.emplace(gvar);
   }
 
-  // same for locals
-  for (const auto& [loc_idx, loc] : deps.local_graph) {
-    if (!loc_idx) continue;
-    const auto gvar = GeneralizedVar::Local(loc_idx);
-    rig.graph.AddNodeIfNotExists(gvar.NodeUID(), std::move(gvar));
+  // register type and node in the graph of that type of every value
+  struct Node {
+    InterferenceGraph* graph = nullptr;
+    u32 idx = 0;
+  };
 
-    cotyl::unordered_map<block_label_t, int> first_write{};
-    for (const auto& pos : loc.writes) {
-      liveliness.at(pos.first).single[pos.second].def = gvar;
-      // deps are computed in order
-      if (!first_write.contains(pos.first)) {
-        first_write.emplace(pos.first, pos.second);
-      }
+  cotyl::vector<Node> nodes(liveness.size());
+  {
+    cotyl::unordered_map<register_type_t, cotyl::vector<GeneralizedVar>> values{};
+    cotyl::vector<std::pair<register_type_t, u32>> class_nodes(liveness.size());
+    for (u32 idx = 0; idx < liveness.size(); idx++) {
+      const auto& gvar = liveness.Value(idx);
+      if (gvar.is_local && memory.contains(gvar.idx)) continue;
+      const auto type = regspace.RegisterType(gvar);
+      auto& class_values = values[type];
+      class_nodes[idx] = {type, (u32)class_values.size()};
+      class_values.push_back(gvar);
     }
 
-    for (const auto& pos : loc.reads) {
-      liveliness.at(pos.first).single[pos.second].use.emplace_back(gvar);
-
-      // in block in if the read happens before the first write
-      if (!first_write.contains(pos.first) || first_write.at(pos.first) > pos.second) {
-        liveliness.at(pos.first).in.emplace(gvar);
-      }
+    for (auto& [type, class_values] : values) {
+      rig.classes.emplace(type, InterferenceGraph{std::move(class_values)});
     }
-
-    if (function.locals.at(loc_idx).non_aggregate.arg_idx.has_value()) {
-      // defined in entry
-      liveliness.at(Function::Entry).def.emplace(gvar);
+    for (u32 idx = 0; idx < liveness.size(); idx++) {
+      const auto& gvar = liveness.Value(idx);
+      if (gvar.is_local && memory.contains(gvar.idx)) continue;
+      nodes[idx] = {&rig.classes.at(class_nodes[idx].first), class_nodes[idx].second};
     }
+  }
 
-    // local is only "def"ined in an ENTIRE block
-    // if it is not read before this
-    // otherwise, some other defined value was needed
-    // as "in"put
-    for (const auto& [block_idx, pos] : first_write) {
-      if (!liveliness.at(block_idx).in.contains(gvar)) {
-        liveliness.at(block_idx).def.emplace(gvar);
-      }
+  // add definitions and uses
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    const auto idx = liveness.Index(GeneralizedVar::Var(var_idx));
+    single.at(var.created.first)[var.created.second].def = idx;
+    for (const auto& pos : var.reads) {
+      single.at(pos.first)[pos.second].use.emplace_back(idx);
     }
   }
-  
-  // function graph may not be acyclic
-  const auto sort = TopSort(deps.block_graph, false);
-  /* Algorithm:
-   * This is an adapted version, since most sources seem to assume that 
-   * "use" and "def" are ALWAYS disjoint, which is not the case for me.
-   * Also, I have a "forced_out" for program results, as these might not
-   * be seen as output for blocks when they should.
-   * 
-   * For every block b:
-   *  out <- U_{b' : succ b} in[b']
-   *  in  <- (use U out) - def
-   * while not stable
-   * 
-   * Go through topological sort in reverse, because we keep updating out
-   * with the in sets of the successors, meaning the variables propagate
-   * faster in reverse order.
-   * 
-   * I think that if a variable is in "out" at some iteration, it will
-   * always be in "out", as the "in" sets will only grow. This means
-   * that for stability checking, we only need to compare the sizes of
-   * the in and out sets to what they were before.
-   * 
-   * There is also no need to clear any of the maps, ensuring they will
-   * only grow.
-   * */
-  bool stable;
-  do {
-    stable = true;
-    for (const auto block_idx : std::ranges::views::reverse(sort)) {
-      auto& l = liveliness.at(block_idx);
-      const auto& node = deps.block_graph.At(block_idx);
-
-      for (const auto& to_idx : node.to) {
-        const auto& lprime = liveliness.at(to_idx);
-        for (const auto& var : lprime.in) {
-          if (l.out.emplace(var).second) {
-            stable = false;
-
-            // element added to out, add to in if not in def
-            // we need to check this because loops may cause
-            // variables to be in both "in" and "def"
-            if (!l.def.contains(var)) {
-              l.in.emplace(var);
-            }
-          }
-        }
-      }
+
+  // same for locals
+  for (const auto& [loc_idx, loc] : deps.local_graph) {
+    if (!loc_idx) continue;
+    const auto idx = liveness.Index(GeneralizedVar::Local(loc_idx));
+    for (const auto& pos : loc.writes) {
+      single.at(pos.first)[pos.second].def = idx;
+    }
+    for (const auto& pos : loc.reads) {
+      single.at(pos.first)[pos.second].use.emplace_back(idx);
     }
-  } while (!stable);
+  }
 
-  for (auto& [block_idx, l] : liveliness) {
+  for (const auto& [block_idx, instrs] : single) {
     /* Single instruction block algorithm:
      *  for every block b:
      *    for every gvar v1 in b.def: 
@@ -171,27 +153,69 @@ RIG RIG::GenerateRIG(const Function& function) {
      *   the new variable's definition.
      * 
      * We fix this by iterating through the block backwards, and updating
-     * in / out according to the "writes".
+     * the live set according to the "writes", starting from "b.out".
+     *
+     * The value copied by a move holds the same value as the def, so
+     * these do not interfere because of the move itself. If they
+     * do interfere, there is an edge from another def.
      * */
-    for (const auto& single : std::ranges::views::reverse(l.single)) {
-      if (single.def.has_value()) {
+    auto live = liveness.LiveOut(block_idx);
+    for (const auto& instr : std::ranges::views::reverse(instrs)) {
+      if (instr.def.has_value()) {
         // local written / variable defined, this counts as a def
         // add edge to RIG
-        const auto& gvar = single.def.value();
+        const auto def = instr.def.value();
+        const auto& def_node = nodes[def];
 
-        // remove def from out
-        l.out.erase(gvar);
+        // remove def from the live set
+        live.Reset(def);
+
+        // add edge to any live variable of the same register type
+        if (def_node.graph) {
+          live.ForEach([&](u32 idx) {
+            if (nodes[idx].graph == def_node.graph && instr.move != idx) {
+              def_node.graph->AddEdge(def_node.idx, nodes[idx].idx);
+            }
+          });
 
-        // add edge to any out variable
-        for (const auto& out_idx : l.out) {
-          rig.graph.AddEdge(gvar.NodeUID(), out_idx.NodeUID());
+          if (instr.move.has_value() && nodes[instr.move.value()].graph == def_node.graph) {
+            def_node.graph->AddMove(def_node.idx, nodes[instr.move.value()].idx, block_idx);
+          }
         }
       }
 
-      // add any used variables back to the "out" set
+      // values that are live across the instruction can not
+      // be assigned a register it overwrites
+      for (const auto& [type, reg_idx] : instr.clobbers) {
+        if (!rig.classes.contains(type)) continue;
+        auto* graph = &rig.classes.at(type);
+        live.ForEach([&](u32 idx) {
+          if (nodes[idx].graph == graph) graph->Exclude(nodes[idx].idx, reg_idx);
+        });
+      }
+
+      // add any used variables back to the live set
       // (they need to be output by any previous instructions)
-      for (const auto& gvar : single.use) {
-        l.out.emplace(gvar);
+      for (const auto& idx : instr.use) {
+        live.Set(idx);
+      }
+    }
+  }
+
+  // argument locals are all written on entry, before the first directive,
+  // so they interfere with each other even if they are not live there
+  cotyl::vector<u32> args{};
+  for (const auto& [loc_idx, loc] : function.locals) {
+    if (loc.type == Local::Type::Aggregate || !loc.non_aggregate.arg_idx.has_value()) continue;
+    const auto gvar = GeneralizedVar::Local(loc_idx);
+    if (liveness.Contains(gvar) && nodes[liveness.Index(gvar)].graph) {
+      args.push_back(liveness.Index(gvar));
+    }
+  }
+  for (u64 i = 0; i < args.size(); i++) {
+    for (u64 j = i + 1; j < args.size(); j++) {
+      if (nodes[args[i]].graph == nodes[args[j]].graph) {
+        nodes[args[i]].graph->AddEdge(nodes[args[i]].idx, nodes[args[j]].idx);
       }
     }
   }
@@ -199,22 +223,19 @@ RIG RIG::GenerateRIG(const Function& function) {
   return std::move(rig);
 }
 
-void RIG::Reduce(const RegisterSpace& regspace) {
-  for (const auto& [nid, node] : graph) {
-    cotyl::flat_set<i64> to_remove{};
-    const auto node_reg_type = regspace.RegisterType(node.value);
-    for (const auto& to_idx : node.to) {
-      if (node_reg_type != regspace.RegisterType(graph.At(to_idx).value)) {
-        to_remove.emplace(to_idx);
-      }
+void RIG::Visualize(const std::string& filename) const {
+  Graph<i64, GeneralizedVar, false> graph{};
+  for (const auto& [type, ig] : classes) {
+    for (u32 node = 0; node < ig.size(); node++) {
+      graph.AddNodeIfNotExists(ig.Value(node).NodeUID(), ig.Value(node));
     }
-    for (const auto& to_idx : to_remove) {
-      graph.RemoveEdge(nid, to_idx);
+    for (u32 node = 0; node < ig.size(); node++) {
+      for (const auto& neighbor : ig.Neighbors(node)) {
+        graph.AddEdge(ig.Value(node).NodeUID(), ig.Value(neighbor).NodeUID());
+      }
     }
   }
-}
 
-void RIG::Visualize(const std::string& filename) const {
   auto vgraph = cycle::VisualGraph(
     graph,
     [](auto idx, auto gvar) -> std::string {
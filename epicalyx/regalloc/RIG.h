@@ -1,7 +1,8 @@
 #pragma once
 
 #include "GeneralizedVar.h"
-#include "cycle/Graph.h"
+#include "InterferenceGraph.h"
+#include "RegisterSpace.h"
 #include "Containers.h"
 
 #include <string>
@@ -10,15 +11,19 @@
 
 namespace epi {
 
-struct RegisterSpace;
-
 struct RIG {
 
-  static RIG GenerateRIG(const calyx::Function& program);
-  void Reduce(const RegisterSpace& regspace);
+  // values can only interfere with values of the same register type,
+  // locals in memory are left out, values that are live across a directive
+  // can not be assigned the registers it overwrites
+  static RIG GenerateRIG(
+          const calyx::Function& program, const RegisterSpace& regspace,
+          const cotyl::unordered_set<loc_index_t>& memory = {}
+  );
   void Visualize(const std::string& filename) const;
 
-  Graph<i64, GeneralizedVar, false> graph{};
+  // interference graph per register type
+  cotyl::unordered_map<register_type_t, InterferenceGraph> classes{};
 };
 
 }
\ No newline at end of file
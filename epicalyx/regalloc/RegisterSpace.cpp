@@ -1,4 +1,5 @@
 #include "RegisterSpace.h"
+#include "Format.h"
 
 
 namespace epi {
@@ -18,4 +19,8 @@ void RegisterSpace::EmitFunction(const Function& function) {
   }
 }
 
+std::string RegisterSpace::RegisterName(const register_t& reg) const {
+  return cotyl::Format("r%d:%d", reg.first, reg.second);
+}
+
 }
\ No newline at end of file
@@ -1,11 +1,13 @@
 #pragma once
 
 #include "Default.h"
+#include "Containers.h"
 #include "GeneralizedVar.h"
 #include "calyx/CalyxFwd.h"
 
 #include <memory>
 #include <optional>
+#include <string>
 
 
 namespace epi {
@@ -26,6 +28,12 @@ namespace epi {
  *   Backend::Emit methods, populating an unordered_map 
  *   mapping GeneralizedVars to potential forced registers.
  *   (for example needed for x86 integer division).
+ * - Registers that are overwritten by a directive (for example
+ *   caller saved registers by calls), which values that are live
+ *   before the directive can not be assigned.
+ * Precolored values that interfere can not both be assigned their
+ * forced register, so a register space that forces registers should
+ * copy these values into short lived vars before allocation.
  * */
 
 using register_type_t = u32;
@@ -54,6 +62,15 @@ struct RegisterSpace {
   virtual register_type_t RegisterType(const GeneralizedVar& gvar) const = 0;
   virtual std::size_t RegisterTypePopulation(const register_type_t& type) const = 0;
   virtual std::optional<register_t> ForcedRegister(const GeneralizedVar& gvar) const = 0;
+
+  // registers overwritten by a directive, values with a forced register are not affected
+  virtual cotyl::vector<register_t> Clobbers(const calyx::AnyDirective& directive) const { return {}; }
+
+  // change the function so that values with a forced register only live
+  // across the directive that needs them in that register, and emit it again
+  virtual void IsolateForcedRegisters(calyx::Function& function) { }
+
+  virtual std::string RegisterName(const register_t& reg) const;
 };
 
 }
\ No newline at end of file
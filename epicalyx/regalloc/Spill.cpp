@@ -0,0 +1,439 @@
+#include "Spill.h"
+#include "Allocator.h"
+#include "optimizer/ProgramDependencies.h"
+#include "optimizer/Liveness.h"
+#include "calyx/Calyx.h"
+#include "calyx/Fields.h"
+#include "Exceptions.h"
+
+#include <algorithm>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+// directives to insert around a directive reading or defining a spilled var
+struct SpillCode {
+  cotyl::vector<AnyDirective> before{};
+  cotyl::vector<AnyDirective> after{};
+
+  // spilled vars read by the directive, and the vars they are reloaded into
+  cotyl::unordered_map<var_index_t, var_index_t> reloads{};
+
+  // split locals accessed by the directive, and the locals of their part
+  cotyl::unordered_map<loc_index_t, loc_index_t> locals{};
+
+  // the directive defines a rematerialized var
+  bool remove = false;
+};
+
+// replace the reads of spilled vars with their reloads,
+// and the accesses of split locals with the locals of their part
+struct ReplaceReloads {
+  const cotyl::unordered_map<var_index_t, var_index_t>& reloads;
+  const cotyl::unordered_map<loc_index_t, loc_index_t>& locals;
+
+  void Var(var_index_t& var_idx) {
+    if (reloads.contains(var_idx)) var_idx = reloads.at(var_idx);
+  }
+  void Local(loc_index_t& loc_idx) {
+    if (locals.contains(loc_idx)) loc_idx = locals.at(loc_idx);
+  }
+  void Block(block_label_t&) { }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // call arguments are shared with copies of the function
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+};
+
+// replace the targets of a branch with the blocks on the edges to them
+struct RetargetBranch {
+  const cotyl::unordered_map<block_label_t, block_label_t>& targets;
+
+  void Var(var_index_t&) { }
+  void Local(loc_index_t&) { }
+  void Block(block_label_t& block_idx) {
+    if (targets.contains(block_idx)) block_idx = targets.at(block_idx);
+  }
+
+  template<typename T>
+  void Value(const T&) { }
+
+  // select tables are shared with copies of the function
+  template<typename T>
+  void Shared(std::shared_ptr<T>& data) { data = std::make_shared<T>(*data); }
+};
+
+bool IsBranch(const AnyDirective& directive) {
+  return directive.visit<bool>(
+    [](const Select&) { return true; },
+    [](const UnconditionalBranch&) { return true; },
+    []<typename T>(const BranchCompare<T>&) { return true; },
+    []<typename T>(const Return<T>&) { return true; },
+    [](const auto&) { return false; }
+  );
+}
+
+// copy of one local into another of the same type, through var_idx
+template<typename T>
+void Move(cotyl::vector<AnyDirective>& moves, loc_index_t from, loc_index_t to, var_index_t var_idx) {
+  moves.emplace_back(LoadLocal<T>{var_idx, from});
+  moves.emplace_back(StoreLocal<T>{to, var_idx});
+}
+
+void Move(cotyl::vector<AnyDirective>& moves, const Local& local, loc_index_t from, loc_index_t to, var_index_t var_idx) {
+  switch (local.type) {
+    case Local::Type::I8: return Move<i8>(moves, from, to, var_idx);
+    case Local::Type::U8: return Move<u8>(moves, from, to, var_idx);
+    case Local::Type::I16: return Move<i16>(moves, from, to, var_idx);
+    case Local::Type::U16: return Move<u16>(moves, from, to, var_idx);
+    case Local::Type::I32: return Move<i32>(moves, from, to, var_idx);
+    case Local::Type::U32: return Move<u32>(moves, from, to, var_idx);
+    case Local::Type::I64: return Move<i64>(moves, from, to, var_idx);
+    case Local::Type::U64: return Move<u64>(moves, from, to, var_idx);
+    case Local::Type::Float: return Move<float>(moves, from, to, var_idx);
+    case Local::Type::Double: return Move<double>(moves, from, to, var_idx);
+    case Local::Type::Pointer: return Move<Pointer>(moves, from, to, var_idx);
+    case Local::Type::Aggregate: break;
+  }
+  throw cotyl::UnreachableException();
+}
+
+// copy of a rematerializable definition, defining var_idx instead
+AnyDirective Rematerialize(const AnyDirective& directive, var_index_t var_idx) {
+  return directive.visit<AnyDirective>(
+    [&]<typename T>(const Imm<T>& op) -> AnyDirective { return Imm<T>{var_idx, op.value}; },
+    [&](const LoadLocalAddr& op) -> AnyDirective { return LoadLocalAddr{var_idx, op.loc_idx}; },
+    [&](const LoadGlobalAddr& op) -> AnyDirective { return LoadGlobalAddr{var_idx, cotyl::CString{op.symbol}}; },
+    [](const auto&) -> AnyDirective { throw cotyl::UnreachableException(); }
+  );
+}
+
+template<typename T>
+Local SpillSlot(loc_index_t loc_idx) {
+  if constexpr(std::is_same_v<T, calyx::Pointer>) {
+    return Local::Pointer(loc_idx, 0);
+  }
+  else {
+    return Local{Local::TypeOf<T>(), loc_idx};
+  }
+}
+
+}
+
+bool Rematerializable(const AnyDirective& directive) {
+  return directive.visit<bool>(
+    []<typename T>(const Imm<T>&) { return true; },
+    [](const LoadLocalAddr&) { return true; },
+    [](const LoadGlobalAddr&) { return true; },
+    [](const auto&) { return false; }
+  );
+}
+
+void FindMemoryLocals(const Function& function, const FunctionDependencies& deps, cotyl::unordered_set<loc_index_t>& memory) {
+  for (const auto& [loc_idx, local] : function.locals) {
+    if (local.type == Local::Type::Aggregate) memory.emplace(loc_idx);
+  }
+  for (const auto& [loc_idx, local] : deps.local_graph) {
+    if (loc_idx && local.needs_address) memory.emplace(loc_idx);
+  }
+}
+
+SpilledVars SpillVars(Function& function, const FunctionDependencies& deps, const cotyl::vector<var_index_t>& vars) {
+  var_index_t next_var = 1;
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    next_var = std::max(next_var, var_idx + 1);
+  }
+  loc_index_t next_loc = 1;
+  for (const auto& [loc_idx, local] : function.locals) {
+    next_loc = std::max(next_loc, loc_idx + 1);
+  }
+
+  SpilledVars result{};
+  cotyl::unordered_map<func_pos_t, SpillCode> code{};
+  for (const auto& var_idx : vars) {
+    const auto& var = deps.var_graph.at(var_idx);
+    const auto& def = function.blocks.at(var.created.first).at(var.created.second);
+    if (Rematerializable(def)) {
+      result.rematerialized++;
+      code[var.created].remove = true;
+      for (const auto& pos : var.reads) {
+        auto& spill = code[pos];
+        if (spill.reloads.contains(var_idx)) continue;
+        const auto reload = next_var++;
+        result.reloads.push_back(reload);
+        spill.reloads.emplace(var_idx, reload);
+        spill.before.emplace_back(Rematerialize(def, reload));
+      }
+      continue;
+    }
+
+    const auto loc_idx = next_loc++;
+    result.locals.push_back(loc_idx);
+    def.visit<void>(
+      [&]<typename D>(const D&) {
+        if constexpr(std::is_base_of_v<Expr, D>) {
+          using T = typename D::result_t;
+          if constexpr(!std::is_same_v<T, void>) {
+            function.locals.emplace(loc_idx, SpillSlot<T>(loc_idx));
+            code[var.created].after.emplace_back(StoreLocal<T>{loc_idx, var_idx});
+            for (const auto& pos : var.reads) {
+              auto& spill = code[pos];
+              if (spill.reloads.contains(var_idx)) continue;
+              const auto reload = next_var++;
+              result.reloads.push_back(reload);
+              spill.reloads.emplace(var_idx, reload);
+              spill.before.emplace_back(LoadLocal<T>{reload, loc_idx});
+            }
+            return;
+          }
+        }
+        throw cotyl::UnreachableException();
+      }
+    );
+  }
+
+  cotyl::unordered_map<block_label_t, BasicBlock> blocks{};
+  for (auto& [block_idx, block] : function.blocks) {
+    auto& spilled = blocks.emplace(block_idx, BasicBlock{}).first->second;
+    for (u64 i = 0; i < block.size(); i++) {
+      auto& directive = block.at(i);
+      if (!code.contains({block_idx, i})) {
+        spilled.push_back(std::move(directive));
+        continue;
+      }
+
+      auto& spill = code.at({block_idx, i});
+      // rematerialized definitions do not read any vars
+      if (spill.remove) continue;
+      for (auto& reload : spill.before) {
+        spilled.push_back(std::move(reload));
+      }
+      if (!spill.reloads.empty()) {
+        auto replace = ReplaceReloads{spill.reloads, spill.locals};
+        VisitFields(directive, replace);
+      }
+      spilled.push_back(std::move(directive));
+      for (auto& store : spill.after) {
+        spilled.push_back(std::move(store));
+      }
+    }
+  }
+  function.blocks = std::move(blocks);
+  return result;
+}
+
+SplitValues SplitAtBlockBoundaries(Function& function, const FunctionDependencies& deps, const cotyl::vector<SplitValue>& values) {
+  var_index_t next_var = 1;
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    next_var = std::max(next_var, var_idx + 1);
+  }
+  loc_index_t next_loc = 1;
+  for (const auto& [loc_idx, local] : function.locals) {
+    next_loc = std::max(next_loc, loc_idx + 1);
+  }
+  block_label_t next_block = Function::Entry;
+  for (const auto& [block_idx, block] : function.blocks) {
+    next_block = std::max(next_block, block_idx + 1);
+  }
+  const auto liveness = Liveness(function, deps);
+
+  SplitValues result{};
+  cotyl::unordered_map<func_pos_t, SpillCode> code{};
+  cotyl::unordered_map<std::pair<block_label_t, block_label_t>, cotyl::vector<AnyDirective>> moves{};
+  for (const auto& value : values) {
+    block_label_t first = value.parts.begin()->first;
+    for (const auto& [block_idx, part] : value.parts) {
+      first = std::min(first, block_idx);
+    }
+
+    // a split local keeps its index in the part of its first block,
+    // parts in memory share a single local
+    cotyl::vector<loc_index_t> locals(value.memory.size(), 0);
+    loc_index_t memory = 0;
+    if (value.gvar.is_local) {
+      const auto part = value.parts.at(first);
+      locals[part] = value.gvar.idx;
+      if (value.memory[part]) memory = value.gvar.idx;
+    }
+    cotyl::vector<loc_index_t> added{};
+    for (u32 part = 0; part < locals.size(); part++) {
+      if (locals[part]) continue;
+      if (value.memory[part] && memory) {
+        locals[part] = memory;
+        continue;
+      }
+      locals[part] = next_loc++;
+      added.push_back(locals[part]);
+      if (value.memory[part]) memory = locals[part];
+    }
+    if (memory) result.memory.push_back(memory);
+    for (const auto& loc_idx : locals) {
+      if (loc_idx != memory) result.locals.push_back(loc_idx);
+    }
+
+    if (value.gvar.is_local) {
+      for (const auto& loc_idx : added) {
+        auto local = function.locals.at(value.gvar.idx);
+        local.idx = loc_idx;
+        local.non_aggregate.arg_idx = {};
+        function.locals.emplace(loc_idx, std::move(local));
+      }
+
+      const auto& local = deps.local_graph.at(value.gvar.idx);
+      for (const auto* accesses : {&local.reads, &local.writes}) {
+        for (const auto& pos : *accesses) {
+          const auto loc_idx = locals[value.parts.at(pos.first)];
+          if (loc_idx != value.gvar.idx) code[pos].locals.emplace(value.gvar.idx, loc_idx);
+        }
+      }
+    }
+    else {
+      const auto var_idx = value.gvar.idx;
+      const auto& var = deps.var_graph.at(var_idx);
+      const auto def_part = value.parts.at(var.created.first);
+      const auto& def = function.blocks.at(var.created.first).at(var.created.second);
+      def.visit<void>(
+        [&]<typename D>(const D&) {
+          if constexpr(std::is_base_of_v<Expr, D>) {
+            using T = typename D::result_t;
+            if constexpr(!std::is_same_v<T, void>) {
+              for (const auto& loc_idx : added) {
+                function.locals.emplace(loc_idx, SpillSlot<T>(loc_idx));
+              }
+
+              // the var is only read directly in its defining block,
+              // if it keeps a register there
+              bool store = liveness.LiveOut(var.created.first, value.gvar);
+              for (const auto& pos : var.reads) {
+                if (pos.first == var.created.first && !value.memory[def_part]) continue;
+                store = true;
+                auto& spill = code[pos];
+                if (spill.reloads.contains(var_idx)) continue;
+                const auto reload = next_var++;
+                result.reloads.push_back(reload);
+                spill.reloads.emplace(var_idx, reload);
+                spill.before.emplace_back(LoadLocal<T>{reload, locals[value.parts.at(pos.first)]});
+              }
+              if (store) {
+                code[var.created].after.emplace_back(StoreLocal<T>{locals[def_part], var_idx});
+              }
+              return;
+            }
+          }
+          throw cotyl::UnreachableException();
+        }
+      );
+    }
+
+    // move between the locals of the parts on the edges into blocks the value is live in
+    for (const auto& [block_idx, part] : value.parts) {
+      if (!liveness.LiveIn(block_idx, value.gvar)) continue;
+      for (const auto& pred : deps.block_graph.At(block_idx).from) {
+        const auto from = locals[value.parts.at(pred)];
+        if (from == locals[part]) continue;
+        const auto var_idx = next_var++;
+        result.reloads.push_back(var_idx);
+        result.moves++;
+        Move(moves[{pred, block_idx}], function.locals.at(from), from, locals[part], var_idx);
+      }
+    }
+  }
+
+  cotyl::vector<std::pair<block_label_t, block_label_t>> edges{};
+  for (const auto& [edge, edge_moves] : moves) {
+    edges.push_back(edge);
+  }
+  std::sort(edges.begin(), edges.end());
+
+  cotyl::unordered_map<block_label_t, cotyl::vector<AnyDirective>> starts{};
+  cotyl::unordered_map<block_label_t, cotyl::vector<AnyDirective>> ends{};
+  cotyl::unordered_map<block_label_t, cotyl::unordered_map<block_label_t, block_label_t>> targets{};
+  cotyl::unordered_map<block_label_t, BasicBlock> blocks{};
+  for (const auto& edge : edges) {
+    const auto& [from, to] = edge;
+    auto& edge_moves = moves.at(edge);
+    cotyl::vector<AnyDirective>* insert;
+    if (deps.block_graph.At(from).to.size() == 1) {
+      insert = &ends[from];
+    }
+    else if (to != Function::Entry && deps.block_graph.At(to).from.size() == 1) {
+      insert = &starts[to];
+    }
+    else {
+      // critical edge
+      const auto block_idx = next_block++;
+      targets[from].emplace(to, block_idx);
+      auto& block = blocks.emplace(block_idx, BasicBlock{}).first->second;
+      for (auto& move : edge_moves) {
+        block.push_back(std::move(move));
+      }
+      block.push_back(UnconditionalBranch{to});
+      continue;
+    }
+    for (auto& move : edge_moves) {
+      insert->push_back(std::move(move));
+    }
+  }
+
+  for (auto& [block_idx, block] : function.blocks) {
+    auto& split = blocks.emplace(block_idx, BasicBlock{}).first->second;
+    if (starts.contains(block_idx)) {
+      for (auto& move : starts.at(block_idx)) {
+        split.push_back(std::move(move));
+      }
+    }
+
+    bool branched = false;
+    for (u64 i = 0; i < block.size(); i++) {
+      auto& directive = block.at(i);
+      if (!branched && IsBranch(directive)) {
+        branched = true;
+        if (ends.contains(block_idx)) {
+          for (auto& move : ends.at(block_idx)) {
+            split.push_back(std::move(move));
+          }
+        }
+        if (targets.contains(block_idx)) {
+          auto retarget = RetargetBranch{targets.at(block_idx)};
+          VisitFields(directive, retarget);
+        }
+      }
+      if (!code.contains({block_idx, i})) {
+        split.push_back(std::move(directive));
+        continue;
+      }
+
+      auto& spill = code.at({block_idx, i});
+      for (auto& reload : spill.before) {
+        split.push_back(std::move(reload));
+      }
+      if (!spill.reloads.empty() || !spill.locals.empty()) {
+        auto replace = ReplaceReloads{spill.reloads, spill.locals};
+        VisitFields(directive, replace);
+      }
+      split.push_back(std::move(directive));
+      for (auto& store : spill.after) {
+        split.push_back(std::move(store));
+      }
+    }
+  }
+  function.blocks = std::move(blocks);
+  return result;
+}
+
+void AssignStackSlots(Allocation& allocation, const cotyl::unordered_set<loc_index_t>& memory) {
+  cotyl::vector<loc_index_t> slots{memory.begin(), memory.end()};
+  std::sort(slots.begin(), slots.end());
+  for (const auto& loc_idx : slots) {
+    allocation.stack_slots.emplace(loc_idx, (u32)allocation.stack_slots.size());
+  }
+}
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "Default.h"
+#include "Containers.h"
+#include "GeneralizedVar.h"
+#include "calyx/CalyxFwd.h"
+
+
+namespace epi {
+
+struct Allocation;
+struct FunctionDependencies;
+
+/*
+ * Spill code shared by the register allocators.
+ * */
+
+// aggregate locals and locals of which the address is taken have to live in memory
+void FindMemoryLocals(
+        const calyx::Function& function, const FunctionDependencies& deps,
+        cotyl::unordered_set<loc_index_t>& memory
+);
+
+// immediates and addresses are cheaper to recompute than to reload
+bool Rematerializable(const calyx::AnyDirective& directive);
+
+struct SpilledVars {
+  // new locals holding the spilled vars, these have to live in memory
+  cotyl::vector<loc_index_t> locals{};
+
+  // vars the spilled vars are loaded or recomputed into before they are read
+  cotyl::vector<var_index_t> reloads{};
+
+  // number of spilled vars that were rematerialized
+  std::size_t rematerialized = 0;
+};
+
+/*
+ * Every spilled var is stored to a new local after its definition,
+ * and loaded from that local into a new var before every directive
+ * reading it, which reads that new var instead.
+ * Vars with a rematerializable definition are not stored, instead their
+ * definition is repeated into a new var before every directive reading
+ * them, and the original definition is removed.
+ * The dependencies are no longer valid after this.
+ * */
+SpilledVars SpillVars(
+        calyx::Function& function, const FunctionDependencies& deps,
+        const cotyl::vector<var_index_t>& vars
+);
+
+struct SplitValue {
+  GeneralizedVar gvar;
+
+  // part of the live range every block the value is live in belongs to,
+  // and which of these parts live in memory
+  cotyl::unordered_map<block_label_t, u32> parts{};
+  cotyl::vector<bool> memory{};
+};
+
+struct SplitValues {
+  // locals of the parts, and those of them that live in memory
+  cotyl::vector<loc_index_t> locals{};
+  cotyl::vector<loc_index_t> memory{};
+
+  // vars that split vars are loaded into before they are read,
+  // and vars that are moved through between parts
+  cotyl::vector<var_index_t> reloads{};
+
+  // number of moves inserted between parts
+  std::size_t moves = 0;
+};
+
+/*
+ * Every part of the live range of a split value gets its own local, which
+ * is accessed instead of the value in the blocks of that part. Parts in
+ * memory share a single local, a split local keeps its own index in the
+ * part of its first block.
+ * A split var is only read directly in its defining block, if that is not
+ * in memory. It is stored to the local of its part after its definition, and
+ * loaded from the local of the part of the block before every other read.
+ * On every edge into a block where the value is live in, of which the
+ * part differs from that of the predecessor, the local of the predecessor
+ * is moved to that of the block. Moves are placed at the end of the
+ * predecessor if it has a single successor, at the start of the block if it
+ * has a single predecessor, or in a new block on the edge otherwise.
+ * The dependencies are no longer valid after this.
+ * */
+SplitValues SplitAtBlockBoundaries(
+        calyx::Function& function, const FunctionDependencies& deps,
+        const cotyl::vector<SplitValue>& values
+);
+
+// number the locals in memory in order of their index
+void AssignStackSlots(Allocation& allocation, const cotyl::unordered_set<loc_index_t>& memory);
+
+}
@@ -0,0 +1,459 @@
+#include "X86_64.h"
+#include "optimizer/ProgramDependencies.h"
+#include "calyx/Calyx.h"
+#include "CustomAssert.h"
+#include "Format.h"
+#include "Exceptions.h"
+
+#include <algorithm>
+#include <type_traits>
+
+
+namespace epi {
+
+using namespace calyx;
+
+namespace {
+
+template<typename T>
+constexpr bool is_vector_type_v = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+template<typename T>
+bool IsIntegerDivision(const Binop<T>& op) {
+  if constexpr(is_calyx_integral_type_v<T>) {
+    return op.op == BinopType::Div || op.op == BinopType::Mod;
+  }
+  return false;
+}
+
+constexpr std::array<const char*, 16> RegisterNames = {
+  "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+  "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+
+}
+
+register_t X86_64RegSpace::Register(GPR reg) {
+  const auto it = std::find(GeneralRegisters.begin(), GeneralRegisters.end(), reg);
+  cotyl::Assert(it != GeneralRegisters.end(), "Register is never allocated");
+  return {static_cast<register_type_t>(RegType::GPR), (register_idx_t)(it - GeneralRegisters.begin())};
+}
+
+register_t X86_64RegSpace::VectorRegister(u32 xmm) {
+  cotyl::Assert(xmm < VectorRegisters, "Register is never allocated");
+  return {static_cast<register_type_t>(RegType::XMM), xmm};
+}
+
+X86_64RegSpace::GPR X86_64RegSpace::GeneralRegister(const register_t& reg) {
+  cotyl::Assert(reg.first == static_cast<register_type_t>(RegType::GPR), "Not a general purpose register");
+  return GeneralRegisters[reg.second];
+}
+
+bool X86_64RegSpace::IsCallerSaved(const register_t& reg) {
+  if (reg.first == static_cast<register_type_t>(RegType::XMM)) return true;
+  return std::find(CalleeSaved.begin(), CalleeSaved.end(), GeneralRegister(reg)) == CalleeSaved.end();
+}
+
+const char* X86_64RegSpace::Name(GPR reg) {
+  return RegisterNames[static_cast<u8>(reg)];
+}
+
+cotyl::vector<std::optional<register_t>> X86_64RegSpace::ArgumentRegisters(const cotyl::vector<Local::Type>& types) {
+  cotyl::vector<std::optional<register_t>> result{};
+  u32 integer = 0;
+  u32 vector = 0;
+  for (const auto& type : types) {
+    switch (type) {
+      case Local::Type::Float:
+      case Local::Type::Double:
+        if (vector < VectorArguments) result.emplace_back(VectorRegister(vector++));
+        else result.emplace_back();
+        break;
+      case Local::Type::Aggregate:
+        // arguments are never aggregates
+        throw cotyl::UnreachableException();
+      default:
+        if (integer < IntegerArguments.size()) result.emplace_back(Register(IntegerArguments[integer++]));
+        else result.emplace_back();
+        break;
+    }
+  }
+  return result;
+}
+
+register_type_t X86_64RegSpace::RegisterType(const GeneralizedVar& gvar) const {
+  return static_cast<register_type_t>(register_type_map.at(gvar));
+}
+
+std::size_t X86_64RegSpace::RegisterTypePopulation(const register_type_t& type) const {
+  switch (static_cast<RegType>(type)) {
+    case RegType::GPR: return GeneralRegisters.size();
+    case RegType::XMM: return VectorRegisters;
+    default: throw cotyl::FormatExcept<RegSpaceError>("Invalid register type: %d", type);
+  }
+}
+
+std::optional<register_t> X86_64RegSpace::ForcedRegister(const GeneralizedVar& gvar) const {
+  if (forced_registers.contains(gvar)) return forced_registers.at(gvar);
+  return {};
+}
+
+cotyl::vector<register_t> X86_64RegSpace::Clobbers(const AnyDirective& directive) const {
+  const auto call = []() {
+    cotyl::vector<register_t> result{};
+    for (register_idx_t idx = 0; idx < GeneralRegisters.size(); idx++) {
+      const auto reg = register_t{static_cast<register_type_t>(RegType::GPR), idx};
+      if (IsCallerSaved(reg)) result.push_back(reg);
+    }
+    for (u32 xmm = 0; xmm < VectorRegisters; xmm++) {
+      result.push_back(VectorRegister(xmm));
+    }
+    return result;
+  };
+
+  return directive.visit<cotyl::vector<register_t>>(
+    [&]<typename T>(const Call<T>&) { return call(); },
+    [&]<typename T>(const CallLabel<T>&) { return call(); },
+    []<typename T>(const Binop<T>& op) -> cotyl::vector<register_t> {
+      if (IsIntegerDivision(op)) return {Register(GPR::Rax), Register(GPR::Rdx)};
+      return {};
+    },
+    [](const auto&) -> cotyl::vector<register_t> { return {}; }
+  );
+}
+
+void X86_64RegSpace::IsolateForcedRegisters(Function& function) {
+  const auto deps = FunctionDependencies::GetDependencies(function);
+  var_index_t next_var = 1;
+  for (const auto& [var_idx, var] : deps.var_graph) {
+    next_var = std::max(next_var, var_idx + 1);
+  }
+
+  // copy src into dst, with the type that src is defined with
+  const auto copy = [&](var_index_t dst, var_index_t src) {
+    const auto& created = deps.var_graph.at(src).created;
+    return function.blocks.at(created.first).at(created.second).visit<AnyDirective>(
+      [&]<typename D>(const D&) -> AnyDirective {
+        if constexpr(std::is_base_of_v<Expr, D>) {
+          using T = typename D::result_t;
+          if constexpr(!std::is_same_v<T, void>) {
+            return Cast<T, T>{dst, src};
+          }
+        }
+        throw cotyl::UnreachableException();
+      }
+    );
+  };
+
+  struct Copies {
+    cotyl::vector<AnyDirective> before{};
+    cotyl::vector<AnyDirective> after{};
+  };
+
+  // replace the forced operands and results of every directive by new vars
+  cotyl::unordered_map<func_pos_t, Copies> code{};
+  for (auto& [block_idx, block] : function.blocks) {
+    for (u64 i = 0; i < block.size(); i++) {
+      Copies copies{};
+      const auto operand = [&](var_index_t& var_idx) {
+        const auto isolated = next_var++;
+        copies.before.emplace_back(copy(isolated, var_idx));
+        var_idx = isolated;
+      };
+      const auto result = [&]<typename T>(Expr& op) {
+        const auto isolated = next_var++;
+        copies.after.emplace_back(Cast<T, T>{op.idx, isolated});
+        op.idx = isolated;
+      };
+      const auto args = [&](std::shared_ptr<ArgData>& data) {
+        // call arguments are shared with copies of the function
+        data = std::make_shared<ArgData>(*data);
+        cotyl::vector<Local::Type> types{};
+        for (const auto& [var_idx, arg] : data->args) types.push_back(arg.type);
+        for (const auto& [var_idx, arg] : data->var_args) types.push_back(arg.type);
+        const auto registers = ArgumentRegisters(types);
+
+        std::size_t idx = 0;
+        for (auto& [var_idx, arg] : data->args) {
+          if (registers[idx++].has_value()) operand(var_idx);
+        }
+        for (auto& [var_idx, arg] : data->var_args) {
+          if (registers[idx++].has_value()) operand(var_idx);
+        }
+      };
+
+      block.at(i).visit<void>(
+        [&]<typename T>(Call<T>& op) {
+          args(op.args);
+          if constexpr(!std::is_same_v<T, void>) result.template operator()<T>(op);
+        },
+        [&]<typename T>(CallLabel<T>& op) {
+          args(op.args);
+          if constexpr(!std::is_same_v<T, void>) result.template operator()<T>(op);
+        },
+        [&]<typename T>(Return<T>& op) {
+          if constexpr(!std::is_same_v<T, void>) {
+            if (op.val.IsVar()) operand(op.val.GetVar());
+          }
+        },
+        [&]<typename T>(Binop<T>& op) {
+          if (IsIntegerDivision(op)) {
+            operand(op.left_idx);
+            result.template operator()<T>(op);
+          }
+        },
+        [&]<typename T>(Shift<T>& op) {
+          if (op.right.IsVar()) operand(op.right.GetVar());
+        },
+        [](auto&) { }
+      );
+
+      if (!copies.before.empty() || !copies.after.empty()) {
+        code.emplace(func_pos_t{block_idx, (int)i}, std::move(copies));
+      }
+    }
+  }
+
+  cotyl::unordered_map<block_label_t, BasicBlock> blocks{};
+  for (auto& [block_idx, block] : function.blocks) {
+    auto& isolated = blocks.emplace(block_idx, BasicBlock{}).first->second;
+    for (u64 i = 0; i < block.size(); i++) {
+      if (!code.contains({block_idx, (int)i})) {
+        isolated.push_back(std::move(block.at(i)));
+        continue;
+      }
+
+      auto& copies = code.at({block_idx, (int)i});
+      for (auto& directive : copies.before) {
+        isolated.push_back(std::move(directive));
+      }
+      isolated.push_back(std::move(block.at(i)));
+      for (auto& directive : copies.after) {
+        isolated.push_back(std::move(directive));
+      }
+    }
+  }
+  function.blocks = std::move(blocks);
+
+  register_type_map.clear();
+  forced_registers.clear();
+  EmitFunction(function);
+}
+
+std::string X86_64RegSpace::RegisterName(const register_t& reg) const {
+  switch (static_cast<RegType>(reg.first)) {
+    case RegType::GPR: return Name(GeneralRegister(reg));
+    case RegType::XMM: return cotyl::Format("xmm%d", reg.second);
+    default: throw cotyl::FormatExcept<RegSpaceError>("Invalid register type: %d", reg.first);
+  }
+}
+
+template<typename T>
+void X86_64RegSpace::OutputGVar(const GeneralizedVar& gvar) {
+  const auto type = is_vector_type_v<T> ? RegType::XMM : RegType::GPR;
+  cotyl::Assert(!register_type_map.contains(gvar) || (register_type_map[gvar] == type));
+  register_type_map[gvar] = type;
+}
+
+template<typename T>
+void X86_64RegSpace::OutputVar(var_index_t var_idx) {
+  OutputGVar<T>(GeneralizedVar::Var(var_idx));
+}
+
+template<typename T>
+void X86_64RegSpace::OutputExpr(const Expr& expr) {
+  static_assert(is_calyx_type_v<T>, "Invalid type for expression variable result");
+  OutputVar<T>(expr.idx);
+}
+
+void X86_64RegSpace::ForceVar(var_index_t var_idx, const register_t& reg) {
+  // vars may be forced into different registers before they are isolated
+  forced_registers.emplace(GeneralizedVar::Var(var_idx), reg);
+}
+
+template<typename T>
+void X86_64RegSpace::ForceReturnValue(var_index_t var_idx) {
+  if constexpr(is_vector_type_v<T>) {
+    ForceVar(var_idx, VectorRegister(0));
+  }
+  else {
+    ForceVar(var_idx, Register(GPR::Rax));
+  }
+}
+
+void X86_64RegSpace::ForceArgs(const ArgData& args) {
+  cotyl::vector<Local::Type> types{};
+  for (const auto& [var_idx, arg] : args.args) types.push_back(arg.type);
+  for (const auto& [var_idx, arg] : args.var_args) types.push_back(arg.type);
+  const auto registers = ArgumentRegisters(types);
+
+  std::size_t idx = 0;
+  for (const auto& [var_idx, arg] : args.args) {
+    if (registers[idx].has_value()) ForceVar(var_idx, registers[idx].value());
+    idx++;
+  }
+  for (const auto& [var_idx, arg] : args.var_args) {
+    if (registers[idx].has_value()) ForceVar(var_idx, registers[idx].value());
+    idx++;
+  }
+}
+
+template<typename To, typename From>
+void X86_64RegSpace::Emit(const Cast<To, From>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  OutputVar<calyx_op_type(op)::src_t>(op.right_idx);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const LoadLocal<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+}
+
+void X86_64RegSpace::Emit(const LoadLocalAddr& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const StoreLocal<T>& op) {
+  if (op.src.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.src.GetVar());
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const LoadGlobal<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+}
+
+void X86_64RegSpace::Emit(const LoadGlobalAddr& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const StoreGlobal<T>& op) {
+  if (op.src.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.src.GetVar());
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const LoadFromPointer<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  OutputVar<calyx::Pointer>(op.ptr_idx);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const StoreToPointer<T>& op) {
+  if (op.src.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.src.GetVar());
+  OutputVar<calyx::Pointer>(op.ptr_idx);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const AddToPointer<T>& op) {
+  OutputExpr<calyx::Pointer>(op);
+  if (op.ptr.IsVar()) OutputVar<calyx::Pointer>(op.ptr.GetVar());
+  if (op.right.IsVar()) OutputVar<calyx_op_type(op)::offset_t>(op.right.GetVar());
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Call<T>& op) {
+  if constexpr(!std::is_same_v<T, void>) {
+    OutputVar<calyx_op_type(op)::result_t>(op.idx);
+    ForceReturnValue<T>(op.idx);
+  }
+  OutputVar<calyx::Pointer>(op.fn_idx);
+  ForceArgs(*op.args);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const CallLabel<T>& op) {
+  if constexpr(!std::is_same_v<T, void>) {
+    OutputVar<calyx_op_type(op)::result_t>(op.idx);
+    ForceReturnValue<T>(op.idx);
+  }
+  ForceArgs(*op.args);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Return<T>& op) {
+  if constexpr(!std::is_same_v<T, void>) {
+    if (op.val.IsVar()) {
+      OutputVar<calyx_op_type(op)::src_t>(op.val.GetVar());
+      ForceReturnValue<T>(op.val.GetVar());
+    }
+  }
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Imm<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Unop<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  OutputVar<calyx_op_type(op)::src_t>(op.right_idx);
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Binop<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  OutputVar<calyx_op_type(op)::src_t>(op.left_idx);
+  if (op.right.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.right.GetVar());
+
+  // idiv divides rdx:rax, and leaves the quotient in rax and the remainder in rdx
+  if (IsIntegerDivision(op)) {
+    ForceVar(op.left_idx, Register(GPR::Rax));
+    ForceVar(op.idx, Register(op.op == BinopType::Div ? GPR::Rax : GPR::Rdx));
+  }
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Shift<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  if (op.left.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.left.GetVar());
+  if (op.right.IsVar()) {
+    // variable shift counts are in cl
+    OutputVar<calyx_op_type(op)::shift_t>(op.right.GetVar());
+    ForceVar(op.right.GetVar(), Register(GPR::Rcx));
+  }
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const Compare<T>& op) {
+  OutputExpr<calyx_op_type(op)::result_t>(op);
+  OutputVar<calyx_op_type(op)::src_t>(op.left_idx);
+  if (op.right.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.right.GetVar());
+}
+
+void X86_64RegSpace::Emit(const UnconditionalBranch& op) {
+
+}
+
+template<typename T>
+void X86_64RegSpace::Emit(const BranchCompare<T>& op) {
+  OutputVar<calyx_op_type(op)::src_t>(op.left_idx);
+  if (op.right.IsVar()) OutputVar<calyx_op_type(op)::src_t>(op.right.GetVar());
+}
+
+void X86_64RegSpace::Emit(const Select& op) {
+  OutputVar<calyx_op_type(op)::src_t>(op.idx);
+}
+
+void X86_64RegSpace::Emit(const AnyDirective& dir) {
+  dir.visit<void>([&](const auto& d) { Emit(d); });
+}
+
+void X86_64RegSpace::Emit(var_index_t loc_idx, const Local& loc) {
+  auto gvar = GeneralizedVar::Local(loc_idx);
+  switch (loc.type) {
+    case Local::Type::Float:
+    case Local::Type::Double:
+      register_type_map.emplace(gvar, RegType::XMM);
+      return;
+    case Local::Type::Aggregate:
+      register_type_map.emplace(gvar, RegType::Stack);
+      return;
+    default:
+      register_type_map.emplace(gvar, RegType::GPR);
+      return;
+  }
+}
+
+}
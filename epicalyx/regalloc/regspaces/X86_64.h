@@ -0,0 +1,133 @@
+#pragma once
+
+#include "RegisterSpace.h"
+#include "Containers.h"
+#include "calyx/Types.h"
+
+#include <array>
+
+
+namespace epi {
+
+/*
+ * Register space for x86-64 under the System V ABI.
+ * Integers and pointers are held in general purpose registers, floats and
+ * doubles in the lower part of xmm registers. Register indices are
+ * positions in the allocation order of the registers of their type.
+ * rsp and rbp hold the stack and frame pointer, and r11 and xmm15 are
+ * never allocated, so that the backend can always use them as scratch
+ * registers. Caller saved registers are allocated first, so that functions
+ * that do not call other functions do not have to save any registers.
+ * Arguments and return values of calls, the dividend and result of integer
+ * division and the shift count of shifts are forced into the registers the
+ * ABI or the instructions require. These are isolated before allocation:
+ * they are copied into a new var right before the directive using them,
+ * and results are copied out of a new var right after it.
+ * Calls overwrite all caller saved registers, and integer division
+ * overwrites rax and rdx.
+ * */
+struct X86_64RegSpace final : RegisterSpace {
+
+  enum class RegType : register_type_t {
+    GPR, XMM, Stack
+  };
+
+  // general purpose registers, in order of their encoding
+  enum class GPR : u8 {
+    Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi,
+    R8, R9, R10, R11, R12, R13, R14, R15
+  };
+
+  // allocation order of the general purpose registers
+  static constexpr std::array<GPR, 13> GeneralRegisters = {
+    GPR::Rax, GPR::Rcx, GPR::Rdx, GPR::Rsi, GPR::Rdi, GPR::R8, GPR::R9, GPR::R10,
+    GPR::Rbx, GPR::R12, GPR::R13, GPR::R14, GPR::R15
+  };
+  // xmm0 - xmm14, all caller saved
+  static constexpr u32 VectorRegisters = 15;
+
+  static constexpr std::array<GPR, 6> IntegerArguments = {
+    GPR::Rdi, GPR::Rsi, GPR::Rdx, GPR::Rcx, GPR::R8, GPR::R9
+  };
+  static constexpr u32 VectorArguments = 8;
+
+  static constexpr std::array<GPR, 6> CalleeSaved = {
+    GPR::Rbx, GPR::Rbp, GPR::R12, GPR::R13, GPR::R14, GPR::R15
+  };
+
+  cotyl::unordered_map<GeneralizedVar, RegType> register_type_map{};
+  cotyl::unordered_map<GeneralizedVar, register_t> forced_registers{};
+
+  static register_t Register(GPR reg);
+  static register_t VectorRegister(u32 xmm);
+  static GPR GeneralRegister(const register_t& reg);
+  static bool IsCallerSaved(const register_t& reg);
+  static const char* Name(GPR reg);
+
+  // registers the arguments of the given types are passed in, in order,
+  // arguments that are passed on the stack have no register
+  static cotyl::vector<std::optional<register_t>> ArgumentRegisters(const cotyl::vector<calyx::Local::Type>& types);
+
+  register_type_t RegisterType(const GeneralizedVar& gvar) const final;
+  std::size_t RegisterTypePopulation(const register_type_t& type) const final;
+  std::optional<register_t> ForcedRegister(const GeneralizedVar& gvar) const final;
+  cotyl::vector<register_t> Clobbers(const calyx::AnyDirective& directive) const final;
+  void IsolateForcedRegisters(calyx::Function& function) final;
+  std::string RegisterName(const register_t& reg) const final;
+
+  template<typename T>
+  void OutputGVar(const GeneralizedVar& gvar);
+  template<typename T>
+  void OutputVar(var_index_t var_idx);
+  template<typename T>
+  void OutputExpr(const calyx::Expr& expr);
+  void ForceVar(var_index_t var_idx, const register_t& reg);
+  template<typename T>
+  void ForceReturnValue(var_index_t var_idx);
+  void ForceArgs(const calyx::ArgData& args);
+
+  void Emit(const calyx::AnyDirective& dir) final;
+  void Emit(var_index_t loc_idx, const calyx::Local& loc) final;
+
+  void Emit(const calyx::NoOp& op) { }
+  template<typename To, typename From>
+  void Emit(const calyx::Cast<To, From>& op);
+  template<typename T>
+  void Emit(const calyx::LoadLocal<T>& op);
+  void Emit(const calyx::LoadLocalAddr& op);
+  template<typename T>
+  void Emit(const calyx::StoreLocal<T>& op);
+  template<typename T>
+  void Emit(const calyx::LoadGlobal<T>& op);
+  void Emit(const calyx::LoadGlobalAddr& op);
+  template<typename T>
+  void Emit(const calyx::StoreGlobal<T>& op);
+  template<typename T>
+  void Emit(const calyx::LoadFromPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::StoreToPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::AddToPointer<T>& op);
+  template<typename T>
+  void Emit(const calyx::Call<T>& op);
+  template<typename T>
+  void Emit(const calyx::CallLabel<T>& op);
+  template<typename T>
+  void Emit(const calyx::Return<T>& op);
+  template<typename T>
+  void Emit(const calyx::Imm<T>& op);
+  template<typename T>
+  void Emit(const calyx::Unop<T>& op);
+  template<typename T>
+  void Emit(const calyx::Binop<T>& op);
+  template<typename T>
+  void Emit(const calyx::Shift<T>& op);
+  template<typename T>
+  void Emit(const calyx::Compare<T>& op);
+  template<typename T>
+  void Emit(const calyx::BranchCompare<T>& op);
+  void Emit(const calyx::UnconditionalBranch& op);
+  void Emit(const calyx::Select& op);
+};
+
+}
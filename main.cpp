@@ -1,14 +1,21 @@
 #include <iostream>
+#include <fstream>
 
 #include "ir_emitter/Emitter.h"
 #include "calyx/backend/interpreter/Interpreter.h"
 #include "optimizer/ProgramDependencies.h"
-#include "optimizer/BasicOptimizer.h"
+#include "optimizer/ProgramOptimizer.h"
 #include "tokenizer/Preprocessor.h"
 #include "tokenizer/Tokenizer.h"
 #include "parser/Parser.h"
 #include "regalloc/RIG.h"
+#include "regalloc/Allocator.h"
+#include "regalloc/LinearScan.h"
 #include "regalloc/regspaces/Example.h"
+#include "regalloc/regspaces/X86_64.h"
+#include "calyx/backend/x86_64/Backend.h"
+#include "calyx/backend/x86_64/Assembly.h"
+#include "calyx/backend/x86_64/Object.h"
 #include "config/Info.h"
 #include "Decltype.h"
 #include "Exceptions.h"
@@ -89,21 +96,26 @@ int main(int argc, char** argv) {
   auto program = std::move(emitter.program);
 //   epi::calyx::PrintProgram(program);
 
-  for (auto& [sym, func] : program.functions) {
-    // repeating multiple times will link more blocks
-    auto func_hash = func.Hash();
-    while (true) {
-      std::cout << "Optimizing function " << sym.c_str() << " hash " << func_hash << "..." << std::endl;
-      SafeRun(ce) << [&]{
-        auto optimizer = epi::BasicOptimizer(std::move(func));
-        func = optimizer.Optimize();
-      };
-
-      auto new_hash = func.Hash();
-      if (func_hash == new_hash) break;
-      func_hash = new_hash;
+  SafeRun(ce) << [&]{
+    auto pipeline = settings.passes.empty() 
+        ? epi::PassPipeline::FromLevel(settings.opt_level) 
+        : epi::PassPipeline::Parse(settings.passes);
+    if (settings.max_iterations) {
+      pipeline.max_iterations = settings.max_iterations;
+    }
+    if (settings.unroll_factor) {
+      pipeline.options.unroll.factor = settings.unroll_factor;
+    }
+    if (settings.unroll_budget) {
+      pipeline.options.unroll.budget = settings.unroll_budget;
     }
-  }
+
+    const auto passes = epi::PassManager(std::move(pipeline));
+    auto stats = epi::OptimizeProgram(program, passes, settings.jobs);
+    if (settings.time_passes) {
+      passes.PrintReport(stats);
+    }
+  };
 
 //   epi::calyx::PrintProgram(program);
 
@@ -121,6 +133,21 @@ int main(int argc, char** argv) {
     epi::calyx::VisualizeProgram(program, "output/program.pdf");
   }
 
+  if (!settings.assembly.empty() || !settings.object.empty()) {
+    SafeRun(ce) << [&]{
+      auto backend = epi::x86_64::Backend(settings.regalloc == "linear");
+      backend.Emit(program);
+      if (!settings.assembly.empty()) {
+        auto out = std::ofstream(settings.assembly);
+        epi::x86_64::WriteAssembly(backend.module, out);
+      }
+      if (!settings.object.empty()) {
+        auto out = std::ofstream(settings.object, std::ios::binary);
+        epi::x86_64::WriteObject(backend.module, out);
+      }
+    };
+  }
+
   int returned = -1;
   SafeRun(ce) << [&]{
     epi::calyx::Interpreter interpreter{};
@@ -149,25 +176,49 @@ int main(int argc, char** argv) {
   if (program.functions.contains(rig_func_sym)) {
     SafeRun(ce) << [&]{
       const auto& rig_func = program.functions.at(rig_func_sym);
-      auto rig = epi::RIG::GenerateRIG(rig_func);
-
-      auto regspace = epi::RegisterSpace::GetRegSpace<epi::ExampleRegSpace>(rig_func);
-      for (const auto& [gvar, regtype] : regspace->register_type_map) {
-        if (gvar.is_local) std::cout << 'c';
-        else std::cout << 'v';
-        std::cout << gvar.idx << ' ';
-        switch (regtype) {
-          case epi::ExampleRegSpace::RegType::GPR: std::cout << "GPR"; break;
-          case epi::ExampleRegSpace::RegType::FPR: std::cout << "FPR"; break;
-          case epi::ExampleRegSpace::RegType::Stack: std::cout << "Stack"; break;
+      std::unique_ptr<epi::RegisterSpace> regspace;
+      if (settings.regspace == "x86-64") {
+        regspace = epi::RegisterSpace::GetRegSpace<epi::X86_64RegSpace>(rig_func);
+      }
+      else {
+        auto example = epi::RegisterSpace::GetRegSpace<epi::ExampleRegSpace>(rig_func);
+        for (const auto& [gvar, regtype] : example->register_type_map) {
+          if (gvar.is_local) std::cout << 'c';
+          else std::cout << 'v';
+          std::cout << gvar.idx << ' ';
+          switch (regtype) {
+            case epi::ExampleRegSpace::RegType::GPR: std::cout << "GPR"; break;
+            case epi::ExampleRegSpace::RegType::FPR: std::cout << "FPR"; break;
+            case epi::ExampleRegSpace::RegType::Stack: std::cout << "Stack"; break;
+          }
+          std::cout << std::endl;
         }
-        std::cout << std::endl;
+        regspace = std::move(example);
       }
+      auto rig = epi::RIG::GenerateRIG(rig_func, *regspace);
 
-      rig.Reduce(*regspace);
       if (!settings.novisualize) {
         rig.Visualize("output/rig.pdf");
       }
+
+      // the allocator inserts spill code, so allocate for a copy
+      auto alloc_func = rig_func;
+      auto allocation = settings.regalloc == "linear"
+          ? epi::LinearScan(alloc_func, *regspace).Run()
+          : epi::Allocator(alloc_func, *regspace).Run();
+      std::cout << std::endl << "-- allocation (" << allocation.rounds << " rounds, "
+                << allocation.spilled << " spilled, "
+                << allocation.rematerialized << " rematerialized, "
+                << allocation.split << " split, "
+                << allocation.coalesced << " moves coalesced)" << std::endl;
+      for (const auto& [gvar, reg] : allocation.registers) {
+        if (gvar.is_local) std::cout << 'c';
+        else std::cout << 'v';
+        std::cout << gvar.idx << ' ' << regspace->RegisterName(reg) << std::endl;
+      }
+      for (const auto& [loc_idx, slot] : allocation.stack_slots) {
+        std::cout << 'c' << loc_idx << " stack " << slot << std::endl;
+      }
     };
   }
 
@@ -0,0 +1,50 @@
+int h;
+
+int
+early(int a, int b)
+{
+	int x;
+
+	/* a is dead before b is written, but the incoming
+	 * value of b is written on entry as well */
+	x = a + 1;
+	b = x * 2;
+	return b + x;
+}
+
+int
+overwritten(int a, int b, int c, int d)
+{
+	/* b and d are overwritten before they are read */
+	b = a * 3;
+	d = c + 1;
+	return a * 1000 + b * 100 + c * 10 + d;
+}
+
+int
+loop(int a, int n)
+{
+	int s;
+
+	/* a is dead before n is written */
+	h = a;
+	n = 3;
+	s = 0;
+	while (n) {
+		s += n;
+		n--;
+	}
+	return s + h;
+}
+
+int
+main(void)
+{
+	if (early(1, 100) != 6)
+		return 1;
+	if (overwritten(1, 5, 2, 7) != 1323)
+		return 2;
+	if (loop(10, 100) != 16)
+		return 3;
+	return 0;
+}
@@ -0,0 +1,25 @@
+int
+second(int p[])
+{
+	return p[1];
+}
+
+int *
+same(int p[3])
+{
+	return p;
+}
+
+int
+main(void)
+{
+	int a[3];
+	int *q;
+
+	a[0] = 4;
+	a[1] = 7;
+	a[2] = 9;
+	/* array parameters are pointers to the first element */
+	q = same(a);
+	return second(a) + *q + q[2];
+}
@@ -0,0 +1,16 @@
+int
+main(void)
+{
+	double x;
+	double y;
+
+	x = 1.0;
+	/* division of a float by 0 is well defined, it must not be folded */
+	y = x / 0.0;
+	if (y < 1e300)
+		return 1;
+	y = -x / 0.0;
+	if (y > -1e300)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,19 @@
+int
+main(void)
+{
+	double a;
+	float b;
+	double c;
+	double *pa;
+	float *pb;
+	double *pc;
+
+	/* the addresses are taken, so the locals are in memory */
+	pa = &a;
+	pb = &b;
+	pc = &c;
+	*pa = 1.5;
+	*pb = 2.25;
+	*pc = 4.0;
+	return (int)(*pa * 4 + *pb * 4 + *pc);
+}
@@ -0,0 +1,11 @@
+int abs(int x);
+
+int
+main(void)
+{
+	int (*f)(int);
+
+	/* declared functions are defined elsewhere, they are not data */
+	f = abs;
+	return f(-42);
+}
@@ -0,0 +1,51 @@
+int *g;
+int **gp;
+int h;
+
+int
+read(void)
+{
+	return *g;
+}
+
+void
+write(int v)
+{
+	*g = v;
+}
+
+void
+redirect(void)
+{
+	/* writes the global g through a pointer */
+	*gp = &h;
+}
+
+int
+main(void)
+{
+	int x;
+	int y;
+	int r;
+	int **pp;
+
+	/* read only callee reads a local through a global */
+	x = 1;
+	g = &x;
+	x = 2;
+	r = read();
+
+	/* callee writes a local that escaped through a global */
+	pp = &g;
+	y = 3;
+	*pp = &y;
+	write(4);
+	r = r * 10 + y;
+
+	/* callee changes where the global points */
+	h = 5;
+	gp = &g;
+	redirect();
+	r = r * 10 + *g;
+	return r;
+}
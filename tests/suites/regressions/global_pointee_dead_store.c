@@ -0,0 +1,26 @@
+int *g;
+
+int
+read(void)
+{
+	return *g;
+}
+
+int
+main(void)
+{
+	int x;
+	int y;
+	int z;
+	int **pp;
+
+	pp = &g;
+	x = 1;
+	/* x escapes through the global, the stores to it are read through g */
+	*pp = &x;
+	y = *g;
+	x = 2;
+	z = read();
+	x = 3;
+	return y * 100 + z * 10 + *g;
+}
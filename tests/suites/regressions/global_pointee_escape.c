@@ -0,0 +1,15 @@
+int *g;
+
+int
+main(void)
+{
+	int x;
+	int **pp;
+
+	x = 1;
+	pp = &g;
+	/* x escapes through the global, the store to it must not be dropped */
+	*pp = &x;
+	x = 5;
+	return *g;
+}
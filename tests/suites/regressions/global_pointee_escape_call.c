@@ -0,0 +1,21 @@
+int *g;
+
+int
+read(void)
+{
+	return *g;
+}
+
+int
+main(void)
+{
+	int x;
+	int **pp;
+
+	x = 1;
+	pp = &g;
+	/* x escapes through the global, the call may read it */
+	*pp = &x;
+	x = 5;
+	return read();
+}
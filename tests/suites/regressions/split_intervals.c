@@ -0,0 +1,84 @@
+int
+f(int x)
+{
+	return x + 1;
+}
+
+int
+branches(int n)
+{
+	int a, b, c, d, e, g, h, i, j, k, l, m, o, p, q, r;
+	int s, t;
+
+	/* more values live across the loop than there are registers,
+	 * while the branches in it only use some of them */
+	a = f(1); b = f(2); c = f(3); d = f(4);
+	e = f(5); g = f(6); h = f(7); i = f(8);
+	j = f(9); k = f(10); l = f(11); m = f(12);
+	o = f(13); p = f(14); q = f(15); r = f(16);
+	s = 0;
+	for (t = 0; t < n; t++) {
+		if (t & 1)
+			s += a * t + b - c;
+		else
+			s -= d * t + e - g;
+		if (t & 2)
+			s += h + i * j;
+		else
+			s ^= k + l;
+	}
+	s += f(s);
+	return s + m + o + p + q + r + a + b + c + d + e + g + h + i + j + k + l;
+}
+
+int
+types(int n)
+{
+	char a, b, c;
+	short d, e;
+	double x, y, z;
+	int arr[4];
+	int *p, *q;
+	int s, t;
+
+	a = f(1); b = f(2); c = f(3);
+	d = f(400); e = f(500);
+	x = f(6) / 4.0; y = f(7) / 8.0; z = f(8);
+	arr[0] = f(0); arr[1] = f(1); arr[2] = f(2); arr[3] = f(3);
+	p = &arr[1];
+	q = &arr[3];
+	s = 0;
+	for (t = 0; t < n; t++) {
+		switch (t % 5) {
+		case 0:
+			s += a + *p;
+			break;
+		case 1:
+			s += b * d;
+			x += y;
+			break;
+		case 2:
+			s -= c + e;
+			break;
+		case 3:
+			z -= x;
+			s += *q;
+			break;
+		default:
+			y *= 2;
+			break;
+		}
+		s += f(t);
+	}
+	return s + a + b + c + d + e + (int)(x + y + z) + *p + *q;
+}
+
+int
+main(void)
+{
+	if (branches(10) != 953)
+		return 1;
+	if (types(23) != 4743)
+		return 2;
+	return 0;
+}
@@ -0,0 +1,43 @@
+int
+sum(int n, int acc)
+{
+	if (n == 0)
+		return acc;
+	return sum(n - 1, acc + n);
+}
+
+int
+gcd(int a, int b)
+{
+	if (b == 0)
+		return a;
+	/* arguments swap places, they must not be overwritten one by one */
+	return gcd(b, a % b);
+}
+
+int
+deref(int n, int *p)
+{
+	int x;
+
+	if (n == 0)
+		return *p;
+	/* the address of a local is passed to the next iteration */
+	x = *p + n;
+	return deref(n - 1, &x);
+}
+
+int
+main(void)
+{
+	int start;
+
+	start = 1;
+	if (sum(10000, 0) != 50005000)
+		return 1;
+	if (gcd(1071, 462) != 21)
+		return 2;
+	if (deref(5, &start) != 16)
+		return 3;
+	return 0;
+}
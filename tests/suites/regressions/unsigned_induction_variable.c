@@ -0,0 +1,17 @@
+int
+main(void)
+{
+	int a[8];
+	int s;
+	unsigned i;
+
+	for (i = 0; i < 8; i++)
+		a[i] = i;
+	s = 0;
+	/* the counter decreases, its step is negative even though it is unsigned */
+	for (i = 7; i > 0; i--)
+		s += a[i];
+	for (i = 8; i != 0; i -= 2)
+		s += a[i - 1];
+	return s;
+}
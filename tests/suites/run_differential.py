@@ -0,0 +1,285 @@
+import subprocess
+import os
+import re
+import sys
+import shutil
+from concurrent.futures import ThreadPoolExecutor
+from typing import NamedTuple, Dict, Optional, Tuple
+
+
+# compile every test without and with optimizations, run it in the interpreter
+# and natively through the assembly and object file backends, with both register
+# allocators, and compare the exit codes
+# every configuration that does not produce an exit code is a failure,
+# unless the test is a known failure
+
+TIMEOUT = 20
+
+# tests with undefined behavior, for which the exit codes may differ
+UNDEFINED = {
+    "0140-int_fold.c",  # remainder by 0
+}
+
+# tests that are known to fail, and why
+KNOWN_FAILURES = {
+    "0017-struct.c": "member access is not implemented",
+    "0018-structptr.c": "member access through pointers is not implemented",
+    "0019-selfrefstruct.c": "member access is not implemented",
+    "0024-typedefstruct.c": "global structs are not implemented",
+    "0025-string.c": "string constants are not implemented",
+    "0027-charval.c": "string constants are not implemented",
+    "0038-ptradd.c": "pointer differences are not implemented",
+    "0041-queen.c": "the interpreter can not call external functions",
+    "0043-union.c": "unions are not implemented",
+    "0044-struct.c": "member access is not implemented",
+    "0045-struct.c": "member access is not implemented",
+    "0047-anonexport.c": "anonymous members are not implemented",
+    "0048-inits.c": "global structs are not implemented",
+    "0049-inits.c": "global structs are not implemented",
+    "0050-inits.c": "global structs are not implemented",
+    "0051-inits.c": "global structs are not implemented",
+    "0052-switch.c": "the interpreter asserts on switch values without a case",
+    "0053-struct.c": "member access is not implemented",
+    "0054-struct.c": "member access is not implemented",
+    "0059-multistring.c": "string constants are not implemented",
+    "0090-fptr.c": "member access is not implemented",
+    "0092-fptr.c": "global structs are not implemented",
+    "0093-arrayinit.c": "global arrays are not implemented",
+    "0094-arrayinit.c": "global arrays are not implemented",
+    "0095-arrayselector.c": "global arrays are not implemented",
+    "0096-inferredarraysize.c": "global arrays are not implemented",
+    "0109-struct.c": "member access is not implemented",
+    "0115-null_comparision.c": "string constants are not implemented",
+    "0117-pointarith.c": "pointer differences are not implemented",
+    "0119-macrostr.c": "global arrays are not implemented",
+    "0121-localinit.c": "initializer lists are not implemented",
+    "0122-localinit.c": "initializer lists are not implemented",
+    "0124-enumstruct.c": "global structs are not implemented",
+    "0129-initi.c": "global arrays are not implemented",
+    "0131-hello.c": "string constants are not implemented",
+    "0132-forward.c": "member access is not implemented",
+    "0138-namespace.c": "global structs are not implemented",
+    "0147-intern_cpp.c": "string constants are not implemented",
+    "0148-cpp_string.c": "string constants are not implemented",
+    "0149-define.c": "string constants are not implemented",
+    "0151-vararg.c": "aggregate arguments are not implemented",
+    "0153-cpp_string.c": "string constants are not implemented",
+    "0155-struct_compl.c": "global structs are not implemented",
+    "0157-list.c": "global structs are not implemented",
+    "0158-ternary.c": "conditionals between void and other pointers are rejected",
+    "0159-typedef.c": "global structs are not implemented",
+    "0161-struct.c": "global structs are not implemented",
+    "0162-array.c": "global arrays are not implemented",
+    "0163-array.c": "global arrays are not implemented",
+    "0164-struct.c": "compound literals are not implemented",
+    "0165-struct.c": "designated initializers are not implemented",
+    "0166-desig.c": "global structs are not implemented",
+    "0167-array.c": "subscripting arrays of arrays is rejected",
+    "0168-array.c": "subscripting arrays of arrays is rejected",
+    "0169-string.c": "global arrays are not implemented",
+    "0173-macro.c": "member access is not implemented",
+    "0177-literal.c": "compound literals are not implemented",
+    "0181-stringize.c": "string constants are not implemented",
+    "0184-esc_macro.c": "string constants are not implemented",
+    "0185-esc_macro2.c": "string constants are not implemented",
+    "0186-dec_ary.c": "global arrays are not implemented",
+    "0187-zero_struct.c": "initializer lists are not implemented",
+    "0188-multi_string.c": "string constants are not implemented",
+    "0189-cpp.c": "global arrays are not implemented",
+    "0191-ary_addr.c": "global arrays are not implemented",
+    "0192-ptrcmp.c": "global arrays are not implemented",
+    "0194-vararg.c": "stdarg.h is not provided",
+    "0196-invalidchar.c": "initializer lists are not implemented",
+    "0200-cpp.c": "string constants are not implemented",
+    "0201-cpp.c": "global arrays are not implemented",
+    "0202-variadic.c": "string constants are not implemented",
+    "0204-cast.c": "string constants are not implemented",
+    "0205-cpparg.c": "string constants are not implemented",
+    "0206-initializer.c": "global arrays are not implemented",
+    "0208-sizeof.c": "string constants are not implemented",
+    "0210-flexible.c": "member access is not implemented",
+    "0211-enum.c": "initializer lists are not implemented",
+    "0213-decay.c": "compound literals are not implemented",
+    "0214-va_copy.c": "stdarg.h is not provided",
+    "0215-ret_struct.c": "aggregate arguments are not implemented",
+    "0216-initialize.c": "string constants are not implemented",
+    "0218-initialize.c": "global structs are not implemented",
+    "0225-func.c": "string constants are not implemented",
+    "0226-pointer.c": "string constants are not implemented",
+    "function_address.c": "the interpreter can not call external functions",
+}
+
+
+ANSI_ESCAPE = re.compile(r"\x1b\[[0-9;]*m")
+
+
+class Result(NamedTuple):
+    file: str
+    codes: Dict[str, str]
+    failures: Dict[str, str]
+
+
+def run(cmd) -> Optional[subprocess.CompletedProcess]:
+    try:
+        return subprocess.run(cmd, capture_output=True, timeout=TIMEOUT)
+    except subprocess.TimeoutExpired:
+        return None
+
+
+def error(proc) -> str:
+    # why a process did not succeed, errors are a header line followed by the message
+    if proc is None:
+        return f"timed out after {TIMEOUT}s"
+    if proc.returncode < 0:
+        return f"killed by signal {-proc.returncode}"
+    stderr = ANSI_ESCAPE.sub("", proc.stderr.decode("utf-8", errors="ignore"))
+    lines = [line.strip() for line in stderr.splitlines() if line.strip()]
+    if lines:
+        return " ".join(lines[:2])
+    return f"no error message, exit code {proc.returncode}"
+
+
+def interpret(proc) -> Tuple[Optional[str], str]:
+    # the compiler exits with the code returned by the interpreted program
+    if proc is not None:
+        returns = [
+            line for line in proc.stdout.decode("utf-8", errors="ignore").splitlines()
+            if line.startswith("return ")
+        ]
+        if returns:
+            return str(int(returns[-1].split()[1]) & 0xff), ""
+    return None, f"compiler: {error(proc)}"
+
+
+def native(cc, compile_proc, source, binary) -> Tuple[Optional[str], str]:
+    if not os.path.exists(source) or not os.path.getsize(source):
+        return None, f"compiler: {error(compile_proc)}"
+    link = run([cc, source, "-o", binary])
+    if link is None or link.returncode:
+        return None, f"assembler / linker: {error(link)}"
+    proc = run([binary])
+    if proc is None:
+        return None, f"program: timed out after {TIMEOUT}s"
+    if proc.returncode < 0:
+        return f"signal {-proc.returncode}", ""
+    return str(proc.returncode), ""
+
+
+def run_test(base_command, cc, out_dir, root, file) -> Result:
+    name = os.path.splitext(file)[0]
+    path = os.path.abspath(os.path.join(root, file)).replace("\\", "/")
+    out = os.path.join(out_dir, name)
+    for ext in (".O0.s", ".O2.s", ".O2.o", ".O0.linear.s", ".O2.linear.s"):
+        if os.path.exists(out + ext):
+            os.remove(out + ext)
+
+    codes = {}
+    failures = {}
+
+    def record(label, code, reason):
+        if code is not None:
+            codes[label] = code
+        else:
+            failures[label] = reason
+
+    compiled = {}
+    for level, options in (
+        ("-O0", ["-asm", out + ".O0.s"]),
+        ("-O2", ["-asm", out + ".O2.s", "-obj", out + ".O2.o"]),
+    ):
+        compiled[level] = run([*base_command, level, *options, path])
+        record(f"interpreter {level}", *interpret(compiled[level]))
+
+    if cc is None:
+        return Result(file=file, codes=codes, failures=failures)
+
+    # the interpreter does not depend on the register allocator,
+    # so these are only run natively
+    for level in ("-O0", "-O2"):
+        compiled[f"{level} linear"] = run(
+            [*base_command, level, "-regalloc", "linear", "-asm", f"{out}.{level[1:]}.linear.s", path]
+        )
+
+    for label, config, source, binary in (
+        ("native -O0", "-O0", out + ".O0.s", out + ".O0"),
+        ("native -O2 -asm", "-O2", out + ".O2.s", out + ".O2.asm"),
+        ("native -O2 -obj", "-O2", out + ".O2.o", out + ".O2.obj"),
+        ("native -O0 linear", "-O0 linear", out + ".O0.linear.s", out + ".O0.linear"),
+        ("native -O2 linear", "-O2 linear", out + ".O2.linear.s", out + ".O2.linear"),
+    ):
+        record(label, *native(cc, compiled[config], source, binary))
+    return Result(file=file, codes=codes, failures=failures)
+
+
+def run_tests(base_command, out_dir, roots):
+    os.makedirs(out_dir, exist_ok=True)
+
+    # the backend emits System V x86-64 code, only link it where that runs
+    cc = None
+    if sys.platform.startswith("linux"):
+        cc = shutil.which("cc") or shutil.which("gcc")
+    if cc is None:
+        print("No native compiler found, only comparing interpreter runs")
+
+    files = [
+        (root, file) for root in roots
+        for file in sorted(os.listdir(root))
+        if file.endswith(".c") and file not in UNDEFINED
+    ]
+    with ThreadPoolExecutor(max_workers=os.cpu_count()) as pool:
+        results = list(pool.map(lambda test: run_test(base_command, cc, out_dir, *test), files))
+
+    passed = 0
+    known = 0
+    failed = 0
+    mismatched = 0
+    for result in results:
+        mismatch = len(set(result.codes.values())) > 1
+        if mismatch:
+            mismatched += 1
+            print("=" * 50)
+            print(f"Mismatch in {result.file}")
+            for label, code in result.codes.items():
+                print(f"  {label: <20} {code}")
+            for label, reason in result.failures.items():
+                print(f"  {label: <20} no result, {reason}")
+
+        if result.file in KNOWN_FAILURES:
+            known += 1
+            if not result.failures:
+                print(f"Known failure {result.file} passed, remove it from the known failures")
+            else:
+                print(f"Known failure {result.file}: {KNOWN_FAILURES[result.file]}")
+        elif result.failures:
+            failed += 1
+            if not mismatch:
+                print("=" * 50)
+                print(f"Failure in {result.file}")
+                for label, reason in result.failures.items():
+                    print(f"  {label: <20} no result, {reason}")
+        elif not mismatch:
+            passed += 1
+
+    print("=" * 50)
+    print(f"Total tests:    {len(results)}")
+    print(f"Passed:         {passed}")
+    print(f"Known failures: {known}")
+    print(f"Failed:         {failed}")
+    print(f"Mismatched:     {mismatched}")
+    print("=" * 50, flush=True)
+    return failed == 0 and mismatched == 0
+
+
+if __name__ == "__main__":
+    _, epicalyx_path, stl_path, out_dir, *suite_roots = sys.argv
+    passed = run_tests(
+        [
+          epicalyx_path,
+          "-stl", stl_path,
+          "-novisualize",
+          "-catch-errors"
+        ],
+        out_dir,
+        suite_roots
+    )
+    sys.exit(0 if passed else 1)